@@ -0,0 +1,137 @@
+#include "CorpusGenerator.hpp"
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+
+extern "C" {
+    #include <unistd.h>
+}
+
+namespace {
+    // Marks a corpus as completely written
+    constexpr const char* kCompleteMarker = ".complete";
+
+    // First file index of each level, plus one past the end
+    std::vector<size_t> levelStarts(const CorpusShape& shape) {
+        size_t depth = std::max<size_t>(1, std::min(shape.depth, shape.files));
+        std::vector<size_t> starts;
+        for (size_t level = 0; level <= depth; ++level) {
+            starts.push_back(level * shape.files / depth);
+        }
+        return starts;
+    }
+
+    void writeModule(std::ostream& out, size_t index, const std::vector<size_t>& children) {
+        const std::string name = CorpusGenerator::moduleName(index);
+        out << "// Synthetic module " << index << " generated by vpm_bench\n"
+            << "/* Block comments may mention module fake_" << index << " (); without declaring it */\n"
+            << "`timescale 1ns/1ps\n\n"
+            << "module " << name << " #(\n"
+            << "    parameter int WIDTH = 8,\n"
+            << "    parameter int DEPTH = 4\n"
+            << ") (\n"
+            << "    input  logic             clk,\n"
+            << "    input  logic             rst_n,\n"
+            << "    input  logic [WIDTH-1:0] in_data,\n"
+            << "    output logic [WIDTH-1:0] out_data\n"
+            << ");\n"
+            << "    logic [WIDTH-1:0] stage [DEPTH];\n"
+            << "    logic [WIDTH-1:0] child_out [" << std::max<size_t>(children.size(), 1) << "];\n\n"
+            << "    always_ff @(posedge clk or negedge rst_n) begin\n"
+            << "        if (!rst_n) begin\n"
+            << "            stage[0] <= '0;\n"
+            << "        end else begin\n"
+            << "            stage[0] <= in_data ^ WIDTH'(" << index % 251 << ");\n"
+            << "        end\n"
+            << "    end\n\n"
+            << "    genvar i;\n"
+            << "    generate\n"
+            << "        for (i = 1; i < DEPTH; i++) begin : g_pipe\n"
+            << "            always_ff @(posedge clk) stage[i] <= stage[i-1] + 1'b1;\n"
+            << "        end\n"
+            << "    endgenerate\n\n";
+
+        for (size_t k = 0; k < children.size(); ++k) {
+            // Every third instance overrides a parameter
+            out << "    " << CorpusGenerator::moduleName(children[k]);
+            if (k % 3 == 2) {
+                out << " #(.WIDTH(WIDTH), .DEPTH(" << 2 + k % 4 << "))";
+            }
+            out << " u_child_" << k << " (\n"
+                << "        .clk      (clk),\n"
+                << "        .rst_n    (rst_n),\n"
+                << "        .in_data  (stage[DEPTH-1]),\n"
+                << "        .out_data (child_out[" << k << "])\n"
+                << "    );\n";
+        }
+        if (children.empty()) {
+            out << "    assign child_out[0] = stage[DEPTH-1];\n";
+        }
+
+        out << "\n    assign out_data = child_out[0];\n"
+            << "    initial $display(\"" << name << " (not an instance)\");\n"
+            << "endmodule\n";
+    }
+}
+
+std::string CorpusShape::name() const {
+    return "corpus_f" + std::to_string(files) + "_d" + std::to_string(depth) + "_o" + std::to_string(fanout) +
+           "_p" + std::to_string(files_per_dir);
+}
+
+std::string CorpusGenerator::moduleName(size_t index) {
+    return "m" + std::to_string(index);
+}
+
+std::filesystem::path CorpusGenerator::relativePath(size_t index, const CorpusShape& shape) {
+    size_t dir = index / std::max<size_t>(shape.files_per_dir, 1);
+    return std::filesystem::path("rtl") / ("g" + std::to_string(dir / 64)) / ("p" + std::to_string(dir)) /
+           (moduleName(index) + ".sv");
+}
+
+void CorpusGenerator::generate(const std::filesystem::path& dir, const CorpusShape& shape) {
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    std::vector<size_t> starts = levelStarts(shape);
+    std::vector<size_t> children;
+    for (size_t level = 0; level + 1 < starts.size(); ++level) {
+        for (size_t index = starts[level]; index < starts[level + 1]; ++index) {
+            // Spread instances over the next level with a fixed stride, so
+            // submodules are shared between parents like in real designs
+            children.clear();
+            if (level + 2 < starts.size()) {
+                size_t first = starts[level + 1];
+                size_t count = starts[level + 2] - first;
+                for (size_t k = 0; k < shape.fanout && count > 0; ++k) {
+                    children.push_back(first + ((index - starts[level]) * shape.fanout + k * 7919) % count);
+                }
+            }
+
+            std::filesystem::path path = dir / relativePath(index, shape);
+            std::filesystem::create_directories(path.parent_path());
+            std::ofstream out(path);
+            if (!out.is_open()) {
+                throw std::runtime_error("Failed to write corpus file: " + path.string());
+            }
+            writeModule(out, index, children);
+        }
+    }
+    std::ofstream(dir / kCompleteMarker) << shape.name() << "\n";
+}
+
+std::filesystem::path CorpusGenerator::ensure(const std::filesystem::path& cache_root, const CorpusShape& shape) {
+    std::filesystem::path dir = cache_root / shape.name();
+    if (std::filesystem::exists(dir / kCompleteMarker)) {
+        return dir;
+    }
+
+    // Generated aside and renamed, so an interrupted run is never reused
+    std::filesystem::path temp_dir = dir;
+    temp_dir += ".tmp-" + std::to_string(::getpid());
+    generate(temp_dir, shape);
+    std::filesystem::remove_all(dir);
+    std::filesystem::rename(temp_dir, dir);
+    return dir;
+}
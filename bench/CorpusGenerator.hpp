@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <filesystem>
+#include <cstddef>
+
+// Shape of a synthetic SystemVerilog source tree
+struct CorpusShape {
+    size_t files = 100;
+    // Levels of module hierarchy; level 0 holds the tops
+    size_t depth = 8;
+    // Instances per module, drawn from the level below
+    size_t fanout = 4;
+    // Files per directory, i.e. per Bazel package
+    size_t files_per_dir = 64;
+
+    // Directory name encoding the shape, so corpora can be reused
+    std::string name() const;
+};
+
+// Writes synthetic trees with one module per file. Each module has
+// parameters, ports, sequential logic, a generate loop, comments and
+// `fanout` instantiations of modules one level down, some with parameter
+// overrides, so the scanner and generators see realistic token streams.
+// Output is deterministic for a given shape.
+class CorpusGenerator {
+public:
+    // Writes the corpus under `dir`, replacing what was there
+    static void generate(const std::filesystem::path& dir, const CorpusShape& shape);
+
+    // Returns `<cache_root>/<shape name>`, generating it first if missing
+    static std::filesystem::path ensure(const std::filesystem::path& cache_root, const CorpusShape& shape);
+
+    // Module name and relative path of file `index`
+    static std::string moduleName(size_t index);
+    static std::filesystem::path relativePath(size_t index, const CorpusShape& shape);
+};
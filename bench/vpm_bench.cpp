@@ -0,0 +1,452 @@
+#include <benchmark/benchmark.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <regex>
+#include <filesystem>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include "BuildGenerator.hpp"
+#include "ModuleIndex.hpp"
+#include "ScanCache.hpp"
+#include "ThreadPool.hpp"
+#include "ProcessRunner.hpp"
+#include "JsonReader.hpp"
+#include "CorpusGenerator.hpp"
+#include "vpm_shm.h"
+
+extern "C" {
+    #include <stdlib.h>
+    #include <unistd.h>
+}
+
+// Front-end benchmarks over synthetic trees of 10 to 100k files:
+//
+//     vpm_bench --vpm=./vpm --baseline=.vpm/bench/<host>.json
+//               --benchmark_out=bench_results.json --benchmark_out_format=json
+//
+// fails if any benchmark is slower than its baseline by more than
+// --max_regression (default 0.25). Timings only compare on the machine that
+// recorded them, so a baseline from another host or CPU count is reported
+// but never fails the run; `make bench-baseline` records one for this host,
+// and bench/reference.json holds the results quoted in the README. A corpus
+// is generated once per shape under --corpus_dir and reused by later runs.
+// --generate_corpus=<dir> with --files, --depth, --fanout and
+// --files_per_dir only writes a corpus. BM_ServeRing measures the vpm
+// --serve shared-memory transport on its own, in transactions per second
+// between two threads.
+
+namespace {
+    std::filesystem::path corpus_root;
+    std::filesystem::path vpm_binary;
+
+    // Corpus of `files` files in the default shape
+    std::filesystem::path corpus(size_t files) {
+        CorpusShape shape;
+        shape.files = files;
+        return CorpusGenerator::ensure(corpus_root, shape);
+    }
+
+    std::vector<std::filesystem::path> sourceFiles(const std::filesystem::path& dir) {
+        return ModuleIndex::listSourceFiles(dir / "rtl");
+    }
+
+    // BuildGenerator's file constructor runs parseSubmodules() on a fresh read
+    void BM_ParseSubmodules(benchmark::State& state) {
+        std::vector<std::filesystem::path> files = sourceFiles(corpus(static_cast<size_t>(state.range(0))));
+        for (auto _ : state) {
+            for (const auto& file : files) {
+                BuildGenerator generator(file);
+                benchmark::DoNotOptimize(generator.getSubmodules().data());
+            }
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * files.size()));
+    }
+    BENCHMARK(BM_ParseSubmodules)->RangeMultiplier(10)->Range(10, 100000)->Unit(benchmark::kMillisecond);
+
+    // Rendering and comparing each file's BUILD content; after the first
+    // iteration nothing changes on disk, as in an incremental build
+    void BM_GenerateBuildFile(benchmark::State& state) {
+        std::filesystem::path dir = corpus(static_cast<size_t>(state.range(0)));
+        ModuleIndex index(dir);
+        ThreadPool pool;
+        index.scanTree(pool);
+
+        std::filesystem::path output_dir = corpus_root / (dir.filename().string() + ".build");
+        std::vector<BuildGenerator> generators;
+        std::vector<std::string> outputs;
+        for (const auto& file : index.files()) {
+            generators.emplace_back(file, *index.findScan(file));
+            generators.back().setModuleIndex(&index);
+            std::filesystem::path output = output_dir / file.lexically_relative(dir);
+            std::filesystem::create_directories(output.parent_path());
+            outputs.push_back(output.replace_extension(".BUILD").string());
+        }
+
+        for (auto _ : state) {
+            for (size_t i = 0; i < generators.size(); ++i) {
+                benchmark::DoNotOptimize(generators[i].generateBuildFile(outputs[i]));
+            }
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * generators.size()));
+    }
+    BENCHMARK(BM_GenerateBuildFile)->RangeMultiplier(10)->Range(10, 100000)->Unit(benchmark::kMillisecond);
+
+    // Workspace indexing as in buildFiles(), with and without a scan cache
+    void BM_ScanTree(benchmark::State& state) {
+        std::filesystem::path dir = corpus(static_cast<size_t>(state.range(0)));
+        bool cached = state.range(1) != 0;
+        std::filesystem::path cache_path = corpus_root / (dir.filename().string() + ".scan-cache");
+        if (cached) {
+            ModuleIndex index(dir);
+            ThreadPool pool;
+            ScanCache cache(cache_path);
+            index.scanTree(pool, &cache);
+            cache.save();
+        }
+
+        ThreadPool pool;
+        for (auto _ : state) {
+            ModuleIndex index(dir);
+            if (cached) {
+                ScanCache cache(cache_path);
+                cache.load();
+                index.scanTree(pool, &cache);
+            } else {
+                index.scanTree(pool);
+            }
+            benchmark::DoNotOptimize(index.size());
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * state.range(0)));
+    }
+    BENCHMARK(BM_ScanTree)
+        ->ArgNames({"files", "cached"})
+        ->ArgsProduct({benchmark::CreateRange(10, 100000, 10), {0, 1}})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+    // The per-line std::regex scan parseSubmodules() did before SvScanner,
+    // over the same trees as BM_ScanTree/cached:0, as the reference for the
+    // lexer's speedup
+    void BM_ScanTreeRegex(benchmark::State& state) {
+        std::filesystem::path dir = corpus(static_cast<size_t>(state.range(0)));
+        const std::regex module_pattern(R"(\b(\w+)\s+\w+\s*\()");
+        ThreadPool pool;
+        for (auto _ : state) {
+            std::vector<std::filesystem::path> files = ModuleIndex::listSourceFiles(dir);
+            std::vector<std::vector<std::string>> submodules(files.size());
+            pool.parallelFor(files.size(), [&](size_t i) {
+                std::ifstream file(files[i]);
+                std::string line;
+                std::smatch matches;
+                while (std::getline(file, line)) {
+                    if (std::regex_search(line, matches, module_pattern)) {
+                        submodules[i].push_back(matches[1]);
+                    }
+                }
+            });
+            benchmark::DoNotOptimize(submodules.data());
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * state.range(0)));
+    }
+    BENCHMARK(BM_ScanTreeRegex)
+        ->ArgName("files")
+        ->RangeMultiplier(10)
+        ->Range(10, 100000)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+    // `vpm --build rtl` in the corpus with a no-op bazel, after a first
+    // build has written the BUILD files and scan cache and a second one has
+    // recorded the build state: the cost of re-running a build when nothing
+    // changed
+    void BM_BuildFiles(benchmark::State& state) {
+        if (vpm_binary.empty()) {
+            state.SkipWithError("vpm binary not found; pass --vpm=<path>");
+            return;
+        }
+        std::filesystem::path dir = corpus(static_cast<size_t>(state.range(0)));
+        std::filesystem::path previous = std::filesystem::current_path();
+        std::filesystem::current_path(dir);
+
+        ProcessOptions options;
+        options.echo = false;
+        std::vector<std::string> command = {vpm_binary.string(), "--build", "rtl"};
+        if (ProcessRunner::run(command, options).exit_code != 0 ||
+            ProcessRunner::run(command, options).exit_code != 0) {
+            std::filesystem::current_path(previous);
+            state.SkipWithError("vpm --build failed");
+            return;
+        }
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(ProcessRunner::run(command, options).exit_code);
+        }
+        std::filesystem::current_path(previous);
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * state.range(0)));
+    }
+    // 20k files is the size the no-op target of under 100 ms is set for
+    BENCHMARK(BM_BuildFiles)
+        ->RangeMultiplier(10)
+        ->Range(10, 100000)
+        ->Arg(20000)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+    // Stands in for a served model: a register file with y = a + b
+    struct LoopbackPorts {
+        uint64_t registers[3] = {};
+        uint64_t read(uint32_t port, uint32_t) { return registers[port]; }
+        bool write(uint32_t port, uint32_t, uint64_t value) {
+            registers[port] = value;
+            return port < 2;
+        }
+        void eval() { registers[2] = registers[0] + registers[1]; }
+        void tick(uint32_t, uint64_t) {}
+    };
+
+    // vpm --serve transport between two threads, without a model: `batch`
+    // posted writes and evals, then one read waiting for the round trip
+    void BM_ServeRing(benchmark::State& state) {
+        const uint64_t batch = static_cast<uint64_t>(state.range(0));
+        std::vector<vpm::ShmPort> ports(3);
+        for (size_t i = 0; i < ports.size(); ++i) {
+            std::snprintf(ports[i].name, sizeof(ports[i].name), "%s", i == 0 ? "a" : i == 1 ? "b" : "y");
+            ports[i].width = 64;
+            ports[i].input = i < 2;
+        }
+        std::string name = "/vpm-bench-" + std::to_string(getpid());
+        vpm::ShmServer server(name, ports);
+        LoopbackPorts handler;
+        std::thread serving([&]() { server.run(handler); });
+
+        {
+            vpm::ShmClient client(name);
+            uint64_t value = 0;
+            for (auto _ : state) {
+                for (uint64_t i = 0; i < batch; ++i) {
+                    client.write(0, ++value);
+                    client.eval();
+                }
+                if (client.read(2) != value) {
+                    state.SkipWithError("loopback returned a stale value");
+                    break;
+                }
+            }
+            client.stop();
+        }
+        serving.join();
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * (2 * batch + 1)));
+    }
+    BENCHMARK(BM_ServeRing)->ArgName("batch")->Arg(1)->Arg(64)->Arg(1024)->UseRealTime();
+
+    // Console output plus the real time of every run, for the baseline check
+    class RecordingReporter : public benchmark::ConsoleReporter {
+    public:
+        // Nanoseconds per iteration by benchmark name
+        std::map<std::string, double> real_times;
+
+        void ReportRuns(const std::vector<Run>& reports) override {
+            for (const auto& run : reports) {
+                if (run.iterations > 0) {
+                    real_times[run.benchmark_name()] =
+                        run.GetAdjustedRealTime() * 1e9 / benchmark::GetTimeUnitMultiplier(run.time_unit);
+                }
+            }
+            ConsoleReporter::ReportRuns(reports);
+        }
+    };
+
+    double nanosecondsPer(std::string_view unit) {
+        if (unit == "s") {
+            return 1e9;
+        }
+        if (unit == "ms") {
+            return 1e6;
+        }
+        if (unit == "us") {
+            return 1e3;
+        }
+        return 1;
+    }
+
+    // A Google Benchmark JSON report and the machine it was recorded on
+    struct Baseline {
+        std::string host;
+        long num_cpus = 0;
+        // Real time per iteration in nanoseconds by name
+        std::map<std::string, double> times;
+    };
+
+    void readContext(JsonReader& json, Baseline& baseline) {
+        json.expect(JsonReader::Token::BeginObject);
+        while (json.next() == JsonReader::Token::Key) {
+            std::string key(json.text());
+            if (key == "host_name") {
+                json.expect(JsonReader::Token::String);
+                baseline.host = std::string(json.text());
+            } else if (key == "num_cpus") {
+                json.expect(JsonReader::Token::Number);
+                baseline.num_cpus = std::strtol(std::string(json.text()).c_str(), nullptr, 10);
+            } else {
+                json.skipValue();
+            }
+        }
+    }
+
+    Baseline readBaseline(const std::filesystem::path& path) {
+        if (!std::filesystem::exists(path)) {
+            throw std::runtime_error("No baseline at " + path.string() +
+                                     "; record one on this host with `make bench-baseline`");
+        }
+        Baseline baseline;
+        std::map<std::string, double>& times = baseline.times;
+        JsonReader json(path);
+        json.expect(JsonReader::Token::BeginObject);
+        while (json.next() == JsonReader::Token::Key) {
+            if (json.text() == "context") {
+                readContext(json, baseline);
+                continue;
+            }
+            if (json.text() != "benchmarks") {
+                json.skipValue();
+                continue;
+            }
+            json.expect(JsonReader::Token::BeginArray);
+            while (json.next() == JsonReader::Token::BeginObject) {
+                std::string name;
+                std::string unit = "ns";
+                double real_time = 0;
+                while (json.next() == JsonReader::Token::Key) {
+                    std::string key(json.text());
+                    if (key == "name" || key == "time_unit") {
+                        json.expect(JsonReader::Token::String);
+                        (key == "name" ? name : unit) = std::string(json.text());
+                    } else if (key == "real_time") {
+                        json.expect(JsonReader::Token::Number);
+                        real_time = std::strtod(std::string(json.text()).c_str(), nullptr);
+                    } else {
+                        json.skipValue();
+                    }
+                }
+                times[name] = real_time * nanosecondsPer(unit);
+            }
+        }
+        return baseline;
+    }
+
+    // Prints each benchmark against its baseline; false if any regressed on
+    // the machine the baseline was recorded on
+    bool checkBaseline(const std::map<std::string, double>& current, const Baseline& baseline,
+                       double max_regression) {
+        const std::string& host = benchmark::SystemInfo::Get().name;
+        long num_cpus = benchmark::CPUInfo::Get().num_cpus;
+        bool gating = baseline.host == host && baseline.num_cpus == num_cpus;
+        bool ok = true;
+        if (gating) {
+            std::cout << "\nComparison with baseline (limit +" << max_regression * 100 << "%):\n";
+        } else {
+            std::cout << "\nComparison with baseline from " << baseline.host << " (" << baseline.num_cpus
+                      << " CPUs); this is " << host << " (" << num_cpus << " CPUs), so not gating:\n";
+        }
+        for (const auto& [name, time] : current) {
+            auto it = baseline.times.find(name);
+            if (it == baseline.times.end() || it->second <= 0) {
+                std::cout << "  " << std::left << std::setw(48) << name << " no baseline\n";
+                continue;
+            }
+            double change = time / it->second - 1;
+            bool regressed = gating && change > max_regression;
+            ok = ok && !regressed;
+            std::cout << "  " << std::left << std::setw(48) << name << std::right << std::showpos << std::fixed
+                      << std::setprecision(1) << std::setw(8) << change * 100 << "%" << std::noshowpos
+                      << (regressed ? "  REGRESSION" : "") << "\n";
+        }
+        return ok;
+    }
+
+    // Value of `--name=value`, if `arg` is that flag
+    bool flagValue(const char* arg, const char* name, std::string& value) {
+        size_t length = std::strlen(name);
+        if (std::strncmp(arg, "--", 2) != 0 || std::strncmp(arg + 2, name, length) != 0 || arg[2 + length] != '=') {
+            return false;
+        }
+        value = arg + 3 + length;
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string baseline;
+    std::string max_regression = "0.25";
+    std::string corpus_dir = (std::filesystem::temp_directory_path() / "vpm_bench").string();
+    std::string vpm = "vpm";
+    std::string generate_dir;
+    CorpusShape shape;
+    std::map<std::string, size_t*> shape_flags = {
+        {"files", &shape.files}, {"depth", &shape.depth},
+        {"fanout", &shape.fanout}, {"files_per_dir", &shape.files_per_dir},
+    };
+
+    // Our flags are removed before Google Benchmark sees the rest
+    int remaining = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string value;
+        bool ours = flagValue(argv[i], "baseline", baseline) || flagValue(argv[i], "max_regression", max_regression) ||
+                    flagValue(argv[i], "corpus_dir", corpus_dir) || flagValue(argv[i], "vpm", vpm) ||
+                    flagValue(argv[i], "generate_corpus", generate_dir);
+        for (const auto& [name, field] : shape_flags) {
+            if (!ours && flagValue(argv[i], name.c_str(), value)) {
+                *field = std::stoull(value);
+                ours = true;
+            }
+        }
+        if (!ours) {
+            argv[remaining++] = argv[i];
+        }
+    }
+    argc = remaining;
+
+    if (!generate_dir.empty()) {
+        CorpusGenerator::generate(generate_dir, shape);
+        std::cout << "Wrote " << shape.files << " files to " << generate_dir << "\n";
+        return 0;
+    }
+
+    corpus_root = std::filesystem::absolute(corpus_dir);
+    std::filesystem::create_directories(corpus_root);
+    if (std::filesystem::exists(vpm)) {
+        vpm_binary = std::filesystem::absolute(vpm);
+    }
+
+    // End-to-end builds run against a bazel that does nothing
+    std::filesystem::path stub_bin = corpus_root / "bin";
+    std::filesystem::create_directories(stub_bin);
+    std::ofstream(stub_bin / "bazel") << "#!/bin/sh\nexit 0\n";
+    std::filesystem::permissions(stub_bin / "bazel", std::filesystem::perms::owner_all);
+    const char* path_env = std::getenv("PATH");
+    ::setenv("PATH", (stub_bin.string() + ":" + (path_env ? path_env : "")).c_str(), 1);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    RecordingReporter reporter;
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+
+    if (baseline.empty()) {
+        return 0;
+    }
+    try {
+        return checkBaseline(reporter.real_times, readBaseline(baseline), std::stod(max_regression)) ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
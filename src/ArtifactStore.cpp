@@ -0,0 +1,206 @@
+#include "ArtifactStore.hpp"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include <cctype>
+#include <charconv>
+#include <limits>
+
+extern "C" {
+    #include <unistd.h>
+}
+
+namespace {
+    constexpr const char* kStoreRcName = "store.bazelrc";
+
+    struct StoreFile {
+        std::filesystem::path path;
+        uintmax_t bytes;
+        std::filesystem::file_time_type mtime;
+    };
+
+    // Regular files under `dir`; unreadable entries are skipped, as Bazel
+    // may be adding and renaming entries while we walk
+    std::vector<StoreFile> listFiles(const std::filesystem::path& dir) {
+        std::vector<StoreFile> files;
+        std::error_code ec;
+        if (!std::filesystem::is_directory(dir, ec)) {
+            return files;
+        }
+        std::filesystem::recursive_directory_iterator it(dir, std::filesystem::directory_options::skip_permission_denied,
+                                                         ec);
+        for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            std::error_code entry_ec;
+            if (!it->is_regular_file(entry_ec)) {
+                continue;
+            }
+            uintmax_t bytes = it->file_size(entry_ec);
+            auto mtime = entry_ec ? std::filesystem::file_time_type() : it->last_write_time(entry_ec);
+            if (!entry_ec) {
+                files.push_back({it->path(), bytes, mtime});
+            }
+        }
+        return files;
+    }
+
+    StoreUsage usageOf(const std::filesystem::path& dir) {
+        StoreUsage usage;
+        for (const auto& file : listFiles(dir)) {
+            ++usage.files;
+            usage.bytes += file.bytes;
+            if (!usage.oldest || file.mtime < *usage.oldest) {
+                usage.oldest = file.mtime;
+            }
+        }
+        return usage;
+    }
+
+    void writeAtomically(const std::filesystem::path& path, const std::string& content) {
+        std::filesystem::path temp_file = path;
+        temp_file += ".tmp-" + std::to_string(::getpid());
+        {
+            std::ofstream out(temp_file, std::ios::trunc);
+            if (!out.is_open() || !(out << content)) {
+                throw std::runtime_error("Failed to write file: " + path.string());
+            }
+        }
+        std::filesystem::rename(temp_file, path);
+    }
+}
+
+ArtifactStore::ArtifactStore(std::filesystem::path store_root) : root(std::move(store_root)) {}
+
+std::filesystem::path ArtifactStore::defaultRoot() {
+    if (const char* dir = std::getenv("VPM_CACHE_DIR"); dir && *dir) {
+        return std::filesystem::absolute(dir);
+    }
+    if (const char* dir = std::getenv("XDG_CACHE_HOME"); dir && *dir) {
+        return std::filesystem::path(dir) / "vpm";
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        return std::filesystem::path(home) / ".cache" / "vpm";
+    }
+    throw std::runtime_error("Failed to locate the artifact store: set VPM_CACHE_DIR or HOME");
+}
+
+void ArtifactStore::configureWorkspace(const std::filesystem::path& workspace_root) const {
+    std::filesystem::create_directories(diskCache());
+    std::filesystem::create_directories(repositoryCache());
+
+    // Machine-specific paths stay out of the committed .bazelrc.
+    // Strict action env keeps PATH and friends out of action keys, so the
+    // same action hits the cache from any shell and any workspace.
+    std::filesystem::path vpm_dir = workspace_root / ".vpm";
+    std::filesystem::create_directories(vpm_dir);
+    std::ostringstream rc;
+    rc << "# Written by vpm --init: artifacts shared by all workspaces on this machine\n"
+       << "build --disk_cache=" << diskCache().string() << "\n"
+       << "common --repository_cache=" << repositoryCache().string() << "\n"
+       << "build --incompatible_strict_action_env\n";
+    writeAtomically(vpm_dir / kStoreRcName, rc.str());
+
+    // Import it from the workspace .bazelrc, keeping anything already there
+    const std::string import = std::string("try-import %workspace%/.vpm/") + kStoreRcName;
+    std::filesystem::path bazelrc = workspace_root / ".bazelrc";
+    std::string existing;
+    if (std::ifstream in(bazelrc); in.is_open()) {
+        std::ostringstream content;
+        content << in.rdbuf();
+        existing = content.str();
+    }
+    std::istringstream lines(existing);
+    for (std::string line; std::getline(lines, line);) {
+        if (line == import) {
+            return;
+        }
+    }
+    if (!existing.empty() && existing.back() != '\n') {
+        existing += '\n';
+    }
+    writeAtomically(bazelrc, existing + import + "\n");
+}
+
+StoreUsage ArtifactStore::diskCacheUsage() const {
+    return usageOf(diskCache());
+}
+
+StoreUsage ArtifactStore::repositoryCacheUsage() const {
+    return usageOf(repositoryCache());
+}
+
+StoreUsage ArtifactStore::packageStoreUsage() const {
+    return usageOf(packageStore());
+}
+
+StoreCollection ArtifactStore::collect(uintmax_t max_bytes, std::optional<std::chrono::hours> max_age) const {
+    std::vector<StoreFile> files = listFiles(diskCache());
+    std::sort(files.begin(), files.end(), [](const StoreFile& a, const StoreFile& b) { return a.mtime < b.mtime; });
+
+    uintmax_t total = 0;
+    for (const auto& file : files) {
+        total += file.bytes;
+    }
+    auto now = std::filesystem::file_time_type::clock::now();
+
+    // Oldest first: an entry removed while a build reads it is only a miss
+    StoreCollection result;
+    for (const auto& file : files) {
+        bool expired = max_age && now - file.mtime > *max_age;
+        std::error_code ec;
+        if ((expired || total > max_bytes) && std::filesystem::remove(file.path, ec)) {
+            total -= file.bytes;
+            ++result.removed_files;
+            result.removed_bytes += file.bytes;
+        } else {
+            ++result.kept_files;
+            result.kept_bytes += file.bytes;
+        }
+    }
+    return result;
+}
+
+uintmax_t ArtifactStore::parseSize(const std::string& text) {
+    size_t digits = 0;
+    while (digits < text.size() && std::isdigit(static_cast<unsigned char>(text[digits]))) {
+        ++digits;
+    }
+    std::string unit = text.substr(digits);
+    std::transform(unit.begin(), unit.end(), unit.begin(), [](unsigned char c) { return std::toupper(c); });
+    if (!unit.empty() && unit.back() == 'B') {
+        unit.pop_back();
+    }
+    static const std::string units = "KMGT";
+    size_t unit_index = unit.empty() ? std::string::npos : units.find(unit);
+    if (digits == 0 || unit.size() > 1 || (!unit.empty() && unit_index == std::string::npos)) {
+        throw std::runtime_error("Invalid size: " + text);
+    }
+    size_t power = unit.empty() ? 0 : unit_index + 1;
+    uintmax_t bytes = 0;
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + digits, bytes);
+    for (size_t i = 0; i < power && ec == std::errc(); ++i) {
+        if (bytes > std::numeric_limits<uintmax_t>::max() / 1024) {
+            ec = std::errc::result_out_of_range;
+        }
+        bytes *= 1024;
+    }
+    if (ec != std::errc()) {
+        throw std::runtime_error("Size out of range: " + text);
+    }
+    return bytes;
+}
+
+std::string ArtifactStore::formatSize(uintmax_t bytes) {
+    static const char* const units[] = {"B", "KB", "MB", "GB", "TB"};
+    double value = static_cast<double>(bytes);
+    size_t unit = 0;
+    while (value >= 1024 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+        value /= 1024;
+        ++unit;
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(unit == 0 ? 0 : 1) << value << " " << units[unit];
+    return out.str();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <filesystem>
+#include <chrono>
+#include <cstdint>
+
+// Disk usage of one part of the store
+struct StoreUsage {
+    size_t files = 0;
+    uintmax_t bytes = 0;
+    // Modification time of the least recently used file, if any
+    std::optional<std::filesystem::file_time_type> oldest;
+};
+
+// What a garbage collection removed and kept
+struct StoreCollection {
+    size_t removed_files = 0;
+    uintmax_t removed_bytes = 0;
+    size_t kept_files = 0;
+    uintmax_t kept_bytes = 0;
+};
+
+// Machine-wide store of Bazel artifacts shared by every workspace that
+// `vpm --init` configured to use it. It holds a Bazel disk cache, keyed by
+// action digest, so verilated C++ and compiled objects of an identical .sv
+// input and flag set are built once per machine, a repository cache of
+// downloaded archives, and the package store (see PackageStore). Bazel
+// refreshes the mtime of disk cache entries it reads, so mtime order is
+// least-recently-used order.
+class ArtifactStore {
+private:
+    std::filesystem::path root;
+
+public:
+    explicit ArtifactStore(std::filesystem::path store_root);
+
+    // $VPM_CACHE_DIR, else $XDG_CACHE_HOME/vpm, else ~/.cache/vpm
+    static std::filesystem::path defaultRoot();
+
+    const std::filesystem::path& path() const { return root; }
+    std::filesystem::path diskCache() const { return root / "disk"; }
+    std::filesystem::path repositoryCache() const { return root / "repos"; }
+    std::filesystem::path packageStore() const { return root / "packages"; }
+
+    // Creates the store and points the workspace's Bazel at it through
+    // .vpm/store.bazelrc, imported from the workspace .bazelrc
+    void configureWorkspace(const std::filesystem::path& workspace_root) const;
+
+    StoreUsage diskCacheUsage() const;
+    StoreUsage repositoryCacheUsage() const;
+    StoreUsage packageStoreUsage() const;
+
+    // Removes disk cache entries unused for longer than `max_age`, then the
+    // least recently used ones until the disk cache fits in `max_bytes`.
+    // Downloads and packages are kept: workspaces link to the packages.
+    StoreCollection collect(uintmax_t max_bytes, std::optional<std::chrono::hours> max_age = std::nullopt) const;
+
+    // Parses sizes like "512M", "10G" or "1048576"; throws on anything else
+    static uintmax_t parseSize(const std::string& text);
+
+    // Human-readable size, e.g. "1.5 GB"
+    static std::string formatSize(uintmax_t bytes);
+};
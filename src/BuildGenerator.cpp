@@ -1,26 +1,17 @@
 #include "BuildGenerator.hpp"
+#include "ModuleIndex.hpp"
+#include "SvPreprocessor.hpp"
 #include <iostream>
-
-// This file is intentionally empty as the template implementation is in the header file
-// Template classes typically require their implementation to be available in the header
+#include <algorithm>
+#include <sstream>
 
 void BuildGenerator::parseSubmodules() {
-    std::ifstream file(sv_file_path);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + sv_file_path.string());
-    }
-
-    std::string line;
-    // Regex pattern to match module instantiations
-    std::regex module_pattern(R"(\b(\w+)\s+\w+\s*\()");
-    
-    while (std::getline(file, line)) {
-        std::smatch matches;
-        if (std::regex_search(line, matches, module_pattern)) {
-            // First capture group contains the module name
-            submodules.push_back(matches[1]);
-        }
-    }
+    // Token-level scan of the preprocessed, memory-mapped source; comments,
+    // strings and disabled `ifdef branches never produce instantiations
+    SvScanResult scan = SvScanner::scanFile(sv_file_path);
+    submodules = scan.instantiatedModules();
+    modules = std::move(scan.modules);
+    includes = std::move(scan.includes);
 }
 
 void BuildGenerator::initWorkspace(const std::string& workspace_path) {
@@ -65,10 +56,37 @@ void BuildGenerator::initWorkspace(const std::string& workspace_path) {
     file << "    build_file_content = \"\"\"\n";
     file << "cc_library(\n";
     file << "    name = \"verilator_runtime\",\n";
-    file << "    srcs = glob([\"share/verilator/include/*.cpp\"]),\n";
-    file << "    hdrs = glob([\"share/verilator/include/*.h\"]),\n";
+    file << "    srcs = [\n";
+    for (const char* runtime_src : {"verilated.cpp", "verilated_dpi.cpp", "verilated_save.cpp",
+                                    "verilated_threads.cpp"}) {
+        file << "        \"share/verilator/include/" << runtime_src << "\",\n";
+    }
+    file << "    ],\n";
+    file << "    hdrs = glob([\n";
+    file << "        \"share/verilator/include/*.h\",\n";
+    file << "        \"share/verilator/include/vltstd/*.h\",\n";
+    file << "    ]),\n";
+    file << "    copts = [\"-std=c++17\"],\n";
+    file << "    linkopts = [\"-pthread\"],\n";
     file << "    strip_include_prefix = \"share/verilator/include\",\n";
     file << "    visibility = [\"//visibility:public\"],\n";
+    file << ")\n\n";
+    file << "# Waveform writers, linked only into models verilated with tracing\n";
+    file << "cc_library(\n";
+    file << "    name = \"verilator_trace_fst\",\n";
+    file << "    srcs = [\"share/verilator/include/verilated_fst_c.cpp\"],\n";
+    file << "    textual_hdrs = glob([\"share/verilator/include/gtkwave/*\"]),\n";
+    file << "    copts = [\"-std=c++17\"],\n";
+    file << "    linkopts = [\"-lz\"],\n";
+    file << "    deps = [\":verilator_runtime\"],\n";
+    file << "    visibility = [\"//visibility:public\"],\n";
+    file << ")\n\n";
+    file << "cc_library(\n";
+    file << "    name = \"verilator_trace_vcd\",\n";
+    file << "    srcs = [\"share/verilator/include/verilated_vcd_c.cpp\"],\n";
+    file << "    copts = [\"-std=c++17\"],\n";
+    file << "    deps = [\":verilator_runtime\"],\n";
+    file << "    visibility = [\"//visibility:public\"],\n";
     file << ")\n";
     file << "\"\"\",\n";
     file << ")\n";
@@ -81,15 +99,361 @@ void BuildGenerator::initWorkspace(const std::string& workspace_path) {
 
     // Create BUILD file
     std::ofstream build_file(tools_dir / "BUILD");
-    build_file << "package(default_visibility = [\"//visibility:public\"])\n\n";
-    build_file << "exports_files([\"defs.bzl\", \"defs_test.bzl\"])\n";
+    build_file << R"BAZEL(load(":defs.bzl", "verilator_flag")
+
+package(default_visibility = ["//visibility:public"])
+
+exports_files(["defs.bzl", "defs_test.bzl"])
+
+# Default simulation profile for targets that do not set one:
+#   bazel test --//tools/verilator:profile=max //...
+verilator_flag(
+    name = "profile",
+    build_setting_default = "fast",
+    values = ["debug", "fast", "max"],
+)
+
+# Default waveform format for targets that do not set one:
+#   bazel test --//tools/verilator:trace=fst //...
+verilator_flag(
+    name = "trace",
+    build_setting_default = "off",
+    values = ["off", "fst", "vcd"],
+)
+
+cc_library(
+    name = "vpm_trace",
+    hdrs = ["vpm_trace.h"],
+    includes = ["."],
+)
+
+# Warm-up checkpoints for verilator_hdl_test targets with a warm_up file
+cc_library(
+    name = "vpm_checkpoint",
+    hdrs = ["vpm_checkpoint.h"],
+    includes = ["."],
+    testonly = True,
+)
+
+# Multi-instance harness for verilator_hdl_sweep targets
+cc_library(
+    name = "vpm_sweep",
+    hdrs = ["vpm_sweep.h"],
+    includes = ["."],
+    testonly = True,
+)
+
+# Shared-memory client for host software driving a verilated model served
+# by a verilator_hdl_server, and the server side of it
+cc_library(
+    name = "vpm_shm",
+    hdrs = ["vpm_shm.h"],
+    includes = ["."],
+    linkopts = ["-lrt"],
+)
+
+cc_library(
+    name = "vpm_serve",
+    hdrs = ["vpm_serve.h"],
+    includes = ["."],
+    deps = [":vpm_shm"],
+)
+
+config_setting(
+    name = "profile_debug",
+    flag_values = {":profile": "debug"},
+)
+
+config_setting(
+    name = "profile_max",
+    flag_values = {":profile": "max"},
+)
+)BAZEL";
+
+    // Create the testbench waveform helper
+    std::ofstream trace_header(tools_dir / "vpm_trace.h");
+    trace_header << R"CPP(#pragma once
+
+// Waveform dumping for verilator_hdl_test testbenches. The format follows the
+// target's `trace` setting; with tracing off the model has no trace code and
+// this class does nothing, so testbenches can call it unconditionally.
+//
+//   Vcounter model;
+//   VpmTrace trace(model, "counter");
+//   for (uint64_t cycle = 0; cycle < 1000; ++cycle) {
+//       model.clk = !model.clk;
+//       model.eval();
+//       trace.dump(cycle);
+//   }
+//
+// Waves are written to $TEST_UNDECLARED_OUTPUTS_DIR (bazel-testlogs/.../
+// test.outputs) when run under `bazel test`. Setting VPM_TRACE_WINDOW to
+// "<start>:<stop>" (either side may be empty) dumps only times in
+// [start, stop), so a long run can be traced around the interesting part.
+
+#include <cstdint>
+#include <string>
+
+#if VM_TRACE
+#include <cstdlib>
+#include <limits>
+#include "verilated.h"
+#if VM_TRACE_FST
+#include "verilated_fst_c.h"
+#else
+#include "verilated_vcd_c.h"
+#endif
+#endif
+
+class VpmTrace {
+private:
+#if VM_TRACE
+#if VM_TRACE_FST
+    VerilatedFstC writer;
+    static constexpr const char* extension = ".fst";
+#else
+    VerilatedVcdC writer;
+    static constexpr const char* extension = ".vcd";
+#endif
+    uint64_t start = 0;
+    uint64_t stop = std::numeric_limits<uint64_t>::max();
+
+    // Reads the dump window from VPM_TRACE_WINDOW
+    void parseWindow() {
+        const char* window = std::getenv("VPM_TRACE_WINDOW");
+        if (!window) {
+            return;
+        }
+        std::string spec(window);
+        size_t colon = spec.find(':');
+        std::string first = spec.substr(0, colon);
+        std::string second = colon == std::string::npos ? "" : spec.substr(colon + 1);
+        if (!first.empty()) {
+            start = std::strtoull(first.c_str(), nullptr, 10);
+        }
+        if (!second.empty()) {
+            stop = std::strtoull(second.c_str(), nullptr, 10);
+        }
+    }
+#endif
+
+public:
+    // Opens `<name>.fst` or `<name>.vcd` and attaches it to `model`
+    template <typename Model>
+    VpmTrace(Model& model, const std::string& name, int levels = 99) {
+#if VM_TRACE
+        parseWindow();
+        Verilated::traceEverOn(true);
+        model.trace(&writer, levels);
+
+        const char* output_dir = std::getenv("TEST_UNDECLARED_OUTPUTS_DIR");
+        std::string path = output_dir ? std::string(output_dir) + "/" + name : name;
+        writer.open((path + extension).c_str());
+#else
+        (void)model;
+        (void)name;
+        (void)levels;
+#endif
+    }
+
+    ~VpmTrace() {
+#if VM_TRACE
+        writer.close();
+#endif
+    }
+
+    VpmTrace(const VpmTrace&) = delete;
+    VpmTrace& operator=(const VpmTrace&) = delete;
+
+    // Records signal values at `time` if it lies in the dump window
+    void dump(uint64_t time) {
+#if VM_TRACE
+        if (time >= start && time < stop) {
+            writer.dump(time);
+        }
+#else
+        (void)time;
+#endif
+    }
+};
+)CPP";
 
     // Create defs.bzl file with our custom rule for regular builds
     std::ofstream defs_file(tools_dir / "defs.bzl");
-    defs_file << R"BAZEL(load("@bazel_tools//tools/cpp:toolchain_utils.bzl", "find_cpp_toolchain")
+    defs_file << R"BAZEL(load("@bazel_tools//tools/cpp:toolchain_utils.bzl", "find_cpp_toolchain", "use_cpp_toolchain")
+load("@rules_cc//cc:defs.bzl", "cc_binary")
+
+VerilogInfo = provider(
+    doc = "Verilog sources needed to elaborate a module and its submodules",
+    fields = {
+        "transitive_sources": "depset of .sv/.v files for the module and everything it instantiates",
+        "transitive_hdrs": "depset of the files those sources `include",
+        "defines": "depset of NAME or NAME=VALUE macros they are verilated with",
+        "includes": "depset of directories searched for their `include files",
+        "hier_blocks": "CcInfo of the hierarchical blocks below the module, linked into every model above them",
+    },
+)
+
+# Verilator and C++ options per simulation profile. "debug" builds quickly
+# and is easy to step through; "fast" and "max" spend build time on
+# simulation speed, with "max" also partitioning the model across threads.
+VERILATOR_PROFILES = {
+    "debug": struct(
+        verilator_flags = ["-O0"],
+        threads = 1,
+        copts = ["-O0", "-g"],
+    ),
+    "fast": struct(
+        verilator_flags = [
+            "-O3",
+            "--x-assign fast",
+            "--x-initial fast",
+            "--output-split 20000",
+            "--output-split-cfuncs 5000",
+        ],
+        threads = 1,
+        copts = ["-O2"],
+    ),
+    "max": struct(
+        verilator_flags = [
+            "-O3",
+            "--x-assign fast",
+            "--x-initial fast",
+            "--noassert",
+            "--output-split 20000",
+            "--output-split-cfuncs 5000",
+        ],
+        threads = 4,
+        copts = ["-O3", "-march=native", "-fno-stack-protector"],
+    ),
+}
+
+# Verilator options, runtime library and model defines per waveform format.
+# "off" verilates without tracing, so no tracing code is compiled or linked.
+VERILATOR_TRACE_FORMATS = {
+    "off": struct(
+        verilator_flags = [],
+        defines = ["VM_TRACE=0", "VM_TRACE_FST=0", "VM_TRACE_VCD=0"],
+    ),
+    "fst": struct(
+        verilator_flags = ["--trace-fst"],
+        defines = ["VM_TRACE=1", "VM_TRACE_FST=1", "VM_TRACE_VCD=0"],
+    ),
+    "vcd": struct(
+        verilator_flags = ["--trace"],
+        defines = ["VM_TRACE=1", "VM_TRACE_FST=0", "VM_TRACE_VCD=1"],
+    ),
+}
+
+VerilatorFlagInfo = provider(
+    doc = "Value of a workspace-wide Verilator build setting such as --//tools/verilator:profile",
+    fields = {"value": "The selected value"},
+)
+
+def _verilator_flag_impl(ctx):
+    if ctx.build_setting_value not in ctx.attr.values:
+        fail("Unknown value '{}' for {}, expected one of {}".format(
+            ctx.build_setting_value,
+            ctx.label,
+            ", ".join(ctx.attr.values),
+        ))
+    return VerilatorFlagInfo(value = ctx.build_setting_value)
+
+verilator_flag = rule(
+    implementation = _verilator_flag_impl,
+    build_setting = config.string(flag = True),
+    attrs = {
+        "values": attr.string_list(mandatory = True),
+    },
+)
+
+def verilator_profile(ctx):
+    """Returns the profile struct for a target: its own attribute, else the workspace flag."""
+    name = ctx.attr.profile if ctx.attr.profile else ctx.attr._profile_flag[VerilatorFlagInfo].value
+    return VERILATOR_PROFILES[name]
+
+def verilator_trace(ctx):
+    """Returns the trace format name for a target: its own attribute, else the workspace flag."""
+    return ctx.attr.trace if ctx.attr.trace else ctx.attr._trace_flag[VerilatorFlagInfo].value
+
+def verilator_threads(ctx, profile):
+    return ctx.attr.threads if ctx.attr.threads > 0 else profile.threads
+
+def verilator_profile_copts(profile = ""):
+    """C++ options of `profile` for use in a macro, or a select on the workspace flag if empty."""
+    if profile:
+        return VERILATOR_PROFILES[profile].copts
+    return select({
+        "//tools/verilator:profile_debug": VERILATOR_PROFILES["debug"].copts,
+        "//tools/verilator:profile_max": VERILATOR_PROFILES["max"].copts,
+        "//conditions:default": VERILATOR_PROFILES["fast"].copts,
+    })
+
+def _shell_quote(text):
+    return "'" + text.replace("'", "'\\''") + "'"
 
 def _verilator_hdl_library_impl(ctx):
-    output_dir = ctx.actions.declare_directory(ctx.attr.name + "_verilated")
+    top_name = ctx.attr.top_module if ctx.attr.top_module else ctx.file.src.basename.rsplit(".", 1)[0]
+    srcs = depset(
+        [ctx.file.src],
+        transitive = [dep[VerilogInfo].transitive_sources for dep in ctx.attr.deps],
+    )
+    hdrs = depset(
+        ctx.files.hdrs,
+        transitive = [dep[VerilogInfo].transitive_hdrs for dep in ctx.attr.deps],
+    )
+    defines = depset(ctx.attr.defines, transitive = [dep[VerilogInfo].defines for dep in ctx.attr.deps])
+    includes = depset(ctx.attr.includes, transitive = [dep[VerilogInfo].includes for dep in ctx.attr.deps])
+    hier_blocks = cc_common.merge_cc_infos(cc_infos = [dep[VerilogInfo].hier_blocks for dep in ctx.attr.deps])
+    profile = verilator_profile(ctx)
+    trace = verilator_trace(ctx)
+
+    # The same macros and include path vpm preprocessed with when it found
+    # the deps, so Verilator elaborates the same `ifdef branches and headers.
+    # Directories of the sources and headers come first, as vpm looks next
+    # to the including file before the +incdir+ directories.
+    include_dirs = []
+    for f in srcs.to_list() + hdrs.to_list():
+        if f.dirname not in include_dirs:
+            include_dirs.append(f.dirname)
+    for include in includes.to_list():
+        if include not in include_dirs:
+            include_dirs.append(include)
+    verilator_flags = [_shell_quote("+define+" + define) for define in defines.to_list()] + \
+                      [_shell_quote("+incdir+" + include) for include in include_dirs]
+    verilator_flags = verilator_flags + profile.verilator_flags + VERILATOR_TRACE_FORMATS[trace].verilator_flags
+    if trace == "fst" and ctx.attr.trace_threads > 0:
+        # Offloads FST compression and writing from the simulation threads
+        verilator_flags = verilator_flags + ["--trace-threads {}".format(ctx.attr.trace_threads)]
+    threads = verilator_threads(ctx, profile)
+    if ctx.attr.savable:
+        # Verilator serializes only single-threaded models, and a
+        # hierarchical block's state lives in its own, unsavable model
+        if hier_blocks.linking_context.linker_inputs.to_list():
+            fail("{}: savable models cannot instantiate hierarchical blocks".format(ctx.label))
+        verilator_flags = verilator_flags + ["--savable"]
+        threads = 1
+
+    # Generated sources and headers go to separate tree artifacts: Verilator
+    # decides the file names, and Bazel expands a source tree into one cached
+    # compile action per file
+    verilated_srcs = ctx.actions.declare_directory(ctx.attr.name + "_srcs")
+    verilated_hdrs = ctx.actions.declare_directory(ctx.attr.name + "_hdrs")
+
+    # A hierarchical block is also verilated as a library with a stub module
+    # of the same name, which models above it elaborate instead of its
+    # sources. Their verilation then costs the same however many copies of
+    # the block they instantiate; the block's model is compiled once, here.
+    outputs = []
+    move_wrapper = ""
+    if ctx.attr.hier_block:
+        wrapper = ctx.actions.declare_file(ctx.attr.name + "_hier/" + top_name + ".sv")
+        outputs.append(wrapper)
+        verilator_flags = verilator_flags + [
+            "--lib-create {}".format(top_name),
+            "--protect-key vpm-{}".format(top_name),
+        ]
+        move_wrapper = "mv {}/{}.sv {}\n".format(verilated_srcs.path, top_name, wrapper.path)
     
     verilate_action = ctx.actions.declare_file(ctx.attr.name + "_verilate.sh")
     ctx.actions.write(
@@ -97,32 +461,93 @@ def _verilator_hdl_library_impl(ctx):
         content = '''\
 #!/bin/bash
 set -e
-mkdir -p {output_dir}
-/usr/local/bin/verilator --cc {input} --Mdir {output_dir}
-rm -f {output_dir}/*.mk {output_dir}/*.dat {output_dir}/*.d
+mkdir -p {srcs_dir} {hdrs_dir}
+/usr/local/bin/verilator --cc {inputs} --top-module {top_name} --Mdir {srcs_dir} \\
+    {verilator_flags} --threads {threads}
+{move_wrapper}mv {srcs_dir}/*.h {hdrs_dir}/
+rm -f {srcs_dir}/*.mk {srcs_dir}/*.dat {srcs_dir}/*.d
 '''.format(
-            input = ctx.file.src.path,
-            output_dir = output_dir.path,
+            move_wrapper = move_wrapper,
+            inputs = " ".join([f.path for f in srcs.to_list()]),
+            top_name = top_name,
+            verilator_flags = " ".join(verilator_flags),
+            threads = threads,
+            srcs_dir = verilated_srcs.path,
+            hdrs_dir = verilated_hdrs.path,
         ),
         is_executable = True,
     )
     
     ctx.actions.run(
-        outputs = [output_dir],
-        inputs = [ctx.file.src],
+        outputs = [verilated_srcs, verilated_hdrs] + outputs,
+        inputs = depset(transitive = [srcs, hdrs]),
         tools = [verilate_action],
         executable = verilate_action,
         mnemonic = "Verilate",
     )
-    
+
+    # Compile the model against the shared runtime. These actions only run
+    # when something links the model, so building the target alone verilates.
+    cc_toolchain = find_cpp_toolchain(ctx)
+    feature_configuration = cc_common.configure_features(
+        ctx = ctx,
+        cc_toolchain = cc_toolchain,
+        requested_features = ctx.features,
+        unsupported_features = ctx.disabled_features,
+    )
+    runtime = [ctx.attr._verilator_runtime[CcInfo], ctx.attr._vpm_trace[CcInfo]]
+    if trace == "fst":
+        runtime.append(ctx.attr._verilator_trace_fst[CcInfo])
+    elif trace == "vcd":
+        runtime.append(ctx.attr._verilator_trace_vcd[CcInfo])
+    compilation_context, compilation_outputs = cc_common.compile(
+        name = ctx.attr.name,
+        actions = ctx.actions,
+        feature_configuration = feature_configuration,
+        cc_toolchain = cc_toolchain,
+        srcs = [verilated_srcs],
+        public_hdrs = [verilated_hdrs],
+        includes = [verilated_hdrs.path],
+        defines = ["VM_COVERAGE=0", "VM_SC=0", "VM_SAVABLE={}".format(int(ctx.attr.savable))] +
+                  VERILATOR_TRACE_FORMATS[trace].defines,
+        user_compile_flags = ["-std=c++17"] + profile.copts,
+        compilation_contexts = [dep.compilation_context for dep in runtime],
+    )
+    linking_context, _ = cc_common.create_linking_context_from_compilation_outputs(
+        name = ctx.attr.name,
+        actions = ctx.actions,
+        feature_configuration = feature_configuration,
+        cc_toolchain = cc_toolchain,
+        compilation_outputs = compilation_outputs,
+        linking_contexts = [dep.linking_context for dep in runtime] + [hier_blocks.linking_context],
+    )
+    model = CcInfo(
+        compilation_context = compilation_context,
+        linking_context = linking_context,
+    )
+
+    if ctx.attr.hier_block:
+        # The stub includes nothing
+        verilog_info = VerilogInfo(
+            transitive_sources = depset(outputs),
+            transitive_hdrs = depset(),
+            defines = depset(),
+            includes = depset(),
+            hier_blocks = cc_common.merge_cc_infos(cc_infos = [model, hier_blocks]),
+        )
+    else:
+        verilog_info = VerilogInfo(
+            transitive_sources = srcs,
+            transitive_hdrs = hdrs,
+            defines = defines,
+            includes = includes,
+            hier_blocks = hier_blocks,
+        )
+
     return [
-        DefaultInfo(files = depset([output_dir])),
-        CcInfo(
-            compilation_context = cc_common.create_compilation_context(
-                headers = depset([output_dir]),
-                includes = depset([output_dir.path]),
-            ),
-        ),
+        DefaultInfo(files = depset([verilated_srcs, verilated_hdrs] + outputs)),
+        model,
+        verilog_info,
     ]
 
 verilator_hdl_library = rule(
@@ -132,184 +557,1425 @@ verilator_hdl_library = rule(
             allow_single_file = [".v", ".sv"],
             mandatory = True,
         ),
+        "top_module": attr.string(
+            mandatory = False,
+            doc = "Name of the top module. If not specified, the src filename without its extension",
+        ),
+        "deps": attr.label_list(
+            providers = [VerilogInfo],
+            doc = "verilator_hdl_library targets of the modules instantiated by this one",
+        ),
+        "hdrs": attr.label_list(
+            allow_files = True,
+            doc = "Files `included by src, made available to Verilator in the sandbox",
+        ),
+        "defines": attr.string_list(
+            doc = "Macros as NAME or NAME=VALUE, passed to Verilator as +define+",
+        ),
+        "includes": attr.string_list(
+            doc = "Directories searched for `include files, relative to the workspace root or absolute",
+        ),
+        "hier_block": attr.bool(
+            default = False,
+            doc = "Verilate as a hierarchical block: modules instantiating this one see a stub and link its model",
+        ),
+        "savable": attr.bool(
+            default = False,
+            doc = "Verilate with --savable so VpmCheckpoint can save and restore the model; forces one thread",
+        ),
+        "profile": attr.string(
+            mandatory = False,
+            values = ["", "debug", "fast", "max"],
+            doc = "Simulation profile. If not specified, taken from --//tools/verilator:profile",
+        ),
+        "threads": attr.int(
+            default = 0,
+            doc = "Verilator --threads for the model. If 0, taken from the profile",
+        ),
+        "trace": attr.string(
+            mandatory = False,
+            values = ["", "off", "fst", "vcd"],
+            doc = "Waveform format. If not specified, taken from --//tools/verilator:trace",
+        ),
+        "trace_threads": attr.int(
+            default = 0,
+            doc = "Threads that write FST waveforms off the simulation threads. If 0, Verilator's default",
+        ),
+        "_profile_flag": attr.label(default = "//tools/verilator:profile"),
+        "_trace_flag": attr.label(default = "//tools/verilator:trace"),
+        "_verilator_runtime": attr.label(
+            default = "@verilator//:verilator_runtime",
+            providers = [CcInfo],
+        ),
+        "_verilator_trace_fst": attr.label(
+            default = "@verilator//:verilator_trace_fst",
+            providers = [CcInfo],
+        ),
+        "_verilator_trace_vcd": attr.label(
+            default = "@verilator//:verilator_trace_vcd",
+            providers = [CcInfo],
+        ),
+        "_vpm_trace": attr.label(
+            default = "//tools/verilator:vpm_trace",
+            providers = [CcInfo],
+        ),
+        "_cc_toolchain": attr.label(default = "@bazel_tools//tools/cpp:current_cc_toolchain"),
     },
     fragments = ["cpp"],
-    provides = [CcInfo],
+    toolchains = use_cpp_toolchain(),
+    provides = [CcInfo, VerilogInfo],
 )
+
+# main() of a verilator_hdl_server. The port table is read from the
+# VL_IN*/VL_OUT* declarations of the verilated model header.
+_SERVE_MAIN_HEAD = """#include <vector>
+#include "V{top}.h"
+#include "vpm_serve.h"
+
+int main(int argc, char** argv) {{
+    VerilatedContext context;
+    context.commandArgs(argc, argv);
+    V{top} model(&context, "top");
+    std::vector<vpm::ServedPort> ports = {{
+"""
+
+_SERVE_MAIN_TAIL = """    }};
+    return vpm::serveMain(argc, argv, "{top}", context, model, ports.data(), ports.size());
+}}
+"""
+
+def verilator_hdl_server(name, model, top, **kwargs):
+    """Process hosting a verilated model behind a shared-memory ring.
+
+    `model` is the verilator_hdl_library target of module `top`. The binary
+    serves it on /vpm-<top> until a client stops it; host software drives
+    the ports through vpm::ShmClient from "vpm_shm.h" without linking any
+    generated code. See vpm_serve.h.
+    """
+    native.genrule(
+        name = name + "_main",
+        srcs = [model],
+        outs = [name + "_main.cpp"],
+        cmd = r"""hdr=$$(find $(SRCS) -name V{top}.h | head -n 1)
+cat > $@ <<'EOF'
+{head}EOF
+sed -n 's/^ *VL_\(IN\|OUT\|INOUT\)[0-9W]*(&\{{0,1\}}\([A-Za-z0-9_]*\),\([0-9]*\),\([0-9]*\).*/\1 \2 \3 \4/p' $$hdr |
+while read dir port msb lsb; do
+    input=true
+    [ $$dir = OUT ] && input=false
+    echo "        {{\"$$port\", $$((msb - lsb + 1)), $$input, &model.$$port}},"
+done >> $@
+cat >> $@ <<'EOF'
+{tail}EOF""".format(
+            top = top,
+            head = _SERVE_MAIN_HEAD.format(top = top),
+            tail = _SERVE_MAIN_TAIL.format(top = top),
+        ),
+    )
+
+    cc_binary(
+        name = name,
+        srcs = [":" + name + "_main"],
+        copts = ["-std=c++17", "-O2"],
+        linkopts = ["-lrt", "-pthread"],
+        deps = [
+            model,
+            "//tools/verilator:vpm_serve",
+        ],
+        **kwargs
+    )
 )BAZEL";
 
+    // Create the harness for multi-instance sweeps
+    std::ofstream sweep_header(tools_dir / "vpm_sweep.h");
+    sweep_header << R"CPP(#pragma once
+
+// Harness for verilator_hdl_sweep targets: runs many independent instances
+// of one Verilator model in a single process, one per seed or stimulus file,
+// across a work-stealing thread pool. The testbench only defines what one
+// instance does; the target generates main() around it:
+//
+//   #include "Vcounter.h"
+//   #include "vpm_sweep.h"
+//
+//   void vpmSweep(Vcounter& model, vpm::SweepRun& run) {
+//       std::mt19937_64 rng(run.seed);
+//       for (run.cycles = 0; run.cycles < 1000 && !run.context.gotFinish(); ++run.cycles) {
+//           model.in = rng();
+//           model.clk = !model.clk;
+//           model.eval();
+//           if (model.out != expected) {
+//               return run.fail("mismatch at cycle " + std::to_string(run.cycles));
+//           }
+//       }
+//   }
+//
+// Every instance has its own VerilatedContext, seeded with its seed, so
+// instances share no simulation state. $stop and $fatal fail only the
+// instance that hit them. Options (or VPM_SWEEP_* environment variables):
+//
+//   --seeds=N            run N instances with seeds first-seed... (default 16)
+//   --first-seed=S       first seed (default 1)
+//   --stimulus=FILE      one instance per stimulus file (repeatable)
+//   --stimulus-list=FILE file listing stimulus files, one per line
+//   --threads=N          worker threads (default: all cores)
+//   --results=FILE       per-instance JSON results (default:
+//                        $TEST_UNDECLARED_OUTPUTS_DIR/sweep_results.json)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "verilated.h"
+
+namespace vpm {
+
+// One instance of a sweep, handed to the testbench
+struct SweepRun {
+    size_t index;
+    uint64_t seed;
+    // Empty for seed sweeps
+    std::string stimulus;
+    VerilatedContext& context;
+
+    bool passed = true;
+    std::string message;
+    // Reported per instance; set by the testbench
+    uint64_t cycles = 0;
+
+    // Marks the instance failed; the first message is kept
+    void fail(const std::string& why) {
+        if (passed) {
+            passed = false;
+            message = why;
+        }
+    }
+};
+
+struct SweepResult {
+    size_t index = 0;
+    uint64_t seed = 0;
+    std::string stimulus;
+    bool passed = false;
+    std::string message;
+    uint64_t cycles = 0;
+    double seconds = 0;
+};
+
+// Each worker owns a deque of job indices seeded with a contiguous block.
+// It takes jobs from the front of its own deque and, once that is empty,
+// steals from the back of the others, so uneven run times still keep
+// every core busy without a shared queue on the fast path.
+class WorkStealingPool {
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<size_t> jobs;
+    };
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    bool take(size_t self, size_t& job) {
+        {
+            Worker& own = *workers[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty()) {
+                job = own.jobs.front();
+                own.jobs.pop_front();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < workers.size(); ++offset) {
+            Worker& victim = *workers[(self + offset) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                job = victim.jobs.back();
+                victim.jobs.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    explicit WorkStealingPool(size_t threads) {
+        for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+    }
+
+    size_t size() const { return workers.size(); }
+
+    // Runs fn(job, worker) for every job in [0, count) and waits. Jobs are
+    // independent, so none is ever added once the run starts.
+    void run(size_t count, const std::function<void(size_t, size_t)>& fn) {
+        for (size_t i = 0; i < workers.size(); ++i) {
+            size_t begin = count * i / workers.size();
+            size_t end = count * (i + 1) / workers.size();
+            for (size_t job = begin; job < end; ++job) {
+                workers[i]->jobs.push_back(job);
+            }
+        }
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < workers.size(); ++i) {
+            threads.emplace_back([this, i, &fn]() {
+                size_t job;
+                while (take(i, job)) {
+                    fn(job, i);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+};
+
+namespace detail {
+    // Value of --name=value, or of the VPM_SWEEP_<NAME> environment variable
+    inline bool option(int argc, char** argv, const std::string& name, std::string& value) {
+        std::string flag = "--" + name + "=";
+        bool found = false;
+        for (int i = 1; i < argc; ++i) {
+            if (std::string(argv[i]).rfind(flag, 0) == 0) {
+                value = argv[i] + flag.size();
+                found = true;
+            }
+        }
+        if (found) {
+            return true;
+        }
+        std::string env = "VPM_SWEEP_" + name;
+        std::transform(env.begin(), env.end(), env.begin(), [](char c) { return c == '-' ? '_' : std::toupper(c); });
+        if (const char* env_value = std::getenv(env.c_str())) {
+            value = env_value;
+            return true;
+        }
+        return false;
+    }
+
+    inline std::string jsonString(const std::string& value) {
+        std::string out = "\"";
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                out += escape;
+            } else {
+                out += c;
+            }
+        }
+        return out + "\"";
+    }
+
+    inline void writeResults(const std::string& path, const std::vector<SweepResult>& results, double seconds,
+                             size_t threads) {
+        std::ofstream out(path);
+        if (!out.is_open()) {
+            std::cerr << "vpm_sweep: cannot write " << path << "\n";
+            return;
+        }
+        out << "{\n  \"wall_seconds\": " << seconds << ",\n  \"threads\": " << threads << ",\n  \"instances\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const SweepResult& result = results[i];
+            out << (i == 0 ? "\n" : ",\n") << "    {\"index\": " << result.index << ", \"seed\": " << result.seed
+                << ", \"stimulus\": " << jsonString(result.stimulus)
+                << ", \"passed\": " << (result.passed ? "true" : "false")
+                << ", \"message\": " << jsonString(result.message) << ", \"cycles\": " << result.cycles
+                << ", \"seconds\": " << result.seconds << "}";
+        }
+        out << (results.empty() ? "]\n}\n" : "\n  ]\n}\n");
+    }
+}
+
+// main() of a sweep: runs `simulate` once per seed or stimulus file and
+// returns non-zero if any instance failed
+template <typename Model>
+int sweepMain(int argc, char** argv, void (*simulate)(Model&, SweepRun&)) {
+    std::string value;
+    uint64_t seeds = 16;
+    uint64_t first_seed = 1;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> stimuli;
+    if (detail::option(argc, argv, "seeds", value)) {
+        seeds = std::strtoull(value.c_str(), nullptr, 10);
+    }
+    if (detail::option(argc, argv, "first-seed", value)) {
+        first_seed = std::strtoull(value.c_str(), nullptr, 10);
+    }
+    if (detail::option(argc, argv, "threads", value) && std::strtoull(value.c_str(), nullptr, 10) > 0) {
+        threads = std::strtoull(value.c_str(), nullptr, 10);
+    }
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--stimulus=", 0) == 0) {
+            stimuli.push_back(arg.substr(11));
+        }
+    }
+    if (detail::option(argc, argv, "stimulus-list", value)) {
+        std::ifstream list(value);
+        if (!list.is_open()) {
+            std::cerr << "vpm_sweep: cannot read stimulus list " << value << "\n";
+            return 1;
+        }
+        for (std::string line; std::getline(list, line);) {
+            if (!line.empty() && line[0] != '#') {
+                stimuli.push_back(line);
+            }
+        }
+    }
+    std::string results_path = "sweep_results.json";
+    if (const char* output_dir = std::getenv("TEST_UNDECLARED_OUTPUTS_DIR")) {
+        results_path = std::string(output_dir) + "/sweep_results.json";
+    }
+    detail::option(argc, argv, "results", results_path);
+
+    size_t count = stimuli.empty() ? seeds : stimuli.size();
+    std::vector<SweepResult> results(count);
+    WorkStealingPool pool(std::min<size_t>(threads, std::max<size_t>(count, 1)));
+    std::atomic<size_t> failures{0};
+
+    auto start = std::chrono::steady_clock::now();
+    pool.run(count, [&](size_t job, size_t) {
+        SweepResult& result = results[job];
+        result.index = job;
+        result.seed = first_seed + job;
+        result.stimulus = stimuli.empty() ? "" : stimuli[job];
+        auto job_start = std::chrono::steady_clock::now();
+
+        // A context per instance keeps seeds, time and $finish apart
+        VerilatedContext context;
+        context.randReset(2);
+        context.randSeed(static_cast<int>(result.seed));
+        context.fatalOnError(false);
+        SweepRun run{job, result.seed, result.stimulus, context, true, "", 0};
+        try {
+            Model model(&context, "top");
+            simulate(model, run);
+            model.final();
+        } catch (const std::exception& e) {
+            run.fail(std::string("exception: ") + e.what());
+        }
+        if (context.gotError()) {
+            run.fail("simulation error ($stop or $fatal)");
+        }
+
+        result.passed = run.passed;
+        result.message = run.message;
+        result.cycles = run.cycles;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job_start).count();
+        if (!run.passed) {
+            ++failures;
+        }
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    detail::writeResults(results_path, results, seconds, pool.size());
+    std::cout << "Sweep: " << count - failures << "/" << count << " instances passed in " << seconds << "s on "
+              << pool.size() << " threads\n";
+    size_t shown = 0;
+    for (const auto& result : results) {
+        if (!result.passed && shown++ < 20) {
+            std::cout << "  FAILED instance " << result.index << " (seed " << result.seed
+                      << (result.stimulus.empty() ? "" : ", stimulus " + result.stimulus) << "): " << result.message
+                      << "\n";
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+}  // namespace vpm
+)CPP";
+
+    // Create the warm-up checkpoint helper
+    std::ofstream checkpoint_header(tools_dir / "vpm_checkpoint.h");
+    checkpoint_header << R"CPP(#pragma once
+
+// Warm-up checkpoints for verilator_hdl_test testbenches. A target with a
+// `warm_up` file builds its model with Verilator's --savable, and the
+// testbench can run the shared reset and initialization sequence once,
+// snapshot the model, and restore that snapshot in every later test:
+//
+//   TEST(Counter, Overflow) {
+//       Vcounter model;
+//       VpmCheckpoint("reset").warmUp(model, [&] { resetSequence(model); });
+//       ...
+//   }
+//
+// The warm-up code (resetSequence above) lives in the `warm_up` file.
+// Checkpoints are keyed by the verilated model and that file, so changing
+// the RTL or the warm-up starts from scratch, while changes to the rest of
+// the testbench keep restoring. They are kept in $VPM_CHECKPOINT_DIR, which
+// `vpm --test` points at .vpm/checkpoints, else in the test's temporary
+// directory for the duration of one run. Without a `warm_up` file the
+// model is not savable and warmUp() always runs the warm-up.
+
+#include <cstdint>
+#include <string>
+
+#if VM_SAVABLE
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "verilated.h"
+#include "verilated_save.h"
+
+namespace vpm {
+// Defined in the <target>_checkpoint_key.cpp generated for the test
+const char* checkpointKey();
+const char* checkpointTarget();
+}  // namespace vpm
+#endif
+
+class VpmCheckpoint {
+private:
+#if VM_SAVABLE
+    std::string path;
+
+    static bool exists(const std::string& file) {
+        if (std::FILE* handle = std::fopen(file.c_str(), "rb")) {
+            std::fclose(handle);
+            return true;
+        }
+        return false;
+    }
+#endif
+
+public:
+    // A checkpoint taken after the warm-up phase `phase`
+    explicit VpmCheckpoint(const std::string& phase) {
+#if VM_SAVABLE
+        const char* dir = std::getenv("VPM_CHECKPOINT_DIR");
+        if (!dir) {
+            dir = std::getenv("TEST_TMPDIR");
+        }
+        path = std::string(dir ? dir : ".") + "/" + vpm::checkpointTarget() + "-" + phase + "-" +
+               vpm::checkpointKey() + ".vlt";
+#else
+        (void)phase;
+#endif
+    }
+
+    // Loads the checkpoint into `model` and its context; false if there is
+    // none for this model and warm-up code yet
+    template <typename Model>
+    bool restore(Model& model) {
+#if VM_SAVABLE
+        if (!exists(path)) {
+            return false;
+        }
+        VerilatedRestore is;
+        is.open(path.c_str());
+        uint64_t time = 0;
+        is >> time;
+        is >> model;
+        is.close();
+        model.contextp()->time(time);
+        return true;
+#else
+        (void)model;
+        return false;
+#endif
+    }
+
+    // Snapshots `model` and its simulation time. Written to a temporary
+    // file first, so tests running in parallel never read half a file.
+    template <typename Model>
+    void save(Model& model) {
+#if VM_SAVABLE
+        std::string temporary = path + "." + std::to_string(getpid()) + ".tmp";
+        VerilatedSave os;
+        os.open(temporary.c_str());
+        os << static_cast<uint64_t>(model.contextp()->time());
+        os << model;
+        os.close();
+        std::rename(temporary.c_str(), path.c_str());
+#else
+        (void)model;
+#endif
+    }
+
+    // Restores the checkpoint, or runs `warm_up` on the model and saves
+    // one. Returns true if the warm-up was skipped.
+    template <typename Model, typename WarmUp>
+    bool warmUp(Model& model, WarmUp&& warm_up) {
+        if (restore(model)) {
+            return true;
+        }
+        warm_up();
+        save(model);
+        return false;
+    }
+};
+)CPP";
+
+    // Create the shared-memory transport for served models and its clients
+    std::ofstream shm_header(tools_dir / "vpm_shm.h");
+    shm_header << R"CPP(#pragma once
+
+// Shared-memory transport between a verilated model served by `vpm --serve`
+// and host software driving it. Header-only and independent of Verilator, so
+// drivers and firmware models link nothing generated:
+//
+//   #include "vpm_shm.h"
+//
+//   vpm::ShmClient alu("/vpm-alu");
+//   uint32_t clk = alu.port("clk"), a = alu.port("a"), y = alu.port("y");
+//   for (uint64_t i = 0; i < 1000000; ++i) {
+//       alu.write(a, i);
+//       alu.tick(clk);
+//   }
+//   uint64_t result = alu.read(y);
+//
+// The segment holds a port table and two single-producer single-consumer
+// rings: requests from the client and responses from the server. Each side
+// only spins on the other's index, on its own cache line, so a transaction
+// costs a few cache-line transfers and no system call. Writes, evals and
+// ticks are posted without waiting; read() and sync() wait for the server to
+// catch up. One client is attached at a time; the server empties both rings
+// before it serves a new one, and drops responses to a client that detached
+// or died.
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+}
+
+namespace vpm {
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory rings need lock-free 64-bit atomics");
+
+constexpr uint32_t kShmMagic = 0x534d5056;  // "VPMS"
+constexpr uint32_t kShmVersion = 2;
+constexpr uint32_t kShmMaxPorts = 512;
+
+enum class ShmOp : uint16_t {
+    Write,
+    Read,
+    Eval,
+    // Toggles the clock port through `value` full cycles, evaluating on each edge
+    Tick,
+    // Responds once every earlier request has been handled
+    Sync,
+    // Shuts the server down
+    Stop,
+};
+
+struct ShmPort {
+    char name[60];
+    uint16_t width;
+    uint16_t input;
+};
+
+struct ShmRequest {
+    ShmOp op;
+    // 32-bit word of a port wider than 64 bits
+    uint16_t word;
+    uint32_t port;
+    uint64_t value;
+};
+
+struct alignas(64) ShmIndex {
+    std::atomic<uint64_t> value{0};
+};
+
+// Start of the segment; the rings follow it
+struct ShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t port_count;
+    // Entries per ring, a power of two
+    uint32_t capacity;
+    // Requests naming a missing port or writing an output
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint32_t> attached{0};
+    std::atomic<uint32_t> stopped{0};
+    // Bumped by each client that attaches; the server echoes it in `served`
+    // once the rings are empty for that client
+    std::atomic<uint32_t> session{0};
+    std::atomic<uint32_t> served{0};
+    std::atomic<int32_t> client_pid{0};
+    ShmPort ports[kShmMaxPorts];
+};
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Spins briefly, then yields, then sleeps, so a waiting side costs little
+// once the other goes quiet but reacts within nanoseconds while it is busy
+class Backoff {
+private:
+    uint32_t rounds = 0;
+
+public:
+    void wait() {
+        if (rounds < 128) {
+            cpuRelax();
+        } else if (rounds < 4096) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        ++rounds;
+    }
+
+    void reset() { rounds = 0; }
+};
+
+// One endpoint of a ring in the segment. The producer and the consumer each
+// keep a private copy of the other's index and only reload it when the ring
+// looks full or empty.
+template <typename T>
+class ShmRing {
+private:
+    ShmIndex* head = nullptr;
+    ShmIndex* tail = nullptr;
+    T* slots = nullptr;
+    uint64_t mask = 0;
+    uint64_t cached = 0;
+
+public:
+    static size_t bytes(uint32_t capacity) { return 2 * sizeof(ShmIndex) + capacity * sizeof(T); }
+
+    ShmRing() = default;
+    ShmRing(void* memory, uint32_t capacity)
+        : head(static_cast<ShmIndex*>(memory)),
+          tail(head + 1),
+          slots(reinterpret_cast<T*>(head + 2)),
+          mask(capacity - 1) {}
+
+    bool tryPush(const T& item) {
+        uint64_t position = tail->value.load(std::memory_order_relaxed);
+        if (position - cached > mask) {
+            cached = head->value.load(std::memory_order_acquire);
+            if (position - cached > mask) {
+                return false;
+            }
+        }
+        slots[position & mask] = item;
+        tail->value.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& item) {
+        uint64_t position = head->value.load(std::memory_order_relaxed);
+        // Indices only grow, so a fresh endpoint's zero copy just reloads
+        if (cached <= position) {
+            cached = tail->value.load(std::memory_order_acquire);
+            if (cached <= position) {
+                return false;
+            }
+        }
+        item = slots[position & mask];
+        head->value.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Discards every entry. Only while the other side is not using the ring.
+    void clear() { head->value.store(tail->value.load(std::memory_order_acquire), std::memory_order_release); }
+};
+
+// A mapped POSIX shared-memory object; the creator unlinks it when done
+class ShmSegment {
+private:
+    std::string name;
+    void* memory = MAP_FAILED;
+    size_t size = 0;
+    bool owner = false;
+
+    void map(int fd) {
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (memory == MAP_FAILED) {
+            throw std::runtime_error("Failed to map shared memory: " + name);
+        }
+    }
+
+public:
+    static size_t bytes(uint32_t capacity) {
+        return sizeof(ShmHeader) + ShmRing<ShmRequest>::bytes(capacity) + ShmRing<uint64_t>::bytes(capacity);
+    }
+
+    // Creates `name` (e.g. "/vpm-alu"), replacing a stale one
+    ShmSegment(const std::string& segment, uint32_t capacity) : name(segment), size(bytes(capacity)), owner(true) {
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 || ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Failed to create shared memory: " + name);
+        }
+        map(fd);
+    }
+
+    // Opens an existing `name`
+    explicit ShmSegment(const std::string& segment) : name(segment) {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) {
+            throw std::runtime_error("No vpm server at " + name);
+        }
+        // magic, version, port_count, capacity
+        uint32_t fields[4] = {};
+        if (pread(fd, fields, sizeof(fields), 0) != static_cast<ssize_t>(sizeof(fields)) || fields[0] != kShmMagic ||
+            fields[1] != kShmVersion) {
+            close(fd);
+            throw std::runtime_error("Not a vpm server segment: " + name);
+        }
+        size = bytes(fields[3]);
+        map(fd);
+    }
+
+    ~ShmSegment() {
+        if (memory != MAP_FAILED) {
+            munmap(memory, size);
+        }
+        if (owner) {
+            shm_unlink(name.c_str());
+        }
+    }
+
+    ShmSegment(const ShmSegment&) = delete;
+    ShmSegment& operator=(const ShmSegment&) = delete;
+
+    ShmHeader* header() const { return static_cast<ShmHeader*>(memory); }
+    char* rings() const { return static_cast<char*>(memory) + sizeof(ShmHeader); }
+};
+
+// Host side: drives a served model through its ports
+class ShmClient {
+private:
+    ShmSegment segment;
+    ShmHeader* header;
+    ShmRing<ShmRequest> requests;
+    ShmRing<uint64_t> responses;
+
+    void post(ShmOp op, uint32_t port = 0, uint64_t value = 0, uint32_t word = 0) {
+        ShmRequest request{op, static_cast<uint16_t>(word), port, value};
+        Backoff backoff;
+        while (!requests.tryPush(request)) {
+            if (header->stopped.load(std::memory_order_acquire)) {
+                throw std::runtime_error("vpm server stopped");
+            }
+            backoff.wait();
+        }
+    }
+
+    uint64_t receive() {
+        uint64_t value = 0;
+        Backoff backoff;
+        while (!responses.tryPop(value)) {
+            if (header->stopped.load(std::memory_order_acquire)) {
+                throw std::runtime_error("vpm server stopped");
+            }
+            backoff.wait();
+        }
+        return value;
+    }
+
+public:
+    // Throws if no server is running under `name` or another client is attached
+    explicit ShmClient(const std::string& name) : segment(name), header(segment.header()) {
+        uint32_t expected = 0;
+        if (header->stopped.load() || !header->attached.compare_exchange_strong(expected, 1)) {
+            throw std::runtime_error("vpm server at " + name + " is stopped or busy");
+        }
+        header->client_pid.store(static_cast<int32_t>(getpid()), std::memory_order_relaxed);
+        uint32_t session = header->session.fetch_add(1, std::memory_order_acq_rel) + 1;
+        // Wait until the server has dropped what an earlier client left behind
+        Backoff backoff;
+        while (header->served.load(std::memory_order_acquire) != session) {
+            if (header->stopped.load(std::memory_order_acquire)) {
+                header->attached.store(0, std::memory_order_release);
+                throw std::runtime_error("vpm server at " + name + " is stopped or busy");
+            }
+            backoff.wait();
+        }
+        requests = ShmRing<ShmRequest>(segment.rings(), header->capacity);
+        responses = ShmRing<uint64_t>(segment.rings() + ShmRing<ShmRequest>::bytes(header->capacity),
+                                      header->capacity);
+    }
+
+    ~ShmClient() {
+        try {
+            if (!header->stopped.load()) {
+                sync();
+            }
+        } catch (const std::exception&) {
+        }
+        header->attached.store(0, std::memory_order_release);
+    }
+
+    ShmClient(const ShmClient&) = delete;
+    ShmClient& operator=(const ShmClient&) = delete;
+
+    // Index of the port called `name`; throws if the model has none
+    uint32_t port(const std::string& name) const {
+        for (uint32_t i = 0; i < header->port_count; ++i) {
+            if (name == header->ports[i].name) {
+                return i;
+            }
+        }
+        throw std::runtime_error("No port named " + name);
+    }
+
+    std::vector<ShmPort> ports() const { return {header->ports, header->ports + header->port_count}; }
+
+    // Requests the server rejected so far
+    uint64_t errors() const { return header->errors.load(); }
+
+    void write(uint32_t port, uint64_t value, uint32_t word = 0) { post(ShmOp::Write, port, value, word); }
+    void eval() { post(ShmOp::Eval); }
+    void tick(uint32_t clock, uint64_t cycles = 1) { post(ShmOp::Tick, clock, cycles); }
+
+    // Value of `port` after every earlier request
+    uint64_t read(uint32_t port, uint32_t word = 0) {
+        post(ShmOp::Read, port, 0, word);
+        return receive();
+    }
+
+    void sync() {
+        post(ShmOp::Sync);
+        receive();
+    }
+
+    // Stops the server process
+    void stop() {
+        post(ShmOp::Stop);
+        receive();
+    }
+};
+
+// Served side: creates the segment and hands requests to a handler with
+//   uint64_t read(uint32_t port, uint32_t word)
+//   bool write(uint32_t port, uint32_t word, uint64_t value)  // false if rejected
+//   void eval()
+//   void tick(uint32_t clock, uint64_t cycles)
+class ShmServer {
+private:
+    ShmSegment segment;
+    ShmHeader* header;
+    ShmRing<ShmRequest> requests;
+    ShmRing<uint64_t> responses;
+    // Session of the client being served
+    uint32_t session = 0;
+
+    // True once the client being served can no longer read its responses
+    bool clientGone() const {
+        if (!header->attached.load(std::memory_order_acquire) ||
+            header->session.load(std::memory_order_acquire) != session) {
+            return true;
+        }
+        pid_t pid = static_cast<pid_t>(header->client_pid.load(std::memory_order_relaxed));
+        return pid > 0 && kill(pid, 0) != 0 && errno == ESRCH;
+    }
+
+    // Waits for room in the responses ring. Gives up, dropping the value,
+    // when the client is gone or `interrupt` is set.
+    void respond(uint64_t value, const std::atomic<bool>* interrupt) {
+        Backoff backoff;
+        while (!responses.tryPush(value)) {
+            if ((interrupt && interrupt->load(std::memory_order_relaxed)) || clientGone()) {
+                if (header->attached.load(std::memory_order_acquire) &&
+                    header->session.load(std::memory_order_acquire) == session) {
+                    // Died while attached; let the next client in
+                    header->attached.store(0, std::memory_order_release);
+                }
+                return;
+            }
+            backoff.wait();
+        }
+    }
+
+    // Empties both rings for a client that just attached. Its requests wait
+    // for `served`, and the previous client has detached, so neither ring is
+    // in use.
+    void acceptSession(uint32_t next) {
+        requests.clear();
+        responses.clear();
+        session = next;
+        header->served.store(next, std::memory_order_release);
+    }
+
+    static uint32_t ringCapacity(uint32_t capacity) {
+        uint32_t rounded = 2;
+        while (rounded < capacity) {
+            rounded *= 2;
+        }
+        return rounded;
+    }
+
+public:
+    // `capacity` is rounded up to a power of two
+    ShmServer(const std::string& name, const std::vector<ShmPort>& ports, uint32_t capacity = 4096)
+        : segment(name, ringCapacity(capacity)), header(new (segment.header()) ShmHeader()) {
+        if (ports.size() > kShmMaxPorts) {
+            throw std::runtime_error("Too many ports to serve: " + std::to_string(ports.size()));
+        }
+        header->port_count = static_cast<uint32_t>(ports.size());
+        header->capacity = ringCapacity(capacity);
+        std::memcpy(header->ports, ports.data(), ports.size() * sizeof(ShmPort));
+        new (segment.rings()) ShmIndex[2];
+        new (segment.rings() + ShmRing<ShmRequest>::bytes(header->capacity)) ShmIndex[2];
+        requests = ShmRing<ShmRequest>(segment.rings(), header->capacity);
+        responses = ShmRing<uint64_t>(segment.rings() + ShmRing<ShmRequest>::bytes(header->capacity),
+                                      header->capacity);
+        // Clients only accept the segment once the magic is set
+        header->version = kShmVersion;
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = kShmMagic;
+    }
+
+    ~ShmServer() { header->stopped.store(1, std::memory_order_release); }
+
+    ShmServer(const ShmServer&) = delete;
+    ShmServer& operator=(const ShmServer&) = delete;
+
+    // Handles requests until a client sends Stop or `interrupt` is set.
+    // Returns the number of requests handled.
+    template <typename Handler>
+    uint64_t run(Handler& handler, const std::atomic<bool>* interrupt = nullptr) {
+        uint64_t handled = 0;
+        ShmRequest request;
+        Backoff backoff;
+        while (!interrupt || !interrupt->load(std::memory_order_relaxed)) {
+            uint32_t next = header->session.load(std::memory_order_acquire);
+            if (next != session) {
+                acceptSession(next);
+            }
+            if (!requests.tryPop(request)) {
+                backoff.wait();
+                continue;
+            }
+            backoff.reset();
+            ++handled;
+            bool valid = request.port < header->port_count;
+            switch (request.op) {
+            case ShmOp::Write:
+                if (!valid || !handler.write(request.port, request.word, request.value)) {
+                    header->errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                break;
+            case ShmOp::Read:
+                if (!valid) {
+                    header->errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                respond(valid ? handler.read(request.port, request.word) : 0, interrupt);
+                break;
+            case ShmOp::Eval:
+                handler.eval();
+                break;
+            case ShmOp::Tick:
+                if (valid) {
+                    handler.tick(request.port, request.value);
+                } else {
+                    header->errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                break;
+            case ShmOp::Sync:
+                respond(0, interrupt);
+                break;
+            case ShmOp::Stop:
+                header->stopped.store(1, std::memory_order_release);
+                respond(0, interrupt);
+                return handled;
+            }
+        }
+        header->stopped.store(1, std::memory_order_release);
+        return handled;
+    }
+};
+
+}  // namespace vpm
+)CPP";
+
+    // Create the server main() of verilator_hdl_server targets
+    std::ofstream serve_header(tools_dir / "vpm_serve.h");
+    serve_header << R"CPP(#pragma once
+
+// Server main() of verilator_hdl_server targets: hosts one V<top> model and
+// exposes its ports through vpm_shm.h, for host software using
+// vpm::ShmClient. The target generates the port table from the model header:
+//
+//   Vcounter model(&context);
+//   vpm::ServedPort ports[] = {{"clk", 1, true, &model.clk}, ...};
+//   return vpm::serveMain(argc, argv, "counter", context, model, ports, count);
+//
+// Options: --name=/vpm-<top> names the shared-memory segment and
+// --capacity=N sets the entries per ring (default 4096). The server runs
+// until a client calls stop() or it gets SIGINT or SIGTERM.
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "verilated.h"
+#include "vpm_shm.h"
+
+namespace vpm {
+
+// A model port: Verilator keeps up to 8, 16, 32 and 64 bits in CData,
+// SData, IData and QData, and wider ports as arrays of 32-bit words
+struct ServedPort {
+    const char* name;
+    uint32_t width;
+    bool input;
+    void* data;
+};
+
+namespace detail {
+    inline std::atomic<bool>& interrupted() {
+        static std::atomic<bool> flag{false};
+        return flag;
+    }
+
+    template <typename Model>
+    class ModelPorts {
+    private:
+        VerilatedContext& context;
+        Model& model;
+        const ServedPort* ports;
+
+    public:
+        ModelPorts(VerilatedContext& context, Model& model, const ServedPort* ports)
+            : context(context), model(model), ports(ports) {}
+
+        uint64_t read(uint32_t index, uint32_t word) {
+            const ServedPort& port = ports[index];
+            if (port.width <= 8) {
+                return *static_cast<const uint8_t*>(port.data);
+            }
+            if (port.width <= 16) {
+                return *static_cast<const uint16_t*>(port.data);
+            }
+            if (port.width <= 32) {
+                return *static_cast<const uint32_t*>(port.data);
+            }
+            if (port.width <= 64) {
+                return *static_cast<const uint64_t*>(port.data);
+            }
+            return word < (port.width + 31) / 32 ? static_cast<const uint32_t*>(port.data)[word] : 0;
+        }
+
+        bool write(uint32_t index, uint32_t word, uint64_t value) {
+            const ServedPort& port = ports[index];
+            if (!port.input) {
+                return false;
+            }
+            uint64_t mask = port.width >= 64 ? ~uint64_t(0) : (uint64_t(1) << port.width) - 1;
+            if (port.width <= 8) {
+                *static_cast<uint8_t*>(port.data) = static_cast<uint8_t>(value & mask);
+            } else if (port.width <= 16) {
+                *static_cast<uint16_t*>(port.data) = static_cast<uint16_t>(value & mask);
+            } else if (port.width <= 32) {
+                *static_cast<uint32_t*>(port.data) = static_cast<uint32_t>(value & mask);
+            } else if (port.width <= 64) {
+                *static_cast<uint64_t*>(port.data) = value & mask;
+            } else if (word < (port.width + 31) / 32) {
+                static_cast<uint32_t*>(port.data)[word] = static_cast<uint32_t>(value);
+            } else {
+                return false;
+            }
+            return true;
+        }
+
+        void eval() { model.eval(); }
+
+        // One cycle is a falling then a rising edge, each a time unit apart
+        void tick(uint32_t clock, uint64_t cycles) {
+            if (ports[clock].width != 1 || !ports[clock].input) {
+                return;
+            }
+            uint8_t& clk = *static_cast<uint8_t*>(ports[clock].data);
+            for (uint64_t i = 0; i < cycles && !context.gotFinish(); ++i) {
+                clk = 0;
+                model.eval();
+                context.timeInc(1);
+                clk = 1;
+                model.eval();
+                context.timeInc(1);
+            }
+        }
+    };
+
+    // Value of --name=value among the arguments
+    inline bool option(int argc, char** argv, const char* name, std::string& value) {
+        std::string flag = std::string("--") + name + "=";
+        for (int i = 1; i < argc; ++i) {
+            if (std::strncmp(argv[i], flag.c_str(), flag.size()) == 0) {
+                value = argv[i] + flag.size();
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+template <typename Model>
+int serveMain(int argc, char** argv, const char* top, VerilatedContext& context, Model& model,
+              const ServedPort* ports, size_t count) {
+    std::string name = std::string("/vpm-") + top;
+    std::string value;
+    uint32_t capacity = 4096;
+    detail::option(argc, argv, "name", name);
+    if (detail::option(argc, argv, "capacity", value)) {
+        capacity = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+    }
+
+    std::vector<ShmPort> table(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::strncpy(table[i].name, ports[i].name, sizeof(table[i].name) - 1);
+        table[i].width = static_cast<uint16_t>(ports[i].width);
+        table[i].input = ports[i].input;
+    }
+
+    std::signal(SIGINT, [](int) { detail::interrupted() = true; });
+    std::signal(SIGTERM, [](int) { detail::interrupted() = true; });
+    try {
+        ShmServer server(name, table, capacity);
+        model.eval();
+        std::cout << "Serving " << top << " on " << name << " (" << count << " ports)" << std::endl;
+        detail::ModelPorts<Model> handler(context, model, ports);
+        uint64_t handled = server.run(handler, &detail::interrupted());
+        model.final();
+        std::cout << "Stopped after " << handled << " requests" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+}  // namespace vpm
+)CPP";
+
     // Create defs_test.bzl file with our custom rule for tests
     std::ofstream defs_test_file(tools_dir / "defs_test.bzl");
-    defs_test_file << R"BAZEL(load("@bazel_tools//tools/cpp:toolchain_utils.bzl", "find_cpp_toolchain")
-load("@rules_cc//cc:defs.bzl", "cc_test")
+    defs_test_file << R"BAZEL(load("@rules_cc//cc:defs.bzl", "cc_test")
+load("//tools/verilator:defs.bzl", "verilator_hdl_library", "verilator_profile_copts")
 
-def _verilator_hdl_test_impl(ctx):
-    output_dir = ctx.actions.declare_directory(ctx.attr.name + "_verilated")
-    output_exe = ctx.actions.declare_file(ctx.attr.name)
-    test_log = ctx.actions.declare_file(ctx.attr.name + ".log")
-    
-    # Create a script to handle the Verilator compilation process
-    verilate_action = ctx.actions.declare_file(ctx.attr.name + "_verilate.sh")
-    ctx.actions.write(
-        output = verilate_action,
-        content = '''\
-#!/bin/bash
-set -ex
-echo "Current directory: $(pwd)"
-echo "Output directory: {output_dir}"
-echo "Output executable: {exe}"
-echo "Test log: {test_log}"
-
-# Convert relative paths to absolute
-WORKSPACE_ROOT=$(pwd)
-OUTPUT_DIR="$WORKSPACE_ROOT/{output_dir}"
-OUTPUT_EXE="$WORKSPACE_ROOT/{exe}"
-TEST_LOG="$WORKSPACE_ROOT/{test_log}"
-
-mkdir -p "$OUTPUT_DIR"
-cp {input} "$OUTPUT_DIR"/
-cp {testbench} "$OUTPUT_DIR"/
-cd "$OUTPUT_DIR"
-
-echo "Changed to directory: $(pwd)"
-ls -la
-
-# Get Verilator include path
-VERILATOR_ROOT=/usr/local/Cellar/verilator/5.026/share/verilator
-
-/usr/local/bin/verilator --cc --exe --trace {input_name} {testbench_name} \\
-    --Mdir . --prefix V{top_name} \\
-    --top-module {top_name} \\
-    -CFLAGS "-I. -I/usr/local/include -I$VERILATOR_ROOT/include -I/usr/local/include/gtest -std=c++17"
-
-sed -i.bak 's|#include "test/rtl/V{top_name}.h"|#include "V{top_name}.h"|' {testbench_name}
-
-echo "Compiling Verilator runtime..."
-# Compile Verilator runtime
-c++ -c -I. -I$VERILATOR_ROOT/include -std=c++17 \\
-    $VERILATOR_ROOT/include/verilated.cpp \\
-    $VERILATOR_ROOT/include/verilated_vcd_c.cpp \\
-    $VERILATOR_ROOT/include/verilated_threads.cpp
-
-# Create archive
-ar rvs libverilated.a verilated.o verilated_vcd_c.o verilated_threads.o
-
-echo "Compiling generated Verilator files..."
-# Compile the generated Verilator files
-c++ -c -I. -I$VERILATOR_ROOT/include -I/usr/local/include \\
-    -std=c++17 -Os \\
-    -DVM_COVERAGE=0 -DVM_SC=0 -DVM_TRACE=1 -DVM_TRACE_FST=0 -DVM_TRACE_VCD=1 \\
-    Vcounter.cpp \\
-    Vcounter___024root__DepSet_h0dd033c2__0.cpp \\
-    Vcounter___024root__DepSet_h5086c508__0.cpp \\
-    Vcounter__Trace__0.cpp \\
-    Vcounter___024root__Slow.cpp \\
-    Vcounter___024root__DepSet_h5086c508__0__Slow.cpp \\
-    Vcounter__Syms.cpp \\
-    Vcounter__Trace__0__Slow.cpp \\
-    Vcounter__TraceDecls__0__Slow.cpp
-
-echo "Compiling test..."
-# Compile the test
-c++ -c -I. -I$VERILATOR_ROOT/include -I/usr/local/include \\
-    -std=c++17 -Os \\
-    -DVM_COVERAGE=0 -DVM_SC=0 -DVM_TRACE=1 -DVM_TRACE_FST=0 -DVM_TRACE_VCD=1 \\
-    counter_tb.cpp
-
-echo "Creating output directory and linking..."
-# Create output directory and link everything together
-mkdir -p $(dirname "$OUTPUT_EXE")
-echo "Output directory created: $(ls -la $(dirname "$OUTPUT_EXE"))"
-
-echo "Linking with debug output..."
-c++ -v -o counter_hdl_test \\
-    counter_tb.o \\
-    Vcounter.o \\
-    Vcounter___024root__DepSet_h0dd033c2__0.o \\
-    Vcounter___024root__DepSet_h5086c508__0.o \\
-    Vcounter__Trace__0.o \\
-    Vcounter___024root__Slow.o \\
-    Vcounter___024root__DepSet_h5086c508__0__Slow.o \\
-    Vcounter__Syms.o \\
-    Vcounter__Trace__0__Slow.o \\
-    Vcounter__TraceDecls__0__Slow.o \\
-    -L/usr/local/lib -L. \\
-    -lpthread -lverilated \\
-    -lgtest -lgtest_main
-
-cp counter_hdl_test "$OUTPUT_EXE"
-echo "Final output: $(ls -la "$OUTPUT_EXE")"
-
-# Run the test and capture output
-echo "Running test..."
-set +e  # Don't exit on error
-"$OUTPUT_EXE" 2>&1 | tee "$TEST_LOG"
-test_exit=$?
-set -e  # Re-enable exit on error
-
-# Print test log
-echo "=== Test Log ==="
-cat "$TEST_LOG"
-echo "=== End Test Log ==="
-
-exit $test_exit
-'''.format(
-            input = ctx.file.src.path,
-            testbench = ctx.file.testbench.path,
-            output_dir = output_dir.path,
-            exe = output_exe.path,
-            test_log = test_log.path,
-            input_name = ctx.file.src.basename,
-            testbench_name = ctx.file.testbench.basename,
-            top_name = ctx.attr.top_module if ctx.attr.top_module else ctx.file.src.basename.replace(".sv", ""),
-        ),
-        is_executable = True,
+# main() of a verilator_hdl_sweep: runs the testbench's vpmSweep() over
+# many instances of the model through vpm_sweep.h
+_SWEEP_MAIN = """#include "V{top}.h"
+#include "vpm_sweep.h"
+
+void vpmSweep(V{top}& model, vpm::SweepRun& run);
+
+int main(int argc, char** argv) {{
+    return vpm::sweepMain<V{top}>(argc, argv, vpmSweep);
+}}
+"""
+
+def verilator_hdl_test(
+        name,
+        src,
+        testbench,
+        top_module = None,
+        deps = [],
+        hdrs = [],
+        defines = [],
+        includes = [],
+        profile = "",
+        threads = 0,
+        trace = "",
+        trace_threads = 0,
+        warm_up = None,
+        **kwargs):
+    """GoogleTest testbench for a Verilog module.
+
+    Expands to a verilator_hdl_library holding the compiled model
+    (`<name>_model`) and a cc_test linking `testbench` against it and the
+    shared Verilator runtime, so the runtime is built once for all tests and
+    the model compiles as separate cached actions.
+
+    With tracing enabled the testbench can dump waveforms through
+    VpmTrace from "vpm_trace.h"; with tracing off that class compiles to
+    nothing.
+
+    `warm_up` is a C++ file holding the reset and initialization code the
+    testbench runs through VpmCheckpoint from "vpm_checkpoint.h". It makes
+    the model savable (and single-threaded), and keys the checkpoints by a
+    hash of the verilated model and this file, so they are rebuilt when the
+    RTL or the warm-up changes but not when the rest of the testbench does.
+    """
+    top_name = top_module if top_module else src.split(":")[-1].split("/")[-1].rsplit(".", 1)[0]
+
+    verilator_hdl_library(
+        name = name + "_model",
+        src = src,
+        top_module = top_module,
+        deps = deps,
+        hdrs = hdrs,
+        defines = defines,
+        includes = includes,
+        profile = profile,
+        threads = threads,
+        trace = trace,
+        trace_threads = trace_threads,
+        savable = warm_up != None,
+        testonly = True,
     )
-    
-    # Run the compilation script
-    ctx.actions.run(
-        outputs = [output_dir, output_exe, test_log],
-        inputs = [ctx.file.src, ctx.file.testbench],
-        tools = [verilate_action],
-        executable = verilate_action,
-        mnemonic = "VerilateTest",
-        use_default_shell_env = True,
+
+    # Testbenches may include the model header by its source path
+    # (e.g. "test/rtl/Vcounter.h"); the model exports it as "Vcounter.h"
+    native.genrule(
+        name = name + "_testbench",
+        srcs = [testbench],
+        outs = [name + "_tb.cpp"],
+        cmd = "sed 's|#include \".*/V{top}.h\"|#include \"V{top}.h\"|' $< > $@".format(top = top_name),
+        testonly = True,
     )
-    
-    return [
-        DefaultInfo(
-            files = depset([output_dir]),
-            executable = output_exe,
-            runfiles = ctx.runfiles(files = [output_exe, test_log]),
-        ),
-        CcInfo(
-            compilation_context = cc_common.create_compilation_context(
-                headers = depset([output_dir]),
-                includes = depset([output_dir.path]),
-            ),
-        ),
+
+    test_srcs = [":" + name + "_testbench"]
+    test_deps = [
+        ":" + name + "_model",
+        "@gtest//:gtest_main",
     ]
+    if warm_up:
+        native.genrule(
+            name = name + "_warm_up",
+            srcs = [warm_up],
+            outs = [name + "_warm_up.cpp"],
+            cmd = "sed 's|#include \".*/V{top}.h\"|#include \"V{top}.h\"|' $< > $@".format(top = top_name),
+            testonly = True,
+        )
 
-verilator_hdl_test = rule(
-    implementation = _verilator_hdl_test_impl,
-    attrs = {
-        "src": attr.label(
-            allow_single_file = [".v", ".sv"],
-            mandatory = True,
-        ),
-        "testbench": attr.label(
-            allow_single_file = [".cpp"],
-            mandatory = True,
-        ),
-        "top_module": attr.string(
-            mandatory = False,
-            doc = "Name of the top module. If not specified, derived from src filename",
-        ),
-    },
-    fragments = ["cpp"],
-    test = True,
-    executable = True,
-)
+        # The key covers everything verilated for the model and its direct
+        # submodules, plus the warm-up code
+        native.genrule(
+            name = name + "_checkpoint_key",
+            srcs = [":" + name + "_model", warm_up] + deps,
+            outs = [name + "_checkpoint_key.cpp"],
+            cmd = """key=$$(find $(SRCS) -type f | LC_ALL=C sort | xargs cat | sha256sum | cut -c1-16)
+cat > $@ <<EOF
+namespace vpm {{
+const char* checkpointKey() {{ return "$$key"; }}
+const char* checkpointTarget() {{ return "{name}"; }}
+}}
+EOF""".format(name = name),
+            testonly = True,
+        )
+        test_srcs += [":" + name + "_warm_up", ":" + name + "_checkpoint_key"]
+        test_deps.append("//tools/verilator:vpm_checkpoint")
+
+    cc_test(
+        name = name,
+        srcs = test_srcs,
+        copts = ["-std=c++17"] + verilator_profile_copts(profile),
+        deps = test_deps,
+        **kwargs
+    )
+
+def verilator_hdl_sweep(
+        name,
+        src,
+        testbench,
+        top_module = None,
+        deps = [],
+        hdrs = [],
+        defines = [],
+        includes = [],
+        profile = "",
+        seeds = 0,
+        stimulus = [],
+        sweep_threads = 0,
+        **kwargs):
+    """Seed or stimulus sweep over many instances of a Verilog module.
+
+    `testbench` defines `void vpmSweep(V<top>& model, vpm::SweepRun& run)`,
+    which simulates one instance; a generated main() runs it once per seed
+    (or once per `stimulus` file) across a work-stealing thread pool in a
+    single process and reports results per instance. See vpm_sweep.h.
+
+    Instances already run in parallel, so the model itself is verilated
+    single-threaded whatever the profile.
+    """
+    top_name = top_module if top_module else src.split(":")[-1].split("/")[-1].rsplit(".", 1)[0]
+
+    verilator_hdl_library(
+        name = name + "_model",
+        src = src,
+        top_module = top_module,
+        deps = deps,
+        hdrs = hdrs,
+        defines = defines,
+        includes = includes,
+        profile = profile,
+        threads = 1,
+        trace = "off",
+        testonly = True,
+    )
+
+    native.genrule(
+        name = name + "_testbench",
+        srcs = [testbench],
+        outs = [name + "_tb.cpp"],
+        cmd = "sed 's|#include \".*/V{top}.h\"|#include \"V{top}.h\"|' $< > $@".format(top = top_name),
+        testonly = True,
+    )
+
+    native.genrule(
+        name = name + "_main",
+        outs = [name + "_main.cpp"],
+        cmd = "cat > $@ <<'EOF'\n" + _SWEEP_MAIN.format(top = top_name) + "EOF",
+        testonly = True,
+    )
+
+    args = ["--stimulus=$(rootpath {})".format(file) for file in stimulus]
+    if seeds > 0:
+        args.append("--seeds={}".format(seeds))
+    if sweep_threads > 0:
+        args.append("--threads={}".format(sweep_threads))
+
+    cc_test(
+        name = name,
+        srcs = [":" + name + "_testbench", ":" + name + "_main"],
+        copts = ["-std=c++17"] + verilator_profile_copts(profile),
+        args = args + kwargs.pop("args", []),
+        data = stimulus + kwargs.pop("data", []),
+        deps = [
+            ":" + name + "_model",
+            "//tools/verilator:vpm_sweep",
+        ],
+        **kwargs
+    )
 )BAZEL";
 }
 
@@ -325,58 +1991,292 @@ BuildGenerator::BuildGenerator(const std::filesystem::path& path,
     parseSubmodules();
 }
 
-void BuildGenerator::generateRegularBuildFile(std::ofstream& build_file, const std::string& module_name, const std::filesystem::path& output_path) {
-    // Write filegroup for the source file
-    build_file << "filegroup(\n";
-    build_file << "    name = \"" << module_name << "_sv\",\n";
-    build_file << "    srcs = [\"" << sv_file_path.filename().string() << "\"],\n";
-    build_file << "    visibility = [\"//visibility:public\"],\n";
-    build_file << ")\n\n";
+BuildGenerator::BuildGenerator(const std::filesystem::path& path, const SvScanResult& scan,
+                             const std::optional<std::filesystem::path>& test_path)
+    : sv_file_path(path), submodules(scan.instantiatedModules()), modules(scan.modules), includes(scan.includes),
+      test_file_path(test_path) {
+    if (test_file_path && !std::filesystem::exists(*test_file_path)) {
+        throw std::runtime_error("Test file does not exist: " + test_file_path->string());
+    }
+}
 
-    // Generate Verilator HDL library target
-    build_file << "verilator_hdl_library(\n";
-    build_file << "    name = \"" << module_name << "_verilated\",\n";
-    build_file << "    src = \"" << sv_file_path.filename().string() << "\",\n";
-    build_file << ")\n";
+std::vector<std::string> BuildGenerator::dependencyLabels(const std::vector<std::string>& names, const std::string& self) const {
+    std::vector<std::string> labels;
+    if (!module_index) {
+        return labels;
+    }
+    for (const auto& name : names) {
+        if (name == self) {
+            continue;
+        }
+        std::string label = module_index->label(name, sv_file_path.parent_path());
+        if (!label.empty() && std::find(labels.begin(), labels.end(), label) == labels.end()) {
+            labels.push_back(label);
+        }
+    }
+    return labels;
 }
 
-void BuildGenerator::generateTestBuildFile(std::ofstream& build_file, const std::string& module_name, const std::filesystem::path& output_path) {
+namespace {
+    // `text` as a Starlark string literal
+    std::string quoted(const std::string& text) {
+        std::string result = "\"";
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+            }
+            result += c;
+        }
+        return result + "\"";
+    }
+
+    void writeList(std::ostream& build_file, const char* attribute, const std::vector<std::string>& values) {
+        if (values.empty()) {
+            return;
+        }
+        build_file << "    " << attribute << " = [\n";
+        for (const auto& value : values) {
+            build_file << "        " << quoted(value) << ",\n";
+        }
+        build_file << "    ],\n";
+    }
+
+    void writeDeps(std::ostream& build_file, const std::vector<std::string>& labels) {
+        writeList(build_file, "deps", labels);
+    }
+
+    // Path of `path` below `root`, or empty if it is outside
+    std::string relativeTo(const std::filesystem::path& path, const std::filesystem::path& root) {
+        std::string relative = path.lexically_relative(root).generic_string();
+        if (relative.empty() || relative.rfind("..", 0) == 0) {
+            return "";
+        }
+        return relative;
+    }
+
+    // Marks the BUILD files generateHeaderBuildFile() writes
+    constexpr std::string_view kHeaderBuildMarker = "# Generated by vpm: headers `included by verilated sources\n";
+}
+
+void BuildGenerator::writePreprocessing(std::ostream& build_file) const {
+    // Each directory of included files is a package exporting them (see
+    // generateHeaderBuildFile); headers outside the workspace are only
+    // reachable through the absolute include directories
+    std::vector<std::string> headers;
+    std::filesystem::path package_dir = sv_file_path.parent_path();
+    for (const auto& include : includes) {
+        std::filesystem::path header(include);
+        if (header.parent_path() == package_dir) {
+            headers.push_back(header.filename().string());
+        } else if (module_index) {
+            std::string package = relativeTo(header.parent_path(), module_index->getRoot());
+            if (!package.empty() || header.parent_path() == module_index->getRoot()) {
+                headers.push_back("//" + (package == "." ? "" : package) + ":" + header.filename().string());
+            }
+        }
+    }
+    writeList(build_file, "hdrs", headers);
+    if (!preprocessor) {
+        return;
+    }
+
+    std::vector<std::string> defines;
+    for (const auto& [name, value] : preprocessor->defines) {
+        defines.push_back(value.empty() ? name : name + "=" + value);
+    }
+    writeList(build_file, "defines", defines);
+
+    // Relative to the workspace root, which is where Verilator runs
+    std::vector<std::string> include_dirs;
+    for (const auto& dir : preprocessor->include_dirs) {
+        std::string relative = module_index ? relativeTo(dir, module_index->getRoot()) : "";
+        include_dirs.push_back(relative.empty() ? dir.string() : relative);
+    }
+    writeList(build_file, "includes", include_dirs);
+}
+
+void BuildGenerator::generateRegularBuildFile(std::ostream& build_file, const std::string& module_name) const {
     // Write filegroup for the source file
     build_file << "filegroup(\n";
     build_file << "    name = \"" << module_name << "_sv\",\n";
     build_file << "    srcs = [\"" << sv_file_path.filename().string() << "\"],\n";
     build_file << "    visibility = [\"//visibility:public\"],\n";
-    build_file << ")\n\n";
+    build_file << ")\n";
+
+    // Generate a Verilator HDL library target per declared module, depending on
+    // the targets of the modules it instantiates. A module declared twice in
+    // one package would give two targets of the same name, so only the
+    // declaration the index resolves to gets one.
+    std::set<std::string> emitted;
+    for (const auto& module : modules) {
+        const ModuleEntry* declaration = module_index ? module_index->find(module.name) : nullptr;
+        if (!emitted.insert(module.name).second ||
+            (declaration && declaration->file != sv_file_path &&
+             declaration->file.parent_path() == sv_file_path.parent_path())) {
+            continue;
+        }
+
+        std::vector<std::string> instantiated;
+        for (const auto& instance : module.instances) {
+            instantiated.push_back(instance.module_name);
+        }
+
+        build_file << "\n";
+        build_file << "verilator_hdl_library(\n";
+        build_file << "    name = \"" << module.name << "_verilated\",\n";
+        build_file << "    src = \"" << sv_file_path.filename().string() << "\",\n";
+        if (module.name != module_name) {
+            build_file << "    top_module = \"" << module.name << "\",\n";
+        }
+        if (hier_blocks && hier_blocks->count(module.name) != 0) {
+            build_file << "    hier_block = True,\n";
+        }
+        writePreprocessing(build_file);
+        writeDeps(build_file, dependencyLabels(instantiated, module.name));
+        build_file << "    visibility = [\"//visibility:public\"],\n";
+        build_file << ")\n";
+    }
+}
+
+void BuildGenerator::generateTestBuildFile(std::ostream& build_file, const std::string& module_name) const {
+    // Submodules declared in this file are already part of src
+    std::vector<std::string> external;
+    for (const auto& submodule : submodules) {
+        bool local = std::any_of(modules.begin(), modules.end(),
+                                 [&](const SvModuleDecl& decl) { return decl.name == submodule; });
+        if (!local) {
+            external.push_back(submodule);
+        }
+    }
 
     // Generate Verilator test target
-    build_file << "verilator_hdl_test(\n";
-    build_file << "    name = \"" << module_name << "_test\",\n";
+    build_file << "\n";
+    build_file << (isSweep() ? "verilator_hdl_sweep(\n" : "verilator_hdl_test(\n");
+    build_file << "    name = \"" << getTargetNames().front() << "\",\n";
     build_file << "    src = \"" << sv_file_path.filename().string() << "\",\n";
     build_file << "    testbench = \"" << test_file_path->filename().string() << "\",\n";
+    if (auto warm_up = warmUpFile()) {
+        build_file << "    warm_up = \"" << warm_up->filename().string() << "\",\n";
+    }
+    writePreprocessing(build_file);
+    writeDeps(build_file, dependencyLabels(external, module_name));
     build_file << ")\n";
 }
 
-void BuildGenerator::generateBuildFile(const std::string& output_path) {
-    std::ofstream build_file(output_path);
-    if (!build_file.is_open()) {
-        throw std::runtime_error("Failed to create BUILD file: " + output_path);
+void BuildGenerator::generateTargets(std::ostream& build_file) const {
+    // Get the module name from the file name
+    std::string module_name = sv_file_path.stem().string();
+
+    // Tested modules keep their library targets, as other targets in the
+    // same build may instantiate them
+    generateRegularBuildFile(build_file, module_name);
+    if (test_file_path) {
+        generateTestBuildFile(build_file, module_name);
+    }
+}
+
+bool BuildGenerator::isSweep() const {
+    static const std::string suffix = "_sweep";
+    if (!test_file_path) {
+        return false;
+    }
+    std::string stem = test_file_path->stem().string();
+    return stem.size() > suffix.size() && stem.compare(stem.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::optional<std::filesystem::path> BuildGenerator::warmUpFile() const {
+    if (!test_file_path || isSweep()) {
+        return std::nullopt;
     }
+    std::filesystem::path warm_up =
+        test_file_path->parent_path() / (sv_file_path.stem().string() + "_warmup.cpp");
+    if (!std::filesystem::exists(warm_up)) {
+        return std::nullopt;
+    }
+    return warm_up;
+}
+
+std::vector<std::string> BuildGenerator::getTargetNames() const {
+    if (test_file_path) {
+        return {sv_file_path.stem().string() + (isSweep() ? "_sweep" : "_test")};
+    }
+    std::vector<std::string> names;
+    for (const auto& module : modules) {
+        names.push_back(module.name + "_verilated");
+    }
+    return names;
+}
+
+bool BuildGenerator::generateBuildFile(const std::string& output_path) {
+    return generatePackageBuildFile(output_path, {this});
+}
+
+bool BuildGenerator::generatePackageBuildFile(const std::string& output_path,
+                                              const std::vector<const BuildGenerator*>& generators,
+                                              const std::set<std::string>& exported_files) {
+    std::ostringstream build_file;
+
+    bool has_tests = std::any_of(generators.begin(), generators.end(),
+                                 [](const BuildGenerator* generator) { return generator->isTest(); });
 
     // Write Bazel build file header with required rules
     build_file << "load(\"@rules_cc//cc:defs.bzl\", \"cc_library\", \"cc_test\")\n";
-    
-    if (test_file_path) {
-        build_file << "load(\"//tools/verilator:defs_test.bzl\", \"verilator_hdl_test\")\n\n";
-    } else {
-        build_file << "load(\"//tools/verilator:defs.bzl\", \"verilator_hdl_library\")\n\n";
+    build_file << "load(\"//tools/verilator:defs.bzl\", \"verilator_hdl_library\")\n";
+    if (has_tests) {
+        build_file << "load(\"//tools/verilator:defs_test.bzl\", \"verilator_hdl_sweep\", \"verilator_hdl_test\")\n";
     }
-    
-    // Get the module name from the file name
-    std::string module_name = sv_file_path.stem().string();
-    
-    if (test_file_path) {
-        generateTestBuildFile(build_file, module_name, output_path);
-    } else {
-        generateRegularBuildFile(build_file, module_name, output_path);
+    if (!exported_files.empty()) {
+        build_file << "\nexports_files([\n";
+        for (const auto& file : exported_files) {
+            build_file << "    " << quoted(file) << ",\n";
+        }
+        build_file << "])\n";
+    }
+
+    for (const BuildGenerator* generator : generators) {
+        build_file << "\n";
+        generator->generateTargets(build_file);
+    }
+
+    return writeIfChanged(output_path, build_file.str());
+}
+
+bool BuildGenerator::generateHeaderBuildFile(const std::string& output_path, const std::set<std::string>& headers) {
+    std::error_code ec;
+    if (std::filesystem::exists(output_path, ec) ||
+        std::filesystem::exists(std::filesystem::path(output_path).parent_path() / "BUILD.bazel", ec)) {
+        std::ifstream existing(output_path, std::ios::binary);
+        std::string first(kHeaderBuildMarker.size(), '\0');
+        if (!existing.read(first.data(), static_cast<std::streamsize>(first.size())) || first != kHeaderBuildMarker) {
+            return false;
+        }
+    }
+
+    std::ostringstream build_file;
+    build_file << kHeaderBuildMarker << "exports_files([\n";
+    for (const auto& header : headers) {
+        build_file << "    " << quoted(header) << ",\n";
+    }
+    build_file << "])\n";
+    return writeIfChanged(output_path, build_file.str());
+}
+
+bool BuildGenerator::writeIfChanged(const std::string& output_path, const std::string& content) {
+    // Rewriting identical bytes would still bump the mtime and make Bazel
+    // re-analyze the package
+    std::error_code ec;
+    if (std::filesystem::file_size(output_path, ec) == content.size() && !ec) {
+        std::ifstream existing(output_path, std::ios::binary);
+        std::string current(content.size(), '\0');
+        if (existing.read(current.data(), static_cast<std::streamsize>(current.size())) && current == content) {
+            return false;
+        }
+    }
+
+    std::ofstream file(output_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to create BUILD file: " + output_path);
     }
+    file << content;
+    return true;
 }
@@ -3,36 +3,106 @@
 #include <string>
 #include <vector>
 #include <fstream>
-#include <regex>
+#include <ostream>
 #include <filesystem>
 #include <optional>
+#include <set>
 #include <stdexcept>
+#include "SvScanner.hpp"
+
+class ModuleIndex;
+struct SvPreprocessorOptions;
 
 class BuildGenerator {
 private:
     std::filesystem::path sv_file_path;
     std::vector<std::string> submodules;
+    std::vector<SvModuleDecl> modules;
+    // Absolute paths of the files the source `includes
+    std::vector<std::string> includes;
     std::optional<std::filesystem::path> test_file_path;
-    
-    // Extracts submodule names from SystemVerilog file
+    const ModuleIndex* module_index = nullptr;
+    const std::set<std::string>* hier_blocks = nullptr;
+    const SvPreprocessorOptions* preprocessor = nullptr;
+
+    // Extracts declared modules and submodule names from SystemVerilog file
     void parseSubmodules();
-    
+
+    // Bazel labels of the library targets for the given modules, skipping
+    // `self` and any module the index cannot resolve
+    std::vector<std::string> dependencyLabels(const std::vector<std::string>& names, const std::string& self) const;
+
+    // Writes the hdrs, defines and includes attributes, so Verilator sees
+    // the headers and macros the scan did
+    void writePreprocessing(std::ostream& build_file) const;
+
     // Generate a regular BUILD file for the SystemVerilog module
-    void generateRegularBuildFile(std::ofstream& build_file, const std::string& module_name, const std::filesystem::path& output_path);
-    
-    // Generate a BUILD file for testing with Verilator testbench
-    void generateTestBuildFile(std::ofstream& build_file, const std::string& module_name, const std::filesystem::path& output_path);
+    void generateRegularBuildFile(std::ostream& build_file, const std::string& module_name) const;
+
+    // Generate the test target for the Verilator testbench, after the library targets
+    void generateTestBuildFile(std::ostream& build_file, const std::string& module_name) const;
+
+    // Write the targets for this file, without the load() header
+    void generateTargets(std::ostream& build_file) const;
 
 public:
     // Initialize workspace with necessary Bazel dependencies
     static void initWorkspace(const std::string& workspace_path);
 
-    explicit BuildGenerator(const std::filesystem::path& path, 
+    explicit BuildGenerator(const std::filesystem::path& path,
                           const std::optional<std::filesystem::path>& test_path = std::nullopt);
 
-    // Generate appropriate Bazel BUILD file based on whether it's a test or not
-    void generateBuildFile(const std::string& output_path);
+    // Construct from an existing scan of the file instead of re-reading it
+    BuildGenerator(const std::filesystem::path& path, const SvScanResult& scan,
+                   const std::optional<std::filesystem::path>& test_path = std::nullopt);
+
+    // Resolve submodule dependencies against a workspace module index. Without
+    // an index, generated targets carry no deps.
+    void setModuleIndex(const ModuleIndex* index) { module_index = index; }
+
+    // Modules whose library targets are verilated as hierarchical blocks;
+    // none without a set
+    void setHierarchicalBlocks(const std::set<std::string>* blocks) { hier_blocks = blocks; }
+
+    // +define+ and +incdir+ settings the sources were scanned with, passed
+    // on to Verilator; none without settings
+    void setPreprocessorOptions(const SvPreprocessorOptions* options) { preprocessor = options; }
+
+    // Generate appropriate Bazel BUILD file based on whether it's a test or not.
+    // Returns false if the file already had exactly this content and was left untouched.
+    bool generateBuildFile(const std::string& output_path);
+
+    // Generate one BUILD file holding the targets of several files in the same
+    // package, exporting `exported_files` of it to targets in other packages
+    static bool generatePackageBuildFile(const std::string& output_path,
+                                         const std::vector<const BuildGenerator*>& generators,
+                                         const std::set<std::string>& exported_files = {});
+
+    // Writes a BUILD file that only exports `headers`, for a directory of
+    // included files without sources. A BUILD file vpm did not write is left
+    // alone. Returns true if written.
+    static bool generateHeaderBuildFile(const std::string& output_path, const std::set<std::string>& headers);
+
+    // Write `content` to `output_path` only if the bytes differ. Returns true if written.
+    static bool writeIfChanged(const std::string& output_path, const std::string& content);
 
     // Get list of parsed submodules
     const std::vector<std::string>& getSubmodules() const { return submodules; }
+
+    // Get the modules declared in the file
+    const std::vector<SvModuleDecl>& getModules() const { return modules; }
+
+    // Absolute paths of the files the source `includes
+    const std::vector<std::string>& getIncludes() const { return includes; }
+
+    // Get names of the Bazel targets this file produces (without package)
+    std::vector<std::string> getTargetNames() const;
+
+    const std::filesystem::path& getPath() const { return sv_file_path; }
+    bool isTest() const { return test_file_path.has_value(); }
+    // Testbenches named <module>_sweep.cpp run as multi-instance sweeps
+    bool isSweep() const;
+    // Warm-up code checkpointed by the test, <module>_warmup.cpp beside
+    // the testbench; none for sweeps
+    std::optional<std::filesystem::path> warmUpFile() const;
 };
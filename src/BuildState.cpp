@@ -0,0 +1,136 @@
+#include "BuildState.hpp"
+#include "ScanCache.hpp"
+#include "SvLexer.hpp"
+#include <fstream>
+#include <sstream>
+#include <charconv>
+
+namespace {
+    // Bump whenever the file format changes
+    constexpr std::string_view kStateHeader = "vpm-build-state 1";
+
+    std::string_view nextField(std::string_view& line) {
+        size_t space = line.find(' ');
+        std::string_view field = line.substr(0, space);
+        line = space == std::string_view::npos ? std::string_view() : line.substr(space + 1);
+        return field;
+    }
+
+    template <typename T>
+    bool parseNumber(std::string_view field, T& value) {
+        auto [ptr, ec] = std::from_chars(field.data(), field.data() + field.size(), value);
+        return ec == std::errc() && ptr == field.data() + field.size();
+    }
+}
+
+BuildState::BuildState(const std::filesystem::path& state_path, const std::string& key)
+    : state_file(state_path) {
+    std::ostringstream out;
+    out << kStateHeader << " " << std::hex << ScanCache::hashContent(key);
+    header = out.str();
+}
+
+std::filesystem::path BuildState::defaultPath(const std::filesystem::path& workspace_root) {
+    return workspace_root / ".vpm" / "build-state";
+}
+
+bool BuildState::load() {
+    FileStamp state_stamp = FileStamp::of(state_file);
+    if (!state_stamp.exists() || state_stamp.size == 0) {
+        return false;
+    }
+
+    MappedFile mapped(state_file);
+    std::string_view data = mapped.view();
+    auto nextLine = [&data]() {
+        size_t newline = data.find('\n');
+        std::string_view line = data.substr(0, newline);
+        data = newline == std::string_view::npos ? std::string_view() : data.substr(newline + 1);
+        return line;
+    };
+    if (nextLine() != header) {
+        return false;
+    }
+
+    // Only kept once the whole state checked out
+    std::vector<std::string> loaded_tops;
+    std::vector<std::string> loaded_targets;
+    std::vector<std::string> loaded_warnings;
+    size_t loaded_files = 0;
+    size_t loaded_packages = 0;
+    std::string path;
+    bool complete = false;
+    while (!data.empty()) {
+        std::string_view line = nextLine();
+        std::string_view tag = nextField(line);
+
+        if (tag == "S") {
+            FileStamp recorded;
+            if (!parseNumber(nextField(line), recorded.mtime_ns) || !parseNumber(nextField(line), recorded.size) ||
+                line.empty()) {
+                return false;
+            }
+            path.assign(line);
+            FileStamp current = FileStamp::of(path.c_str());
+            if (current != recorded || !current.exists() || current.mtime_ns >= state_stamp.mtime_ns) {
+                return false;
+            }
+        } else if (tag == "T") {
+            loaded_tops.emplace_back(line);
+        } else if (tag == "L") {
+            loaded_targets.emplace_back(line);
+        } else if (tag == "W") {
+            loaded_warnings.emplace_back(line);
+        } else if (tag == "N") {
+            // Written last, so a truncated state is never trusted
+            complete = parseNumber(nextField(line), loaded_files) && parseNumber(nextField(line), loaded_packages);
+        } else if (!tag.empty()) {
+            return false;
+        }
+    }
+    if (!complete) {
+        return false;
+    }
+    tops = std::move(loaded_tops);
+    targets = std::move(loaded_targets);
+    warnings = std::move(loaded_warnings);
+    file_count = loaded_files;
+    package_count = loaded_packages;
+    return true;
+}
+
+void BuildState::addStamp(const std::filesystem::path& path, FileStamp stamp) {
+    stamps.emplace_back(path, stamp);
+}
+
+void BuildState::addStamps(const StampedPaths& stamped) {
+    stamps.insert(stamps.end(), stamped.begin(), stamped.end());
+}
+
+void BuildState::save() const {
+    std::filesystem::create_directories(state_file.parent_path());
+    std::filesystem::path temp_file = state_file;
+    temp_file += ".tmp";
+    {
+        std::ofstream file(temp_file, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to write build state: " + temp_file.string());
+        }
+
+        file << header << "\n";
+        for (const auto& [path, stamp] : stamps) {
+            file << "S " << stamp.mtime_ns << " " << stamp.size << " " << path.string() << "\n";
+        }
+        for (const auto& top : tops) {
+            file << "T " << top << "\n";
+        }
+        for (const auto& target : targets) {
+            file << "L " << target << "\n";
+        }
+        for (const auto& warning : warnings) {
+            file << "W " << warning << "\n";
+        }
+        file << "N " << file_count << " " << package_count << "\n";
+    }
+    std::filesystem::rename(temp_file, state_file);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <cstdint>
+#include "FileStamp.hpp"
+
+// What a plain `vpm --build` produced, with the stamps of everything it
+// depended on: the directories it walked, the sources and includes it
+// scanned, and the BUILD files it wrote. As long as none of those changed, a
+// repeated build reuses the recorded Bazel targets instead of walking,
+// scanning and regenerating the tree. The key covers everything else the
+// result depends on, such as the inputs and the preprocessor options.
+class BuildState {
+private:
+    std::filesystem::path state_file;
+    std::string header;
+    StampedPaths stamps;
+
+public:
+    std::vector<std::string> tops;
+    std::vector<std::string> targets;
+    // Warnings the recorded build printed, repeated when it is reused
+    std::vector<std::string> warnings;
+    size_t file_count = 0;
+    size_t package_count = 0;
+
+    BuildState(const std::filesystem::path& state_path, const std::string& key);
+
+    // Default state location inside a workspace
+    static std::filesystem::path defaultPath(const std::filesystem::path& workspace_root);
+
+    // Loads the recorded state. True only if it was recorded under the same
+    // key and every stamped path is unchanged; a path modified in the same
+    // timestamp tick the state was saved in does not count as unchanged.
+    bool load();
+
+    void addStamp(const std::filesystem::path& path, FileStamp stamp);
+    void addStamps(const StampedPaths& stamped);
+
+    // Writes the state atomically
+    void save() const;
+};
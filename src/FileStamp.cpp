@@ -0,0 +1,20 @@
+#include "FileStamp.hpp"
+
+extern "C" {
+    #include <sys/stat.h>
+}
+
+FileStamp FileStamp::of(const char* path) {
+    FileStamp stamp;
+    struct stat st;
+    if (::stat(path, &st) != 0) {
+        return stamp;
+    }
+#ifdef __APPLE__
+    stamp.mtime_ns = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    stamp.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    stamp.size = static_cast<uint64_t>(st.st_size);
+    return stamp;
+}
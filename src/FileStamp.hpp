@@ -0,0 +1,23 @@
+#pragma once
+
+#include <filesystem>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// mtime and size of a file or directory, which the caches compare to tell
+// whether it changed without reading it
+struct FileStamp {
+    // -1 if the path does not exist
+    int64_t mtime_ns = -1;
+    uint64_t size = 0;
+
+    static FileStamp of(const char* path);
+    static FileStamp of(const std::filesystem::path& path) { return of(path.c_str()); }
+
+    bool exists() const { return mtime_ns >= 0; }
+    bool operator==(const FileStamp& other) const { return mtime_ns == other.mtime_ns && size == other.size; }
+    bool operator!=(const FileStamp& other) const { return !(*this == other); }
+};
+
+using StampedPaths = std::vector<std::pair<std::filesystem::path, FileStamp>>;
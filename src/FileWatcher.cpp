@@ -0,0 +1,174 @@
+#include "FileWatcher.hpp"
+#include "ModuleIndex.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+extern "C" {
+    #include <sys/inotify.h>
+    #include <poll.h>
+    #include <unistd.h>
+}
+#endif
+
+namespace {
+    bool isSourceFile(const std::filesystem::path& path) {
+        std::string extension = path.extension().string();
+        return extension == ".sv" || extension == ".v" || extension == ".svh" || extension == ".vh";
+    }
+
+    bool isIgnoredDirectory(const std::string& name) {
+        return name.rfind(".", 0) == 0 || name.rfind("bazel-", 0) == 0 || name.rfind("build_", 0) == 0;
+    }
+}
+
+#ifdef __linux__
+
+FileWatcher::FileWatcher(const std::filesystem::path& watch_root)
+    : root(std::filesystem::absolute(watch_root)) {
+    inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        throw std::runtime_error("Failed to initialize inotify");
+    }
+    addWatches(root);
+}
+
+FileWatcher::~FileWatcher() {
+    if (inotify_fd >= 0) {
+        ::close(inotify_fd);
+    }
+}
+
+void FileWatcher::addWatches(const std::filesystem::path& dir) {
+    constexpr uint32_t mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                              IN_DELETE_SELF | IN_ONLYDIR;
+
+    int wd = ::inotify_add_watch(inotify_fd, dir.c_str(), mask);
+    if (wd >= 0) {
+        watch_dirs[wd] = dir;
+    }
+
+    std::error_code ec;
+    for (auto it = std::filesystem::directory_iterator(dir, ec); !ec && it != std::filesystem::directory_iterator();
+         it.increment(ec)) {
+        if (it->is_directory(ec) && !it->is_symlink(ec) && !isIgnoredDirectory(it->path().filename().string())) {
+            addWatches(it->path());
+        }
+    }
+}
+
+bool FileWatcher::readEvents(int timeout_ms, std::vector<std::filesystem::path>& changed) {
+    struct pollfd pfd = {inotify_fd, POLLIN, 0};
+    if (::poll(&pfd, 1, timeout_ms) <= 0) {
+        return false;
+    }
+
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    while (true) {
+        ssize_t length = ::read(inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+
+        for (char* p = buffer; p < buffer + length;) {
+            auto* event = reinterpret_cast<struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_IGNORED) {
+                watch_dirs.erase(event->wd);
+                continue;
+            }
+            auto dir = watch_dirs.find(event->wd);
+            if (dir == watch_dirs.end() || event->len == 0) {
+                continue;
+            }
+
+            std::filesystem::path path = dir->second / event->name;
+            if (event->mask & IN_ISDIR) {
+                if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && !isIgnoredDirectory(event->name)) {
+                    // New directory (possibly a whole moved-in subtree): watch it
+                    // and report the sources it already contains
+                    addWatches(path);
+                    for (const auto& file : ModuleIndex::listSourceFiles(path)) {
+                        changed.push_back(file);
+                    }
+                }
+                continue;
+            }
+            if (isSourceFile(path)) {
+                changed.push_back(path);
+            }
+        }
+    }
+    return true;
+}
+
+std::vector<std::filesystem::path> FileWatcher::waitForChanges(std::chrono::milliseconds timeout,
+                                                               std::chrono::milliseconds settle) {
+    std::vector<std::filesystem::path> changed;
+    if (!readEvents(static_cast<int>(timeout.count()), changed)) {
+        return changed;
+    }
+    while (readEvents(static_cast<int>(settle.count()), changed)) {
+    }
+
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    return changed;
+}
+
+#else
+
+FileWatcher::FileWatcher(const std::filesystem::path& watch_root)
+    : root(std::filesystem::absolute(watch_root)) {
+    std::vector<std::filesystem::path> ignored;
+    pollChanges(ignored);
+}
+
+FileWatcher::~FileWatcher() = default;
+
+void FileWatcher::pollChanges(std::vector<std::filesystem::path>& changed) {
+    std::unordered_map<std::string, int64_t> current;
+    for (const auto& file : ModuleIndex::listSourceFiles(root)) {
+        std::error_code ec;
+        auto mtime = std::filesystem::last_write_time(file, ec);
+        if (ec) {
+            continue;
+        }
+        int64_t stamp = static_cast<int64_t>(mtime.time_since_epoch().count());
+        auto it = mtimes.find(file.string());
+        if (it == mtimes.end() || it->second != stamp) {
+            changed.push_back(file);
+        }
+        current.emplace(file.string(), stamp);
+    }
+    for (const auto& [file, stamp] : mtimes) {
+        if (current.count(file) == 0) {
+            changed.push_back(file);
+        }
+    }
+    mtimes = std::move(current);
+}
+
+std::vector<std::filesystem::path> FileWatcher::waitForChanges(std::chrono::milliseconds timeout,
+                                                               std::chrono::milliseconds settle) {
+    constexpr auto interval = std::chrono::milliseconds(500);
+    std::vector<std::filesystem::path> changed;
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (changed.empty() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::min<std::chrono::milliseconds>(interval, timeout));
+        pollChanges(changed);
+    }
+    if (!changed.empty()) {
+        std::this_thread::sleep_for(settle);
+        pollChanges(changed);
+    }
+
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    return changed;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include <chrono>
+#include <cstdint>
+
+// Watches a source tree for created, modified and deleted .sv/.v files and
+// .svh/.vh headers.
+// Uses inotify on Linux (one watch per directory, extended as directories
+// appear) and falls back to mtime polling elsewhere.
+class FileWatcher {
+private:
+    std::filesystem::path root;
+#ifdef __linux__
+    int inotify_fd = -1;
+    std::unordered_map<int, std::filesystem::path> watch_dirs;
+
+    // Adds watches for `dir` and every non-hidden directory below it
+    void addWatches(const std::filesystem::path& dir);
+
+    // Reads pending events, appending changed source files. Returns false if
+    // no event arrived within the timeout.
+    bool readEvents(int timeout_ms, std::vector<std::filesystem::path>& changed);
+#else
+    std::unordered_map<std::string, int64_t> mtimes;
+
+    // Stats every source file, appending those whose mtime changed or that appeared/disappeared
+    void pollChanges(std::vector<std::filesystem::path>& changed);
+#endif
+
+public:
+    explicit FileWatcher(const std::filesystem::path& watch_root);
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Waits up to `timeout` for a change, then keeps collecting until the tree
+    // has been quiet for `settle`, so an editor's save or a checkout arrives as
+    // one batch. Returns the unique changed paths; empty on timeout.
+    std::vector<std::filesystem::path> waitForChanges(std::chrono::milliseconds timeout,
+                                                      std::chrono::milliseconds settle = std::chrono::milliseconds(150));
+};
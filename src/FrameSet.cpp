@@ -0,0 +1,229 @@
+#include "FrameSet.hpp"
+#include "SvLexer.hpp"
+#include <fstream>
+#include <charconv>
+#include <ctime>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+    // Configuration packet words (UG470, chapter 5)
+    constexpr uint32_t kSync = 0xAA995566;
+    constexpr uint32_t kNoop = 0x20000000;
+    constexpr uint32_t kRegFar = 0x01;
+    constexpr uint32_t kRegFdri = 0x02;
+    constexpr uint32_t kRegCmd = 0x04;
+    constexpr uint32_t kRegIdcode = 0x0C;
+    constexpr uint32_t kCmdWcfg = 0x1;
+    constexpr uint32_t kCmdRcrc = 0x7;
+    constexpr uint32_t kCmdDesync = 0xD;
+
+    uint32_t type1Write(uint32_t reg, uint32_t words) {
+        return 0x30000000 | (reg << 13) | words;
+    }
+
+    uint32_t type2Write(uint32_t words) {
+        return 0x50000000 | words;
+    }
+
+    // Reads "0x<hex>" at the start of `text`, advancing past it
+    bool readHex(std::string_view& text, uint32_t& value) {
+        size_t start = text.find_first_not_of(" \t");
+        if (start == std::string_view::npos || text.compare(start, 2, "0x") != 0) {
+            return false;
+        }
+        text.remove_prefix(start + 2);
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value, 16);
+        if (ec != std::errc() || ptr == text.data()) {
+            return false;
+        }
+        text.remove_prefix(static_cast<size_t>(ptr - text.data()));
+        return true;
+    }
+
+    void putWord(std::string& out, uint32_t word) {
+        out.push_back(static_cast<char>(word >> 24));
+        out.push_back(static_cast<char>(word >> 16));
+        out.push_back(static_cast<char>(word >> 8));
+        out.push_back(static_cast<char>(word));
+    }
+
+    // A .bit header field: key, 16-bit length, NUL-terminated value
+    void putField(std::string& out, char key, const std::string& value) {
+        size_t length = value.size() + 1;
+        out.push_back(key);
+        out.push_back(static_cast<char>(length >> 8));
+        out.push_back(static_cast<char>(length));
+        out.append(value).push_back('\0');
+    }
+}
+
+FrameSet FrameSet::parse(std::string_view text) {
+    FrameSet result;
+    size_t line_number = 0;
+    while (!text.empty()) {
+        size_t newline = text.find('\n');
+        std::string_view line = text.substr(0, newline);
+        text = newline == std::string_view::npos ? std::string_view() : text.substr(newline + 1);
+        ++line_number;
+        if (line.find_first_not_of(" \t\r") == std::string_view::npos || line[0] == '#') {
+            continue;
+        }
+
+        auto malformed = [&]() {
+            return std::runtime_error("Malformed frame on line " + std::to_string(line_number));
+        };
+        uint32_t address = 0;
+        if (!readHex(line, address)) {
+            throw malformed();
+        }
+        std::vector<uint32_t> words;
+        words.reserve(kFrameWords);
+        uint32_t word = 0;
+        while (readHex(line, word)) {
+            words.push_back(word);
+            size_t comma = line.find_first_not_of(" \t\r");
+            if (comma == std::string_view::npos) {
+                break;
+            }
+            if (line[comma] != ',') {
+                throw malformed();
+            }
+            line.remove_prefix(comma + 1);
+        }
+        if (words.empty() || words.size() > kFrameWords) {
+            throw malformed();
+        }
+        words.resize(kFrameWords, 0);
+        result.frames[address] = std::move(words);
+    }
+    return result;
+}
+
+FrameSet FrameSet::read(const std::filesystem::path& path) {
+    MappedFile mapped(path);
+    try {
+        return parse(mapped.view());
+    } catch (const std::exception& e) {
+        throw std::runtime_error(path.string() + ": " + e.what());
+    }
+}
+
+void FrameSet::write(const std::filesystem::path& path) const {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Failed to write frames: " + path.string());
+    }
+    char hex[16];
+    for (const auto& [address, words] : frames) {
+        std::snprintf(hex, sizeof(hex), "0x%08x", address);
+        out << hex;
+        for (size_t i = 0; i < words.size(); ++i) {
+            std::snprintf(hex, sizeof(hex), "0x%08x", words[i]);
+            out << (i == 0 ? " " : ",") << hex;
+        }
+        out << "\n";
+    }
+    if (!out) {
+        throw std::runtime_error("Failed to write frames: " + path.string());
+    }
+}
+
+FrameSet FrameSet::diff(const FrameSet& before, const FrameSet& after) {
+    FrameSet result;
+    auto old_it = before.frames.begin();
+    auto new_it = after.frames.begin();
+    // Both maps are ordered by address, so one merge pass finds all changes
+    while (old_it != before.frames.end() || new_it != after.frames.end()) {
+        if (new_it == after.frames.end() || (old_it != before.frames.end() && old_it->first < new_it->first)) {
+            result.frames[old_it->first] = std::vector<uint32_t>(kFrameWords, 0);
+            ++old_it;
+        } else if (old_it == before.frames.end() || new_it->first < old_it->first) {
+            result.frames.insert(*new_it);
+            ++new_it;
+        } else {
+            if (old_it->second != new_it->second) {
+                result.frames.insert(*new_it);
+            }
+            ++old_it;
+            ++new_it;
+        }
+    }
+    return result;
+}
+
+void FrameSet::writePartialBitstream(const std::filesystem::path& path, const BitstreamTarget& target) const {
+    std::string data;
+    for (int i = 0; i < 8; ++i) {
+        putWord(data, 0xFFFFFFFF);
+    }
+    // Bus width detection, then synchronization
+    putWord(data, 0x000000BB);
+    putWord(data, 0x11220044);
+    putWord(data, 0xFFFFFFFF);
+    putWord(data, 0xFFFFFFFF);
+    putWord(data, kSync);
+    putWord(data, kNoop);
+    putWord(data, type1Write(kRegIdcode, 1));
+    putWord(data, target.idcode);
+    putWord(data, type1Write(kRegCmd, 1));
+    putWord(data, kCmdRcrc);
+    putWord(data, kNoop);
+    putWord(data, kNoop);
+
+    for (auto it = frames.begin(); it != frames.end();) {
+        auto end = std::next(it);
+        uint32_t last = it->first;
+        while (end != frames.end() && end->first == last + 1) {
+            last = end->first;
+            ++end;
+        }
+        size_t count = static_cast<size_t>(std::distance(it, end));
+
+        putWord(data, type1Write(kRegCmd, 1));
+        putWord(data, kCmdWcfg);
+        putWord(data, kNoop);
+        putWord(data, type1Write(kRegFar, 1));
+        putWord(data, it->first);
+        putWord(data, kNoop);
+        // Frame data is pipelined, so every write ends with a pad frame
+        putWord(data, type1Write(kRegFdri, 0));
+        putWord(data, type2Write(static_cast<uint32_t>((count + 1) * kFrameWords)));
+        for (; it != end; ++it) {
+            for (uint32_t word : it->second) {
+                putWord(data, word);
+            }
+        }
+        for (size_t i = 0; i < kFrameWords; ++i) {
+            putWord(data, 0);
+        }
+    }
+
+    putWord(data, type1Write(kRegCmd, 1));
+    putWord(data, kCmdDesync);
+    for (int i = 0; i < 16; ++i) {
+        putWord(data, kNoop);
+    }
+
+    std::time_t now = std::time(nullptr);
+    char date[16];
+    char time[16];
+    std::strftime(date, sizeof(date), "%Y/%m/%d", std::localtime(&now));
+    std::strftime(time, sizeof(time), "%H:%M:%S", std::localtime(&now));
+
+    static const unsigned char kPreamble[] = {0x00, 0x09, 0x0f, 0xf0, 0x0f, 0xf0, 0x0f,
+                                              0xf0, 0x0f, 0xf0, 0x00, 0x00, 0x01};
+    std::string header(reinterpret_cast<const char*>(kPreamble), sizeof(kPreamble));
+    putField(header, 'a', target.design + ";PARTIAL=TRUE");
+    putField(header, 'b', target.part);
+    putField(header, 'c', date);
+    putField(header, 'd', time);
+    header.push_back('e');
+    putWord(header, static_cast<uint32_t>(data.size()));
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << header << data;
+    if (!out) {
+        throw std::runtime_error("Failed to write bitstream: " + path.string());
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <filesystem>
+#include <cstdint>
+#include <cstddef>
+
+// Device a partial bitstream is written for
+struct BitstreamTarget {
+    // Part name as in the .bit header, e.g. "7a35tcsg324"
+    std::string part;
+    // JTAG IDCODE the bitstream is checked against
+    uint32_t idcode = 0;
+    // Design name recorded in the .bit header
+    std::string design;
+};
+
+// Configuration frames of a 7-series device, as in the .frames files
+// fasm2frames writes: one "0x<address> 0x<word>,0x<word>,..." line per
+// frame. With --sparse, frames that are all zero are left out, so a frame
+// missing here is a zero frame.
+class FrameSet {
+public:
+    // 32-bit words per frame on 7-series devices
+    static constexpr size_t kFrameWords = 101;
+
+private:
+    std::map<uint32_t, std::vector<uint32_t>> frames;
+
+public:
+    static FrameSet parse(std::string_view text);
+
+    // Throws if `path` cannot be read or is malformed
+    static FrameSet read(const std::filesystem::path& path);
+
+    void write(const std::filesystem::path& path) const;
+
+    // The frames of `after` that differ from `before`; frames `after` no
+    // longer has are included as zero frames, so they are cleared
+    static FrameSet diff(const FrameSet& before, const FrameSet& after);
+
+    const std::map<uint32_t, std::vector<uint32_t>>& getFrames() const { return frames; }
+    size_t size() const { return frames.size(); }
+    bool empty() const { return frames.empty(); }
+
+    // Writes a .bit that loads only these frames, without a device reset:
+    // one FAR and FDRI write per run of consecutive addresses. Everything
+    // else keeps its current configuration, so the device must hold the
+    // design these frames were diffed against.
+    void writePartialBitstream(const std::filesystem::path& path, const BitstreamTarget& target) const;
+};
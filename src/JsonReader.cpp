@@ -0,0 +1,293 @@
+#include "JsonReader.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+extern "C" {
+    #include <fcntl.h>
+    #include <unistd.h>
+}
+
+namespace {
+    bool isJsonSpace(char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    void appendUtf8(std::string& out, uint32_t code_point) {
+        if (code_point < 0x80) {
+            out += static_cast<char>(code_point);
+        } else if (code_point < 0x800) {
+            out += static_cast<char>(0xc0 | (code_point >> 6));
+            out += static_cast<char>(0x80 | (code_point & 0x3f));
+        } else if (code_point < 0x10000) {
+            out += static_cast<char>(0xe0 | (code_point >> 12));
+            out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code_point & 0x3f));
+        } else {
+            out += static_cast<char>(0xf0 | (code_point >> 18));
+            out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code_point & 0x3f));
+        }
+    }
+}
+
+JsonReader::JsonReader(const std::filesystem::path& file, size_t buffer_size)
+    : buffer(buffer_size), path(file.string()) {
+    fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file: " + path + " (" + std::strerror(errno) + ")");
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+JsonReader::~JsonReader() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+bool JsonReader::fill() {
+    offset += length;
+    pos = 0;
+    length = 0;
+    while (true) {
+        ssize_t count = ::read(fd, buffer.data(), buffer.size());
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            throw std::runtime_error("Failed to read file: " + path + " (" + std::strerror(errno) + ")");
+        }
+        length = static_cast<size_t>(count);
+        return length > 0;
+    }
+}
+
+char JsonReader::peek() {
+    while (true) {
+        if (pos == length && !fill()) {
+            return 0;
+        }
+        char c = buffer[pos];
+        if (!isJsonSpace(c)) {
+            return c;
+        }
+        ++pos;
+    }
+}
+
+char JsonReader::get() {
+    if (pos == length && !fill()) {
+        fail("unexpected end of file");
+    }
+    return buffer[pos++];
+}
+
+void JsonReader::fail(const std::string& message) const {
+    throw std::runtime_error("Malformed JSON in " + path + " at byte " + std::to_string(offset + pos) + ": " +
+                             message);
+}
+
+void JsonReader::readString() {
+    scratch.clear();
+    while (true) {
+        // Copy the run up to the next quote or escape in one step
+        if (pos == length && !fill()) {
+            fail("unterminated string");
+        }
+        const char* start = buffer.data() + pos;
+        const char* end = buffer.data() + length;
+        const char* stop = start;
+        while (stop < end && *stop != '"' && *stop != '\\') {
+            ++stop;
+        }
+        scratch.append(start, stop);
+        pos += static_cast<size_t>(stop - start);
+        if (stop == end) {
+            continue;
+        }
+
+        char c = get();
+        if (c == '"') {
+            return;
+        }
+        char escape = get();
+        switch (escape) {
+            case '"': scratch += '"'; break;
+            case '\\': scratch += '\\'; break;
+            case '/': scratch += '/'; break;
+            case 'b': scratch += '\b'; break;
+            case 'f': scratch += '\f'; break;
+            case 'n': scratch += '\n'; break;
+            case 'r': scratch += '\r'; break;
+            case 't': scratch += '\t'; break;
+            case 'u': {
+                uint32_t code_point = 0;
+                for (int i = 0; i < 4; ++i) {
+                    char hex = get();
+                    code_point <<= 4;
+                    if (hex >= '0' && hex <= '9') {
+                        code_point |= static_cast<uint32_t>(hex - '0');
+                    } else if (hex >= 'a' && hex <= 'f') {
+                        code_point |= static_cast<uint32_t>(hex - 'a' + 10);
+                    } else if (hex >= 'A' && hex <= 'F') {
+                        code_point |= static_cast<uint32_t>(hex - 'A' + 10);
+                    } else {
+                        fail("invalid \\u escape");
+                    }
+                }
+                appendUtf8(scratch, code_point);
+                break;
+            }
+            default:
+                fail("invalid escape");
+        }
+    }
+}
+
+void JsonReader::readNumber() {
+    scratch.clear();
+    while (true) {
+        if (pos == length && !fill()) {
+            return;
+        }
+        char c = buffer[pos];
+        if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+            scratch += c;
+            ++pos;
+        } else {
+            return;
+        }
+    }
+}
+
+void JsonReader::completeValue() {
+    after_value = true;
+    expect_key = !containers.empty() && containers.back() == '{';
+}
+
+void JsonReader::readLiteral(std::string_view literal) {
+    for (char expected : literal) {
+        if (get() != expected) {
+            fail("invalid literal");
+        }
+    }
+}
+
+JsonReader::Token JsonReader::next() {
+    char c = peek();
+
+    // Separators between values; validated just enough to catch truncation
+    if (after_value && !containers.empty()) {
+        if (c == ',') {
+            ++pos;
+            c = peek();
+        } else if (c != '}' && c != ']') {
+            fail("expected ',' or closing bracket");
+        }
+    }
+
+    if (c == 0) {
+        if (!containers.empty()) {
+            fail("unexpected end of file");
+        }
+        return Token::End;
+    }
+    if (expect_key && c != '"' && c != '}') {
+        fail("expected key");
+    }
+
+    ++pos;
+    switch (c) {
+        case '{':
+            containers.push_back('{');
+            after_value = false;
+            expect_key = true;
+            return Token::BeginObject;
+        case '[':
+            containers.push_back('[');
+            after_value = false;
+            expect_key = false;
+            return Token::BeginArray;
+        case '}':
+        case ']':
+            if (containers.empty() || containers.back() != (c == '}' ? '{' : '[')) {
+                fail("mismatched closing bracket");
+            }
+            containers.pop_back();
+            completeValue();
+            return c == '}' ? Token::EndObject : Token::EndArray;
+        case '"':
+            readString();
+            if (expect_key) {
+                if (peek() != ':') {
+                    fail("expected ':' after key");
+                }
+                ++pos;
+                after_value = false;
+                expect_key = false;
+                return Token::Key;
+            }
+            completeValue();
+            return Token::String;
+        default:
+            break;
+    }
+
+    completeValue();
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        --pos;
+        readNumber();
+        return Token::Number;
+    }
+    if (c == 't') {
+        readLiteral("rue");
+        return Token::True;
+    }
+    if (c == 'f') {
+        readLiteral("alse");
+        return Token::False;
+    }
+    if (c == 'n') {
+        readLiteral("ull");
+        return Token::Null;
+    }
+    fail(std::string("unexpected character '") + c + "'");
+}
+
+void JsonReader::expect(Token expected) {
+    if (next() != expected) {
+        fail("unexpected token");
+    }
+}
+
+void JsonReader::skipValue() {
+    int depth = 0;
+    do {
+        Token token = next();
+        if (token == Token::BeginObject || token == Token::BeginArray) {
+            ++depth;
+        } else if (token == Token::EndObject || token == Token::EndArray) {
+            --depth;
+        } else if (token == Token::End) {
+            fail("unexpected end of file");
+        }
+    } while (depth > 0);
+}
+
+void JsonReader::skipNested() {
+    int depth = 1;
+    do {
+        Token token = next();
+        if (token == Token::BeginObject || token == Token::BeginArray) {
+            ++depth;
+        } else if (token == Token::EndObject || token == Token::EndArray) {
+            --depth;
+        } else if (token == Token::End) {
+            fail("unexpected end of file");
+        }
+    } while (depth > 0);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+#include <cstddef>
+#include <cstdint>
+
+// Pull parser for JSON files of any size. The file is read through a fixed
+// buffer and strings are decoded into one reused scratch string, so memory
+// stays bounded by the buffer and the longest single string, not the file.
+//
+//     JsonReader json(path);
+//     json.expect(JsonReader::Token::BeginObject);
+//     while (json.next() == JsonReader::Token::Key) {
+//         if (json.text() == "modules") { ... } else { json.skipValue(); }
+//     }
+class JsonReader {
+public:
+    enum class Token {
+        BeginObject,
+        EndObject,
+        BeginArray,
+        EndArray,
+        Key,
+        String,
+        Number,
+        True,
+        False,
+        Null,
+        End,
+    };
+
+private:
+    int fd = -1;
+    std::vector<char> buffer;
+    size_t pos = 0;
+    size_t length = 0;
+    // Bytes consumed before the current buffer, for error positions
+    uint64_t offset = 0;
+    std::string scratch;
+    std::string path;
+    // Open containers: '{' or '['
+    std::vector<char> containers;
+    // A value just ended, so ',' or a closing bracket comes next
+    bool after_value = false;
+    // Inside an object, where the next string is a key
+    bool expect_key = false;
+
+    // Refills the buffer; false at end of file
+    bool fill();
+
+    // Next significant character without consuming it; 0 at end of file
+    char peek();
+
+    char get();
+
+    [[noreturn]] void fail(const std::string& message) const;
+
+    void readString();
+    void readNumber();
+    void readLiteral(std::string_view literal);
+
+    // Updates the separator state after a complete value
+    void completeValue();
+
+public:
+    explicit JsonReader(const std::filesystem::path& file, size_t buffer_size = 1 << 20);
+    ~JsonReader();
+
+    JsonReader(const JsonReader&) = delete;
+    JsonReader& operator=(const JsonReader&) = delete;
+
+    Token next();
+
+    // Reads the next token and throws unless it is `expected`
+    void expect(Token expected);
+
+    // Content of the last Key, String or Number token; valid until next()
+    std::string_view text() const { return scratch; }
+
+    // Skips one complete value (called after its Key, or where a value is due)
+    void skipValue();
+
+    // Skips the rest of an object or array whose Begin token was just read
+    void skipNested();
+
+    // Byte position in the file, for diagnostics
+    uint64_t position() const { return offset + pos; }
+};
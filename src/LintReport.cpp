@@ -0,0 +1,124 @@
+#include "LintReport.hpp"
+#include <algorithm>
+#include <charconv>
+
+namespace {
+    std::string_view trimLeft(std::string_view text) {
+        size_t start = text.find_first_not_of(" \t");
+        return start == std::string_view::npos ? std::string_view() : text.substr(start);
+    }
+
+    // Reads a decimal number at the start of `text`, advancing past it
+    bool readNumber(std::string_view& text, size_t& value) {
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (ec != std::errc() || ptr == text.data()) {
+            return false;
+        }
+        text.remove_prefix(static_cast<size_t>(ptr - text.data()));
+        return true;
+    }
+
+    // Boilerplate verilator repeats under every message, and notes naming
+    // the instance, which differ between the modules a file is linted under
+    bool isNoise(std::string_view line) {
+        line = trimLeft(line);
+        return line.empty() || line.rfind("... For ", 0) == 0 || line.rfind("... Use ", 0) == 0 ||
+               line.rfind(": ... note: In instance", 0) == 0;
+    }
+
+    // Parses "file:line[:column]: message"; false if `text` has no location
+    bool parseLocation(std::string_view text, LintDiagnostic& diagnostic) {
+        size_t colon = text.find(':');
+        if (colon == std::string_view::npos || colon == 0) {
+            return false;
+        }
+        std::string_view rest = text.substr(colon + 1);
+        size_t line = 0;
+        size_t column = 0;
+        if (!readNumber(rest, line)) {
+            return false;
+        }
+        if (rest.size() > 1 && rest[0] == ':' && rest[1] != ' ') {
+            rest.remove_prefix(1);
+            if (!readNumber(rest, column)) {
+                return false;
+            }
+        }
+        if (rest.rfind(": ", 0) != 0) {
+            return false;
+        }
+        diagnostic.file = std::string(text.substr(0, colon));
+        diagnostic.line = line;
+        diagnostic.column = column;
+        diagnostic.message = std::string(rest.substr(2));
+        return true;
+    }
+}
+
+std::vector<LintDiagnostic> LintReport::parse(std::string_view output) {
+    std::vector<LintDiagnostic> result;
+    bool in_message = false;
+    while (!output.empty()) {
+        size_t newline = output.find('\n');
+        std::string_view line = output.substr(0, newline);
+        output = newline == std::string_view::npos ? std::string_view() : output.substr(newline + 1);
+
+        if (line.rfind("%Error", 0) != 0 && line.rfind("%Warning", 0) != 0) {
+            if (in_message && !isNoise(line)) {
+                result.back().detail.append(line).append("\n");
+            }
+            continue;
+        }
+
+        // "%Warning-CODE: file:line:col: message" or "%Error: message"
+        size_t separator = line.find(": ");
+        if (separator == std::string_view::npos) {
+            in_message = false;
+            continue;
+        }
+        std::string_view tag = line.substr(1, separator - 1);
+        std::string_view text = line.substr(separator + 2);
+        if (text.rfind("Exiting due to", 0) == 0) {
+            in_message = false;
+            continue;
+        }
+
+        LintDiagnostic diagnostic;
+        diagnostic.error = tag.rfind("Error", 0) == 0;
+        if (size_t dash = tag.find('-'); dash != std::string_view::npos) {
+            diagnostic.code = std::string(tag.substr(dash + 1));
+        }
+        if (!parseLocation(text, diagnostic)) {
+            diagnostic.message = std::string(text);
+        }
+        result.push_back(std::move(diagnostic));
+        in_message = true;
+    }
+    return result;
+}
+
+void LintReport::addOutput(std::string_view output) {
+    for (auto& diagnostic : parse(output)) {
+        if (seen.emplace(diagnostic.file, diagnostic.line, diagnostic.column, diagnostic.code, diagnostic.message)
+                .second) {
+            diagnostics.push_back(std::move(diagnostic));
+        }
+    }
+}
+
+std::vector<LintDiagnostic> LintReport::sorted() const {
+    std::vector<LintDiagnostic> result = diagnostics;
+    std::stable_sort(result.begin(), result.end(), [](const LintDiagnostic& a, const LintDiagnostic& b) {
+        return std::tie(a.file, a.line, a.column) < std::tie(b.file, b.line, b.column);
+    });
+    return result;
+}
+
+size_t LintReport::errorCount() const {
+    return static_cast<size_t>(std::count_if(diagnostics.begin(), diagnostics.end(),
+                                             [](const LintDiagnostic& diagnostic) { return diagnostic.error; }));
+}
+
+size_t LintReport::warningCount() const {
+    return diagnostics.size() - errorCount();
+}
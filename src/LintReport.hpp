@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <set>
+#include <tuple>
+
+// One message of `verilator --lint-only`
+struct LintDiagnostic {
+    bool error = false;
+    // Warning code, e.g. WIDTHTRUNC; empty for plain errors
+    std::string code;
+    // As verilator printed it; empty for messages without a location
+    std::string file;
+    size_t line = 0;
+    size_t column = 0;
+    std::string message;
+    // Source excerpt and notes printed below the message, if any
+    std::string detail;
+};
+
+// Diagnostics of a lint pass over many modules. Each module is linted with
+// the files of everything it instantiates, so a problem in a shared file is
+// reported once per module above it; the report keeps it once.
+class LintReport {
+private:
+    std::vector<LintDiagnostic> diagnostics;
+    std::set<std::tuple<std::string, size_t, size_t, std::string, std::string>> seen;
+
+public:
+    // Splits verilator output into diagnostics
+    static std::vector<LintDiagnostic> parse(std::string_view output);
+
+    // Adds the diagnostics in `output` that were not reported before
+    void addOutput(std::string_view output);
+
+    // Diagnostics ordered by file, line and column
+    std::vector<LintDiagnostic> sorted() const;
+
+    size_t errorCount() const;
+    size_t warningCount() const;
+};
@@ -0,0 +1,133 @@
+#include "ModuleGraph.hpp"
+#include <algorithm>
+
+ModuleGraph::ModuleGraph(const ModuleIndex& index) {
+    // Ids follow file order, so results do not depend on hash order
+    for (const auto& file : index.files()) {
+        for (const auto& decl : index.findScan(file)->modules) {
+            const ModuleEntry* entry = index.find(decl.name);
+            if (entry && entry->file == file && ids.emplace(entry->name, static_cast<Id>(entries.size())).second) {
+                entries.push_back(entry);
+            }
+        }
+    }
+
+    offsets.reserve(entries.size() + 1);
+    offsets.push_back(0);
+    for (const ModuleEntry* entry : entries) {
+        for (const auto& submodule : entry->submodules) {
+            if (Id id = find(submodule); id != kNone) {
+                edges.push_back(id);
+            }
+        }
+        offsets.push_back(static_cast<uint32_t>(edges.size()));
+    }
+}
+
+ModuleGraph::Id ModuleGraph::find(std::string_view name) const {
+    auto it = ids.find(name);
+    return it == ids.end() ? kNone : it->second;
+}
+
+void ModuleGraph::mark(const std::vector<Id>& starts, bool include_starts, std::vector<char>& visited) const {
+    std::vector<Id> stack;
+    auto push = [&](Id id) {
+        if (!visited[id]) {
+            visited[id] = 1;
+            stack.push_back(id);
+        }
+    };
+    for (Id start : starts) {
+        if (include_starts) {
+            push(start);
+        } else {
+            for (uint32_t i = offsets[start]; i < offsets[start + 1]; ++i) {
+                push(edges[i]);
+            }
+        }
+    }
+    // Iterative, so deep hierarchies cannot overflow the call stack
+    while (!stack.empty()) {
+        Id id = stack.back();
+        stack.pop_back();
+        for (uint32_t i = offsets[id]; i < offsets[id + 1]; ++i) {
+            push(edges[i]);
+        }
+    }
+}
+
+std::vector<std::string> ModuleGraph::roots(const std::vector<std::string>& candidates) const {
+    std::vector<Id> starts;
+    for (const auto& candidate : candidates) {
+        if (Id id = find(candidate); id != kNone) {
+            starts.push_back(id);
+        }
+    }
+    std::vector<char> below(entries.size(), 0);
+    mark(starts, false, below);
+
+    std::vector<std::string> result;
+    for (Id id : starts) {
+        if (!below[id] && std::find(result.begin(), result.end(), name(id)) == result.end()) {
+            result.push_back(name(id));
+        }
+    }
+    return result;
+}
+
+std::vector<std::string> ModuleGraph::topsOf(const ModuleIndex& index,
+                                             const std::vector<std::filesystem::path>& files) const {
+    std::vector<std::string> declared;
+    std::vector<std::string> candidates;
+    for (const auto& file : files) {
+        if (const SvScanResult* scan = index.findScan(file)) {
+            for (const auto& module : scan->modules) {
+                declared.push_back(module.name);
+                if (!isTestbenchName(module.name)) {
+                    candidates.push_back(module.name);
+                }
+            }
+        }
+    }
+    const std::vector<std::string>& considered = candidates.empty() ? declared : candidates;
+    std::vector<std::string> tops = roots(considered);
+    // Everything instantiates something else in the files: a cycle
+    return tops.empty() ? considered : tops;
+}
+
+bool ModuleGraph::isTestbenchName(const std::string& module) {
+    auto endsWith = [&module](const std::string& suffix) {
+        return module.size() > suffix.size() &&
+               module.compare(module.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    return module.rfind("tb_", 0) == 0 || module.rfind("test_", 0) == 0 || endsWith("_tb") || endsWith("_test");
+}
+
+std::vector<ModuleGraph::Id> ModuleGraph::reachable(const std::vector<std::string>& tops) const {
+    std::vector<Id> starts;
+    for (const auto& top : tops) {
+        if (Id id = find(top); id != kNone) {
+            starts.push_back(id);
+        }
+    }
+    std::vector<char> visited(entries.size(), 0);
+    mark(starts, true, visited);
+
+    std::vector<Id> result;
+    for (Id id = 0; id < entries.size(); ++id) {
+        if (visited[id]) {
+            result.push_back(id);
+        }
+    }
+    return result;
+}
+
+std::vector<std::filesystem::path> ModuleGraph::reachableFiles(const std::vector<std::string>& tops) const {
+    std::vector<std::filesystem::path> files;
+    for (Id id : reachable(tops)) {
+        files.push_back(file(id));
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return files;
+}
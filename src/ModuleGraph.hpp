@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include <cstdint>
+#include "ModuleIndex.hpp"
+
+// Instantiation graph of the modules declared in a ModuleIndex. Module names
+// are interned to dense ids and the edges of all modules share one array, so
+// a traversal over a large workspace touches a few flat vectors instead of
+// hashing names at every step. Built once per run; the index must outlive it.
+class ModuleGraph {
+public:
+    using Id = uint32_t;
+    static constexpr Id kNone = UINT32_MAX;
+
+private:
+    // Id -> declaration; ids of instantiated but undeclared modules are
+    // not kept, as traversals never reach past them
+    std::vector<const ModuleEntry*> entries;
+    std::unordered_map<std::string_view, Id> ids;
+    // Submodules of module i are edges[offsets[i]] .. edges[offsets[i + 1]]
+    std::vector<uint32_t> offsets;
+    std::vector<Id> edges;
+
+    // Marks everything reachable from `starts` in `visited`; the starts
+    // themselves only if `include_starts`
+    void mark(const std::vector<Id>& starts, bool include_starts, std::vector<char>& visited) const;
+
+public:
+    explicit ModuleGraph(const ModuleIndex& index);
+
+    // kNone if `name` is not declared
+    Id find(std::string_view name) const;
+    const std::string& name(Id id) const { return entries[id]->name; }
+    const std::filesystem::path& file(Id id) const { return entries[id]->file; }
+    size_t size() const { return entries.size(); }
+
+    // The modules among `candidates` that no other candidate instantiates,
+    // directly or through modules outside the candidates, in the order
+    // given. Undeclared candidates are ignored.
+    std::vector<std::string> roots(const std::vector<std::string>& candidates) const;
+
+    // The top modules of `files`: those declared in them that none of the
+    // others instantiates. Modules named like testbenches are not considered,
+    // unless there is nothing else; if the candidates all instantiate each
+    // other, every one of them is returned.
+    std::vector<std::string> topsOf(const ModuleIndex& index, const std::vector<std::filesystem::path>& files) const;
+
+    // True for tb_*, test_*, *_tb and *_test, the testbench naming of `vpm test`
+    static bool isTestbenchName(const std::string& module);
+
+    // The tops and every module reachable from them
+    std::vector<Id> reachable(const std::vector<std::string>& tops) const;
+
+    // Files declaring the tops and every module reachable from them, sorted
+    std::vector<std::filesystem::path> reachableFiles(const std::vector<std::string>& tops) const;
+};
@@ -0,0 +1,317 @@
+#include "ModuleIndex.hpp"
+#include "ThreadPool.hpp"
+#include "ScanCache.hpp"
+#include <unordered_set>
+#include <functional>
+#include <algorithm>
+
+ModuleIndex::ModuleIndex(const std::filesystem::path& workspace_root)
+    : root(std::filesystem::absolute(workspace_root)) {}
+
+std::vector<std::filesystem::path> ModuleIndex::listSourceFiles(const std::filesystem::path& dir,
+                                                                StampedPaths* directories) {
+    namespace fs = std::filesystem;
+    std::vector<fs::path> files;
+    if (directories) {
+        directories->emplace_back(dir, FileStamp::of(dir));
+    }
+    for (auto it = fs::recursive_directory_iterator(dir, fs::directory_options::skip_permission_denied);
+         it != fs::recursive_directory_iterator(); ++it) {
+        const fs::path& path = it->path();
+        std::string name = path.filename().string();
+
+        if (it->is_directory()) {
+            // build_<top> holds --emulate's port stubs, which redeclare modules
+            if (name.rfind(".", 0) == 0 || name.rfind("bazel-", 0) == 0 || name.rfind("build_", 0) == 0) {
+                it.disable_recursion_pending();
+            } else if (directories) {
+                directories->emplace_back(path, FileStamp::of(path));
+            }
+            continue;
+        }
+
+        std::string extension = path.extension().string();
+        if (it->is_regular_file() && (extension == ".sv" || extension == ".v")) {
+            files.push_back(path.is_absolute() ? path : fs::absolute(path));
+        }
+    }
+    // Sorted so "first declaration wins" does not depend on directory order
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+void ModuleIndex::scanTree(ThreadPool& pool, ScanCache* cache, StampedPaths* directories) {
+    std::vector<std::filesystem::path> files = listSourceFiles(root, directories);
+    std::vector<SvScanPtr> results(files.size());
+    pool.parallelFor(files.size(), [&](size_t i) {
+        results[i] = cache ? cache->scan(files[i]) : std::make_shared<SvScanResult>(SvScanner::scanFile(files[i]));
+    });
+    for (size_t i = 0; i < files.size(); ++i) {
+        addFile(files[i], std::move(results[i]));
+    }
+}
+
+void ModuleIndex::addFile(const std::filesystem::path& file, SvScanPtr scan) {
+    std::string key = file.is_absolute() ? file.string() : std::filesystem::absolute(file).string();
+    const SvScanPtr& stored = scans[key] = std::move(scan);
+    indexDeclarations(key, *stored);
+}
+
+void ModuleIndex::addFile(const std::filesystem::path& file, SvScanResult scan) {
+    addFile(file, std::make_shared<SvScanResult>(std::move(scan)));
+}
+
+void ModuleIndex::indexDeclarations(const std::string& file, const SvScanResult& scan) {
+    for (const auto& decl : scan.modules) {
+        ModuleEntry entry;
+        entry.name = decl.name;
+        entry.file = file;
+
+        std::unordered_set<std::string> seen;
+        for (const auto& instance : decl.instances) {
+            if (seen.insert(instance.module_name).second) {
+                entry.submodules.push_back(instance.module_name);
+            }
+        }
+
+        auto [it, inserted] = modules.emplace(decl.name, std::move(entry));
+        if (!inserted && it->second.file != file) {
+            duplicates.push_back(decl.name + ": " + it->second.file.string() + ", " + file);
+        }
+    }
+}
+
+void ModuleIndex::reindex() {
+    modules.clear();
+    duplicates.clear();
+
+    // Same order as scanTree, so the winner among duplicates does not change
+    std::vector<std::pair<std::filesystem::path, const SvScanResult*>> files;
+    files.reserve(scans.size());
+    for (const auto& [file, scan] : scans) {
+        files.emplace_back(file, scan.get());
+    }
+    std::sort(files.begin(), files.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (const auto& [file, scan] : files) {
+        indexDeclarations(file.string(), *scan);
+    }
+}
+
+void ModuleIndex::updateFiles(std::vector<std::pair<std::filesystem::path, SvScanPtr>> changes) {
+    for (auto& [file, scan] : changes) {
+        std::string key = std::filesystem::absolute(file).string();
+        if (scan) {
+            scans[key] = std::move(scan);
+        } else {
+            scans.erase(key);
+        }
+    }
+    reindex();
+}
+
+std::vector<std::filesystem::path> ModuleIndex::files() const {
+    std::vector<std::filesystem::path> paths;
+    paths.reserve(scans.size());
+    for (const auto& [file, scan] : scans) {
+        paths.emplace_back(file);
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+const ModuleEntry* ModuleIndex::find(const std::string& name) const {
+    auto it = modules.find(name);
+    return it == modules.end() ? nullptr : &it->second;
+}
+
+const SvScanResult* ModuleIndex::findScan(const std::filesystem::path& file) const {
+    auto it = scans.find(file.is_absolute() ? file.string() : std::filesystem::absolute(file).string());
+    return it == scans.end() ? nullptr : it->second.get();
+}
+
+std::vector<std::filesystem::path> ModuleIndex::includers(const std::filesystem::path& file) const {
+    std::string path = std::filesystem::absolute(file).lexically_normal().string();
+    std::vector<std::filesystem::path> result;
+    for (const auto& [scanned, scan] : scans) {
+        if (std::find(scan->includes.begin(), scan->includes.end(), path) != scan->includes.end()) {
+            result.emplace_back(scanned);
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+std::vector<std::string> ModuleIndex::transitiveSubmodules(const std::string& top,
+                                                           std::vector<std::string>* missing) const {
+    return transitiveSubmodules(std::vector<std::string>{top}, missing);
+}
+
+std::vector<std::string> ModuleIndex::transitiveSubmodules(const std::vector<std::string>& tops,
+                                                           std::vector<std::string>* missing) const {
+    std::vector<std::string> order;
+    std::unordered_set<std::string> visited;
+    std::unordered_set<std::string> reported;
+
+    // Depth-first post-order; the visited set also breaks instantiation cycles
+    std::function<void(const std::string&)> visit = [&](const std::string& name) {
+        const ModuleEntry* entry = find(name);
+        if (!entry) {
+            return;
+        }
+        for (const auto& sub : entry->submodules) {
+            if (!visited.insert(sub).second) {
+                continue;
+            }
+            if (!find(sub)) {
+                if (missing && reported.insert(sub).second) {
+                    missing->push_back(sub);
+                }
+                continue;
+            }
+            visit(sub);
+            order.push_back(sub);
+        }
+    };
+
+    for (const auto& top : tops) {
+        // A top reached earlier as someone's submodule has already been expanded
+        if (visited.count(top) == 0) {
+            visit(top);
+        }
+    }
+    return order;
+}
+
+std::vector<std::string> ModuleIndex::dependents(const std::vector<std::string>& changed) const {
+    // Reverse instantiation edges: submodule -> modules that instantiate it
+    std::unordered_map<std::string, std::vector<const std::string*>> users;
+    for (const auto& [name, entry] : modules) {
+        for (const auto& sub : entry.submodules) {
+            users[sub].push_back(&entry.name);
+        }
+    }
+
+    std::vector<std::string> closure;
+    std::unordered_set<std::string> visited;
+    std::vector<std::string> stack(changed.begin(), changed.end());
+    while (!stack.empty()) {
+        std::string name = std::move(stack.back());
+        stack.pop_back();
+        if (!visited.insert(name).second) {
+            continue;
+        }
+        if (find(name)) {
+            closure.push_back(name);
+        }
+        auto it = users.find(name);
+        if (it != users.end()) {
+            for (const std::string* user : it->second) {
+                stack.push_back(*user);
+            }
+        }
+    }
+    return closure;
+}
+
+std::set<std::string> ModuleIndex::hierarchicalBlocks(uintmax_t threshold) const {
+    std::unordered_set<std::string> instantiated;
+    std::unordered_set<std::string> overridden;
+    for (const auto& [file, scan] : scans) {
+        for (const auto& module : scan->modules) {
+            for (const auto& instance : module.instances) {
+                instantiated.insert(instance.module_name);
+                if (instance.parameterized) {
+                    overridden.insert(instance.module_name);
+                }
+            }
+        }
+    }
+
+    // Files by id, with their sizes, so subtrees are sets of small integers
+    std::unordered_map<std::string, uint32_t> file_ids;
+    std::vector<uintmax_t> file_sizes;
+    auto fileId = [&](const std::filesystem::path& file) {
+        auto [it, inserted] = file_ids.emplace(file.string(), static_cast<uint32_t>(file_sizes.size()));
+        if (inserted) {
+            std::error_code ec;
+            uintmax_t size = std::filesystem::file_size(file, ec);
+            file_sizes.push_back(ec ? 0 : size);
+        }
+        return it->second;
+    };
+
+    // The distinct files under each module and their total size, computed
+    // once per module, bottom-up. A subtree that reaches the threshold drops
+    // its files: every module above it reaches the threshold too, so the
+    // sets stay small however large the hierarchy is. An instantiation cycle
+    // is cut where the traversal first meets it.
+    struct Subtree {
+        uintmax_t size = 0;
+        std::vector<uint32_t> files;
+        bool done = false;
+    };
+    std::unordered_map<std::string, Subtree> subtrees;
+    std::function<const Subtree*(const std::string&)> subtreeOf = [&](const std::string& name) -> const Subtree* {
+        const ModuleEntry* entry = find(name);
+        if (!entry) {
+            return nullptr;
+        }
+        auto [it, inserted] = subtrees.try_emplace(name);
+        Subtree& subtree = it->second;
+        if (!inserted) {
+            return subtree.done ? &subtree : nullptr;
+        }
+
+        std::vector<uint32_t> files = {fileId(entry->file)};
+        for (const auto& sub : entry->submodules) {
+            const Subtree* below = subtreeOf(sub);
+            if (below && below->size >= threshold) {
+                subtree.size = below->size;
+                break;
+            }
+            if (below) {
+                files.insert(files.end(), below->files.begin(), below->files.end());
+            }
+        }
+        if (subtree.size < threshold) {
+            std::sort(files.begin(), files.end());
+            files.erase(std::unique(files.begin(), files.end()), files.end());
+            for (uint32_t file : files) {
+                subtree.size += file_sizes[file];
+            }
+            if (subtree.size < threshold) {
+                subtree.files = std::move(files);
+            }
+        }
+        subtree.done = true;
+        return &subtree;
+    };
+
+    std::set<std::string> blocks;
+    for (const auto& [name, entry] : modules) {
+        if (instantiated.count(name) != 0 && overridden.count(name) == 0 && subtreeOf(name)->size >= threshold) {
+            blocks.insert(name);
+        }
+    }
+    return blocks;
+}
+
+std::string ModuleIndex::label(const std::string& module, const std::filesystem::path& package_dir) const {
+    const ModuleEntry* entry = find(module);
+    if (!entry) {
+        return "";
+    }
+
+    std::filesystem::path module_dir = entry->file.parent_path();
+    std::string target = module + "_verilated";
+    if (module_dir == std::filesystem::absolute(package_dir)) {
+        return ":" + target;
+    }
+
+    std::string package = module_dir.lexically_relative(root).generic_string();
+    if (package == ".") {
+        package.clear();
+    }
+    return "//" + package + ":" + target;
+}
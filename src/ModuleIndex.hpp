@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <set>
+#include <filesystem>
+#include "SvScanner.hpp"
+#include "FileStamp.hpp"
+
+class ThreadPool;
+class ScanCache;
+
+// A module declaration located in the source tree
+struct ModuleEntry {
+    std::string name;
+    std::filesystem::path file;
+    // Unique names of the modules it instantiates, in first-seen order
+    std::vector<std::string> submodules;
+};
+
+// Index of module declarations across a workspace, used to resolve the
+// instantiation graph into Bazel targets and labels.
+class ModuleIndex {
+private:
+    std::filesystem::path root;
+    std::unordered_map<std::string, ModuleEntry> modules;
+    // Scan results by absolute file path, so generators can reuse them
+    std::unordered_map<std::string, SvScanPtr> scans;
+    // "module: first_file, other_file" for every module declared more than once
+    std::vector<std::string> duplicates;
+
+    // Adds the declarations of one file to `modules`
+    void indexDeclarations(const std::string& file, const SvScanResult& scan);
+
+    // Rebuilds `modules` and `duplicates` from the stored scans
+    void reindex();
+
+public:
+    explicit ModuleIndex(const std::filesystem::path& workspace_root);
+
+    // Lists every .sv/.v file under `dir` in sorted order, skipping hidden
+    // directories and the bazel-* and build_* output trees. Each directory
+    // walked is appended to `directories` if given, stamped before it is read,
+    // so a later change to its entries shows in its stamp.
+    static std::vector<std::filesystem::path> listSourceFiles(const std::filesystem::path& dir,
+                                                              StampedPaths* directories = nullptr);
+
+    // Scans every source file under the workspace root across the pool,
+    // reusing cached results for unchanged files when a cache is given
+    void scanTree(ThreadPool& pool, ScanCache* cache = nullptr, StampedPaths* directories = nullptr);
+
+    // Records the declarations found in one file. The first declaration of a
+    // module name wins; later ones are reported through getDuplicates().
+    void addFile(const std::filesystem::path& file, SvScanPtr scan);
+    void addFile(const std::filesystem::path& file, SvScanResult scan);
+
+    // Applies a batch of on-disk changes: each file gets its new scan, or is
+    // forgotten if the scan is null (the file was deleted)
+    void updateFiles(std::vector<std::pair<std::filesystem::path, SvScanPtr>> changes);
+
+    // Returns every indexed file in sorted order
+    std::vector<std::filesystem::path> files() const;
+
+    // Returns the declaration of a module, or nullptr if it is not in the index
+    const ModuleEntry* find(const std::string& name) const;
+
+    // Returns the scan of an indexed file, or nullptr if it was never added
+    const SvScanResult* findScan(const std::filesystem::path& file) const;
+
+    // Returns every indexed file that `include`s `file`, directly or not, in
+    // sorted order
+    std::vector<std::filesystem::path> includers(const std::filesystem::path& file) const;
+
+    // Returns every module reachable from `top` (excluding `top` itself), with
+    // dependencies ordered before their users. Instantiated names that are not
+    // declared anywhere in the index are appended to `missing` if provided.
+    std::vector<std::string> transitiveSubmodules(const std::string& top,
+                                                  std::vector<std::string>* missing = nullptr) const;
+
+    // Union of the above over several tops in a single traversal; the tops
+    // themselves are only included when reachable from another top
+    std::vector<std::string> transitiveSubmodules(const std::vector<std::string>& tops,
+                                                  std::vector<std::string>* missing = nullptr) const;
+
+    // Returns the given modules plus every declared module that transitively
+    // instantiates one of them (the reverse-dependency closure)
+    std::vector<std::string> dependents(const std::vector<std::string>& changed) const;
+
+    // Modules to verilate as hierarchical blocks: those instantiated by
+    // another module whose sources, together with those of everything below
+    // them, reach `threshold` bytes. Modules instantiated with a parameter
+    // override anywhere are left out, as a block is verilated once, with its
+    // default parameters.
+    std::set<std::string> hierarchicalBlocks(uintmax_t threshold) const;
+
+    // Bazel label of a module's verilator_hdl_library target, as seen from the
+    // package rooted at `package_dir`
+    std::string label(const std::string& module, const std::filesystem::path& package_dir) const;
+
+    const std::vector<std::string>& getDuplicates() const { return duplicates; }
+    // Number of indexed files
+    size_t size() const { return scans.size(); }
+    const std::filesystem::path& getRoot() const { return root; }
+};
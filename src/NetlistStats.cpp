@@ -0,0 +1,405 @@
+#include "NetlistStats.hpp"
+#include "JsonReader.hpp"
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <string_view>
+#include <cstdint>
+
+namespace {
+    using Token = JsonReader::Token;
+
+    bool startsWith(std::string_view text, std::string_view prefix) {
+        return text.substr(0, prefix.size()) == prefix;
+    }
+
+    bool isFlipFlop(std::string_view type) {
+        static const std::unordered_set<std::string_view> word_level = {
+            "$ff", "$dff", "$dffe", "$adff", "$adffe", "$sdff", "$sdffe", "$sdffce", "$aldff", "$aldffe",
+            "$dffsr", "$dffsre", "$dlatch", "$adlatch", "$dlatchsr", "$sr",
+            // Xilinx primitives
+            "FDRE", "FDSE", "FDCE", "FDPE", "LDCE", "LDPE",
+        };
+        for (std::string_view prefix : {"$_DFF", "$_SDFF", "$_ALDFF", "$_DLATCH", "$_SR_", "$_FF_"}) {
+            if (startsWith(type, prefix)) {
+                return true;
+            }
+        }
+        return word_level.count(type) != 0;
+    }
+
+    bool isWordLevelFlipFlop(std::string_view type) {
+        return type[0] == '$' && type[1] != '_';
+    }
+
+    bool isMappedLut(std::string_view type) {
+        return type == "$lut" || (type.size() == 4 && startsWith(type, "LUT") && type[3] >= '1' && type[3] <= '6');
+    }
+
+    // Two-input merges a gate contributes; a LUT6 absorbs five of them
+    int gateMerges(std::string_view type) {
+        static const std::unordered_map<std::string_view, int> merges = {
+            {"$_NOT_", 0}, {"$_BUF_", 0},
+            {"$_AND_", 1}, {"$_NAND_", 1}, {"$_OR_", 1}, {"$_NOR_", 1},
+            {"$_XOR_", 1}, {"$_XNOR_", 1}, {"$_ANDNOT_", 1}, {"$_ORNOT_", 1},
+            {"$_MUX_", 2}, {"$_NMUX_", 2}, {"$_AOI3_", 2}, {"$_OAI3_", 2},
+            {"$_AOI4_", 3}, {"$_OAI4_", 3},
+            {"$_MUX4_", 5}, {"$_MUX8_", 10}, {"$_MUX16_", 20},
+        };
+        auto it = merges.find(type);
+        return it == merges.end() ? -1 : it->second;
+    }
+
+    // Cells a combinational path passes through; anything else (flip-flops,
+    // memories, submodules, hard blocks) starts and ends paths
+    bool isCombinational(std::string_view type) {
+        if (type[0] == '$') {
+            return !isFlipFlop(type) && !startsWith(type, "$mem") && type != "$scopeinfo";
+        }
+        return isMappedLut(type) || type == "MUXF7" || type == "MUXF8" || type == "CARRY4";
+    }
+
+    size_t parseDecimal(std::string_view value) {
+        size_t result = 0;
+        for (char c : value) {
+            if (c < '0' || c > '9') {
+                break;
+            }
+            result = result * 10 + static_cast<size_t>(c - '0');
+        }
+        return result;
+    }
+
+    // Yosys writes parameter and attribute values as binary strings, or as
+    // JSON numbers when they are small integers
+    size_t parseParameter(Token token, std::string_view value) {
+        if (token != Token::String) {
+            return parseDecimal(value);
+        }
+        size_t result = 0;
+        for (char c : value) {
+            if (c != '0' && c != '1') {
+                return 0;
+            }
+            result = (result << 1) | static_cast<size_t>(c - '0');
+        }
+        return result;
+    }
+
+    // Connectivity of one module's combinational cells, as flat arrays
+    struct CombGraph {
+        std::vector<uint8_t> weight;
+        std::vector<uint32_t> input_begin;
+        std::vector<int32_t> inputs;
+        // Combinational cell driving each bit, or -1
+        std::vector<int32_t> driver;
+
+        void clear() {
+            weight.clear();
+            input_begin.assign(1, 0);
+            inputs.clear();
+            driver.clear();
+        }
+
+        void addCell(uint8_t cell_weight, const std::vector<int32_t>& in, const std::vector<int32_t>& out) {
+            int32_t index = static_cast<int32_t>(weight.size());
+            weight.push_back(cell_weight);
+            inputs.insert(inputs.end(), in.begin(), in.end());
+            input_begin.push_back(static_cast<uint32_t>(inputs.size()));
+            for (int32_t bit : out) {
+                if (static_cast<size_t>(bit) >= driver.size()) {
+                    driver.resize(static_cast<size_t>(bit) + 1, -1);
+                }
+                driver[static_cast<size_t>(bit)] = index;
+            }
+        }
+
+        int32_t driverOf(int32_t bit) const {
+            return static_cast<size_t>(bit) < driver.size() ? driver[static_cast<size_t>(bit)] : -1;
+        }
+
+        // Longest weighted path; iterative so deep logic cannot overflow the stack
+        size_t longestPath(bool& loop) const {
+            size_t count = weight.size();
+            std::vector<uint32_t> depth(count, 0);
+            std::vector<uint8_t> state(count, 0);
+            std::vector<std::pair<uint32_t, uint32_t>> stack;
+            size_t longest = 0;
+
+            for (uint32_t start = 0; start < count; ++start) {
+                if (state[start] != 0) {
+                    continue;
+                }
+                state[start] = 1;
+                stack.emplace_back(start, input_begin[start]);
+                while (!stack.empty()) {
+                    auto& [cell, next_input] = stack.back();
+                    if (next_input < input_begin[cell + 1]) {
+                        int32_t source = driverOf(inputs[next_input++]);
+                        if (source < 0) {
+                            continue;
+                        }
+                        if (state[static_cast<size_t>(source)] == 0) {
+                            state[static_cast<size_t>(source)] = 1;
+                            stack.emplace_back(static_cast<uint32_t>(source), input_begin[static_cast<size_t>(source)]);
+                        } else if (state[static_cast<size_t>(source)] == 1) {
+                            loop = true;
+                        }
+                        continue;
+                    }
+
+                    uint32_t deepest = 0;
+                    for (uint32_t i = input_begin[cell]; i < input_begin[cell + 1]; ++i) {
+                        int32_t source = driverOf(inputs[i]);
+                        if (source >= 0 && state[static_cast<size_t>(source)] == 2) {
+                            deepest = std::max(deepest, depth[static_cast<size_t>(source)]);
+                        }
+                    }
+                    depth[cell] = deepest + weight[cell];
+                    state[cell] = 2;
+                    longest = std::max<size_t>(longest, depth[cell]);
+                    stack.pop_back();
+                }
+            }
+            return longest;
+        }
+    };
+
+    // Per-cell fields, reused across cells to avoid reallocating
+    struct CellScratch {
+        std::string type;
+        size_t width = 1;
+        std::vector<std::pair<std::string, bool>> port_is_output;
+        std::vector<std::pair<std::string, std::vector<int32_t>>> connections;
+        size_t connection_count = 0;
+        std::vector<int32_t> in;
+        std::vector<int32_t> out;
+
+        void clear() {
+            type.clear();
+            width = 1;
+            port_is_output.clear();
+            connection_count = 0;
+        }
+
+        std::vector<int32_t>& addConnection(std::string_view port) {
+            if (connection_count == connections.size()) {
+                connections.emplace_back();
+            }
+            auto& slot = connections[connection_count++];
+            slot.first.assign(port);
+            slot.second.clear();
+            return slot.second;
+        }
+
+        bool isOutput(const std::string& port) const {
+            for (const auto& [name, output] : port_is_output) {
+                if (name == port) {
+                    return output;
+                }
+            }
+            // Without directions, assume the Yosys convention for gate outputs
+            return port == "Y" || port == "Q" || port == "O";
+        }
+    };
+
+    void readConnections(JsonReader& json, CellScratch& cell) {
+        json.expect(Token::BeginObject);
+        while (json.next() == Token::Key) {
+            std::vector<int32_t>& bits = cell.addConnection(json.text());
+            json.expect(Token::BeginArray);
+            for (Token token = json.next(); token != Token::EndArray; token = json.next()) {
+                // Strings are the constants "0", "1", "x" and "z"
+                if (token == Token::Number) {
+                    bits.push_back(static_cast<int32_t>(parseDecimal(json.text())));
+                }
+            }
+        }
+    }
+
+    void readCell(JsonReader& json, CellScratch& cell, bool compute_depth) {
+        cell.clear();
+        json.expect(Token::BeginObject);
+        while (json.next() == Token::Key) {
+            std::string_view key = json.text();
+            if (key == "type") {
+                json.expect(Token::String);
+                cell.type.assign(json.text());
+            } else if (key == "parameters") {
+                json.expect(Token::BeginObject);
+                while (json.next() == Token::Key) {
+                    bool is_width = json.text() == "WIDTH";
+                    Token value = json.next();
+                    if (value == Token::BeginObject || value == Token::BeginArray) {
+                        json.skipNested();
+                    } else if (is_width) {
+                        cell.width = std::max<size_t>(parseParameter(value, json.text()), 1);
+                    }
+                }
+            } else if (key == "port_directions" && compute_depth) {
+                json.expect(Token::BeginObject);
+                while (json.next() == Token::Key) {
+                    std::string port(json.text());
+                    json.expect(Token::String);
+                    cell.port_is_output.emplace_back(std::move(port), json.text() == "output");
+                }
+            } else if (key == "connections" && compute_depth) {
+                readConnections(json, cell);
+            } else {
+                json.skipValue();
+            }
+        }
+    }
+
+    void addCell(ModuleStats& stats, CellScratch& cell, CombGraph& graph, size_t& lut_merges, bool compute_depth) {
+        if (cell.type.empty()) {
+            return;
+        }
+        ++stats.cells;
+        ++stats.cell_counts[cell.type];
+
+        bool flip_flop = isFlipFlop(cell.type);
+        int merges = gateMerges(cell.type);
+        if (flip_flop) {
+            stats.flip_flops += isWordLevelFlipFlop(cell.type) ? cell.width : 1;
+        } else if (isMappedLut(cell.type)) {
+            ++stats.luts;
+        } else if (merges >= 0) {
+            lut_merges += static_cast<size_t>(merges);
+        } else if (cell.type[0] == '$' && !startsWith(cell.type, "$mem") && cell.type != "$scopeinfo") {
+            ++stats.unmapped_cells;
+        }
+
+        if (!compute_depth || !isCombinational(cell.type)) {
+            return;
+        }
+        cell.in.clear();
+        cell.out.clear();
+        for (size_t i = 0; i < cell.connection_count; ++i) {
+            const auto& [port, bits] = cell.connections[i];
+            auto& target = cell.isOutput(port) ? cell.out : cell.in;
+            target.insert(target.end(), bits.begin(), bits.end());
+        }
+        graph.addCell(merges == 0 ? 0 : 1, cell.in, cell.out);
+    }
+
+    void readModule(JsonReader& json, ModuleStats& stats, bool compute_depth) {
+        CellScratch cell;
+        CombGraph graph;
+        graph.clear();
+        size_t lut_merges = 0;
+
+        json.expect(Token::BeginObject);
+        while (json.next() == Token::Key) {
+            std::string_view key = json.text();
+            if (key == "attributes") {
+                json.expect(Token::BeginObject);
+                while (json.next() == Token::Key) {
+                    bool is_top = json.text() == "top";
+                    Token value = json.next();
+                    if (value == Token::BeginObject || value == Token::BeginArray) {
+                        json.skipNested();
+                    } else if (is_top && parseParameter(value, json.text()) != 0) {
+                        stats.top = true;
+                    }
+                }
+            } else if (key == "cells") {
+                json.expect(Token::BeginObject);
+                while (json.next() == Token::Key) {
+                    readCell(json, cell, compute_depth);
+                    addCell(stats, cell, graph, lut_merges, compute_depth);
+                }
+            } else {
+                // ports, netnames, memories: not needed for the estimates
+                json.skipValue();
+            }
+        }
+
+        stats.luts += (lut_merges + 4) / 5;
+        if (compute_depth) {
+            stats.logic_depth = graph.longestPath(stats.combinational_loop);
+        }
+    }
+}
+
+NetlistStats NetlistStats::analyze(const std::filesystem::path& netlist, bool compute_depth) {
+    NetlistStats result;
+    JsonReader json(netlist);
+    json.expect(Token::BeginObject);
+    while (json.next() == Token::Key) {
+        if (json.text() != "modules") {
+            json.skipValue();
+            continue;
+        }
+        json.expect(Token::BeginObject);
+        while (json.next() == Token::Key) {
+            ModuleStats stats;
+            stats.name = std::string(json.text());
+            readModule(json, stats, compute_depth);
+            result.modules.push_back(std::move(stats));
+        }
+    }
+    return result;
+}
+
+const ModuleStats* NetlistStats::findTop() const {
+    std::unordered_set<std::string> instantiated;
+    for (const auto& module : modules) {
+        if (module.top) {
+            return &module;
+        }
+        for (const auto& [type, count] : module.cell_counts) {
+            instantiated.insert(type);
+        }
+    }
+    for (const auto& module : modules) {
+        if (instantiated.count(module.name) == 0) {
+            return &module;
+        }
+    }
+    return modules.empty() ? nullptr : &modules.front();
+}
+
+ModuleStats NetlistStats::hierarchyTotal(const std::string& module) const {
+    std::unordered_map<std::string, const ModuleStats*> by_name;
+    for (const auto& stats : modules) {
+        by_name.emplace(stats.name, &stats);
+    }
+
+    // Each module is expanded once, however many instances share it;
+    // `active` stops a module that instantiates itself, directly or not
+    std::unordered_map<std::string, ModuleStats> expanded;
+    std::unordered_set<std::string> active;
+    std::function<const ModuleStats&(const ModuleStats&)> expand = [&](const ModuleStats& stats) -> const ModuleStats& {
+        auto cached = expanded.find(stats.name);
+        if (cached != expanded.end()) {
+            return cached->second;
+        }
+        if (!active.insert(stats.name).second) {
+            return stats;
+        }
+        ModuleStats total = stats;
+        for (const auto& [type, count] : stats.cell_counts) {
+            auto it = by_name.find(type);
+            if (it == by_name.end()) {
+                continue;
+            }
+            const ModuleStats& child = expand(*it->second);
+            total.cells += child.cells * count;
+            total.flip_flops += child.flip_flops * count;
+            total.luts += child.luts * count;
+            total.unmapped_cells += child.unmapped_cells * count;
+            total.logic_depth = std::max(total.logic_depth, child.logic_depth);
+            total.combinational_loop = total.combinational_loop || child.combinational_loop;
+            for (const auto& [child_type, child_count] : child.cell_counts) {
+                total.cell_counts[child_type] += child_count * count;
+            }
+        }
+        active.erase(stats.name);
+        return expanded.emplace(stats.name, std::move(total)).first->second;
+    };
+
+    auto it = by_name.find(module);
+    return it == by_name.end() ? ModuleStats() : expand(*it->second);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <filesystem>
+#include <cstddef>
+
+// Resource and timing estimates for one module of a Yosys netlist
+struct ModuleStats {
+    std::string name;
+    bool top = false;
+    size_t cells = 0;
+    std::map<std::string, size_t> cell_counts;
+    // Flip-flop and latch bits
+    size_t flip_flops = 0;
+    // LUT6 estimate: mapped LUTs plus gate-level logic packed six inputs per LUT
+    size_t luts = 0;
+    // Longest chain of combinational cells (inverters and buffers are free)
+    size_t logic_depth = 0;
+    bool combinational_loop = false;
+    // Word-level cells left unmapped, which the LUT estimate does not cover
+    size_t unmapped_cells = 0;
+};
+
+// Reads a Yosys `write_json` netlist in one streaming pass. Only one
+// module's connectivity is held at a time, in compact arrays, so memory
+// depends on the largest module rather than the size of the file.
+class NetlistStats {
+private:
+    std::vector<ModuleStats> modules;
+
+public:
+    // Parses `netlist`; `compute_depth` = false skips connectivity entirely
+    static NetlistStats analyze(const std::filesystem::path& netlist, bool compute_depth = true);
+
+    const std::vector<ModuleStats>& getModules() const { return modules; }
+
+    // The module marked top by Yosys, or else the one no other module instantiates
+    const ModuleStats* findTop() const;
+
+    // Stats of `module` with every submodule instance expanded; the logic
+    // depth is the deepest module, as paths are not traced across boundaries
+    ModuleStats hierarchyTotal(const std::string& module) const;
+};
@@ -0,0 +1,323 @@
+#include "PackageManifest.hpp"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cctype>
+
+extern "C" {
+    #include <unistd.h>
+}
+
+namespace {
+    struct TomlValue {
+        enum class Kind { Scalar, Array, Table } kind = Kind::Scalar;
+        std::string text;
+        std::vector<std::string> items;
+        std::vector<std::pair<std::string, std::string>> fields;
+    };
+
+    // A [table] or one element of an [[array]] with its key/value pairs
+    struct TomlTable {
+        std::string name;
+        std::vector<std::pair<std::string, TomlValue>> entries;
+    };
+
+    // Line-oriented reader for the TOML subset vpm writes and documents
+    class TomlParser {
+    private:
+        std::string source;
+        std::string_view line;
+        size_t line_number = 0;
+
+        [[noreturn]] void fail(const std::string& what) const {
+            throw std::runtime_error("Failed to parse " + source + ":" + std::to_string(line_number) + ": " + what);
+        }
+
+        void skipSpace() {
+            while (!line.empty() && (line.front() == ' ' || line.front() == '\t')) {
+                line.remove_prefix(1);
+            }
+        }
+
+        bool consume(char c) {
+            skipSpace();
+            if (!line.empty() && line.front() == c) {
+                line.remove_prefix(1);
+                return true;
+            }
+            return false;
+        }
+
+        std::string parseKey() {
+            skipSpace();
+            if (!line.empty() && (line.front() == '"' || line.front() == '\'')) {
+                return parseString();
+            }
+            size_t length = 0;
+            while (length < line.size() &&
+                   (std::isalnum(static_cast<unsigned char>(line[length])) || line[length] == '_' ||
+                    line[length] == '-' || line[length] == '.')) {
+                ++length;
+            }
+            if (length == 0) {
+                fail("expected a key");
+            }
+            std::string key(line.substr(0, length));
+            line.remove_prefix(length);
+            return key;
+        }
+
+        std::string parseString() {
+            char quote = line.front();
+            line.remove_prefix(1);
+            std::string value;
+            while (!line.empty() && line.front() != quote) {
+                char c = line.front();
+                line.remove_prefix(1);
+                if (c == '\\' && quote == '"' && !line.empty()) {
+                    char escaped = line.front();
+                    line.remove_prefix(1);
+                    c = escaped == 'n' ? '\n' : escaped == 't' ? '\t' : escaped;
+                }
+                value += c;
+            }
+            if (line.empty()) {
+                fail("unterminated string");
+            }
+            line.remove_prefix(1);
+            return value;
+        }
+
+        // String, or a bare number or boolean kept as text
+        std::string parseScalar() {
+            skipSpace();
+            if (!line.empty() && (line.front() == '"' || line.front() == '\'')) {
+                return parseString();
+            }
+            size_t length = 0;
+            while (length < line.size() && line[length] != ',' && line[length] != ']' && line[length] != '}' &&
+                   line[length] != '#' && line[length] != ' ' && line[length] != '\t') {
+                ++length;
+            }
+            if (length == 0) {
+                fail("expected a value");
+            }
+            std::string value(line.substr(0, length));
+            line.remove_prefix(length);
+            return value;
+        }
+
+        TomlValue parseValue() {
+            TomlValue value;
+            if (consume('[')) {
+                value.kind = TomlValue::Kind::Array;
+                while (!consume(']')) {
+                    value.items.push_back(parseScalar());
+                    if (!consume(',') && (skipSpace(), line.empty() || line.front() != ']')) {
+                        fail("expected ',' or ']'");
+                    }
+                }
+            } else if (consume('{')) {
+                value.kind = TomlValue::Kind::Table;
+                while (!consume('}')) {
+                    std::string key = parseKey();
+                    if (!consume('=')) {
+                        fail("expected '=' after " + key);
+                    }
+                    value.fields.emplace_back(key, parseScalar());
+                    if (!consume(',') && (skipSpace(), line.empty() || line.front() != '}')) {
+                        fail("expected ',' or '}'");
+                    }
+                }
+            } else {
+                value.text = parseScalar();
+            }
+            return value;
+        }
+
+    public:
+        explicit TomlParser(std::string source_name) : source(std::move(source_name)) {}
+
+        std::vector<TomlTable> parse(std::istream& in) {
+            std::vector<TomlTable> tables(1);
+            std::string text;
+            while (std::getline(in, text)) {
+                ++line_number;
+                line = text;
+                skipSpace();
+                if (line.empty() || line.front() == '#') {
+                    continue;
+                }
+                if (consume('[')) {
+                    bool array = consume('[');
+                    std::string name = parseKey();
+                    if (!consume(']') || (array && !consume(']'))) {
+                        fail("malformed table header");
+                    }
+                    tables.push_back({array ? "[" + name + "]" : name, {}});
+                } else {
+                    std::string key = parseKey();
+                    if (!consume('=')) {
+                        fail("expected '=' after " + key);
+                    }
+                    tables.back().entries.emplace_back(key, parseValue());
+                }
+                skipSpace();
+                if (!line.empty() && line.front() != '#') {
+                    fail("unexpected text after value");
+                }
+            }
+            return tables;
+        }
+    };
+
+    std::vector<TomlTable> parseFile(const std::filesystem::path& path) {
+        std::ifstream in(path);
+        if (!in.is_open()) {
+            throw std::runtime_error("Failed to read file: " + path.string());
+        }
+        return TomlParser(path.string()).parse(in);
+    }
+
+    std::string quoted(const std::string& value) {
+        std::string out = "\"";
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+            }
+            out += c;
+        }
+        return out + "\"";
+    }
+}
+
+bool PackageManifest::isValidName(const std::string& name) {
+    return !name.empty() && std::all_of(name.begin(), name.end(), [](unsigned char c) {
+        return std::isalnum(c) || c == '_' || c == '-';
+    });
+}
+
+void PackageManifest::checkName(const std::string& name, const std::string& where) {
+    if (!isValidName(name)) {
+        throw std::runtime_error("Invalid package name '" + name + "' in " + where +
+                                 "; names may only use letters, digits, '_' and '-'");
+    }
+}
+
+PackageManifest PackageManifest::read(const std::filesystem::path& path) {
+    PackageManifest manifest;
+    std::filesystem::path base = std::filesystem::absolute(path).parent_path();
+    for (const auto& table : parseFile(path)) {
+        for (const auto& [key, value] : table.entries) {
+            if (table.name == "package" && key == "name") {
+                manifest.name = value.text;
+            } else if (table.name == "package" && key == "version") {
+                manifest.version = value.text;
+            } else if (table.name == "registry" && key == "path") {
+                manifest.registry = (base / value.text).lexically_normal();
+            } else if (table.name == "dependencies") {
+                checkName(key, path.string());
+                PackageDependency dependency;
+                dependency.name = key;
+                if (value.kind == TomlValue::Kind::Scalar) {
+                    dependency.requirement = value.text;
+                }
+                for (const auto& [field, text] : value.fields) {
+                    if (field == "version") {
+                        dependency.requirement = text;
+                    } else if (field == "path") {
+                        dependency.path = text;
+                    } else {
+                        throw std::runtime_error("Unknown field '" + field + "' of dependency " + key + " in " +
+                                                 path.string());
+                    }
+                }
+                if (value.kind == TomlValue::Kind::Array) {
+                    throw std::runtime_error("Dependency " + key + " in " + path.string() +
+                                             " must be a version string or a table");
+                }
+                manifest.dependencies.push_back(std::move(dependency));
+            }
+        }
+    }
+    return manifest;
+}
+
+PackageLock PackageLock::read(const std::filesystem::path& path) {
+    PackageLock lock;
+    for (const auto& table : parseFile(path)) {
+        if (table.name != "[package]") {
+            continue;
+        }
+        LockedPackage package;
+        for (const auto& [key, value] : table.entries) {
+            if (key == "name") {
+                package.name = value.text;
+            } else if (key == "version") {
+                package.version = value.text;
+            } else if (key == "source") {
+                package.source = value.text;
+            } else if (key == "hash") {
+                package.hash = value.text;
+            } else if (key == "dependencies") {
+                package.dependencies = value.items;
+            }
+        }
+        if (package.name.empty() || package.hash.empty()) {
+            throw std::runtime_error("Package without name or hash in " + path.string());
+        }
+        PackageManifest::checkName(package.name, path.string());
+        for (const auto& dependency : package.dependencies) {
+            PackageManifest::checkName(dependency, path.string());
+        }
+        lock.packages.push_back(std::move(package));
+    }
+    return lock;
+}
+
+void PackageLock::write(const std::filesystem::path& path) const {
+    std::vector<const LockedPackage*> sorted;
+    for (const auto& package : packages) {
+        sorted.push_back(&package);
+    }
+    std::sort(sorted.begin(), sorted.end(),
+              [](const LockedPackage* a, const LockedPackage* b) { return a->name < b->name; });
+
+    std::ostringstream out;
+    out << "# Written by vpm --install; do not edit by hand\n"
+        << "version = 1\n";
+    for (const LockedPackage* package : sorted) {
+        out << "\n[[package]]\n"
+            << "name = " << quoted(package->name) << "\n"
+            << "version = " << quoted(package->version) << "\n"
+            << "source = " << quoted(package->source) << "\n"
+            << "hash = " << quoted(package->hash) << "\n";
+        if (!package->dependencies.empty()) {
+            out << "dependencies = [";
+            for (size_t i = 0; i < package->dependencies.size(); ++i) {
+                out << (i == 0 ? "" : ", ") << quoted(package->dependencies[i]);
+            }
+            out << "]\n";
+        }
+    }
+
+    std::filesystem::path temp_file = path;
+    temp_file += ".tmp-" + std::to_string(::getpid());
+    {
+        std::ofstream file(temp_file, std::ios::trunc);
+        if (!file.is_open() || !(file << out.str())) {
+            throw std::runtime_error("Failed to write lockfile: " + path.string());
+        }
+    }
+    std::filesystem::rename(temp_file, path);
+}
+
+const LockedPackage* PackageLock::find(const std::string& name) const {
+    for (const auto& package : packages) {
+        if (package.name == name) {
+            return &package;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+
+// A dependency declared in a [dependencies] table:
+//   uart = "1.2"                      from the registry
+//   fifo = { path = "../ip/fifo" }    a package directory on disk
+struct PackageDependency {
+    std::string name;
+    // Version requirement; empty for path dependencies
+    std::string requirement;
+    // Relative to the declaring manifest's directory
+    std::string path;
+};
+
+// vpm.toml, the manifest at the root of a workspace or package:
+//
+//   [package]
+//   name = "soc"
+//   version = "0.1.0"
+//
+//   [registry]
+//   path = "../registry"
+//
+//   [dependencies]
+//   uart = "^1.2"
+//
+// Only the subset of TOML needed here is read: tables, string values,
+// string arrays and inline tables of strings.
+struct PackageManifest {
+    std::string name;
+    std::string version;
+    // Registry directory, absolute; empty if the manifest sets none
+    std::filesystem::path registry;
+    std::vector<PackageDependency> dependencies;
+
+    static constexpr const char* kFileName = "vpm.toml";
+
+    // Throws if the file cannot be read or is malformed
+    static PackageManifest read(const std::filesystem::path& path);
+
+    // Package names become directories under vpm_packages/ and the
+    // registry, so only [A-Za-z0-9_-]+ is accepted
+    static bool isValidName(const std::string& name);
+
+    // Throws naming `where` unless isValidName(name)
+    static void checkName(const std::string& name, const std::string& where);
+};
+
+// One resolved package pinned in vpm.lock
+struct LockedPackage {
+    std::string name;
+    std::string version;
+    // "registry", or "path+<dir>" relative to the workspace
+    std::string source;
+    // Content hash of the package tree in the package store
+    std::string hash;
+    // Names of the locked packages it depends on
+    std::vector<std::string> dependencies;
+};
+
+// vpm.lock: the exact versions and content hashes an install produced, so
+// later installs on any machine get the same bytes without resolving again
+struct PackageLock {
+    std::vector<LockedPackage> packages;
+
+    static constexpr const char* kFileName = "vpm.lock";
+
+    // Throws if the file cannot be read or is malformed
+    static PackageLock read(const std::filesystem::path& path);
+
+    // Writes packages sorted by name, replacing the file atomically
+    void write(const std::filesystem::path& path) const;
+
+    const LockedPackage* find(const std::string& name) const;
+};
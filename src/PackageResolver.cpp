@@ -0,0 +1,302 @@
+#include "PackageResolver.hpp"
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <tuple>
+#include <stdexcept>
+#include <cctype>
+#include <charconv>
+
+namespace {
+    // A requirement on a package and the package (or "vpm.toml") making it
+    struct Requirement {
+        std::string requirement;
+        // Absolute directory of a path dependency; empty for registry ones
+        std::filesystem::path path;
+        std::string from;
+    };
+
+    std::string describe(const std::string& name, const std::vector<Requirement>& requirements) {
+        std::string text = name + " is required as";
+        for (const auto& requirement : requirements) {
+            text += "\n  " + (requirement.path.empty() ? "\"" + requirement.requirement + "\""
+                                                       : requirement.path.string()) +
+                    " by " + requirement.from;
+        }
+        return text;
+    }
+}
+
+PackageVersion PackageVersion::parse(const std::string& text) {
+    PackageVersion version;
+    unsigned long* parts[] = {&version.major, &version.minor, &version.patch};
+    size_t position = 0;
+    for (size_t i = 0; i < 3 && position < text.size(); ++i) {
+        size_t end = position;
+        while (end < text.size() && std::isdigit(static_cast<unsigned char>(text[end]))) {
+            ++end;
+        }
+        auto [ptr, ec] = std::from_chars(text.data() + position, text.data() + end, *parts[i]);
+        if (end == position || ec != std::errc() || (end < text.size() && (text[end] != '.' || i == 2))) {
+            throw std::runtime_error("Invalid version: '" + text + "'");
+        }
+        position = end + 1;
+    }
+    if (text.empty() || text.back() == '.') {
+        throw std::runtime_error("Invalid version: '" + text + "'");
+    }
+    return version;
+}
+
+bool PackageVersion::satisfies(const std::string& requirement) const {
+    std::string text = requirement;
+    text.erase(std::remove_if(text.begin(), text.end(), [](unsigned char c) { return std::isspace(c); }), text.end());
+    if (text.empty() || text == "*") {
+        return true;
+    }
+    std::string op;
+    while (!text.empty() && std::string("^~=><").find(text.front()) != std::string::npos) {
+        op += text.front();
+        text.erase(0, 1);
+    }
+    size_t parts = std::count(text.begin(), text.end(), '.') + 1;
+    PackageVersion base = parse(text);
+
+    if (op == "=") {
+        return *this == base;
+    }
+    if (op == ">=") {
+        return !(*this < base);
+    }
+    if (op == "~") {
+        // ~1.2.3 and ~1.2 allow patch updates, ~1 minor updates
+        return !(*this < base) && major == base.major && (parts == 1 || minor == base.minor);
+    }
+    if (op.empty() || op == "^") {
+        // Compatible updates: the leftmost non-zero part may not change
+        if (*this < base) {
+            return false;
+        }
+        if (base.major > 0 || parts == 1) {
+            return major == base.major;
+        }
+        if (base.minor > 0 || parts == 2) {
+            return major == 0 && minor == base.minor;
+        }
+        return *this == base;
+    }
+    throw std::runtime_error("Invalid version requirement: '" + requirement + "'");
+}
+
+std::string PackageVersion::str() const {
+    return std::to_string(major) + "." + std::to_string(minor) + "." + std::to_string(patch);
+}
+
+bool PackageVersion::operator<(const PackageVersion& other) const {
+    return std::tie(major, minor, patch) < std::tie(other.major, other.minor, other.patch);
+}
+
+bool PackageVersion::operator==(const PackageVersion& other) const {
+    return std::tie(major, minor, patch) == std::tie(other.major, other.minor, other.patch);
+}
+
+PackageResolver::PackageResolver(std::filesystem::path workspace_root, std::filesystem::path registry_dir)
+    : workspace(std::filesystem::absolute(workspace_root)), registry(std::move(registry_dir)) {}
+
+const std::vector<std::pair<PackageVersion, std::string>>& PackageResolver::versionsOf(const std::string& name) {
+    auto it = available.find(name);
+    if (it != available.end()) {
+        return it->second;
+    }
+    std::vector<std::pair<PackageVersion, std::string>>& versions = available[name];
+    std::error_code ec;
+    std::filesystem::path dir = registry / name;
+    if (!registry.empty() && std::filesystem::is_directory(dir, ec)) {
+        for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+            std::string version = entry.path().filename().string();
+            try {
+                if (entry.is_directory()) {
+                    versions.emplace_back(PackageVersion::parse(version), version);
+                }
+            } catch (const std::exception&) {
+                // Not a version directory
+            }
+        }
+    }
+    std::sort(versions.begin(), versions.end(), [](const auto& a, const auto& b) { return b.first < a.first; });
+    return versions;
+}
+
+std::string PackageResolver::pathSource(const std::filesystem::path& directory) const {
+    return "path+" + directory.lexically_relative(workspace).generic_string();
+}
+
+std::vector<ResolvedPackage> PackageResolver::resolve(const PackageManifest& manifest) {
+    std::map<std::string, std::vector<Requirement>> requirements;
+    std::map<std::string, ResolvedPackage> chosen;
+    std::deque<std::string> pending;
+
+    auto require = [&](const std::string& from, const std::filesystem::path& base,
+                       const std::vector<PackageDependency>& dependencies) {
+        for (const auto& dependency : dependencies) {
+            PackageManifest::checkName(dependency.name, from);
+            Requirement requirement{dependency.requirement, {}, from};
+            if (!dependency.path.empty()) {
+                requirement.path = (base / dependency.path).lexically_normal();
+            }
+            requirements[dependency.name].push_back(std::move(requirement));
+            pending.push_back(dependency.name);
+        }
+    };
+    require(PackageManifest::kFileName, workspace, manifest.dependencies);
+
+    // Greedy, without backtracking: a package is re-picked whenever the
+    // requirements on it change, and dropping a version also drops the
+    // requirements it made
+    size_t steps = 0;
+    while (!pending.empty()) {
+        if (++steps > 100000) {
+            throw std::runtime_error("Dependency resolution did not converge");
+        }
+        std::string name = pending.front();
+        pending.pop_front();
+        const std::vector<Requirement>& wanted = requirements[name];
+        if (wanted.empty()) {
+            continue;
+        }
+
+        ResolvedPackage package;
+        package.name = name;
+        std::set<std::filesystem::path> paths;
+        for (const auto& requirement : wanted) {
+            if (!requirement.path.empty()) {
+                paths.insert(requirement.path);
+            }
+        }
+        if (paths.size() > 1) {
+            throw std::runtime_error("Conflicting paths for package " + describe(name, wanted));
+        }
+
+        auto meetsAll = [&](const PackageVersion& version) {
+            return std::all_of(wanted.begin(), wanted.end(), [&](const Requirement& requirement) {
+                return !requirement.path.empty() || requirement.requirement.empty() ||
+                       version.satisfies(requirement.requirement);
+            });
+        };
+        std::filesystem::path package_manifest;
+        if (!paths.empty()) {
+            package.directory = *paths.begin();
+            package.source = pathSource(package.directory);
+            package_manifest = package.directory / PackageManifest::kFileName;
+            package.version = "0.0.0";
+            if (std::filesystem::exists(package_manifest)) {
+                std::string version = PackageManifest::read(package_manifest).version;
+                package.version = version.empty() ? package.version : PackageVersion::parse(version).str();
+            }
+            if (!std::filesystem::is_directory(package.directory) ||
+                !meetsAll(PackageVersion::parse(package.version))) {
+                throw std::runtime_error("No usable version of " + describe(name, wanted));
+            }
+        } else {
+            const auto& versions = versionsOf(name);
+            auto match = std::find_if(versions.begin(), versions.end(),
+                                      [&](const auto& version) { return meetsAll(version.first); });
+            if (match == versions.end()) {
+                throw std::runtime_error(
+                    (versions.empty() ? "Package not found in registry " + registry.string() + ": "
+                                      : std::string("No version in the registry satisfies all requirements: ")) +
+                    describe(name, wanted));
+            }
+            package.version = match->first.str();
+            package.source = "registry";
+            package.directory = registry / name / match->second;
+            package_manifest = package.directory / PackageManifest::kFileName;
+        }
+
+        auto previous = chosen.find(name);
+        if (previous != chosen.end()) {
+            if (previous->second.version == package.version && previous->second.source == package.source) {
+                continue;
+            }
+            // The old version's own requirements no longer apply
+            for (auto& [dependency, list] : requirements) {
+                size_t before = list.size();
+                list.erase(std::remove_if(list.begin(), list.end(),
+                                          [&](const Requirement& requirement) { return requirement.from == name; }),
+                           list.end());
+                if (list.size() != before) {
+                    pending.push_back(dependency);
+                }
+            }
+        }
+
+        if (std::filesystem::exists(package_manifest)) {
+            PackageManifest dependencies = PackageManifest::read(package_manifest);
+            for (const auto& dependency : dependencies.dependencies) {
+                package.dependencies.push_back(dependency.name);
+            }
+            require(name, package.directory, dependencies.dependencies);
+        }
+        chosen[name] = std::move(package);
+    }
+
+    // Packages only an abandoned version depended on are left out
+    std::vector<ResolvedPackage> resolved;
+    std::set<std::string> reachable;
+    std::deque<std::string> queue;
+    for (const auto& dependency : manifest.dependencies) {
+        queue.push_back(dependency.name);
+    }
+    while (!queue.empty()) {
+        std::string name = queue.front();
+        queue.pop_front();
+        if (!reachable.insert(name).second) {
+            continue;
+        }
+        for (const auto& dependency : chosen.at(name).dependencies) {
+            queue.push_back(dependency);
+        }
+    }
+    for (const auto& name : reachable) {
+        resolved.push_back(chosen.at(name));
+    }
+    return resolved;
+}
+
+std::filesystem::path PackageResolver::sourceDirectory(const LockedPackage& package) {
+    if (package.source.rfind("path+", 0) == 0) {
+        return (workspace / package.source.substr(5)).lexically_normal();
+    }
+    for (const auto& [version, directory] : versionsOf(package.name)) {
+        if (version.str() == package.version) {
+            return registry / package.name / directory;
+        }
+    }
+    throw std::runtime_error("Locked package " + package.name + " " + package.version + " is not in the registry " +
+                             registry.string());
+}
+
+bool PackageResolver::lockSatisfies(const PackageLock& lock, const PackageManifest& manifest) const {
+    for (const auto& dependency : manifest.dependencies) {
+        const LockedPackage* locked = lock.find(dependency.name);
+        if (!locked) {
+            return false;
+        }
+        if (!dependency.path.empty()) {
+            if (locked->source != pathSource((workspace / dependency.path).lexically_normal())) {
+                return false;
+            }
+        } else if (locked->source != "registry" ||
+                   !PackageVersion::parse(locked->version).satisfies(dependency.requirement)) {
+            return false;
+        }
+    }
+    for (const auto& package : lock.packages) {
+        for (const auto& dependency : package.dependencies) {
+            if (!lock.find(dependency)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <filesystem>
+#include "PackageManifest.hpp"
+
+// major.minor.patch; missing parts are 0 and pre-release tags are not used
+struct PackageVersion {
+    unsigned long major = 0;
+    unsigned long minor = 0;
+    unsigned long patch = 0;
+
+    // Throws on anything but one to three dot-separated numbers
+    static PackageVersion parse(const std::string& text);
+
+    // Whether this version meets a Cargo-style requirement: "1.2" and
+    // "^1.2" allow compatible updates (>=1.2.0, <2.0.0), "~1.2" patch
+    // updates only, "=1.2.3" that version, ">=1.2" anything newer, "*" any
+    bool satisfies(const std::string& requirement) const;
+
+    std::string str() const;
+
+    bool operator<(const PackageVersion& other) const;
+    bool operator==(const PackageVersion& other) const;
+};
+
+// A package picked by resolution, with the directory its files come from
+struct ResolvedPackage {
+    std::string name;
+    std::string version;
+    std::string source;
+    std::filesystem::path directory;
+    std::vector<std::string> dependencies;
+};
+
+// Picks one version of every package reachable from a manifest. Registry
+// packages live in <registry>/<name>/<version>/, each with an optional
+// vpm.toml of its own. Each package gets the newest version that meets
+// every requirement on it; a package whose requirements no version meets
+// is an error naming who asked for what.
+class PackageResolver {
+private:
+    std::filesystem::path workspace;
+    std::filesystem::path registry;
+    // Versions in the registry with their directory names, newest first
+    std::map<std::string, std::vector<std::pair<PackageVersion, std::string>>> available;
+
+    const std::vector<std::pair<PackageVersion, std::string>>& versionsOf(const std::string& name);
+
+    // "path+<dir>" source of a path dependency, relative to the workspace
+    std::string pathSource(const std::filesystem::path& directory) const;
+
+public:
+    PackageResolver(std::filesystem::path workspace_root, std::filesystem::path registry_dir);
+
+    std::vector<ResolvedPackage> resolve(const PackageManifest& manifest);
+
+    // Directory holding a locked package's files
+    std::filesystem::path sourceDirectory(const LockedPackage& package);
+
+    // Whether `lock` still pins every dependency of `manifest`, at a version
+    // meeting its requirement, along with everything those depend on
+    bool lockSatisfies(const PackageLock& lock, const PackageManifest& manifest) const;
+};
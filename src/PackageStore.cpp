@@ -0,0 +1,187 @@
+#include "PackageStore.hpp"
+#include "ScanCache.hpp"
+#include "SvLexer.hpp"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+extern "C" {
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/ioctl.h>
+#if defined(__linux__)
+    #include <linux/fs.h>
+#elif defined(__APPLE__)
+    #include <sys/clonefile.h>
+#endif
+}
+
+namespace {
+    // Written last into an installed package, holding its hash
+    constexpr const char* kInstalledMarker = ".vpm-package";
+
+    std::string hexHash(uint64_t hash) {
+        std::ostringstream out;
+        out << std::hex << std::setw(16) << std::setfill('0') << hash;
+        return out.str();
+    }
+
+    // A process-unique name beside `path` for publishing it by rename
+    std::filesystem::path tempPath(const std::filesystem::path& path) {
+        static std::atomic<size_t> counter{0};
+        std::filesystem::path temp = path;
+        temp += ".tmp-" + std::to_string(::getpid()) + "-" + std::to_string(counter++);
+        return temp;
+    }
+
+    bool tryReflink(const std::filesystem::path& object, const std::filesystem::path& target) {
+#if defined(__linux__) && defined(FICLONE)
+        int source = ::open(object.c_str(), O_RDONLY | O_CLOEXEC);
+        if (source < 0) {
+            return false;
+        }
+        int destination = ::open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0444);
+        bool cloned = destination >= 0 && ::ioctl(destination, FICLONE, source) == 0;
+        if (destination >= 0) {
+            ::close(destination);
+            if (!cloned) {
+                ::unlink(target.c_str());
+            }
+        }
+        ::close(source);
+        return cloned;
+#elif defined(__APPLE__)
+        return ::clonefile(object.c_str(), target.c_str(), 0) == 0;
+#else
+        return false;
+#endif
+    }
+}
+
+PackageStore::PackageStore(std::filesystem::path store_root) : root(std::move(store_root)) {}
+
+std::filesystem::path PackageStore::filePath(const std::string& hash) const {
+    return root / "files" / hash.substr(0, 2) / hash;
+}
+
+std::filesystem::path PackageStore::treePath(const std::string& hash) const {
+    return root / "trees" / hash;
+}
+
+bool PackageStore::contains(const std::string& hash) const {
+    return std::filesystem::exists(treePath(hash));
+}
+
+std::string PackageStore::addFile(const std::filesystem::path& file) const {
+    std::string hash;
+    {
+        MappedFile mapped(file);
+        hash = hexHash(ScanCache::hashContent(mapped.view()));
+    }
+    std::filesystem::path object = filePath(hash);
+    if (std::filesystem::exists(object)) {
+        return hash;
+    }
+
+    // Stored files are read-only: a workspace editing its hardlink in place
+    // would otherwise change the file for every other workspace
+    std::filesystem::create_directories(object.parent_path());
+    std::filesystem::path temp = tempPath(object);
+    std::filesystem::copy_file(file, temp);
+    std::filesystem::permissions(temp, std::filesystem::perms::owner_read | std::filesystem::perms::group_read |
+                                           std::filesystem::perms::others_read);
+    std::filesystem::rename(temp, object);
+    return hash;
+}
+
+std::string PackageStore::add(const std::filesystem::path& directory) const {
+    namespace fs = std::filesystem;
+    if (!fs::is_directory(directory)) {
+        throw std::runtime_error("Package directory does not exist: " + directory.string());
+    }
+    std::vector<std::pair<std::string, std::string>> entries;
+    for (auto it = fs::recursive_directory_iterator(directory); it != fs::recursive_directory_iterator(); ++it) {
+        std::string name = it->path().filename().string();
+        if (it->is_directory()) {
+            if (name.rfind(".", 0) == 0 || name.rfind("bazel-", 0) == 0) {
+                it.disable_recursion_pending();
+            }
+            continue;
+        }
+        if (!it->is_regular_file() || name == "BUILD" || name == "BUILD.bazel" || name == kInstalledMarker) {
+            continue;
+        }
+        entries.emplace_back(it->path().lexically_relative(directory).generic_string(), addFile(it->path()));
+    }
+    std::sort(entries.begin(), entries.end());
+
+    std::ostringstream tree;
+    for (const auto& [path, hash] : entries) {
+        tree << hash << " " << path << "\n";
+    }
+    std::string hash = "fnv1a64-" + hexHash(ScanCache::hashContent(tree.str()));
+
+    // Published after all its files, so a tree always has them
+    fs::path tree_path = treePath(hash);
+    if (!fs::exists(tree_path)) {
+        fs::create_directories(tree_path.parent_path());
+        fs::path temp = tempPath(tree_path);
+        {
+            std::ofstream out(temp, std::ios::trunc);
+            if (!out.is_open() || !(out << tree.str())) {
+                throw std::runtime_error("Failed to write package tree: " + tree_path.string());
+            }
+        }
+        fs::rename(temp, tree_path);
+    }
+    return hash;
+}
+
+void PackageStore::linkFile(const std::filesystem::path& object, const std::filesystem::path& target,
+                            LinkCounts& counts) {
+    if (::link(object.c_str(), target.c_str()) == 0) {
+        ++counts.hardlinked;
+        return;
+    }
+    // Across filesystems, or past the filesystem's link limit
+    if (tryReflink(object, target)) {
+        ++counts.reflinked;
+        return;
+    }
+    std::filesystem::copy_file(object, target);
+    ++counts.copied;
+}
+
+bool PackageStore::install(const std::string& hash, const std::filesystem::path& target, LinkCounts& counts) const {
+    std::filesystem::path marker = target / kInstalledMarker;
+    if (std::ifstream in(marker); in.is_open()) {
+        std::string installed;
+        std::getline(in, installed);
+        if (installed == hash) {
+            return false;
+        }
+    }
+
+    std::ifstream tree(treePath(hash));
+    if (!tree.is_open()) {
+        throw std::runtime_error("Package is not in the store: " + hash);
+    }
+    std::filesystem::remove_all(target);
+    std::filesystem::create_directories(target);
+    std::string line;
+    while (std::getline(tree, line)) {
+        size_t space = line.find(' ');
+        if (space == std::string::npos) {
+            throw std::runtime_error("Corrupt package tree: " + treePath(hash).string());
+        }
+        std::filesystem::path destination = target / line.substr(space + 1);
+        std::filesystem::create_directories(destination.parent_path());
+        linkFile(filePath(line.substr(0, space)), destination, counts);
+    }
+    std::ofstream(marker) << hash << "\n";
+    return true;
+}
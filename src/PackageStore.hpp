@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <atomic>
+#include <cstddef>
+
+// How installed files got into the workspace
+struct LinkCounts {
+    std::atomic<size_t> hardlinked{0};
+    std::atomic<size_t> reflinked{0};
+    std::atomic<size_t> copied{0};
+};
+
+// Machine-wide content-addressed store of package files. Every distinct
+// file content is stored once, read-only, under files/<hash>, and a package
+// version is a tree listing under trees/<hash> naming the file behind each
+// relative path. Workspaces get hardlinks to the stored files (reflinks or
+// copies across filesystems), so any number of workspaces and versions
+// sharing a file cost its disk space once. Objects are published by
+// rename, so concurrent installs never see partial entries.
+class PackageStore {
+private:
+    std::filesystem::path root;
+
+    std::filesystem::path filePath(const std::string& hash) const;
+    std::filesystem::path treePath(const std::string& hash) const;
+
+    // Stores one file if its content is not stored yet; returns its hash
+    std::string addFile(const std::filesystem::path& file) const;
+
+    // Puts `object` at `target` as cheaply as the filesystems allow
+    static void linkFile(const std::filesystem::path& object, const std::filesystem::path& target, LinkCounts& counts);
+
+public:
+    explicit PackageStore(std::filesystem::path store_root);
+
+    // Whether a package tree with this hash is fully stored
+    bool contains(const std::string& hash) const;
+
+    // Stores every file of `directory` except BUILD files, which vpm
+    // generates per workspace, and returns the package's content hash
+    std::string add(const std::filesystem::path& directory) const;
+
+    // Replaces `target` with the stored package `hash`. A marker records the
+    // hash, so an unchanged installed package is left alone; returns false
+    // in that case.
+    bool install(const std::string& hash, const std::filesystem::path& target, LinkCounts& counts) const;
+};
@@ -0,0 +1,132 @@
+#include "PlaceRouteLog.hpp"
+#include "SvLexer.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+    std::string_view trim(std::string_view text) {
+        size_t start = text.find_first_not_of(" \t\r");
+        if (start == std::string_view::npos) {
+            return {};
+        }
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(start, end - start + 1);
+    }
+
+    // Parses the number at the start of `text`; advances past it
+    bool readNumber(std::string_view& text, double& value) {
+        text = trim(text);
+        std::string number(text.substr(0, text.find_first_not_of("0123456789.")));
+        if (number.empty()) {
+            return false;
+        }
+        value = std::strtod(number.c_str(), nullptr);
+        text.remove_prefix(number.size());
+        return true;
+    }
+
+    // "Max frequency for clock 'clk': 123.45 MHz (PASS at 100.00 MHz)"
+    bool parseClock(std::string_view line, std::string& name, ClockTiming& timing) {
+        static const std::string_view marker = "Max frequency for clock '";
+        size_t start = line.find(marker);
+        if (start == std::string_view::npos) {
+            return false;
+        }
+        line.remove_prefix(start + marker.size());
+        size_t quote = line.find("':");
+        if (quote == std::string_view::npos) {
+            return false;
+        }
+        name = std::string(line.substr(0, quote));
+        line.remove_prefix(quote + 2);
+        if (!readNumber(line, timing.achieved_mhz)) {
+            return false;
+        }
+        timing.target_mhz = 0;
+        size_t at = line.find(" at ");
+        if (at != std::string_view::npos) {
+            line.remove_prefix(at + 4);
+            readNumber(line, timing.target_mhz);
+        }
+        return true;
+    }
+
+    // "SLICE_LUTX:   120/ 41000     0%"
+    bool parseResource(std::string_view line, std::string& name, ResourceUsage& usage) {
+        size_t colon = line.find(':');
+        size_t slash = line.find('/');
+        if (colon == std::string_view::npos || slash == std::string_view::npos || slash < colon) {
+            return false;
+        }
+        name = std::string(trim(line.substr(0, colon)));
+        std::string_view used = line.substr(colon + 1, slash - colon - 1);
+        std::string_view available = line.substr(slash + 1);
+        double used_value = 0;
+        double available_value = 0;
+        if (name.empty() || name.find(' ') != std::string::npos || !readNumber(used, used_value) ||
+            !readNumber(available, available_value)) {
+            return false;
+        }
+        usage.used = static_cast<size_t>(used_value);
+        usage.available = static_cast<size_t>(available_value);
+        return true;
+    }
+}
+
+PlaceRouteLog PlaceRouteLog::parse(std::string_view text) {
+    PlaceRouteLog log;
+    bool in_utilisation = false;
+    while (!text.empty()) {
+        size_t newline = text.find('\n');
+        std::string_view line = text.substr(0, newline);
+        text = newline == std::string_view::npos ? std::string_view() : text.substr(newline + 1);
+        if (line.rfind("Info:", 0) == 0) {
+            line.remove_prefix(5);
+        }
+
+        std::string name;
+        ClockTiming timing;
+        ResourceUsage usage;
+        if (line.find("Device utilisation:") != std::string_view::npos) {
+            in_utilisation = true;
+        } else if (in_utilisation && parseResource(line, name, usage)) {
+            log.resources[name] = usage;
+        } else if (parseClock(line, name, timing)) {
+            in_utilisation = false;
+            log.clocks[name] = timing;
+        } else if (!trim(line).empty()) {
+            in_utilisation = false;
+        }
+    }
+    return log;
+}
+
+PlaceRouteLog PlaceRouteLog::read(const std::filesystem::path& log) {
+    MappedFile mapped(log);
+    return parse(mapped.view());
+}
+
+double PlaceRouteLog::worstFmax() const {
+    double worst = 0;
+    for (const auto& [name, timing] : clocks) {
+        if (worst == 0 || timing.achieved_mhz < worst) {
+            worst = timing.achieved_mhz;
+        }
+    }
+    return worst;
+}
+
+bool PlaceRouteLog::meetsConstraints() const {
+    return std::all_of(clocks.begin(), clocks.end(), [](const auto& clock) {
+        return clock.second.target_mhz == 0 || clock.second.achieved_mhz >= clock.second.target_mhz;
+    });
+}
+
+size_t PlaceRouteLog::cellsUsed() const {
+    size_t used = 0;
+    for (const auto& [name, usage] : resources) {
+        used += usage.used;
+    }
+    return used;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <filesystem>
+#include <cstddef>
+
+// Timing of one clock domain after routing
+struct ClockTiming {
+    double achieved_mhz = 0;
+    // Constrained frequency; 0 if the clock has no constraint
+    double target_mhz = 0;
+};
+
+// Device usage of one resource type, e.g. SLICE_LUTX
+struct ResourceUsage {
+    size_t used = 0;
+    size_t available = 0;
+};
+
+// What a nextpnr run reported in its log: the achieved frequency of each
+// clock and the device utilisation. nextpnr prints timing after placement
+// and again after routing; the last report of each clock wins.
+class PlaceRouteLog {
+private:
+    std::map<std::string, ClockTiming> clocks;
+    std::map<std::string, ResourceUsage> resources;
+
+public:
+    static PlaceRouteLog parse(std::string_view text);
+
+    // Throws if `log` cannot be read
+    static PlaceRouteLog read(const std::filesystem::path& log);
+
+    const std::map<std::string, ClockTiming>& getClocks() const { return clocks; }
+    const std::map<std::string, ResourceUsage>& getResources() const { return resources; }
+
+    // Achieved frequency of the slowest clock; 0 without any clock
+    double worstFmax() const;
+
+    // True if every constrained clock meets its constraint
+    bool meetsConstraints() const;
+
+    // Used cells over all resource types, as a tie-breaker between runs
+    size_t cellsUsed() const;
+};
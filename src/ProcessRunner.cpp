@@ -0,0 +1,308 @@
+#include "ProcessRunner.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <mutex>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+extern "C" {
+    #include <spawn.h>
+    #include <poll.h>
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <unistd.h>
+    #include <sys/wait.h>
+    #include <sys/resource.h>
+
+    extern char** environ;
+}
+
+namespace {
+    // Time a process gets to exit after SIGTERM before it is killed
+    constexpr std::chrono::seconds kKillGrace(2);
+
+    // Serializes echoed output of concurrent jobs
+    std::mutex echo_mutex;
+
+    // One output pipe of a child and where its data goes
+    struct OutputStream {
+        int fd = -1;
+        // Our descriptor the data is echoed to
+        int target = STDOUT_FILENO;
+        std::string* capture = nullptr;
+        // Echoed once complete, so prefixed lines of concurrent jobs do not mix
+        std::string partial_line;
+    };
+
+    // Creates a pipe whose ends are not inherited by children spawned
+    // concurrently from other threads
+    void openPipe(int fds[2]) {
+#ifdef __linux__
+        if (::pipe2(fds, O_CLOEXEC) != 0) {
+            throw std::runtime_error(std::string("Failed to create pipe: ") + std::strerror(errno));
+        }
+#else
+        // Without pipe2 there is a short window where another thread's
+        // child can inherit these ends; it only delays end of file
+        if (::pipe(fds) != 0) {
+            throw std::runtime_error(std::string("Failed to create pipe: ") + std::strerror(errno));
+        }
+        ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+    }
+
+    void writeAll(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t count = ::write(fd, data, size);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                return;
+            }
+            data += count;
+            size -= static_cast<size_t>(count);
+        }
+    }
+
+    void echo(OutputStream& stream, const char* data, size_t size, const std::string& prefix) {
+        if (prefix.empty()) {
+            std::lock_guard<std::mutex> lock(echo_mutex);
+            writeAll(stream.target, data, size);
+            return;
+        }
+
+        stream.partial_line.append(data, size);
+        size_t end = stream.partial_line.rfind('\n');
+        if (end == std::string::npos) {
+            return;
+        }
+        std::string lines;
+        size_t begin = 0;
+        while (begin <= end) {
+            size_t newline = stream.partial_line.find('\n', begin);
+            lines += prefix;
+            lines.append(stream.partial_line, begin, newline + 1 - begin);
+            begin = newline + 1;
+        }
+        stream.partial_line.erase(0, end + 1);
+        std::lock_guard<std::mutex> lock(echo_mutex);
+        writeAll(stream.target, lines.data(), lines.size());
+    }
+
+    // Reads what is available and closes the pipe at end of file. Returns
+    // false once nothing more can be read right now.
+    bool readAvailable(OutputStream& stream, const ProcessOptions& options) {
+        char buffer[65536];
+        ssize_t count = ::read(stream.fd, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR) {
+            return true;
+        }
+        if (count < 0 && errno == EAGAIN) {
+            return false;
+        }
+        if (count <= 0) {
+            ::close(stream.fd);
+            stream.fd = -1;
+            return false;
+        }
+        if (stream.capture) {
+            stream.capture->append(buffer, static_cast<size_t>(count));
+        }
+        if (options.echo) {
+            echo(stream, buffer, static_cast<size_t>(count), options.prefix);
+        }
+        return true;
+    }
+
+    double seconds(const struct timeval& time) {
+        return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_usec) / 1e6;
+    }
+}
+
+ProcessResult ProcessRunner::run(const std::vector<std::string>& argv, const ProcessOptions& options) {
+    if (argv.empty()) {
+        throw std::runtime_error("Failed to execute: empty command");
+    }
+
+    ProcessResult result;
+    OutputStream streams[2];
+    streams[0].target = STDOUT_FILENO;
+    streams[1].target = STDERR_FILENO;
+    if (options.capture) {
+        streams[0].capture = &result.output;
+        streams[1].capture = &result.errors;
+    }
+
+    int out_pipe[2];
+    int err_pipe[2];
+    openPipe(out_pipe);
+    try {
+        openPipe(err_pipe);
+    } catch (...) {
+        ::close(out_pipe[0]);
+        ::close(out_pipe[1]);
+        throw;
+    }
+
+    std::vector<char*> args;
+    for (const auto& arg : argv) {
+        args.push_back(const_cast<char*>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    ::posix_spawn_file_actions_init(&actions);
+    ::posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+    ::posix_spawn_file_actions_adddup2(&actions, err_pipe[1], STDERR_FILENO);
+
+    // Anything already written by us must appear before the child's output
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = 0;
+    int spawn_error = ::posix_spawnp(&pid, args[0], &actions, nullptr, args.data(), environ);
+    ::posix_spawn_file_actions_destroy(&actions);
+    ::close(out_pipe[1]);
+    ::close(err_pipe[1]);
+    if (spawn_error != 0) {
+        ::close(out_pipe[0]);
+        ::close(err_pipe[0]);
+        throw std::runtime_error("Failed to execute " + argv[0] + ": " + std::strerror(spawn_error));
+    }
+    streams[0].fd = out_pipe[0];
+    streams[1].fd = err_pipe[0];
+    for (auto& stream : streams) {
+        ::fcntl(stream.fd, F_SETFL, ::fcntl(stream.fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    // Output is pumped until the process itself exits; descendants that
+    // keep the pipes open (e.g. a daemonized server) are not waited for
+    int status = 0;
+    struct rusage usage = {};
+    bool terminating = false;
+    bool killed = false;
+    std::chrono::steady_clock::time_point kill_deadline;
+    while (true) {
+        struct pollfd fds[2];
+        nfds_t count = 0;
+        for (auto& stream : streams) {
+            if (stream.fd >= 0) {
+                fds[count++] = {stream.fd, POLLIN, 0};
+            }
+        }
+        // Once both pipes are closed the process is about to exit
+        ::poll(fds, count, count > 0 ? 50 : 5);
+        for (auto& stream : streams) {
+            if (stream.fd >= 0) {
+                readAvailable(stream, options);
+            }
+        }
+
+        pid_t done = ::wait4(pid, &status, WNOHANG, &usage);
+        if (done == pid || (done < 0 && errno != EINTR)) {
+            break;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (!terminating) {
+            result.timed_out = options.timeout.count() > 0 && now - start >= options.timeout;
+            result.cancelled = options.cancel && options.cancel->load();
+            if (result.timed_out || result.cancelled) {
+                ::kill(pid, SIGTERM);
+                terminating = true;
+                kill_deadline = now + kKillGrace;
+            }
+        } else if (!killed && now >= kill_deadline) {
+            ::kill(pid, SIGKILL);
+            killed = true;
+        }
+    }
+    result.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Whatever the process wrote before exiting is still in the pipes
+    for (auto& stream : streams) {
+        while (stream.fd >= 0 && readAvailable(stream, options)) {
+        }
+        if (stream.fd >= 0) {
+            ::close(stream.fd);
+        }
+        if (options.echo && !stream.partial_line.empty()) {
+            stream.partial_line += '\n';
+            echo(stream, "", 0, options.prefix);
+        }
+    }
+
+    if (WIFEXITED(status)) {
+        result.exit_code = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        result.exit_code = 128 + WTERMSIG(status);
+    }
+    if (result.timed_out) {
+        result.exit_code = 124;
+    } else if (result.cancelled) {
+        result.exit_code = 125;
+    }
+    result.user_seconds = seconds(usage.ru_utime);
+    result.system_seconds = seconds(usage.ru_stime);
+#ifdef __APPLE__
+    result.peak_rss_kb = usage.ru_maxrss / 1024;
+#else
+    result.peak_rss_kb = usage.ru_maxrss;
+#endif
+    return result;
+}
+
+ProcessResult ProcessRunner::run(const std::string& command, const ProcessOptions& options) {
+    return run(splitCommand(command), options);
+}
+
+std::vector<std::string> ProcessRunner::splitCommand(const std::string& command) {
+    std::vector<std::string> args;
+    std::string current;
+    bool in_word = false;
+    for (size_t i = 0; i < command.size(); ++i) {
+        char c = command[i];
+        if (c == ' ' || c == '\t' || c == '\n') {
+            if (in_word) {
+                args.push_back(std::move(current));
+                current.clear();
+                in_word = false;
+            }
+            continue;
+        }
+
+        in_word = true;
+        if (c == '\'') {
+            size_t end = command.find('\'', i + 1);
+            if (end == std::string::npos) {
+                throw std::runtime_error("Unterminated quote in command: " + command);
+            }
+            current.append(command, i + 1, end - i - 1);
+            i = end;
+        } else if (c == '"') {
+            for (++i; i < command.size() && command[i] != '"'; ++i) {
+                // Inside double quotes a backslash only escapes these
+                if (command[i] == '\\' && i + 1 < command.size() && std::strchr("\"\\$`", command[i + 1])) {
+                    ++i;
+                }
+                current += command[i];
+            }
+            if (i >= command.size()) {
+                throw std::runtime_error("Unterminated quote in command: " + command);
+            }
+        } else if (c == '\\' && i + 1 < command.size()) {
+            current += command[++i];
+        } else {
+            current += c;
+        }
+    }
+    if (in_word) {
+        args.push_back(std::move(current));
+    }
+    return args;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+
+// How a child process is run and what happens to its output
+struct ProcessOptions {
+    // Terminate the process after this long; zero means no limit
+    std::chrono::milliseconds timeout{0};
+    // Copy output to our stdout/stderr as it arrives
+    bool echo = true;
+    // Keep output in the result
+    bool capture = false;
+    // Prepended to every echoed line, so concurrent jobs stay readable;
+    // without one, output is passed through unchanged
+    std::string prefix;
+    // Terminates the process once set, e.g. when a sibling job already won
+    const std::atomic<bool>* cancel = nullptr;
+};
+
+struct ProcessResult {
+    // Exit status, 128 + signal number if killed by a signal, 124 on
+    // timeout and 125 if cancelled, following the shell's conventions
+    int exit_code = 0;
+    bool timed_out = false;
+    bool cancelled = false;
+    // Captured output, if requested
+    std::string output;
+    std::string errors;
+    double wall_seconds = 0;
+    double user_seconds = 0;
+    double system_seconds = 0;
+    // Peak resident set size of the process itself, not its descendants
+    long peak_rss_kb = 0;
+};
+
+// Runs tools directly through posix_spawn instead of a shell. Output is read
+// through pipes, so it can be captured and prefixed, and resource usage is
+// taken from the child's own rusage. Safe to call from several threads at
+// once, which is how independent jobs run concurrently.
+class ProcessRunner {
+public:
+    // Runs `argv` (searched in PATH) and waits for it. Throws if the
+    // program cannot be started.
+    static ProcessResult run(const std::vector<std::string>& argv, const ProcessOptions& options = {});
+
+    // Runs a command line, split by splitCommand()
+    static ProcessResult run(const std::string& command, const ProcessOptions& options = {});
+
+    // Splits a command line into arguments the way the shell would for
+    // plain words and single- or double-quoted strings; no expansions
+    static std::vector<std::string> splitCommand(const std::string& command);
+};
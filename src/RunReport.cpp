@@ -0,0 +1,130 @@
+#include "RunReport.hpp"
+#include "ProcessRunner.hpp"
+#include <fstream>
+#include <stdexcept>
+#include <cstdio>
+
+extern "C" {
+    #include <sys/resource.h>
+}
+
+namespace {
+    std::string jsonString(const std::string& value) {
+        std::string out = "\"";
+        for (char c : value) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char escape[8];
+                        std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                        out += escape;
+                    } else {
+                        out += c;
+                    }
+            }
+        }
+        return out + "\"";
+    }
+
+    std::string jsonSeconds(double seconds) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.3f", seconds);
+        return buffer;
+    }
+
+    void processUsage(double& user, double& system, long& peak_rss_kb) {
+        struct rusage usage = {};
+        ::getrusage(RUSAGE_SELF, &usage);
+        user = static_cast<double>(usage.ru_utime.tv_sec) + static_cast<double>(usage.ru_utime.tv_usec) / 1e6;
+        system = static_cast<double>(usage.ru_stime.tv_sec) + static_cast<double>(usage.ru_stime.tv_usec) / 1e6;
+#ifdef __APPLE__
+        peak_rss_kb = usage.ru_maxrss / 1024;
+#else
+        peak_rss_kb = usage.ru_maxrss;
+#endif
+    }
+}
+
+RunReport::RunReport(std::string vpm_command)
+    : invocation(std::move(vpm_command)), start(std::chrono::steady_clock::now()) {}
+
+std::filesystem::path RunReport::defaultPath(const std::filesystem::path& workspace_root) {
+    return workspace_root / ".vpm" / "report.json";
+}
+
+void RunReport::add(StageRecord record) {
+    std::lock_guard<std::mutex> lock(mutex);
+    stages.push_back(std::move(record));
+}
+
+void RunReport::add(const std::string& name, const std::string& command, const ProcessResult& result) {
+    StageRecord record;
+    record.name = name;
+    record.command = command;
+    record.exit_code = result.exit_code;
+    record.timed_out = result.timed_out;
+    record.wall_seconds = result.wall_seconds;
+    record.user_seconds = result.user_seconds;
+    record.system_seconds = result.system_seconds;
+    record.peak_rss_kb = result.peak_rss_kb;
+    add(std::move(record));
+}
+
+void RunReport::write(const std::filesystem::path& path) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!path.parent_path().empty()) {
+        std::filesystem::create_directories(path.parent_path());
+    }
+    std::filesystem::path temp_file = path;
+    temp_file += ".tmp";
+    {
+        std::ofstream file(temp_file, std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to write report: " + temp_file.string());
+        }
+
+        file << "{\n  \"command\": " << jsonString(invocation) << ",\n"
+             << "  \"wall_seconds\": " << jsonSeconds(total) << ",\n"
+             << "  \"stages\": [";
+        for (size_t i = 0; i < stages.size(); ++i) {
+            const StageRecord& stage = stages[i];
+            file << (i == 0 ? "\n" : ",\n")
+                 << "    {\"name\": " << jsonString(stage.name)
+                 << ", \"command\": " << jsonString(stage.command)
+                 << ", \"cached\": " << (stage.cached ? "true" : "false")
+                 << ", \"exit_code\": " << stage.exit_code
+                 << ", \"timed_out\": " << (stage.timed_out ? "true" : "false")
+                 << ", \"wall_seconds\": " << jsonSeconds(stage.wall_seconds)
+                 << ", \"user_seconds\": " << jsonSeconds(stage.user_seconds)
+                 << ", \"system_seconds\": " << jsonSeconds(stage.system_seconds)
+                 << ", \"peak_rss_kb\": " << stage.peak_rss_kb << "}";
+        }
+        file << (stages.empty() ? "]\n}\n" : "\n  ]\n}\n");
+    }
+    std::filesystem::rename(temp_file, path);
+}
+
+StageTimer::StageTimer(RunReport& run_report, std::string name)
+    : report(run_report), start(std::chrono::steady_clock::now()) {
+    record.name = std::move(name);
+    processUsage(start_user, start_system, record.peak_rss_kb);
+}
+
+void StageTimer::finish(int exit_code, bool cached) {
+    double user = 0;
+    double system = 0;
+    processUsage(user, system, record.peak_rss_kb);
+    record.exit_code = exit_code;
+    record.cached = cached;
+    record.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    record.user_seconds = user - start_user;
+    record.system_seconds = system - start_system;
+    report.add(record);
+}
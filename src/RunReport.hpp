@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <mutex>
+#include <chrono>
+
+struct ProcessResult;
+
+// Timing of one stage of a vpm command
+struct StageRecord {
+    std::string name;
+    // Empty for work vpm does itself
+    std::string command;
+    bool cached = false;
+    int exit_code = 0;
+    bool timed_out = false;
+    double wall_seconds = 0;
+    double user_seconds = 0;
+    double system_seconds = 0;
+    long peak_rss_kb = 0;
+};
+
+// Collects per-stage wall time, CPU time and peak RSS of one vpm command and
+// writes them as JSON for tracking build performance over time. Stages may
+// be recorded from several threads at once.
+class RunReport {
+private:
+    std::string invocation;
+    std::vector<StageRecord> stages;
+    std::chrono::steady_clock::time_point start;
+    mutable std::mutex mutex;
+
+public:
+    explicit RunReport(std::string vpm_command);
+
+    // Default report location inside a workspace
+    static std::filesystem::path defaultPath(const std::filesystem::path& workspace_root);
+
+    void add(StageRecord record);
+
+    // Records a tool run
+    void add(const std::string& name, const std::string& command, const ProcessResult& result);
+
+    // Writes the report, replacing any previous one
+    void write(const std::filesystem::path& path) const;
+};
+
+// Measures a stage vpm runs in-process, from construction until finish().
+// CPU time and peak RSS are those of the whole vpm process.
+class StageTimer {
+private:
+    RunReport& report;
+    StageRecord record;
+    std::chrono::steady_clock::time_point start;
+    double start_user = 0;
+    double start_system = 0;
+
+public:
+    StageTimer(RunReport& run_report, std::string name);
+
+    void finish(int exit_code = 0, bool cached = false);
+};
@@ -0,0 +1,264 @@
+#include "ScanCache.hpp"
+#include "SvLexer.hpp"
+#include <fstream>
+#include <sstream>
+#include <charconv>
+#include <vector>
+
+namespace {
+    // Bump whenever the file format or SvScanner's results change
+    constexpr std::string_view kCacheHeader = "vpm-scan-cache 4";
+
+    // Splits off the next space-separated field of a cache line
+    std::string_view nextField(std::string_view& line) {
+        size_t space = line.find(' ');
+        std::string_view field = line.substr(0, space);
+        line = space == std::string_view::npos ? std::string_view() : line.substr(space + 1);
+        return field;
+    }
+
+    template <typename T>
+    bool parseNumber(std::string_view field, T& value, int base = 10) {
+        auto [ptr, ec] = std::from_chars(field.data(), field.data() + field.size(), value, base);
+        return ec == std::errc() && ptr == field.data() + field.size();
+    }
+}
+
+ScanCache::ScanCache(const std::filesystem::path& cache_path, SvPreprocessorOptions options)
+    : cache_file(cache_path), includes(std::move(options)) {
+    std::ostringstream out;
+    out << kCacheHeader << " " << std::hex << includes.options().fingerprint();
+    header = out.str();
+}
+
+std::filesystem::path ScanCache::defaultPath(const std::filesystem::path& workspace_root) {
+    return workspace_root / ".vpm" / "cache";
+}
+
+uint64_t ScanCache::hashContent(std::string_view content) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : content) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+void ScanCache::load() {
+    FileStamp cache_stamp = FileStamp::of(cache_file);
+    if (!cache_stamp.exists() || cache_stamp.size == 0) {
+        return;
+    }
+    loaded_mtime_ns = cache_stamp.mtime_ns;
+
+    MappedFile mapped(cache_file);
+    std::string_view data = mapped.view();
+
+    auto nextLine = [&data]() {
+        size_t newline = data.find('\n');
+        std::string_view line = data.substr(0, newline);
+        data = newline == std::string_view::npos ? std::string_view() : data.substr(newline + 1);
+        return line;
+    };
+
+    if (nextLine() != header) {
+        // Different format version or preprocessor options; rebuild from scratch
+        dirty = true;
+        return;
+    }
+
+    Entry* entry = nullptr;
+    bool corrupt = false;
+    while (!data.empty() && !corrupt) {
+        std::string_view line = nextLine();
+        std::string_view tag = nextField(line);
+
+        if (tag == "F") {
+            Entry parsed;
+            if (!parseNumber(nextField(line), parsed.mtime_ns) ||
+                !parseNumber(nextField(line), parsed.size) ||
+                !parseNumber(nextField(line), parsed.hash, 16) || line.empty()) {
+                corrupt = true;
+                continue;
+            }
+            entry = &(entries[std::string(line)] = std::move(parsed));
+        } else if (tag == "H" && entry) {
+            FileStamp stamp;
+            if (!parseNumber(nextField(line), stamp.mtime_ns) || !parseNumber(nextField(line), stamp.size) ||
+                line.empty()) {
+                corrupt = true;
+                continue;
+            }
+            entry->scan->includes.emplace_back(line);
+            entry->include_stamps.push_back(stamp);
+        } else if (tag == "M" && entry) {
+            SvModuleDecl decl;
+            if (!parseNumber(nextField(line), decl.line) || line.empty()) {
+                corrupt = true;
+                continue;
+            }
+            decl.name = std::string(line);
+            entry->scan->modules.push_back(std::move(decl));
+        } else if (tag == "I" && entry && !entry->scan->modules.empty()) {
+            SvInstance instance;
+            int parameterized = 0;
+            if (!parseNumber(nextField(line), instance.line) || !parseNumber(nextField(line), parameterized)) {
+                corrupt = true;
+                continue;
+            }
+            instance.parameterized = parameterized != 0;
+            instance.module_name = std::string(nextField(line));
+            instance.instance_name = std::string(line);
+            entry->scan->modules.back().instances.push_back(std::move(instance));
+        } else if (!tag.empty()) {
+            corrupt = true;
+        }
+    }
+
+    if (corrupt) {
+        // Truncated or corrupt cache: keep nothing rather than trust a partial entry
+        entries.clear();
+        dirty = true;
+    }
+}
+
+void ScanCache::save() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (!it->second.used) {
+            it = entries.erase(it);
+            dirty = true;
+        } else {
+            ++it;
+        }
+    }
+    if (!dirty) {
+        return;
+    }
+
+    std::filesystem::create_directories(cache_file.parent_path());
+    std::filesystem::path temp_file = cache_file;
+    temp_file += ".tmp";
+    {
+        std::ofstream file(temp_file, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to write scan cache: " + temp_file.string());
+        }
+
+        file << header << "\n";
+        for (const auto& [path, entry] : entries) {
+            file << "F " << entry.mtime_ns << " " << entry.size << " " << std::hex << entry.hash << std::dec
+                 << " " << path << "\n";
+            for (size_t i = 0; i < entry.scan->includes.size(); ++i) {
+                file << "H " << entry.include_stamps[i].mtime_ns << " " << entry.include_stamps[i].size << " "
+                     << entry.scan->includes[i] << "\n";
+            }
+            for (const auto& module : entry.scan->modules) {
+                file << "M " << module.line << " " << module.name << "\n";
+                for (const auto& instance : module.instances) {
+                    file << "I " << instance.line << " " << instance.parameterized << " " << instance.module_name << " "
+                         << instance.instance_name << "\n";
+                }
+            }
+        }
+    }
+    // Atomic replace, so an interrupted run never leaves a half-written cache
+    std::filesystem::rename(temp_file, cache_file);
+    dirty = false;
+}
+
+SvScanPtr ScanCache::scan(const std::filesystem::path& file) {
+    std::string key = file.is_absolute() ? file.string() : std::filesystem::absolute(file).string();
+    FileStamp stamp = FileStamp::of(file);
+    const int64_t mtime_ns = stamp.mtime_ns;
+    const uint64_t size = stamp.size;
+    if (!stamp.exists()) {
+        // Let the scanner report the error
+        return std::make_shared<SvScanResult>(SvScanner::scanFile(file, &includes));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end() && it->second.mtime_ns == mtime_ns && it->second.size == size &&
+            mtime_ns < loaded_mtime_ns && includesUnchanged(it->second)) {
+            it->second.used = true;
+            ++hits;
+            return it->second.scan;
+        }
+    }
+
+    MappedFile mapped(file);
+    uint64_t hash = hashContent(mapped.view());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end() && it->second.hash == hash && it->second.size == size &&
+            includesUnchanged(it->second)) {
+            it->second.mtime_ns = mtime_ns;
+            it->second.used = true;
+            dirty = true;
+            ++hits;
+            return it->second.scan;
+        }
+    }
+
+    auto result = std::make_shared<SvScanResult>(SvScanner::scan(mapped.view(), file, &includes));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = entries[key];
+    entry.mtime_ns = mtime_ns;
+    entry.size = size;
+    entry.hash = hash;
+    entry.scan = result;
+    entry.include_stamps.clear();
+    for (const auto& include : result->includes) {
+        entry.include_stamps.push_back(includeStamp(include));
+    }
+    entry.used = true;
+    dirty = true;
+    ++misses;
+    return result;
+}
+
+void ScanCache::invalidateInclude(const std::filesystem::path& path) {
+    std::string key = std::filesystem::absolute(path).lexically_normal().string();
+    includes.invalidate(key);
+    std::lock_guard<std::mutex> lock(mutex);
+    include_stats.erase(key);
+}
+
+FileStamp ScanCache::includeStamp(const std::string& path) {
+    auto it = include_stats.find(path);
+    if (it == include_stats.end()) {
+        it = include_stats.emplace(path, FileStamp::of(path.c_str())).first;
+    }
+    return it->second;
+}
+
+bool ScanCache::includesUnchanged(const Entry& entry) {
+    for (size_t i = 0; i < entry.scan->includes.size(); ++i) {
+        // Same racy-mtime rule as for the file itself
+        FileStamp stamp = includeStamp(entry.scan->includes[i]);
+        if (stamp != entry.include_stamps[i] || !stamp.exists() || stamp.mtime_ns >= loaded_mtime_ns) {
+            return false;
+        }
+    }
+    return true;
+}
+
+StampedPaths ScanCache::stamps() {
+    std::lock_guard<std::mutex> lock(mutex);
+    StampedPaths stamped;
+    for (const auto& [path, entry] : entries) {
+        if (!entry.used) {
+            continue;
+        }
+        stamped.emplace_back(path, FileStamp{entry.mtime_ns, entry.size});
+        for (size_t i = 0; i < entry.scan->includes.size(); ++i) {
+            stamped.emplace_back(entry.scan->includes[i], entry.include_stamps[i]);
+        }
+    }
+    return stamped;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <filesystem>
+#include <mutex>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include "SvScanner.hpp"
+#include "SvPreprocessor.hpp"
+#include "FileStamp.hpp"
+
+// On-disk cache of SvScanner results, keyed by file path. An entry is reused
+// without reading the file when its mtime and size are unchanged, or after
+// reading it when the content hash still matches (e.g. after a touch or a
+// branch switch that restored the same bytes), and as long as the files it
+// includes are unchanged too. Results depend on the preprocessor options, so
+// a cache written under different ones is discarded on load. Safe to query
+// from several threads at once.
+class ScanCache {
+private:
+    struct Entry {
+        int64_t mtime_ns = 0;
+        uint64_t size = 0;
+        uint64_t hash = 0;
+        std::shared_ptr<SvScanResult> scan = std::make_shared<SvScanResult>();
+        // Stamp of each of scan.includes when it was scanned
+        std::vector<FileStamp> include_stamps;
+        bool used = false;
+    };
+
+    std::filesystem::path cache_file;
+    std::string header;
+    SvIncludeCache includes;
+    // Memoized stat of included files: many sources share each header
+    std::unordered_map<std::string, FileStamp> include_stats;
+    std::unordered_map<std::string, Entry> entries;
+    // mtime of the cache when it was loaded; files modified at or after it may
+    // have changed within the same timestamp tick and are verified by hash
+    int64_t loaded_mtime_ns = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+    bool dirty = false;
+    std::mutex mutex;
+
+    // Current stamp of an included file. Called with `mutex` held.
+    FileStamp includeStamp(const std::string& path);
+
+    // True if none of the entry's includes changed since it was scanned.
+    // Called with `mutex` held.
+    bool includesUnchanged(const Entry& entry);
+
+public:
+    explicit ScanCache(const std::filesystem::path& cache_path, SvPreprocessorOptions options = {});
+
+    // Default cache location inside a workspace
+    static std::filesystem::path defaultPath(const std::filesystem::path& workspace_root);
+
+    // 64-bit FNV-1a hash of file content
+    static uint64_t hashContent(std::string_view content);
+
+    // Load the cache file; a missing or unreadable cache starts empty
+    void load();
+
+    // Write the cache back if anything changed, dropping entries for files
+    // that were not looked up during this run
+    void save();
+
+    // Returns the scan of `file`, served from the cache when it is still
+    // valid. A hit shares the cached result rather than copying it.
+    SvScanPtr scan(const std::filesystem::path& file);
+
+    // Forgets what is known about an included file that changed on disk, for
+    // long-running callers; its includers must be scanned again
+    void invalidateInclude(const std::filesystem::path& path);
+
+    // Every file looked up during this run and each file it includes, with
+    // the stamp its cached result is valid for
+    StampedPaths stamps();
+
+    size_t getHits() const { return hits; }
+    size_t getMisses() const { return misses; }
+};
@@ -0,0 +1,145 @@
+#include "StageCache.hpp"
+#include "ScanCache.hpp"
+#include "SvLexer.hpp"
+#include "ProcessRunner.hpp"
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstdlib>
+
+extern "C" {
+    #include <unistd.h>
+}
+
+namespace {
+    // Bump whenever the key layout changes
+    constexpr const char* kStageKeyVersion = "vpm-stage 1";
+
+    std::string hexKey(uint64_t hash) {
+        std::ostringstream out;
+        out << std::hex << std::setw(16) << std::setfill('0') << hash;
+        return out.str();
+    }
+
+    // Resolves `tool` through PATH like the shell would
+    std::filesystem::path findExecutable(const std::string& tool) {
+        if (tool.find('/') != std::string::npos) {
+            return tool;
+        }
+        const char* path_env = std::getenv("PATH");
+        std::istringstream dirs(path_env ? path_env : "");
+        std::string dir;
+        while (std::getline(dirs, dir, ':')) {
+            std::filesystem::path candidate = std::filesystem::path(dir.empty() ? "." : dir) / tool;
+            if (::access(candidate.c_str(), X_OK) == 0) {
+                return candidate;
+            }
+        }
+        return {};
+    }
+}
+
+StageCache::StageCache(const std::filesystem::path& cache_path) : cache_dir(cache_path) {}
+
+std::filesystem::path StageCache::defaultPath(const std::filesystem::path& workspace_root) {
+    return workspace_root / ".vpm" / "stages";
+}
+
+const std::string& StageCache::toolVersion(const std::string& tool) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = tool_versions.find(tool);
+    if (it != tool_versions.end()) {
+        return it->second;
+    }
+
+    std::string version;
+    std::filesystem::path executable = findExecutable(tool);
+    if (!executable.empty()) {
+        std::error_code ec;
+        auto size = std::filesystem::file_size(executable, ec);
+        auto mtime = std::filesystem::last_write_time(executable, ec);
+        version = std::filesystem::canonical(executable, ec).string() + " " + std::to_string(size) + " " +
+                  std::to_string(mtime.time_since_epoch().count()) + "\n";
+
+        // A tool that hangs on --version must not hang every build
+        ProcessOptions options;
+        options.echo = false;
+        options.capture = true;
+        options.timeout = std::chrono::seconds(30);
+        try {
+            ProcessResult result = ProcessRunner::run({executable.string(), "--version"}, options);
+            version += result.output + result.errors;
+        } catch (const std::exception&) {
+            // Identified by the executable alone
+        }
+    }
+    return tool_versions.emplace(tool, std::move(version)).first->second;
+}
+
+std::string StageCache::key(const Stage& stage) {
+    std::ostringstream manifest;
+    manifest << kStageKeyVersion << "\n"
+             << "tool " << stage.tool << "\n" << toolVersion(stage.tool) << "\n"
+             << "command " << stage.command << "\n";
+    for (const auto& input : stage.inputs) {
+        MappedFile mapped(input);
+        manifest << "input " << input.filename().string() << " " << ScanCache::hashContent(mapped.view()) << "\n";
+    }
+    for (const auto& output : stage.outputs) {
+        manifest << "output " << output.filename().string() << "\n";
+    }
+    return hexKey(ScanCache::hashContent(manifest.str()));
+}
+
+bool StageCache::restore(const Stage& stage, const std::filesystem::path& entry) const {
+    for (const auto& output : stage.outputs) {
+        if (!std::filesystem::exists(entry / output.filename())) {
+            return false;
+        }
+    }
+    for (const auto& output : stage.outputs) {
+        if (!output.parent_path().empty()) {
+            std::filesystem::create_directories(output.parent_path());
+        }
+        std::filesystem::copy_file(entry / output.filename(), output,
+                                   std::filesystem::copy_options::overwrite_existing);
+    }
+    return true;
+}
+
+void StageCache::store(const Stage& stage, const std::filesystem::path& entry) const {
+    std::filesystem::path temp_entry = entry;
+    temp_entry += ".tmp-" + std::to_string(::getpid());
+    std::filesystem::remove_all(temp_entry);
+    std::filesystem::create_directories(temp_entry);
+    for (const auto& output : stage.outputs) {
+        if (!std::filesystem::exists(output)) {
+            std::filesystem::remove_all(temp_entry);
+            throw std::runtime_error("Stage '" + stage.name + "' did not produce: " + output.string());
+        }
+        std::filesystem::copy_file(output, temp_entry / output.filename());
+    }
+
+    // Publish the complete entry in one rename; a concurrent run that got
+    // there first already stored identical outputs
+    std::error_code ec;
+    std::filesystem::rename(temp_entry, entry, ec);
+    if (ec) {
+        std::filesystem::remove_all(temp_entry);
+    }
+}
+
+int StageCache::run(const Stage& stage, const std::function<int(const std::string&)>& execute, bool& cached) {
+    std::filesystem::path entry = cache_dir / key(stage);
+    cached = restore(stage, entry);
+    if (cached) {
+        return 0;
+    }
+
+    int exit_code = execute(stage.command);
+    if (exit_code == 0) {
+        std::filesystem::create_directories(cache_dir);
+        store(stage, entry);
+    }
+    return exit_code;
+}
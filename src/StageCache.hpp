@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <cstdint>
+
+// One step of a tool pipeline: a command that reads `inputs` and writes `outputs`
+struct Stage {
+    std::string name;
+    // Executable whose version is part of the stage key, e.g. "yosys"
+    std::string tool;
+    std::string command;
+    std::vector<std::filesystem::path> inputs;
+    std::vector<std::filesystem::path> outputs;
+};
+
+// Content-addressed cache of pipeline stage outputs. A stage is keyed by the
+// content of its input files, its exact command line and the identity of its
+// tool, so it only re-runs when one of those changes; otherwise its outputs
+// are restored from `<cache_dir>/<key>/`. Stages may run from several
+// threads at once.
+class StageCache {
+private:
+    std::filesystem::path cache_dir;
+    std::map<std::string, std::string> tool_versions;
+    std::mutex mutex;
+
+    // `tool --version` output plus the size and mtime of its executable, so
+    // both upgrades and rebuilt-in-place tools invalidate the cache
+    const std::string& toolVersion(const std::string& tool);
+
+    // Copies the cached outputs into place; false if any is missing
+    bool restore(const Stage& stage, const std::filesystem::path& entry) const;
+
+    // Copies the stage outputs into the cache, atomically per entry
+    void store(const Stage& stage, const std::filesystem::path& entry) const;
+
+public:
+    explicit StageCache(const std::filesystem::path& cache_path);
+
+    // Default cache location inside a workspace
+    static std::filesystem::path defaultPath(const std::filesystem::path& workspace_root);
+
+    // Hex key of the stage's inputs, command and tool
+    std::string key(const Stage& stage);
+
+    // Restores the stage's outputs if cached, otherwise runs its command
+    // through `execute` and caches the outputs on success. Returns the
+    // command's exit code (0 on a cache hit); `cached` reports which happened.
+    int run(const Stage& stage, const std::function<int(const std::string&)>& execute, bool& cached);
+};
@@ -0,0 +1,453 @@
+#include "SvLexer.hpp"
+#include <utility>
+#include <cerrno>
+#include <cstring>
+
+extern "C" {
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+}
+
+namespace {
+    // Largest file read into memory rather than mapped
+    constexpr size_t kMaxReadSize = 64 * 1024;
+}
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file: " + path.string() + " (" + std::strerror(errno) + ")");
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat file: " + path.string());
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0 && size_ <= kMaxReadSize) {
+        buffer_ = std::make_unique<char[]>(size_);
+        size_t done = 0;
+        while (done < size_) {
+            ssize_t count = ::read(fd, buffer_.get() + done, size_ - done);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count < 0) {
+                ::close(fd);
+                throw std::runtime_error("Failed to read file: " + path.string() + " (" + std::strerror(errno) + ")");
+            }
+            if (count == 0) {
+                // The file shrank since fstat
+                break;
+            }
+            done += static_cast<size_t>(count);
+        }
+        size_ = done;
+        data_ = buffer_.get();
+    } else if (size_ > 0) {
+        void* mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Failed to map file: " + path.string());
+        }
+        // The scanner makes a single forward pass over the file
+        ::madvise(mapping, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(mapping);
+    }
+    ::close(fd);
+}
+
+void MappedFile::release() {
+    if (data_ && !buffer_) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+    buffer_.reset();
+    data_ = nullptr;
+    size_ = 0;
+}
+
+MappedFile::~MappedFile() {
+    release();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)),
+      buffer_(std::move(other.buffer_)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        release();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        buffer_ = std::move(other.buffer_);
+    }
+    return *this;
+}
+
+namespace {
+    const char* const kKeywords[] = {
+        "accept_on", "alias", "always", "always_comb", "always_ff", "always_latch", "and",
+        "assert", "assign", "assume", "automatic", "before", "begin", "bind", "bins", "binsof",
+        "bit", "break", "buf", "bufif0", "bufif1", "byte", "case", "casex", "casez", "cell",
+        "chandle", "checker", "class", "clocking", "cmos", "config", "const", "constraint",
+        "context", "continue", "cover", "covergroup", "coverpoint", "cross", "deassign",
+        "default", "defparam", "design", "disable", "dist", "do", "edge", "else", "end",
+        "endcase", "endchecker", "endclass", "endclocking", "endconfig", "endfunction",
+        "endgenerate", "endgroup", "endinterface", "endmodule", "endpackage", "endprimitive",
+        "endprogram", "endproperty", "endspecify", "endsequence", "endtable", "endtask", "enum",
+        "event", "eventually", "expect", "export", "extends", "extern", "final", "first_match",
+        "for", "force", "foreach", "forever", "fork", "forkjoin", "function", "generate",
+        "genvar", "global", "highz0", "highz1", "if", "iff", "ifnone", "ignore_bins",
+        "illegal_bins", "implements", "implies", "import", "incdir", "include", "initial",
+        "inout", "input", "inside", "instance", "int", "integer", "interconnect", "interface",
+        "intersect", "join", "join_any", "join_none", "large", "let", "liblist", "library",
+        "local", "localparam", "logic", "longint", "macromodule", "matches", "medium",
+        "modport", "module", "nand", "negedge", "nettype", "new", "nexttime", "nmos", "nor",
+        "noshowcancelled", "not", "notif0", "notif1", "null", "or", "output", "package",
+        "packed", "parameter", "pmos", "posedge", "primitive", "priority", "program",
+        "property", "protected", "pull0", "pull1", "pulldown", "pullup",
+        "pulsestyle_ondetect", "pulsestyle_onevent", "pure", "rand", "randc", "randcase",
+        "randsequence", "rcmos", "real", "realtime", "ref", "reg", "reject_on", "release",
+        "repeat", "restrict", "return", "rnmos", "rpmos", "rtran", "rtranif0", "rtranif1",
+        "s_always", "s_eventually", "s_nexttime", "s_until", "s_until_with", "scalared",
+        "sequence", "shortint", "shortreal", "showcancelled", "signed", "small", "soft",
+        "solve", "specify", "specparam", "static", "string", "strong", "strong0", "strong1",
+        "struct", "super", "supply0", "supply1", "sync_accept_on", "sync_reject_on", "table",
+        "tagged", "task", "this", "throughout", "time", "timeprecision", "timeunit", "tran",
+        "tranif0", "tranif1", "tri", "tri0", "tri1", "triand", "trior", "trireg", "type",
+        "typedef", "union", "unique", "unique0", "unsigned", "until", "until_with", "untyped",
+        "use", "uwire", "var", "vectored", "virtual", "void", "wait", "wait_order", "wand",
+        "weak", "weak0", "weak1", "while", "wildcard", "wire", "with", "within", "wor",
+        "xnor", "xor",
+    };
+
+    // Open-addressed set of the keywords. The hash reads only the length and
+    // three characters, so rejecting a design identifier is a few loads
+    // rather than hashing every character.
+    class KeywordTable {
+    private:
+        static constexpr size_t kSlots = 1024;
+        std::string_view slots[kSlots];
+
+        static size_t slotOf(std::string_view word) {
+            auto at = [&word](size_t i) { return static_cast<size_t>(static_cast<unsigned char>(word[i])); };
+            return (word.size() * 151 + at(0) * 31 + at(word.size() / 2) * 7 + at(word.size() - 1)) % kSlots;
+        }
+
+    public:
+        KeywordTable() {
+            for (const char* keyword : kKeywords) {
+                size_t slot = slotOf(keyword);
+                while (!slots[slot].empty()) {
+                    slot = (slot + 1) % kSlots;
+                }
+                slots[slot] = keyword;
+            }
+        }
+
+        bool contains(std::string_view word) const {
+            // Keywords are 2 to 19 lowercase letters, digits and underscores
+            if (word.size() < 2 || word.size() > 19 || word[0] < 'a' || word[0] > 'z') {
+                return false;
+            }
+            for (size_t slot = slotOf(word); !slots[slot].empty(); slot = (slot + 1) % kSlots) {
+                if (slots[slot] == word) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+}
+
+bool isSvKeyword(std::string_view word) {
+    static const KeywordTable keywords;
+    return keywords.contains(word);
+}
+
+namespace {
+    // Character classes, looked up once per character of the source
+    enum CharClass : unsigned char {
+        kIdentStart = 1,
+        kIdentChar = 2,
+    };
+
+    struct CharClasses {
+        unsigned char of[256] = {};
+
+        constexpr CharClasses() {
+            for (int c = 0; c < 256; ++c) {
+                bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+                bool digit = c >= '0' && c <= '9';
+                of[c] = (letter ? kIdentStart : 0) | (letter || digit || c == '$' ? kIdentChar : 0);
+            }
+        }
+    };
+
+    constexpr CharClasses kCharClasses;
+
+    inline bool isIdentStart(char c) {
+        return kCharClasses.of[static_cast<unsigned char>(c)] & kIdentStart;
+    }
+
+    inline bool isIdentChar(char c) {
+        return kCharClasses.of[static_cast<unsigned char>(c)] & kIdentChar;
+    }
+
+    inline bool isDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    inline bool isBaseChar(char c) {
+        switch (c) {
+            case 'b': case 'B': case 'o': case 'O':
+            case 'd': case 'D': case 'h': case 'H':
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    inline bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+    }
+}
+
+void SvLexer::skipTrivia() {
+    while (cur < end) {
+        char c = *cur;
+        if (c == '\n') {
+            ++line;
+            ++cur;
+        } else if (isSpace(c)) {
+            ++cur;
+        } else if (c == '/' && cur + 1 < end && cur[1] == '/') {
+            cur += 2;
+            while (cur < end && *cur != '\n') {
+                ++cur;
+            }
+        } else if (c == '/' && cur + 1 < end && cur[1] == '*') {
+            cur += 2;
+            while (cur < end && !(*cur == '*' && cur + 1 < end && cur[1] == '/')) {
+                if (*cur == '\n') {
+                    ++line;
+                }
+                ++cur;
+            }
+            cur = cur < end ? cur + 2 : end;
+        } else if (c == '(' && cur + 1 < end && cur[1] == '*') {
+            // Attribute instance, unless this is the "@(*)" event control
+            const char* p = cur + 2;
+            while (p < end && isSpace(*p)) {
+                ++p;
+            }
+            if (p >= end || *p == ')') {
+                return;
+            }
+            cur += 2;
+            while (cur < end && !(*cur == '*' && cur + 1 < end && cur[1] == ')')) {
+                if (*cur == '\n') {
+                    ++line;
+                }
+                ++cur;
+            }
+            cur = cur < end ? cur + 2 : end;
+        } else {
+            return;
+        }
+    }
+}
+
+void SvLexer::skipLogicalLine() {
+    while (cur < end && *cur != '\n') {
+        if (*cur == '\\' && cur + 1 < end && (cur[1] == '\n' || cur[1] == '\r')) {
+            cur += (cur[1] == '\r' && cur + 2 < end && cur[2] == '\n') ? 3 : 2;
+            ++line;
+            continue;
+        }
+        if (*cur == '/' && cur + 1 < end && cur[1] == '/') {
+            // A trailing line comment ends the directive, continuation or not
+            while (cur < end && *cur != '\n') {
+                ++cur;
+            }
+            return;
+        }
+        ++cur;
+    }
+}
+
+SvToken SvLexer::lexDirective(const char* start, size_t start_line) {
+    const char* name_start = cur;
+    while (cur < end && isIdentChar(*cur)) {
+        ++cur;
+    }
+    std::string_view name(name_start, cur - name_start);
+
+    auto skipHorizontalSpace = [this]() {
+        while (cur < end && isSpace(*cur)) {
+            ++cur;
+        }
+    };
+
+    if (name == "define" || name == "timescale" || name == "line" || name == "pragma" ||
+        name == "begin_keywords" || name == "unconnected_drive") {
+        skipLogicalLine();
+    } else if (name == "ifdef" || name == "ifndef" || name == "elsif" || name == "undef" ||
+               name == "default_nettype") {
+        skipHorizontalSpace();
+        while (cur < end && isIdentChar(*cur)) {
+            ++cur;
+        }
+    } else if (name == "include") {
+        skipHorizontalSpace();
+        if (cur < end && (*cur == '"' || *cur == '<')) {
+            char close = *cur == '"' ? '"' : '>';
+            ++cur;
+            while (cur < end && *cur != close && *cur != '\n') {
+                ++cur;
+            }
+            if (cur < end && *cur == close) {
+                ++cur;
+            }
+        } else if (cur < end && *cur == '`') {
+            ++cur;
+            while (cur < end && isIdentChar(*cur)) {
+                ++cur;
+            }
+        }
+    }
+
+    return {SvToken::Kind::Directive, std::string_view(start, cur - start), start_line};
+}
+
+SvToken SvLexer::lexNumber(const char* start, size_t start_line) {
+    if (*cur != '\'') {
+        while (cur < end && (isDigit(*cur) || *cur == '_')) {
+            ++cur;
+        }
+        if (cur + 1 < end && *cur == '.' && isDigit(cur[1])) {
+            ++cur;
+            while (cur < end && (isDigit(*cur) || *cur == '_')) {
+                ++cur;
+            }
+        }
+        // Exponents and time units (1e3, 10ns)
+        while (cur < end && isIdentStart(*cur)) {
+            ++cur;
+        }
+        // Sized literal with whitespace before the base, e.g. "8 'hff"
+        const char* p = cur;
+        while (p < end && isSpace(*p)) {
+            ++p;
+        }
+        if (p < end && *p == '\'') {
+            cur = p;
+        }
+    }
+
+    if (cur < end && *cur == '\'') {
+        const char* p = cur + 1;
+        if (p < end && (*p == 's' || *p == 'S')) {
+            ++p;
+        }
+        if (p < end && isBaseChar(*p)) {
+            cur = p + 1;
+            while (cur < end && isSpace(*cur)) {
+                ++cur;
+            }
+            while (cur < end && (isIdentChar(*cur) || *cur == '?')) {
+                ++cur;
+            }
+        } else if (cur == start && p == cur + 1 && p < end &&
+                   (*p == '0' || *p == '1' || *p == 'x' || *p == 'X' || *p == 'z' || *p == 'Z') &&
+                   !(p + 1 < end && isIdentChar(p[1]))) {
+            // Unbased unsized literal: '0, '1, 'x, 'z
+            cur = p + 1;
+        } else if (cur == start) {
+            // Cast or assignment pattern apostrophe
+            ++cur;
+            return {SvToken::Kind::Symbol, std::string_view(start, 1), start_line};
+        }
+    }
+
+    return {SvToken::Kind::Number, std::string_view(start, cur - start), start_line};
+}
+
+SvToken SvLexer::next() {
+    skipTrivia();
+    if (cur >= end) {
+        return {SvToken::Kind::End, std::string_view(), line};
+    }
+
+    const char* start = cur;
+    size_t start_line = line;
+    char c = *cur;
+
+    if (isIdentStart(c)) {
+        ++cur;
+        while (cur < end && isIdentChar(*cur)) {
+            ++cur;
+        }
+        return {SvToken::Kind::Identifier, std::string_view(start, cur - start), start_line};
+    }
+
+    if (c == '$' && cur + 1 < end && isIdentChar(cur[1])) {
+        ++cur;
+        while (cur < end && isIdentChar(*cur)) {
+            ++cur;
+        }
+        return {SvToken::Kind::SystemIdentifier, std::string_view(start, cur - start), start_line};
+    }
+
+    if (c == '\\') {
+        // Escaped identifier, terminated by whitespace
+        ++cur;
+        while (cur < end && !isSpace(*cur) && *cur != '\n') {
+            ++cur;
+        }
+        return {SvToken::Kind::Identifier, std::string_view(start, cur - start), start_line};
+    }
+
+    if (isDigit(c) || c == '\'') {
+        return lexNumber(start, start_line);
+    }
+
+    if (c == '"') {
+        ++cur;
+        while (cur < end && *cur != '"') {
+            if (*cur == '\\' && cur + 1 < end) {
+                if (cur[1] == '\n') {
+                    ++line;
+                }
+                cur += 2;
+                continue;
+            }
+            if (*cur == '\n') {
+                // Unterminated string; recover at end of line
+                break;
+            }
+            ++cur;
+        }
+        if (cur < end && *cur == '"') {
+            ++cur;
+        }
+        return {SvToken::Kind::String, std::string_view(start, cur - start), start_line};
+    }
+
+    if (c == '`') {
+        ++cur;
+        return lexDirective(start, start_line);
+    }
+
+    if (c == ':' && cur + 1 < end && cur[1] == ':') {
+        cur += 2;
+        return {SvToken::Kind::Symbol, std::string_view(start, 2), start_line};
+    }
+
+    ++cur;
+    return {SvToken::Kind::Symbol, std::string_view(start, 1), start_line};
+}
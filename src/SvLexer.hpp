@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+
+// Read-only memory mapping of a source file. Empty files map to an empty view.
+// Files up to 64 KiB are read into memory instead: for those, setting up and
+// tearing down the mapping costs more than copying them.
+class MappedFile {
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    // Holds the contents of a file that was read rather than mapped
+    std::unique_ptr<char[]> buffer_;
+
+    void release();
+
+public:
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    std::string_view view() const { return std::string_view(data_, size_); }
+};
+
+struct SvToken {
+    enum class Kind {
+        Identifier,       // plain or escaped identifier, including keywords
+        SystemIdentifier, // $display, $clog2, ...
+        Number,
+        String,
+        Directive,        // `define, `ifdef FOO, `include "x.svh", `MACRO, ...
+        Symbol,           // single punctuation character, or "::"
+        End
+    };
+
+    Kind kind = Kind::End;
+    std::string_view text;
+    size_t line = 0;
+
+    bool is(Kind k, std::string_view t) const { return kind == k && text == t; }
+    bool isSymbol(char c) const { return kind == Kind::Symbol && text.size() == 1 && text[0] == c; }
+};
+
+// Returns true if the identifier is a reserved SystemVerilog (IEEE 1800-2017) keyword
+bool isSvKeyword(std::string_view word);
+
+// Hand-written SystemVerilog tokenizer over an in-memory buffer. Comments,
+// whitespace and attribute instances are skipped; compiler directives are
+// returned as single tokens together with their arguments so callers can
+// ignore or interpret them as a unit.
+class SvLexer {
+private:
+    const char* cur;
+    const char* end;
+    size_t line = 1;
+
+    // Skips whitespace, comments and (* attribute *) instances
+    void skipTrivia();
+
+    // Consumes up to (not including) the next unescaped newline, honouring
+    // backslash line continuations
+    void skipLogicalLine();
+
+    SvToken lexDirective(const char* start, size_t start_line);
+    SvToken lexNumber(const char* start, size_t start_line);
+
+public:
+    explicit SvLexer(std::string_view source)
+        : cur(source.data()), end(source.data() + source.size()) {}
+
+    // Returns the next token, or a token of kind End once input is exhausted
+    SvToken next();
+};
@@ -0,0 +1,421 @@
+#include "SvPreprocessor.hpp"
+#include <algorithm>
+#include <cctype>
+
+namespace {
+    // Expansion and include depth past which input is assumed to recurse
+    constexpr size_t kMaxFrames = 256;
+
+    inline bool isIdentStart(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+    inline bool isIdentChar(char c) {
+        return isIdentStart(c) || (c >= '0' && c <= '9') || c == '$';
+    }
+
+    std::string_view trim(std::string_view text) {
+        while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    // Leading identifier of `text`
+    std::string_view identifier(std::string_view text) {
+        size_t length = 0;
+        while (length < text.size() && isIdentChar(text[length])) {
+            ++length;
+        }
+        return text.substr(0, length);
+    }
+
+    // Splits `+a+b+c` (after the +define+ or +incdir+ prefix) on '+'
+    std::vector<std::string> plusList(std::string_view text) {
+        std::vector<std::string> items;
+        while (!text.empty()) {
+            size_t plus = text.find('+');
+            if (plus != 0) {
+                items.emplace_back(text.substr(0, plus));
+            }
+            text = plus == std::string_view::npos ? std::string_view() : text.substr(plus + 1);
+        }
+        return items;
+    }
+}
+
+bool SvPreprocessorOptions::parseArgument(const std::string& arg) {
+    static const std::string define_prefix = "+define+";
+    static const std::string incdir_prefix = "+incdir+";
+    if (arg.rfind(define_prefix, 0) == 0) {
+        for (const auto& item : plusList(std::string_view(arg).substr(define_prefix.size()))) {
+            size_t equals = item.find('=');
+            defines.emplace_back(item.substr(0, equals), equals == std::string::npos ? "" : item.substr(equals + 1));
+        }
+        return true;
+    }
+    if (arg.rfind(incdir_prefix, 0) == 0) {
+        for (const auto& item : plusList(std::string_view(arg).substr(incdir_prefix.size()))) {
+            include_dirs.push_back(std::filesystem::absolute(item).lexically_normal());
+        }
+        return true;
+    }
+    return false;
+}
+
+uint64_t SvPreprocessorOptions::fingerprint() const {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&hash](std::string_view text) {
+        for (unsigned char c : text) {
+            hash ^= c;
+            hash *= 0x100000001b3ULL;
+        }
+        hash ^= 0xff;
+        hash *= 0x100000001b3ULL;
+    };
+    for (const auto& [name, value] : defines) {
+        mix(name);
+        mix(value);
+    }
+    for (const auto& dir : include_dirs) {
+        mix(dir.string());
+    }
+    return hash;
+}
+
+SvIncludeCache::SvIncludeCache(SvPreprocessorOptions options) : settings(std::move(options)) {}
+
+std::shared_ptr<const SvIncludeCache::File> SvIncludeCache::find(const std::string& name,
+                                                                 const std::filesystem::path& including_dir) {
+    std::vector<std::filesystem::path> candidates;
+    std::filesystem::path relative(name);
+    if (relative.is_absolute()) {
+        candidates.push_back(relative);
+    } else {
+        candidates.push_back(including_dir / relative);
+        for (const auto& dir : settings.include_dirs) {
+            candidates.push_back(dir / relative);
+        }
+    }
+
+    for (const auto& candidate : candidates) {
+        std::string key = candidate.lexically_normal().string();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = files.find(key);
+            if (it != files.end()) {
+                if (it->second) {
+                    return it->second;
+                }
+                continue;
+            }
+        }
+
+        // Loaded outside the lock; if two files race for the same header,
+        // the first one stored is kept and shared
+        std::shared_ptr<const File> loaded;
+        std::error_code ec;
+        if (std::filesystem::is_regular_file(key, ec)) {
+            try {
+                auto file = std::make_shared<File>(File{key, MappedFile(key), {}});
+                SvLexer lexer(file->mapped.view());
+                for (SvToken token = lexer.next(); token.kind != SvToken::Kind::End; token = lexer.next()) {
+                    file->tokens.push_back(token);
+                }
+                loaded = std::move(file);
+            } catch (const std::exception&) {
+                // Unreadable: treated as missing
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        auto [it, inserted] = files.emplace(key, loaded);
+        if (it->second) {
+            return it->second;
+        }
+    }
+    return nullptr;
+}
+
+void SvIncludeCache::invalidate(const std::filesystem::path& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    files.erase(path.lexically_normal().string());
+}
+
+size_t SvIncludeCache::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return static_cast<size_t>(std::count_if(files.begin(), files.end(),
+                                              [](const auto& entry) { return entry.second != nullptr; }));
+}
+
+SvPreprocessor::SvPreprocessor(std::string_view source, const std::filesystem::path& file,
+                               SvIncludeCache& include_cache)
+    : includes(include_cache), source_lexer(source), source_path(file) {
+    for (const auto& [name, value] : includes.options().defines) {
+        macros[name].body = value;
+    }
+}
+
+SvToken SvPreprocessor::rawNext() {
+    while (!frames.empty()) {
+        Frame& frame = frames.back();
+        SvToken token;
+        if (frame.lexer) {
+            token = frame.lexer->next();
+        } else if (frame.index < frame.include->tokens.size()) {
+            token = frame.include->tokens[frame.index++];
+        }
+        if (token.kind != SvToken::Kind::End) {
+            token.line = frame.line;
+            return token;
+        }
+        if (frame.text) {
+            retained.push_back(std::move(frame.text));
+        } else {
+            retained.push_back(std::move(frame.include));
+        }
+        frames.pop_back();
+    }
+    return source_lexer.next();
+}
+
+SvToken SvPreprocessor::next() {
+    while (true) {
+        SvToken token = rawNext();
+        if (token.kind == SvToken::Kind::End) {
+            return token;
+        }
+        if (token.kind == SvToken::Kind::Directive) {
+            handleDirective(token);
+        } else if (active()) {
+            return token;
+        }
+    }
+}
+
+void SvPreprocessor::handleDirective(const SvToken& directive) {
+    std::string_view text = directive.text.substr(1);
+    std::string_view name = identifier(text);
+    std::string_view argument = trim(text.substr(name.size()));
+
+    if (name == "ifdef" || name == "ifndef") {
+        bool parent = active();
+        bool taken = parent && (macros.count(std::string(identifier(argument))) != 0) == (name == "ifdef");
+        conditionals.push_back({parent, taken, taken});
+        return;
+    }
+    if (name == "elsif" || name == "else" || name == "endif") {
+        if (conditionals.empty()) {
+            return;
+        }
+        Conditional& conditional = conditionals.back();
+        if (name == "endif") {
+            conditionals.pop_back();
+        } else if (conditional.taken) {
+            conditional.active = false;
+        } else {
+            conditional.active = conditional.parent_active &&
+                                 (name == "else" || macros.count(std::string(identifier(argument))) != 0);
+            conditional.taken = conditional.active;
+        }
+        return;
+    }
+    if (!active()) {
+        return;
+    }
+
+    if (name == "define") {
+        define(text.substr(name.size()));
+    } else if (name == "undef") {
+        macros.erase(std::string(identifier(argument)));
+    } else if (name == "undefineall") {
+        macros.clear();
+    } else if (name == "include") {
+        if (!argument.empty() && argument.front() == '`') {
+            // `include `HEADER, with the macro holding the quoted name
+            auto it = macros.find(std::string(identifier(argument.substr(1))));
+            argument = it == macros.end() ? std::string_view() : trim(it->second.body);
+        }
+        if (argument.size() >= 2) {
+            pushInclude(std::string(argument.substr(1, argument.size() - 2)), directive.line);
+        }
+    } else {
+        // A macro use; other compiler directives and undefined macros have
+        // no effect on the design structure
+        auto it = macros.find(std::string(name));
+        if (it != macros.end()) {
+            // Copied: the expansion may redefine it
+            Macro macro = it->second;
+            expand(macro, directive.line);
+        }
+    }
+}
+
+void SvPreprocessor::define(std::string_view text) {
+    // Directive text runs to the end of the logical line, including any
+    // backslash continuations
+    text = trim(text);
+    std::string name(identifier(text));
+    if (name.empty()) {
+        return;
+    }
+    text.remove_prefix(name.size());
+
+    Macro macro;
+    if (!text.empty() && text.front() == '(') {
+        macro.function_like = true;
+        int depth = 0;
+        size_t start = 1;
+        size_t i = 0;
+        for (; i < text.size(); ++i) {
+            char c = text[i];
+            if (c == '(' || c == '[' || c == '{') {
+                ++depth;
+            } else if (c == ')' || c == ']' || c == '}') {
+                --depth;
+            }
+            if ((c == ',' && depth == 1) || depth == 0) {
+                std::string_view param = trim(text.substr(start, i - start));
+                size_t equals = param.find('=');
+                if (!param.empty()) {
+                    macro.params.emplace_back(trim(param.substr(0, equals)));
+                    macro.defaults.emplace_back(equals == std::string_view::npos ? std::string_view()
+                                                                                 : trim(param.substr(equals + 1)));
+                }
+                start = i + 1;
+                if (depth == 0) {
+                    break;
+                }
+            }
+        }
+        text = i < text.size() ? text.substr(i + 1) : std::string_view();
+    }
+
+    std::string body;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '\\' && i + 1 < text.size() && (text[i + 1] == '\n' || text[i + 1] == '\r')) {
+            body += ' ';
+            ++i;
+            if (text[i] == '\r' && i + 1 < text.size() && text[i + 1] == '\n') {
+                ++i;
+            }
+            continue;
+        }
+        body += text[i];
+    }
+    macro.body = std::string(trim(body));
+    macros[name] = std::move(macro);
+}
+
+void SvPreprocessor::expand(const Macro& macro, size_t line) {
+    if (frames.size() >= kMaxFrames) {
+        return;
+    }
+
+    std::vector<std::string> args;
+    if (macro.function_like) {
+        // Arguments are raw tokens up to the matching ')', split on commas
+        // outside nested brackets
+        SvToken open = rawNext();
+        if (!open.isSymbol('(')) {
+            return;
+        }
+        int depth = 0;
+        std::string current;
+        for (SvToken token = rawNext(); token.kind != SvToken::Kind::End; token = rawNext()) {
+            if (token.isSymbol('(') || token.isSymbol('[') || token.isSymbol('{')) {
+                ++depth;
+            } else if (token.isSymbol(')') || token.isSymbol(']') || token.isSymbol('}')) {
+                if (depth == 0) {
+                    break;
+                }
+                --depth;
+            } else if (token.isSymbol(',') && depth == 0) {
+                args.push_back(std::move(current));
+                current.clear();
+                continue;
+            }
+            current += current.empty() ? "" : " ";
+            current += token.text;
+        }
+        args.push_back(std::move(current));
+    }
+
+    // Substitutes arguments for parameters outside string literals; ``
+    // pastes tokens and `" quotes a string whose contents are substituted
+    const std::string& body = macro.body;
+    auto text = std::make_shared<std::string>();
+    text->reserve(body.size());
+    size_t i = 0;
+    while (i < body.size()) {
+        char c = body[i];
+        if (c == '`' && i + 1 < body.size() && body[i + 1] == '`') {
+            i += 2;
+        } else if (c == '`' && i + 1 < body.size() && body[i + 1] == '"') {
+            *text += '"';
+            i += 2;
+        } else if (c == '`' && body.compare(i, 4, "`\\`\"") == 0) {
+            *text += "\\\"";
+            i += 4;
+        } else if (c == '"') {
+            size_t close = i + 1;
+            while (close < body.size() && body[close] != '"') {
+                close += body[close] == '\\' ? 2 : 1;
+            }
+            close = std::min(close + 1, body.size());
+            text->append(body, i, close - i);
+            i = close;
+        } else if (isIdentStart(c) || (c == '`' && i + 1 < body.size() && isIdentStart(body[i + 1]))) {
+            size_t start = i;
+            i += c == '`' ? 1 : 0;
+            std::string_view word = identifier(std::string_view(body).substr(i));
+            i += word.size();
+            auto param = std::find(macro.params.begin(), macro.params.end(), word);
+            if (c != '`' && param != macro.params.end()) {
+                size_t index = static_cast<size_t>(param - macro.params.begin());
+                *text += index < args.size() && !args[index].empty() ? args[index] : macro.defaults[index];
+            } else {
+                text->append(body, start, i - start);
+            }
+        } else {
+            *text += c;
+            ++i;
+        }
+    }
+
+    Frame frame;
+    frame.text = std::move(text);
+    frame.lexer.emplace(*frame.text);
+    if (!frames.empty()) {
+        frame.dir = frames.back().dir;
+    }
+    frame.line = line;
+    frames.push_back(std::move(frame));
+}
+
+void SvPreprocessor::pushInclude(std::string name, size_t line) {
+    if (frames.size() >= kMaxFrames) {
+        return;
+    }
+    if (source_dir.empty()) {
+        // Resolved here rather than up front, as most files include nothing
+        source_dir = source_path.empty() ? std::filesystem::current_path()
+                                         : std::filesystem::absolute(source_path).parent_path();
+    }
+    bool nested = !frames.empty() && !frames.back().dir.empty();
+    std::shared_ptr<const SvIncludeCache::File> file = includes.find(name, nested ? frames.back().dir : source_dir);
+    if (!file) {
+        return;
+    }
+    std::string path = file->path.string();
+    if (std::find(included.begin(), included.end(), path) == included.end()) {
+        included.push_back(path);
+    }
+    Frame frame;
+    frame.include = std::move(file);
+    frame.dir = frame.include->path.parent_path();
+    frame.line = line;
+    frames.push_back(std::move(frame));
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <mutex>
+#include <unordered_map>
+#include <filesystem>
+#include <cstdint>
+#include "SvLexer.hpp"
+
+// Preprocessor settings of a run, given to vpm as Verilator-style
+// +define+NAME[=VALUE][+...] and +incdir+DIR[+...] arguments
+struct SvPreprocessorOptions {
+    std::vector<std::pair<std::string, std::string>> defines;
+    // Absolute, searched in order after the including file's directory
+    std::vector<std::filesystem::path> include_dirs;
+
+    // Adds the settings of a +define+ or +incdir+ argument. Returns false if
+    // `arg` is neither.
+    bool parseArgument(const std::string& arg);
+
+    // Identifies the settings, so cached scans made under others are dropped
+    uint64_t fingerprint() const;
+};
+
+// Tokens of every file pulled in by `include during a run. A header is read
+// and tokenized once, however many files include it, and the tokens are
+// shared by all of them; each includer still interprets the directives in
+// them against its own macro state. Safe to use from several threads.
+class SvIncludeCache {
+public:
+    struct File {
+        std::filesystem::path path;
+        MappedFile mapped;
+        // Views into `mapped`
+        std::vector<SvToken> tokens;
+    };
+
+private:
+    SvPreprocessorOptions settings;
+    // By absolute path; null for paths that do not exist
+    std::unordered_map<std::string, std::shared_ptr<const File>> files;
+    std::mutex mutex;
+
+public:
+    explicit SvIncludeCache(SvPreprocessorOptions options = {});
+
+    const SvPreprocessorOptions& options() const { return settings; }
+
+    // Resolves `name` against `including_dir`, then the include directories,
+    // and returns its tokens, or null if it is in none of them
+    std::shared_ptr<const File> find(const std::string& name, const std::filesystem::path& including_dir);
+
+    // Forgets a header that changed on disk
+    void invalidate(const std::filesystem::path& path);
+
+    size_t size();
+};
+
+// Token stream of one source file after preprocessing: `define, `undef,
+// `ifdef/`ifndef/`elsif/`else/`endif and `include are applied and macros
+// are expanded, so callers see only the tokens a compiler would. Other
+// directives are dropped. Tokens from includes and macro expansions carry
+// the line of the `include or macro use in the file itself.
+class SvPreprocessor {
+private:
+    struct Macro {
+        std::vector<std::string> params;
+        // Default argument of each parameter; empty if none
+        std::vector<std::string> defaults;
+        bool function_like = false;
+        std::string body;
+    };
+
+    // A source of raw tokens pushed over the file: an included file or an
+    // expansion
+    struct Frame {
+        std::optional<SvLexer> lexer;
+        std::shared_ptr<const std::string> text;
+        std::shared_ptr<const SvIncludeCache::File> include;
+        size_t index = 0;
+        // Directory `include resolves against; empty for expansions in the
+        // file itself
+        std::filesystem::path dir;
+        // Line of the `include or macro use, reported for every token
+        size_t line = 0;
+    };
+
+    struct Conditional {
+        bool parent_active;
+        bool taken;
+        bool active;
+    };
+
+    SvIncludeCache& includes;
+    // The file itself is lexed directly; frames only exist while an include
+    // or expansion is being read
+    SvLexer source_lexer;
+    std::filesystem::path source_path;
+    // Absolute directory of the file; empty until the first `include
+    std::filesystem::path source_dir;
+    std::vector<Frame> frames;
+    std::unordered_map<std::string, Macro> macros;
+    std::vector<Conditional> conditionals;
+    std::vector<std::string> included;
+    // Expansions and includes already read, whose token text callers may
+    // still hold
+    std::vector<std::shared_ptr<const void>> retained;
+
+    bool active() const { return conditionals.empty() || conditionals.back().active; }
+
+    SvToken rawNext();
+    void handleDirective(const SvToken& directive);
+    void define(std::string_view text);
+    void expand(const Macro& macro, size_t line);
+    void pushInclude(std::string name, size_t line);
+
+public:
+    // `source` and `includes` must outlive the preprocessor
+    SvPreprocessor(std::string_view source, const std::filesystem::path& file, SvIncludeCache& include_cache);
+
+    // Returns the next token that is not a directive, or End
+    SvToken next();
+
+    // Absolute paths of the files included so far, in first-seen order
+    const std::vector<std::string>& includedFiles() const { return included; }
+};
@@ -0,0 +1,238 @@
+#include "SvScanner.hpp"
+#include "SvLexer.hpp"
+#include "SvPreprocessor.hpp"
+#include <unordered_set>
+
+std::vector<std::string> SvScanResult::instantiatedModules() const {
+    std::vector<std::string> names;
+    std::unordered_set<std::string_view> seen;
+    for (const auto& module : modules) {
+        for (const auto& instance : module.instances) {
+            if (seen.insert(instance.module_name).second) {
+                names.push_back(instance.module_name);
+            }
+        }
+    }
+    return names;
+}
+
+namespace {
+    bool isDeclKeyword(std::string_view word) {
+        return word == "module" || word == "macromodule" || word == "interface" || word == "program";
+    }
+
+    bool isDeclEndKeyword(std::string_view word) {
+        return word == "endmodule" || word == "endinterface" || word == "endprogram";
+    }
+
+    // Keywords after which a new module item or statement may begin
+    bool startsStatement(std::string_view word) {
+        return word == "begin" || word == "else" || word == "generate" || word == "fork" ||
+               word == "join" || word == "join_any" || word == "join_none" ||
+               (word.compare(0, 3, "end") == 0 && isSvKeyword(word));
+    }
+
+    class Parser {
+    private:
+        SvPreprocessor preprocessor;
+        SvToken tok;
+        SvScanResult& result;
+        // Index of the declaration whose body is being scanned, or -1 at file scope
+        long current = -1;
+
+        void advance() {
+            tok = preprocessor.next();
+        }
+
+        bool isPlainIdentifier() const {
+            return tok.kind == SvToken::Kind::Identifier && !isSvKeyword(tok.text);
+        }
+
+        // Consumes a bracketed group starting at tok. Returns true with tok on the
+        // closing bracket, or false if a ';' or end of input interrupts the group.
+        bool skipBalanced(char open, char close) {
+            int depth = 0;
+            while (tok.kind != SvToken::Kind::End) {
+                if (tok.isSymbol(open)) {
+                    ++depth;
+                } else if (tok.isSymbol(close)) {
+                    if (--depth == 0) {
+                        return true;
+                    }
+                } else if (tok.isSymbol(';')) {
+                    return false;
+                }
+                advance();
+            }
+            return false;
+        }
+
+        // Parses "module [lifetime] name ... ;" and opens the declaration body
+        void parseHeader() {
+            advance();
+            if (tok.is(SvToken::Kind::Identifier, "static") || tok.is(SvToken::Kind::Identifier, "automatic")) {
+                advance();
+            }
+            if (!isPlainIdentifier()) {
+                // e.g. "interface class"; not a design unit
+                return;
+            }
+
+            result.modules.push_back({std::string(tok.text), tok.line, {}});
+            current = static_cast<long>(result.modules.size()) - 1;
+
+            int depth = 0;
+            while (tok.kind != SvToken::Kind::End) {
+                if (tok.isSymbol('(')) {
+                    ++depth;
+                } else if (tok.isSymbol(')')) {
+                    --depth;
+                } else if (tok.isSymbol(';') && depth <= 0) {
+                    advance();
+                    return;
+                }
+                advance();
+            }
+        }
+
+        // Attempts to match an instantiation at a statement boundary, with tok on
+        // the candidate module name. Returns true if tok is still at a statement
+        // boundary afterwards (the identifier was a label).
+        bool matchInstance() {
+            SvToken type_tok = tok;
+            advance();
+
+            if (tok.isSymbol(':')) {
+                advance();
+                return true;
+            }
+
+            bool parameterized = tok.isSymbol('#');
+            if (parameterized) {
+                advance();
+                if (tok.isSymbol('(')) {
+                    if (!skipBalanced('(', ')')) {
+                        return false;
+                    }
+                    advance();
+                } else if (tok.kind == SvToken::Kind::Number || tok.kind == SvToken::Kind::Identifier) {
+                    advance();
+                } else {
+                    return false;
+                }
+            }
+
+            while (isPlainIdentifier()) {
+                SvToken instance_tok = tok;
+                advance();
+                while (tok.isSymbol('[')) {
+                    if (!skipBalanced('[', ']')) {
+                        return false;
+                    }
+                    advance();
+                }
+                if (!tok.isSymbol('(') || !skipBalanced('(', ')')) {
+                    return false;
+                }
+                result.modules[current].instances.push_back(
+                    {std::string(type_tok.text), std::string(instance_tok.text), instance_tok.line, parameterized});
+                advance();
+                if (!tok.isSymbol(',')) {
+                    break;
+                }
+                advance();
+            }
+            return false;
+        }
+
+    public:
+        Parser(std::string_view source, const std::filesystem::path& file, SvIncludeCache& includes,
+               SvScanResult& out)
+            : preprocessor(source, file, includes), result(out) {}
+
+        void run() {
+            bool stmt_start = true;
+            int depth = 0;
+
+            advance();
+            while (tok.kind != SvToken::Kind::End) {
+                if (tok.kind == SvToken::Kind::Identifier) {
+                    if (current < 0) {
+                        // Only a keyword starting a file-scope item declares a unit;
+                        // "virtual interface bus_if vif;" in a package class does not
+                        if (stmt_start && depth == 0 && isDeclKeyword(tok.text)) {
+                            parseHeader();
+                            stmt_start = true;
+                            depth = 0;
+                            continue;
+                        }
+                        if (tok.text == "extern") {
+                            // Prototype only: skip "extern module name (...);"
+                            while (tok.kind != SvToken::Kind::End && !tok.isSymbol(';')) {
+                                advance();
+                            }
+                            continue;
+                        }
+                        stmt_start = startsStatement(tok.text);
+                        advance();
+                        continue;
+                    }
+
+                    if (isDeclEndKeyword(tok.text)) {
+                        current = -1;
+                        stmt_start = true;
+                        advance();
+                        continue;
+                    }
+
+                    if (stmt_start && depth == 0 && !isSvKeyword(tok.text)) {
+                        stmt_start = matchInstance();
+                        continue;
+                    }
+
+                    stmt_start = startsStatement(tok.text);
+                    advance();
+                    continue;
+                }
+
+                if (tok.isSymbol('(')) {
+                    ++depth;
+                    stmt_start = false;
+                } else if (tok.isSymbol(')')) {
+                    depth = depth > 0 ? depth - 1 : 0;
+                    stmt_start = depth == 0;
+                } else if (tok.isSymbol(';')) {
+                    stmt_start = depth == 0;
+                } else if (tok.isSymbol(':') && stmt_start) {
+                    // Block label, e.g. "begin : g_lanes"
+                    advance();
+                    if (tok.kind == SvToken::Kind::Identifier) {
+                        advance();
+                    }
+                    continue;
+                } else {
+                    stmt_start = false;
+                }
+                advance();
+            }
+            result.includes = preprocessor.includedFiles();
+        }
+    };
+}
+
+SvScanResult SvScanner::scan(std::string_view source, const std::filesystem::path& file,
+                              SvIncludeCache* includes) {
+    SvScanResult result;
+    if (includes) {
+        Parser(source, file, *includes, result).run();
+    } else {
+        SvIncludeCache local;
+        Parser(source, file, local, result).run();
+    }
+    return result;
+}
+
+SvScanResult SvScanner::scanFile(const std::filesystem::path& path, SvIncludeCache* includes) {
+    MappedFile file(path);
+    return scan(file.view(), path, includes);
+}
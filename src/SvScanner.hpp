@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+#include <memory>
+#include <cstddef>
+
+class SvIncludeCache;
+
+// A single instantiation found inside a design unit body
+struct SvInstance {
+    std::string module_name;
+    std::string instance_name;
+    size_t line = 0;
+    // Instantiated with a parameter override (#(...) or #value)
+    bool parameterized = false;
+};
+
+// A module (or interface/program) declaration and what it instantiates
+struct SvModuleDecl {
+    std::string name;
+    size_t line = 0;
+    std::vector<SvInstance> instances;
+};
+
+struct SvScanResult {
+    std::vector<SvModuleDecl> modules;
+    // Absolute paths of the files pulled in by `include, in first-seen order
+    std::vector<std::string> includes;
+
+    // Unique instantiated module names across all declarations, in first-seen order
+    std::vector<std::string> instantiatedModules() const;
+};
+
+// Scan results are shared between the scan cache, the module index and
+// their users rather than copied
+using SvScanPtr = std::shared_ptr<const SvScanResult>;
+
+// Recognizes design unit declarations and module instantiations on top of
+// SvPreprocessor, so `ifdef'd out code is ignored and units declared in
+// includes or macros are found. Instantiations are matched structurally at statement boundaries:
+//
+//     type [#(params)] name [dims] (ports) {, name [dims] (ports)} ;
+//
+// which handles multi-line and parameterized instances while rejecting
+// keywords, function and task calls, and anything in comments or strings.
+class SvScanner {
+public:
+    // `file` locates relative includes. Without an include cache, no macros
+    // are predefined and only the file's own directory is searched.
+    static SvScanResult scan(std::string_view source, const std::filesystem::path& file = {},
+                             SvIncludeCache* includes = nullptr);
+    static SvScanResult scanFile(const std::filesystem::path& path, SvIncludeCache* includes = nullptr);
+};
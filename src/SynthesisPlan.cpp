@@ -0,0 +1,74 @@
+#include "SynthesisPlan.hpp"
+#include <unordered_set>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+
+SynthesisPlan::SynthesisPlan(const ModuleIndex& index, const std::string& top) {
+    std::vector<std::string> reachable = index.transitiveSubmodules(top, &missing);
+    reachable.push_back(top);
+
+    // Modules instantiated with parameter overrides anywhere under the top
+    std::unordered_set<std::string> inline_modules;
+    for (const auto& name : reachable) {
+        const ModuleEntry* entry = index.find(name);
+        const SvScanResult* scan = entry ? index.findScan(entry->file) : nullptr;
+        if (!scan) {
+            continue;
+        }
+        for (const auto& decl : scan->modules) {
+            if (decl.name != name) {
+                continue;
+            }
+            for (const auto& instance : decl.instances) {
+                if (instance.parameterized) {
+                    inline_modules.insert(instance.module_name);
+                }
+            }
+        }
+    }
+    inline_modules.erase(top);
+
+    auto addUnique = [](std::vector<std::filesystem::path>& files, const std::filesystem::path& file) {
+        if (std::find(files.begin(), files.end(), file) == files.end()) {
+            files.push_back(file);
+        }
+    };
+
+    // transitiveSubmodules is post-order, so units come out leaves first
+    std::unordered_map<std::string, size_t> depths;
+    for (const auto& name : reachable) {
+        const ModuleEntry* entry = index.find(name);
+        if (!entry || inline_modules.count(name) != 0) {
+            continue;
+        }
+
+        SynthesisUnit unit;
+        unit.module = name;
+        unit.sources.push_back(entry->file);
+
+        // Pull inline submodules into this unit; stop at other units
+        std::unordered_set<std::string> visited = {name};
+        std::function<void(const ModuleEntry&)> visit = [&](const ModuleEntry& module) {
+            for (const auto& sub : module.submodules) {
+                const ModuleEntry* sub_entry = index.find(sub);
+                if (!sub_entry || !visited.insert(sub).second) {
+                    continue;
+                }
+                if (inline_modules.count(sub) != 0) {
+                    addUnique(unit.sources, sub_entry->file);
+                    visit(*sub_entry);
+                } else {
+                    unit.blackboxes.push_back(sub);
+                }
+            }
+        };
+        visit(*entry);
+
+        for (const auto& blackbox : unit.blackboxes) {
+            unit.depth = std::max(unit.depth, depths[blackbox] + 1);
+        }
+        depths[name] = unit.depth;
+        units.push_back(std::move(unit));
+    }
+}
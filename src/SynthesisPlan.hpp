@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "ModuleIndex.hpp"
+
+// A module synthesized out of context into its own netlist
+struct SynthesisUnit {
+    std::string module;
+    // Read in full: the module's file and those of submodules synthesized inline
+    std::vector<std::filesystem::path> sources;
+    // Submodules that are units of their own and stay unresolved cells here
+    std::vector<std::string> blackboxes;
+    // Longest chain of units below this one; units of equal depth are independent
+    size_t depth = 0;
+};
+
+// Splits the hierarchy under a top module into out-of-context synthesis
+// units, so a change to one module only re-synthesizes that module before
+// the cached netlists are stitched together. A unit sees its submodule units
+// only through their port stubs, so it is reused as long as their ports do
+// not change. A module becomes its own unit unless it is instantiated with
+// parameter overrides: a netlist synthesized with default parameters cannot
+// stand in for those, so such modules are synthesized inline in each unit
+// that instantiates them.
+class SynthesisPlan {
+private:
+    std::vector<SynthesisUnit> units;
+    std::vector<std::string> missing;
+
+public:
+    SynthesisPlan(const ModuleIndex& index, const std::string& top);
+
+    // Units in dependency order, leaves first; the top module is last
+    const std::vector<SynthesisUnit>& getUnits() const { return units; }
+
+    // Instantiated modules that are not declared in the workspace
+    const std::vector<std::string>& getMissing() const { return missing; }
+};
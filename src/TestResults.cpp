@@ -0,0 +1,160 @@
+#include "TestResults.hpp"
+#include "JsonReader.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+
+namespace {
+    using Token = JsonReader::Token;
+
+    // The parts of a testResult or testSummary build event that we use
+    struct TestEvent {
+        std::string kind;
+        std::string label;
+        long shard = 0;
+        long attempt = 0;
+        std::string status;
+        double duration_seconds = 0;
+        bool cached = false;
+    };
+
+    // Text of a scalar value; int64 fields are strings in proto JSON
+    std::string readScalar(JsonReader& json) {
+        Token token = json.next();
+        if (token == Token::String || token == Token::Number) {
+            return std::string(json.text());
+        }
+        if (token == Token::BeginObject || token == Token::BeginArray) {
+            json.skipNested();
+        }
+        return token == Token::True ? "true" : "";
+    }
+
+    void readId(JsonReader& json, TestEvent& event) {
+        json.expect(Token::BeginObject);
+        while (json.next() == Token::Key) {
+            std::string kind(json.text());
+            if (kind != "testResult" && kind != "testSummary") {
+                json.skipValue();
+                continue;
+            }
+            event.kind = kind;
+            json.expect(Token::BeginObject);
+            while (json.next() == Token::Key) {
+                std::string key(json.text());
+                if (key == "label") {
+                    event.label = readScalar(json);
+                } else if (key == "shard") {
+                    event.shard = std::strtol(readScalar(json).c_str(), nullptr, 10);
+                } else if (key == "attempt") {
+                    event.attempt = std::strtol(readScalar(json).c_str(), nullptr, 10);
+                } else {
+                    json.skipValue();
+                }
+            }
+        }
+    }
+
+    void readPayload(JsonReader& json, TestEvent& event) {
+        json.expect(Token::BeginObject);
+        while (json.next() == Token::Key) {
+            std::string key(json.text());
+            if (key == "status" || key == "overallStatus") {
+                event.status = readScalar(json);
+            } else if (key == "testAttemptDurationMillis") {
+                event.duration_seconds = std::strtod(readScalar(json).c_str(), nullptr) / 1000;
+            } else if (key == "testAttemptDuration") {
+                // Newer Bazel releases write a Duration such as "1.250s"
+                event.duration_seconds = std::strtod(readScalar(json).c_str(), nullptr);
+            } else if (key == "cachedLocally") {
+                event.cached = readScalar(json) == "true";
+            } else {
+                json.skipValue();
+            }
+        }
+    }
+}
+
+TestResults TestResults::fromBuildEvents(const std::filesystem::path& events,
+                                         const std::vector<std::string>& expected) {
+    TestResults results;
+    for (const auto& label : expected) {
+        results.outcomes[label].label = label;
+    }
+
+    // Final status of each shard is that of its last attempt; a summary
+    // event, when present, already accounts for shards and retries
+    std::map<std::pair<std::string, long>, std::pair<long, std::string>> shard_status;
+    std::map<std::string, std::string> summary_status;
+    if (std::filesystem::exists(events)) {
+        try {
+            JsonReader json(events);
+            for (Token token = json.next(); token != Token::End; token = json.next()) {
+                if (token != Token::BeginObject) {
+                    throw std::runtime_error("build event is not an object");
+                }
+                TestEvent event;
+                while (json.next() == Token::Key) {
+                    std::string key(json.text());
+                    if (key == "id") {
+                        readId(json, event);
+                    } else if (key == "testResult" || key == "testSummary") {
+                        readPayload(json, event);
+                    } else {
+                        json.skipValue();
+                    }
+                }
+                if (event.label.empty()) {
+                    continue;
+                }
+
+                TestOutcome& outcome = results.outcomes[event.label];
+                outcome.label = event.label;
+                if (event.kind == "testSummary") {
+                    summary_status[event.label] = event.status;
+                } else if (event.kind == "testResult") {
+                    outcome.duration_seconds += event.duration_seconds;
+                    outcome.cached = outcome.cached || event.cached;
+                    ++outcome.attempts;
+                    auto& last = shard_status[{event.label, event.shard}];
+                    if (event.attempt >= last.first) {
+                        last = {event.attempt, event.status};
+                    }
+                }
+            }
+        } catch (const std::exception&) {
+            // Bazel was interrupted mid-write; keep the complete events
+        }
+    }
+
+    for (const auto& [key, last] : shard_status) {
+        std::string& status = results.outcomes[key.first].status;
+        if (status == "NO_STATUS" || status == "PASSED") {
+            status = last.second;
+        }
+    }
+    for (const auto& [label, status] : summary_status) {
+        if (!status.empty()) {
+            results.outcomes[label].status = status;
+        }
+    }
+    return results;
+}
+
+std::vector<TestOutcome> TestResults::bySlowest() const {
+    std::vector<TestOutcome> sorted;
+    sorted.reserve(outcomes.size());
+    for (const auto& [label, outcome] : outcomes) {
+        sorted.push_back(outcome);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const TestOutcome& a, const TestOutcome& b) {
+        return a.duration_seconds > b.duration_seconds;
+    });
+    return sorted;
+}
+
+size_t TestResults::passedCount() const {
+    return static_cast<size_t>(std::count_if(outcomes.begin(), outcomes.end(), [](const auto& entry) {
+        return entry.second.passed();
+    }));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <filesystem>
+
+// Outcome of one test target in a `bazel test` run
+struct TestOutcome {
+    std::string label;
+    // Bazel's status, e.g. PASSED, FAILED, TIMEOUT, FLAKY; NO_STATUS if the
+    // test never ran, typically because it failed to build
+    std::string status = "NO_STATUS";
+    // Summed over shards and attempts
+    double duration_seconds = 0;
+    bool cached = false;
+    size_t attempts = 0;
+
+    bool passed() const { return status == "PASSED" || status == "FLAKY"; }
+};
+
+// Per-test results of a `bazel test` run, read from the JSON build event
+// stream it wrote with --build_event_json_file. The stream is parsed one
+// event at a time, so large runs do not need to fit in memory.
+class TestResults {
+private:
+    std::map<std::string, TestOutcome> outcomes;
+
+public:
+    // Reads `events`; every label in `expected` gets an outcome, even if the
+    // stream has none for it (or does not exist because Bazel failed early)
+    static TestResults fromBuildEvents(const std::filesystem::path& events, const std::vector<std::string>& expected);
+
+    // Outcomes ordered by duration, slowest first
+    std::vector<TestOutcome> bySlowest() const;
+
+    size_t passedCount() const;
+    size_t size() const { return outcomes.size(); }
+};
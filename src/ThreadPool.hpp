@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <exception>
+
+// Fixed-size worker pool. Tasks are run in submission order by whichever
+// worker is free; wait() blocks until every submitted task has finished and
+// rethrows the first exception any of them raised.
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable task_ready;
+    std::condition_variable all_done;
+    size_t pending = 0;
+    bool stopping = false;
+    std::exception_ptr first_error;
+
+    void workerLoop();
+
+public:
+    // Number of workers used when none is requested: one per hardware thread
+    static size_t defaultThreads();
+
+    explicit ThreadPool(size_t threads = defaultThreads());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+
+    // Block until all submitted tasks complete
+    void wait();
+
+    // Run fn(i) for every i in [0, count) across the pool and wait for completion.
+    // Indices are handed out in chunks to keep queue traffic low on large counts.
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+    size_t size() const { return workers.size(); }
+};
@@ -7,29 +7,316 @@
 #include <cstdio>
 #include <cstddef>
 #include <csignal>
+#include <map>
+#include <set>
+#include <memory>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <optional>
+#include <atomic>
+#include <mutex>
+#include <charconv>
+#include <limits>
 #include "BuildGenerator.hpp"
+#include "ModuleIndex.hpp"
+#include "ModuleGraph.hpp"
+#include "ThreadPool.hpp"
+#include "ScanCache.hpp"
+#include "FileWatcher.hpp"
+#include "StageCache.hpp"
+#include "SynthesisPlan.hpp"
+#include "NetlistStats.hpp"
+#include "ProcessRunner.hpp"
+#include "RunReport.hpp"
+#include "TestResults.hpp"
+#include "ArtifactStore.hpp"
+#include "PackageManifest.hpp"
+#include "PackageResolver.hpp"
+#include "PackageStore.hpp"
+#include "LintReport.hpp"
+#include "PlaceRouteLog.hpp"
+#include "FrameSet.hpp"
+#include "BuildState.hpp"
 
 extern "C" {
     #include <stdlib.h>
+    #include <glob.h>
+#ifdef __APPLE__
+    #include <mach-o/dyld.h>
+#endif
 }
 
+// Limits and timing report shared by the tool runs of one vpm command
+struct RunOptions {
+    // Terminate a tool that runs longer than this; zero means no limit
+    std::chrono::seconds timeout{0};
+    // Where the timing report is written; empty means .vpm/report.json
+    std::filesystem::path report_path;
+    // Receives a record per tool run, if set
+    RunReport* report = nullptr;
+};
+
 namespace {
-    // Execute a shell command and return its exit code
-    int executeCommand(const std::string& command) {
-        std::cout << "Executing: " << command << "\n";
-        const char* cmd = command.c_str();
-        return std::system(cmd);
+    // Execute a command as stage `stage` and return its exit code. Output is
+    // streamed with `prefix` on every line, so concurrent stages stay readable.
+    int executeCommand(const RunOptions& run, const std::string& stage, const std::string& command,
+                       const std::string& prefix = "") {
+        std::cout << prefix << "Executing: " << command << std::endl;
+        ProcessOptions process;
+        process.timeout = run.timeout;
+        process.prefix = prefix;
+        ProcessResult result;
+        try {
+            result = ProcessRunner::run(command, process);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            result.exit_code = 127;
+        }
+        if (result.timed_out) {
+            std::cerr << "Error: " << stage << " timed out after " << run.timeout.count() << "s\n";
+        }
+        if (run.report) {
+            run.report->add(stage, command, result);
+        }
+        return result.exit_code;
     }
 }
 
 void printUsage() {
     std::cout << "Usage: vpm [options] [files...]\n"
               << "Options:\n"
-              << "  --init                            Initialize Bazel workspace\n"
-              << "  --build <file1.sv> [file2.sv ...]  Build specified SystemVerilog files\n"
+              << "  --init                            Initialize Bazel workspace and point it at the artifact store\n"
+              << "  --build <file.sv|dir|glob> [...]   Build specified SystemVerilog files, directories or glob patterns\n"
               << "  --test <file.sv> <test.cpp>        Build with test file\n"
-              << "  --emulate <file.sv> [file2.sv ...] --xdc <constraints.xdc>  Synthesize and emulate on Xilinx FPGA\n"
-              << "  --help                             Display this help message\n";
+              << "  --test <file.sv|dir|glob> [...]    Run the testbench next to each module (<name>_test.cpp,\n"
+              << "                                     <name>_tb.cpp, test_<name>.cpp or tb_<name>.cpp; a\n"
+              << "                                     <name>_sweep.cpp runs as a multi-instance seed sweep, and\n"
+              << "                                     a <name>_warmup.cpp beside it is checkpointed once)\n"
+              << "  --test --manifest <tests.txt>      Run the \"<file.sv> <test.cpp>\" pairs listed in a manifest\n"
+              << "  --watch [dir ...]                  Regenerate BUILD files and rebuild affected targets on change\n"
+              << "  --check <file.sv|dir|glob> [...]   Lint every module and its submodules with verilator --lint-only\n"
+              << "  --serve <module> [--name <shm>]    Build the module's model and serve its ports over shared\n"
+              << "                                     memory (default /vpm-<module>) for vpm_shm.h clients\n"
+              << "  --emulate <file.sv> [file2.sv ...] --xdc <constraints.xdc> [--top <module>]\n"
+              << "                                     Synthesize and emulate on Xilinx FPGA\n"
+              << "    [--pnr-seeds N] [--pnr-cores C]  Place and route with N seeds in parallel on C cores and\n"
+              << "                                     keep the fastest result (default: 1 seed, all cores)\n"
+              << "    [--target-fmax <MHz>]            Stop the other seeds once one reaches this Fmax\n"
+              << "    [--partial]                      Program only the frames changed since the last programming\n"
+              << "  --stats <netlist.json> [...] [--max-luts N] [--max-ffs N] [--max-depth N]\n"
+              << "                                     Estimate resources and logic depth of Yosys netlists\n"
+              << "  --frames-diff <before.frames> <after.frames> [--output <partial.bit>]\n"
+              << "                                     Count changed frames and write a partial bitstream for them\n"
+              << "  --install [--frozen] [--registry <dir>]\n"
+              << "                                     Install the dependencies in vpm.toml into vpm_packages/\n"
+              << "  --cache-stats                      Show the size of the artifact store shared by all workspaces\n"
+              << "  --cache-gc [--max-size <size>] [--max-age <days>]\n"
+              << "                                     Trim least recently used artifacts (default max size: 10G)\n"
+              << "  --help                             Display this help message\n"
+              << "Store options (--init, --install, --cache-stats, --cache-gc):\n"
+              << "  --cache-dir <dir>                  Artifact store (default: $VPM_CACHE_DIR or ~/.cache/vpm)\n"
+              << "Build options (--build, --test, --watch, --check, --serve):\n"
+              << "  --profile <debug|fast|max>         Simulation profile (default: fast)\n"
+              << "  --trace <off|fst|vcd>              Waveform format (default: off)\n"
+              << "  --trace-window <start>:<stop>      Only dump waveforms in this time range (--test)\n"
+              << "  --jobs <n>                         Run at most n Bazel actions, tests or lint jobs at once\n"
+              << "  --seeds <n>                        Instances each sweep testbench runs (--test)\n"
+              << "  --top <module>                     Build only this module and what it instantiates (--build);\n"
+              << "                                     by default, every module the others do not instantiate\n"
+              << "  --hier-threshold <size>            Verilate instantiated modules with at least this much source\n"
+              << "                                     (e.g. 256K) as separately built hierarchical blocks\n"
+              << "  +define+<name>[=<value>][+...]     Macros defined while scanning sources for modules\n"
+              << "  +incdir+<dir>[+...]                Directories searched for `include files while scanning\n"
+              << "Run options (--build, --test, --watch, --check, --serve, --emulate):\n"
+              << "  --timeout <seconds>                Stop any tool that runs longer than this\n"
+              << "  --report <file.json>               Write per-stage timings here (default: .vpm/report.json);\n"
+              << "                                     --watch rewrites it after every rebuild\n";
+}
+
+// Options shared by the commands that run Bazel
+struct BuildOptions {
+    // Simulation profile; empty keeps the workspace default
+    std::string profile;
+    // Waveform format; empty keeps the workspace default
+    std::string trace;
+    // "<start>:<stop>" dump window passed to the test at run time
+    std::string trace_window;
+    // Concurrent Bazel actions and local tests; 0 leaves it to Bazel
+    size_t jobs = 0;
+    // Instances per sweep testbench; 0 keeps each target's default
+    size_t seeds = 0;
+    // +define+ and +incdir+ settings the module scan preprocesses with
+    SvPreprocessorOptions preprocessor;
+    // Module to build with what it instantiates; empty builds every root
+    std::string top;
+    // Source size from which an instantiated module is verilated as a
+    // hierarchical block; 0 verilates every model flat
+    uintmax_t hier_threshold = 0;
+    // Build a shared-memory server for the top instead of its library
+    bool serve = false;
+};
+
+// A module source and the GoogleTest testbench that exercises it
+struct TestCase {
+    std::string source;
+    std::string testbench;
+};
+
+// Parses a decimal argument of digits only into `value`. False if it is
+// empty, malformed or above `max`, so that an out-of-range value gets the
+// caller's usual error instead of an uncaught exception.
+template <typename T>
+bool parseNumber(const std::string& text, T& value, T max = std::numeric_limits<T>::max()) {
+    T parsed = 0;
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), parsed);
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos || ec != std::errc() ||
+        ptr != text.data() + text.size() || parsed > max) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+// Removes build options from `args` into `options`. Returns false after
+// printing an error if an option is malformed.
+bool parseBuildOptions(std::vector<std::string>& args, BuildOptions& options) {
+    static const std::set<std::string> profiles = {"debug", "fast", "max"};
+    static const std::set<std::string> trace_formats = {"off", "fst", "vcd"};
+    std::vector<std::string> remaining;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--profile") {
+            if (i + 1 >= args.size() || profiles.count(args[i + 1]) == 0) {
+                std::cout << "Error: --profile requires one of: debug, fast, max\n";
+                return false;
+            }
+            options.profile = args[++i];
+        } else if (args[i] == "--trace") {
+            if (i + 1 >= args.size() || trace_formats.count(args[i + 1]) == 0) {
+                std::cout << "Error: --trace requires one of: off, fst, vcd\n";
+                return false;
+            }
+            options.trace = args[++i];
+        } else if (args[i] == "--trace-window") {
+            const std::string window = i + 1 < args.size() ? args[i + 1] : "";
+            size_t colon = window.find(':');
+            bool valid = colon != std::string::npos && window.size() > 1 &&
+                         window.find(':', colon + 1) == std::string::npos &&
+                         window.find_first_not_of("0123456789:") == std::string::npos;
+            if (!valid) {
+                std::cout << "Error: --trace-window requires <start>:<stop>, e.g. 1000:2000 or 1000:\n";
+                return false;
+            }
+            options.trace_window = window;
+            ++i;
+        } else if (args[i] == "--jobs") {
+            if (i + 1 >= args.size() || !parseNumber(args[i + 1], options.jobs) || options.jobs == 0) {
+                std::cout << "Error: --jobs requires a positive number\n";
+                return false;
+            }
+            ++i;
+        } else if (args[i] == "--seeds") {
+            if (i + 1 >= args.size() || !parseNumber(args[i + 1], options.seeds) || options.seeds == 0) {
+                std::cout << "Error: --seeds requires a positive number\n";
+                return false;
+            }
+            ++i;
+        } else if (args[i] == "--top") {
+            if (i + 1 >= args.size()) {
+                std::cout << "Error: --top requires a module name\n";
+                return false;
+            }
+            options.top = args[++i];
+        } else if (args[i] == "--hier-threshold") {
+            try {
+                options.hier_threshold = ArtifactStore::parseSize(i + 1 < args.size() ? args[i + 1] : "");
+            } catch (const std::exception&) {
+                std::cout << "Error: --hier-threshold requires a size, e.g. 256K or 1M\n";
+                return false;
+            }
+            ++i;
+        } else if (!options.preprocessor.parseArgument(args[i])) {
+            remaining.push_back(args[i]);
+        }
+    }
+    args = std::move(remaining);
+    return true;
+}
+
+// Removes run options from `args` into `options`. Returns false after
+// printing an error if an option is malformed.
+bool parseRunOptions(std::vector<std::string>& args, RunOptions& options) {
+    std::vector<std::string> remaining;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--timeout") {
+            // Deadlines are compared in steady_clock ticks, which must not overflow
+            const auto max_seconds =
+                std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::duration::max()).count();
+            std::chrono::seconds::rep seconds = 0;
+            if (i + 1 >= args.size() || !parseNumber(args[i + 1], seconds, max_seconds)) {
+                std::cout << "Error: --timeout requires a number of seconds\n";
+                return false;
+            }
+            options.timeout = std::chrono::seconds(seconds);
+            ++i;
+        } else if (args[i] == "--report") {
+            if (i + 1 >= args.size()) {
+                std::cout << "Error: --report requires a file\n";
+                return false;
+            }
+            options.report_path = args[++i];
+        } else {
+            remaining.push_back(args[i]);
+        }
+    }
+    args = std::move(remaining);
+    return true;
+}
+
+// Writes the timing report of a finished command; a failure to write it
+// does not fail the command
+void writeReport(const RunReport& report, const RunOptions& options) {
+    std::filesystem::path path = options.report_path.empty()
+        ? RunReport::defaultPath(std::filesystem::current_path())
+        : options.report_path;
+    try {
+        report.write(path);
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: " << e.what() << "\n";
+        return;
+    }
+    if (!options.report_path.empty()) {
+        std::cout << "Timing report written to: " << path.string() << "\n";
+    }
+}
+
+// Bazel flags selecting the requested options. The profile and trace format
+// are build settings rather than BUILD attributes, so switching them does not
+// rewrite any BUILD file and each combination keeps its own action cache
+// entries. The trace window only affects the test run, not what is built.
+std::string bazelFlags(const BuildOptions& options, bool test = false) {
+    std::string flags;
+    if (!options.profile.empty()) {
+        flags += " --//tools/verilator:profile=" + options.profile;
+    }
+    if (!options.trace.empty()) {
+        flags += " --//tools/verilator:trace=" + options.trace;
+    }
+    if (options.jobs > 0) {
+        flags += " --jobs=" + std::to_string(options.jobs);
+    }
+    if (test && options.jobs > 0) {
+        flags += " --local_test_jobs=" + std::to_string(options.jobs);
+    }
+    if (test && !options.trace_window.empty()) {
+        flags += " --test_env=VPM_TRACE_WINDOW=" + options.trace_window;
+    }
+    if (test && options.seeds > 0) {
+        // Comes after a sweep target's own args, so it overrides them;
+        // GoogleTest testbenches ignore flags they do not know
+        flags += " --test_arg=--seeds=" + std::to_string(options.seeds);
+    }
+    return flags;
 }
 
 bool hasValidExtension(const std::string& filename, bool is_test_file = false) {
@@ -40,10 +327,350 @@ bool hasValidExtension(const std::string& filename, bool is_test_file = false) {
     return filename.substr(filename.length() - extension.length()) == extension;
 }
 
-void buildFiles(const std::vector<std::string>& files, const std::optional<std::string>& test_file = std::nullopt) {
+// Expand directory arguments (recursively) and glob patterns into .sv files.
+// The directories walked are appended to `directories` if given.
+std::vector<std::string> expandInputs(const std::vector<std::string>& inputs, StampedPaths* directories = nullptr) {
+    std::vector<std::string> files;
+    for (const auto& input : inputs) {
+        if (std::filesystem::is_directory(input)) {
+            for (const auto& path : ModuleIndex::listSourceFiles(input, directories)) {
+                if (hasValidExtension(path.string())) {
+                    files.push_back(path.string());
+                }
+            }
+        } else if (input.find_first_of("*?[") != std::string::npos) {
+            glob_t matches;
+            if (glob(input.c_str(), 0, nullptr, &matches) == 0) {
+                for (size_t i = 0; i < matches.gl_pathc; ++i) {
+                    files.push_back(matches.gl_pathv[i]);
+                }
+            } else {
+                std::cout << "Warning: Pattern '" << input << "' matched no files\n";
+            }
+            globfree(&matches);
+        } else {
+            files.push_back(input);
+        }
+    }
+    return files;
+}
+
+// Pairs each module file among `inputs` with the testbench beside it named
+// <stem>_test.cpp, <stem>_tb.cpp, test_<stem>.cpp, tb_<stem>.cpp or
+// <stem>_sweep.cpp, in that order. Files without a testbench are skipped.
+std::vector<TestCase> discoverTests(const std::vector<std::string>& inputs) {
+    std::vector<TestCase> tests;
+    for (const auto& file : expandInputs(inputs)) {
+        std::filesystem::path source(file);
+        std::string stem = source.stem().string();
+        for (const auto& name : {stem + "_test.cpp", stem + "_tb.cpp", "test_" + stem + ".cpp", "tb_" + stem + ".cpp",
+                                  stem + "_sweep.cpp"}) {
+            std::filesystem::path testbench = source.parent_path() / name;
+            if (std::filesystem::exists(testbench)) {
+                tests.push_back({file, testbench.string()});
+                break;
+            }
+        }
+    }
+    return tests;
+}
+
+// Picks the top modules of `files`: `requested` if given, otherwise those
+// ModuleGraph::topsOf() finds. Returns an empty list after printing an error.
+std::vector<std::string> selectTops(const ModuleIndex& index, const ModuleGraph& graph,
+                                    const std::vector<std::filesystem::path>& files, const std::string& requested) {
+    if (!requested.empty()) {
+        if (graph.find(requested) == ModuleGraph::kNone) {
+            std::cerr << "Error: Top module '" << requested << "' is not declared in the workspace\n";
+            return {};
+        }
+        return {requested};
+    }
+
+    std::vector<std::string> tops = graph.topsOf(index, files);
+    if (tops.empty()) {
+        std::cerr << "Error: No module is declared in the input files\n";
+    }
+    return tops;
+}
+
+// Appends the "<file.sv> <test.cpp>" pairs listed in `manifest`, one per
+// line; '#' starts a comment and relative paths are taken from the
+// manifest's directory. Returns false after printing an error.
+bool readTestManifest(const std::filesystem::path& manifest, std::vector<TestCase>& tests) {
+    std::ifstream file(manifest);
+    if (!file.is_open()) {
+        std::cout << "Error: Cannot read test manifest '" << manifest.string() << "'\n";
+        return false;
+    }
+    std::string line;
+    for (size_t line_number = 1; std::getline(file, line); ++line_number) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string source;
+        std::string testbench;
+        std::string extra;
+        if (!(fields >> source)) {
+            continue;
+        }
+        if (!(fields >> testbench) || (fields >> extra)) {
+            std::cout << "Error: " << manifest.string() << ":" << line_number
+                      << ": expected \"<file.sv> <test.cpp>\"\n";
+            return false;
+        }
+        tests.push_back({(manifest.parent_path() / source).lexically_normal().string(),
+                         (manifest.parent_path() / testbench).lexically_normal().string()});
+    }
+    return true;
+}
+
+// Prints the outcome of every test, slowest first
+void printTestSummary(const TestResults& results) {
+    std::vector<TestOutcome> outcomes = results.bySlowest();
+    size_t passed = results.passedCount();
+    std::cout << "\nTest summary: " << passed << " passed, " << outcomes.size() - passed << " failed, "
+              << outcomes.size() << " total\n";
+    for (const auto& outcome : outcomes) {
+        char duration[32];
+        std::snprintf(duration, sizeof(duration), "%9.2fs", outcome.duration_seconds);
+        std::cout << "  " << outcome.status << std::string(outcome.status.size() < 10 ? 10 - outcome.status.size() : 1, ' ')
+                  << duration << "  " << outcome.label << (outcome.cached ? " (cached)" : "") << "\n";
+    }
+}
+
+// Bazel label of a target in the package rooted at `dir`
+std::string targetLabel(const std::filesystem::path& workspace_root, const std::filesystem::path& dir,
+                        const std::string& target_name) {
+    // Lexical paths avoid a realpath() per file on large trees
+    std::string package = dir.lexically_relative(workspace_root).generic_string();
+    if (package == ".") {
+        package.clear();
+    }
+    return "//" + package + ":" + target_name;
+}
+
+// Writes build_serve/<top>/BUILD holding a server for the model target
+// `model_label` and returns the server's label. Each served module has its
+// own package, which the module scan skips like other build_* directories.
+std::string writeServerPackage(const std::filesystem::path& workspace_root, const std::string& top,
+                               const std::string& model_label) {
+    std::filesystem::path dir = workspace_root / "build_serve" / top;
+    std::filesystem::create_directories(dir);
+    BuildGenerator::writeIfChanged((dir / "BUILD").string(),
+                                   "load(\"//tools/verilator:defs.bzl\", \"verilator_hdl_server\")\n\n"
+                                   "verilator_hdl_server(\n"
+                                   "    name = \"server\",\n"
+                                   "    model = \"" + model_label + "\",\n"
+                                   "    top = \"" + top + "\",\n"
+                                   ")\n");
+    return targetLabel(workspace_root, dir, "server");
+}
+
+// Appends generators for the files declaring every module transitively
+// instantiated by the existing generators, so their targets exist for deps.
+// Missing modules already in `reported` are not warned about again.
+void addDependencyGenerators(const ModuleIndex& index, std::vector<BuildGenerator>& generators,
+                             std::set<std::filesystem::path>& seen_files,
+                             std::set<std::string>* reported = nullptr) {
+    std::vector<std::string> requested_modules;
+    for (const auto& generator : generators) {
+        for (const auto& module : generator.getModules()) {
+            requested_modules.push_back(module.name);
+        }
+    }
+
+    std::vector<std::string> missing;
+    std::vector<std::filesystem::path> dependency_files;
+    for (const auto& name : index.transitiveSubmodules(requested_modules, &missing)) {
+        const ModuleEntry* entry = index.find(name);
+        if (seen_files.insert(entry->file).second) {
+            dependency_files.push_back(entry->file);
+        }
+    }
+    for (const auto& name : missing) {
+        if (!reported || reported->insert(name).second) {
+            std::cerr << "Warning: submodule '" << name << "' is instantiated but not declared in the workspace\n";
+        }
+    }
+    for (const auto& file : dependency_files) {
+        generators.emplace_back(file, *index.findScan(file));
+    }
+}
+
+// Appends generators for the other source files in the packages the
+// generators belong to, so a rewritten package BUILD file keeps the targets
+// of every file in its directory
+void addPackageSiblings(const ModuleIndex& index, std::vector<BuildGenerator>& generators,
+                        std::set<std::filesystem::path>& seen_files) {
+    std::set<std::filesystem::path> packages;
+    for (const auto& generator : generators) {
+        packages.insert(generator.getPath().parent_path());
+    }
+    for (const auto& file : index.files()) {
+        if (packages.count(file.parent_path()) != 0 && hasValidExtension(file.string()) &&
+            seen_files.insert(file).second) {
+            generators.emplace_back(file, *index.findScan(file));
+        }
+    }
+}
+
+// Writes one BUILD file per package, holding every target in that directory.
+// Modules reaching `hier_threshold` bytes of source are marked as
+// hierarchical blocks. Directories of `included headers export them, in a
+// BUILD file of their own if they hold no sources. BUILD files are only
+// rewritten when their content changes; returns the paths of those that
+// were written, and sets `build_paths` to those of every package.
+std::vector<std::filesystem::path> writePackages(ThreadPool& pool, const ModuleIndex& index,
+                                                 std::vector<BuildGenerator>& generators, uintmax_t hier_threshold,
+                                                 const SvPreprocessorOptions& preprocessor,
+                                                 std::vector<std::filesystem::path>& build_paths) {
+    std::set<std::string> hier_blocks;
+    if (hier_threshold > 0) {
+        hier_blocks = index.hierarchicalBlocks(hier_threshold);
+    }
+    std::map<std::filesystem::path, std::vector<const BuildGenerator*>> package_map;
+    for (auto& generator : generators) {
+        generator.setModuleIndex(&index);
+        generator.setHierarchicalBlocks(&hier_blocks);
+        generator.setPreprocessorOptions(&preprocessor);
+        package_map[generator.getPath().parent_path()].push_back(&generator);
+    }
+    // Headers outside the workspace cannot be labelled; Verilator finds
+    // those through the absolute +incdir+ paths
+    std::map<std::filesystem::path, std::set<std::string>> header_map;
+    for (const auto& generator : generators) {
+        for (const auto& include : generator.getIncludes()) {
+            std::filesystem::path header(include);
+            std::string relative = header.lexically_relative(index.getRoot()).generic_string();
+            if (!relative.empty() && relative.rfind("..", 0) != 0) {
+                header_map[header.parent_path()].insert(header.filename().string());
+            }
+        }
+    }
+    std::vector<std::pair<std::filesystem::path, std::vector<const BuildGenerator*>>> packages(
+        package_map.begin(), package_map.end());
+    for (const auto& [dir, headers] : header_map) {
+        if (package_map.count(dir) == 0) {
+            packages.emplace_back(dir, std::vector<const BuildGenerator*>{});
+        }
+    }
+
+    const std::set<std::string> no_headers;
+    std::vector<char> written(packages.size(), 0);
+    pool.parallelFor(packages.size(), [&](size_t i) {
+        std::filesystem::path build_path = packages[i].first / "BUILD";
+        auto headers = header_map.find(packages[i].first);
+        const auto& exported = headers == header_map.end() ? no_headers : headers->second;
+        written[i] = packages[i].second.empty()
+                         ? BuildGenerator::generateHeaderBuildFile(build_path.string(), exported)
+                         : BuildGenerator::generatePackageBuildFile(build_path.string(), packages[i].second, exported);
+    });
+
+    std::vector<std::filesystem::path> written_paths;
+    build_paths.clear();
+    for (size_t i = 0; i < packages.size(); ++i) {
+        build_paths.push_back(packages[i].first / "BUILD");
+        if (written[i]) {
+            written_paths.push_back(build_paths.back());
+        }
+    }
+    return written_paths;
+}
+
+// Path of the running vpm executable; empty if it cannot be found
+std::string executablePath() {
+#ifdef __APPLE__
+    char buffer[4096];
+    uint32_t size = sizeof(buffer);
+    return _NSGetExecutablePath(buffer, &size) == 0 ? std::string(buffer) : std::string();
+#else
+    return "/proc/self/exe";
+#endif
+}
+
+// Everything besides the source tree that decides what a plain build
+// generates. The vpm executable is stamped too, as a rebuilt or upgraded
+// vpm may generate different BUILD files.
+std::string buildStateKey(const std::vector<std::string>& inputs, const BuildOptions& options) {
+    std::ostringstream key;
+    key << std::filesystem::current_path().string() << "\n";
+    for (const auto& input : inputs) {
+        key << input << "\n";
+    }
+    FileStamp executable = FileStamp::of(executablePath().c_str());
+    key << std::hex << options.preprocessor.fingerprint() << std::dec << "\n"
+        << options.top << "\n"
+        << options.hier_threshold << "\n"
+        << executable.mtime_ns << " " << executable.size << "\n";
+    return key.str();
+}
+
+// Runs `bazel build` on the given targets. Returns false if it failed.
+bool runBazelBuild(const RunOptions& run, const BuildOptions& options, const std::vector<std::string>& targets) {
+    std::string bazel_command = "bazel build" + bazelFlags(options);
+    for (const auto& target : targets) {
+        bazel_command += " " + target;
+    }
+
+    std::cout << "\nBuilding Verilator targets...\n";
+    if (int exit_code = executeCommand(run, "bazel build", bazel_command); exit_code != 0) {
+        std::cerr << "Error: Bazel build failed with exit code " << exit_code << "\n";
+        return false;
+    }
+    std::cout << "Build completed successfully.\n";
+    return true;
+}
+
+// Builds the targets of `inputs`, or with `tests` given, runs those tests
+// in one `bazel test`. Returns false if anything failed.
+bool buildFiles(const std::vector<std::string>& inputs, const BuildOptions& options, const RunOptions& run,
+                const std::vector<TestCase>& tests = {}) {
+    const bool testing = !tests.empty();
+
+    // A plain build of an unchanged tree reuses what the last one generated,
+    // without walking or scanning the tree. Glob matches are not stamped, and
+    // --serve writes a package of its own, so those always regenerate.
+    const bool stateful = !testing && !options.serve &&
+                          std::none_of(inputs.begin(), inputs.end(), [](const std::string& input) {
+                              return input.find_first_of("*?[") != std::string::npos;
+                          });
+    BuildState state(BuildState::defaultPath(std::filesystem::current_path()), buildStateKey(inputs, options));
+    if (stateful) {
+        StageTimer checking(*run.report, "check build state");
+        bool up_to_date = false;
+        try {
+            up_to_date = state.load();
+        } catch (const std::exception&) {
+            // An unreadable state only costs a full build
+        }
+        checking.finish(0, up_to_date);
+        if (up_to_date) {
+            for (const auto& warning : state.warnings) {
+                std::cerr << "Warning: " << warning << "\n";
+            }
+            std::cout << "Top module" << (state.tops.size() > 1 ? "s" : "") << ":";
+            for (const auto& top : state.tops) {
+                std::cout << " " << top;
+            }
+            std::cout << "\n";
+            std::cout << "No changes since the last build: " << state.file_count << " files in "
+                      << state.package_count << " packages are up to date\n";
+            return state.targets.empty() || runBazelBuild(run, options, state.targets);
+        }
+    }
+
+    StampedPaths walked;
+    std::vector<std::string> files;
+    if (testing) {
+        for (const auto& test : tests) {
+            files.push_back(test.source);
+        }
+    } else {
+        files = expandInputs(inputs, &walked);
+    }
     if (files.empty()) {
         std::cout << "Error: No input files specified for build command\n";
-        return;
+        return false;
     }
 
     // Validate file extensions
@@ -55,34 +682,135 @@ void buildFiles(const std::vector<std::string>& files, const std::optional<std::
         }
     }
 
-    if (test_file && !hasValidExtension(*test_file, true)) {
-        std::cout << "Error: Test file '" << *test_file << "' does not have .cpp extension\n";
-        hasInvalidFiles = true;
+    // The generated test target names its testbench relative to the package
+    std::map<std::filesystem::path, std::filesystem::path> testbenches;
+    for (const auto& test : tests) {
+        std::filesystem::path source = std::filesystem::absolute(test.source).lexically_normal();
+        std::filesystem::path testbench = std::filesystem::absolute(test.testbench).lexically_normal();
+        if (!hasValidExtension(test.testbench, true)) {
+            std::cout << "Error: Test file '" << test.testbench << "' does not have .cpp extension\n";
+            hasInvalidFiles = true;
+        } else if (testbench.parent_path() != source.parent_path()) {
+            std::cout << "Error: Test file '" << test.testbench << "' must be in the same directory as '"
+                      << test.source << "'\n";
+            hasInvalidFiles = true;
+        } else if (!testbenches.emplace(source, testbench).second && testbenches[source] != testbench) {
+            std::cout << "Error: '" << test.source << "' is listed with more than one testbench\n";
+            hasInvalidFiles = true;
+        }
     }
 
     if (hasInvalidFiles) {
-        return;
+        return false;
     }
 
     std::vector<std::string> bazel_targets;
+    ThreadPool pool;
+
+    // Index module declarations across the workspace so submodules resolve to
+    // targets; unchanged files are served from the persistent scan cache
+    ModuleIndex index(std::filesystem::current_path());
+    ScanCache cache(ScanCache::defaultPath(index.getRoot()), options.preprocessor);
+    StageTimer indexing(*run.report, "index workspace");
+    try {
+        cache.load();
+        index.scanTree(pool, &cache, &walked);
+    } catch (const std::exception& e) {
+        std::cerr << "Error indexing workspace: " << e.what() << "\n";
+        indexing.finish(1);
+        return false;
+    }
+    for (const auto& duplicate : index.getDuplicates()) {
+        state.warnings.push_back("module declared more than once, using the first: " + duplicate);
+        std::cerr << "Warning: " << state.warnings.back() << "\n";
+    }
 
-    // Process each file and generate BUILD files
+    // Requested files, deduplicated; files outside the workspace root were not
+    // covered by the tree scan and are scanned here
+    std::vector<std::filesystem::path> input_paths;
+    std::set<std::filesystem::path> seen_files;
+    std::vector<std::filesystem::path> unindexed;
     for (const auto& file : files) {
+        std::filesystem::path file_path = std::filesystem::absolute(file).lexically_normal();
+        if (!std::filesystem::exists(file_path)) {
+            std::cerr << "Error processing file '" << file << "': File does not exist: " << file_path.string() << "\n";
+            return false;
+        }
+        if (!seen_files.insert(file_path).second) {
+            continue;
+        }
+        input_paths.push_back(file_path);
+        if (!index.findScan(file_path)) {
+            unindexed.push_back(file_path);
+        }
+    }
+
+    std::vector<SvScanPtr> unindexed_scans(unindexed.size());
+    try {
+        pool.parallelFor(unindexed.size(), [&](size_t i) {
+            unindexed_scans[i] = cache.scan(unindexed[i]);
+        });
+    } catch (const std::exception& e) {
+        std::cerr << "Error processing files: " << e.what() << "\n";
+        return false;
+    }
+    for (size_t i = 0; i < unindexed.size(); ++i) {
+        index.addFile(unindexed[i], std::move(unindexed_scans[i]));
+    }
+    indexing.finish();
+
+    // Without tests only the top modules are built, as their targets
+    // verilate everything below them; input files no top reaches, such as
+    // unused modules or testbenches, are left out
+    std::vector<std::string> tops;
+    if (!testing) {
+        ModuleGraph graph(index);
+        tops = selectTops(index, graph, input_paths, options.top);
+        if (tops.empty()) {
+            return false;
+        }
+        std::vector<std::filesystem::path> reachable = graph.reachableFiles(tops);
+        size_t given = input_paths.size();
+        input_paths.erase(std::remove_if(input_paths.begin(), input_paths.end(),
+                                         [&](const std::filesystem::path& file) {
+                                             return !std::binary_search(reachable.begin(), reachable.end(), file);
+                                         }),
+                          input_paths.end());
+        size_t skipped = given - input_paths.size();
+        // A requested file holding a top reaches itself and was kept, so
+        // only tops from files that were not requested are added
+        for (const auto& top : tops) {
+            std::filesystem::path file = graph.file(graph.find(top));
+            if (seen_files.insert(file).second) {
+                input_paths.push_back(file);
+            }
+        }
+
+        std::cout << "Top module" << (tops.size() > 1 ? "s" : "") << ":";
+        for (const auto& top : tops) {
+            std::cout << " " << top;
+        }
+        std::cout << "\n";
+        if (skipped > 0) {
+            std::cout << "Skipping " << skipped << " file(s) not reachable from the top\n";
+        }
+    }
+
+    std::vector<BuildGenerator> generators;
+    generators.reserve(input_paths.size());
+    std::filesystem::path workspace_root = index.getRoot();
+
+    // Process each file
+    for (const auto& file_path : input_paths) {
         try {
-            std::filesystem::path file_path = std::filesystem::absolute(file);
-            std::filesystem::path dir_path = file_path.parent_path();
-            std::filesystem::path build_path = dir_path / "BUILD";
-
-            std::cout << "Generating BUILD file for: " << file << "\n";
-            
-            std::optional<std::filesystem::path> test_path = 
-                test_file ? std::make_optional(std::filesystem::absolute(*test_file)) : std::nullopt;
-            
-            BuildGenerator generator(file_path, test_path);
-            generator.generateBuildFile(build_path.string());
-            
-            std::cout << "Created BUILD file at: " << build_path << "\n";
-            
+            std::cout << "Generating BUILD file for: " << file_path.lexically_relative(workspace_root).string() << "\n";
+
+            auto testbench = testbenches.find(file_path);
+            generators.emplace_back(file_path, *index.findScan(file_path),
+                                    testbench == testbenches.end() ? std::nullopt
+                                                                   : std::make_optional(testbench->second));
+            const BuildGenerator& generator = generators.back();
+
             // Print detected submodules
             const auto& submodules = generator.getSubmodules();
             if (!submodules.empty()) {
@@ -92,43 +820,917 @@ void buildFiles(const std::vector<std::string>& files, const std::optional<std::
                 }
             }
 
-            // Add Bazel target for this file
-            std::string module_name = file_path.stem().string();
-            std::string target_path = std::filesystem::relative(dir_path).string();
-            
-            if (test_file) {
-                // For test mode, we only need the test target
-                std::string test_target = "//" + target_path + ":" + module_name + "_test";
-                bazel_targets.push_back(test_target);
-            } else {
-                // For build mode, we need the verilated target
-                std::string bazel_target = "//" + target_path + ":" + module_name + "_verilated";
-                bazel_targets.push_back(bazel_target);
+            // In test mode, the file's test target
+            if (testing) {
+                for (const auto& target_name : generator.getTargetNames()) {
+                    bazel_targets.push_back(targetLabel(workspace_root, file_path.parent_path(), target_name));
+                }
             }
 
         } catch (const std::exception& e) {
-            std::cerr << "Error processing file '" << file << "': " << e.what() << "\n";
+            std::cerr << "Error processing file '" << file_path.string() << "': " << e.what() << "\n";
+            return false;
+        }
+    }
+    for (const auto& top : tops) {
+        bazel_targets.push_back(targetLabel(workspace_root, index.find(top)->file.parent_path(), top + "_verilated"));
+    }
+
+    // Resolve the transitive instantiation graph
+    StageTimer generating(*run.report, "generate BUILD files");
+    addDependencyGenerators(index, generators, seen_files);
+    addPackageSiblings(index, generators, seen_files);
+
+    std::vector<std::filesystem::path> build_paths;
+    std::vector<std::filesystem::path> written;
+    try {
+        written = writePackages(pool, index, generators, options.hier_threshold, options.preprocessor, build_paths);
+    } catch (const std::exception& e) {
+        std::cerr << "Error writing BUILD files: " << e.what() << "\n";
+        generating.finish(1);
+        return false;
+    }
+    if (options.serve && tops.size() == 1) {
+        try {
+            bazel_targets = {writeServerPackage(workspace_root, tops.front(), bazel_targets.back())};
+        } catch (const std::exception& e) {
+            std::cerr << "Error writing server package: " << e.what() << "\n";
+            generating.finish(1);
+            return false;
+        }
+    }
+    generating.finish();
+    for (const auto& build_path : written) {
+        std::cout << "Created BUILD file at: " << build_path << "\n";
+    }
+    std::cout << "Scanned " << index.size() << " files (" << cache.getHits() << " cached) into "
+              << build_paths.size() << " packages (" << build_paths.size() - written.size() << " unchanged) using "
+              << pool.size() << " threads\n";
+
+    try {
+        cache.save();
+        // Writing a BUILD file changed the stamp of its directory after the
+        // walk, so the state is only recorded once a build wrote none
+        if (stateful && written.empty()) {
+            state.addStamps(walked);
+            state.addStamps(cache.stamps());
+            for (const auto& build_path : build_paths) {
+                state.addStamp(build_path, FileStamp::of(build_path));
+            }
+            state.tops = tops;
+            state.targets = bazel_targets;
+            state.file_count = index.size();
+            state.package_count = build_paths.size();
+            state.save();
+        }
+    } catch (const std::exception& e) {
+        // A stale cache or state only costs a rescan next time
+        std::cerr << "Warning: " << e.what() << "\n";
+    }
+
+    if (bazel_targets.empty()) {
+        return true;
+    }
+    if (!testing) {
+        return runBazelBuild(run, options, bazel_targets);
+    }
+
+    // All tests run in one invocation, paying Bazel's startup and analysis
+    // once; per-test results come from the build event stream
+    std::filesystem::path events = workspace_root / ".vpm" / "test_events.json";
+    std::filesystem::create_directories(events.parent_path());
+    std::filesystem::remove(events);
+    // Warm-up checkpoints outlive a test run, so tests restore them on the
+    // next run too; the sandbox must let tests write there
+    std::filesystem::path checkpoints = workspace_root / ".vpm" / "checkpoints";
+    std::filesystem::create_directories(checkpoints);
+    std::string bazel_command = "bazel test --keep_going --test_output=errors --build_event_json_file=" +
+                                events.string() + bazelFlags(options, true) +
+                                " --test_env=VPM_CHECKPOINT_DIR=" + checkpoints.string() +
+                                " --sandbox_writable_path=" + checkpoints.string();
+    for (const auto& target : bazel_targets) {
+        bazel_command += " " + target;
+    }
+
+    std::cout << "\nRunning " << bazel_targets.size() << " Verilator test(s)...\n";
+    int exit_code = executeCommand(run, "bazel test", bazel_command);
+    TestResults results = TestResults::fromBuildEvents(events, bazel_targets);
+    printTestSummary(results);
+    for (const auto& outcome : results.bySlowest()) {
+        StageRecord record;
+        record.name = "test " + outcome.label;
+        record.cached = outcome.cached;
+        record.exit_code = outcome.passed() ? 0 : 1;
+        record.wall_seconds = outcome.duration_seconds;
+        run.report->add(record);
+    }
+    if (exit_code != 0 || results.passedCount() != results.size()) {
+        std::cerr << "Error: Bazel test failed with exit code " << exit_code << "\n";
+        return false;
+    }
+    std::cout << "All tests passed.\n";
+    return true;
+}
+
+// Set from SIGINT so --watch can save its cache and exit cleanly
+volatile std::sig_atomic_t stop_watching = 0;
+
+void handleWatchInterrupt(int) {
+    stop_watching = 1;
+}
+
+// Regenerates the BUILD files for every source under the watched roots and
+// returns the modules that now have targets. Only changed BUILD files are written.
+std::set<std::string> regenerateWatched(ThreadPool& pool, const ModuleIndex& index,
+                                        const std::vector<std::filesystem::path>& roots, uintmax_t hier_threshold,
+                                        const SvPreprocessorOptions& preprocessor,
+                                        std::set<std::string>& reported_missing) {
+    std::vector<BuildGenerator> generators;
+    std::set<std::filesystem::path> seen_files;
+    for (const auto& file : index.files()) {
+        bool watched = std::any_of(roots.begin(), roots.end(), [&](const std::filesystem::path& root) {
+            std::string relative = file.lexically_relative(root).generic_string();
+            return !relative.empty() && relative.rfind("..", 0) != 0;
+        });
+        if (watched && hasValidExtension(file.string())) {
+            seen_files.insert(file);
+            generators.emplace_back(file, *index.findScan(file));
+        }
+    }
+    addDependencyGenerators(index, generators, seen_files, &reported_missing);
+
+    std::vector<std::filesystem::path> build_paths;
+    for (const auto& build_path : writePackages(pool, index, generators, hier_threshold, preprocessor, build_paths)) {
+        std::cout << "Updated BUILD file at: " << build_path << "\n";
+    }
+
+    std::set<std::string> modules;
+    for (const auto& generator : generators) {
+        for (const auto& module : generator.getModules()) {
+            modules.insert(module.name);
+        }
+    }
+    return modules;
+}
+
+std::string bazelBuildCommand(const ModuleIndex& index, const std::vector<std::string>& modules,
+                              const BuildOptions& options) {
+    // --watchfs lets the already-running Bazel server rely on file system
+    // notifications instead of re-stat'ing the whole workspace per build
+    std::string command = "bazel build --watchfs --keep_going" + bazelFlags(options);
+    for (const auto& module : modules) {
+        const ModuleEntry* entry = index.find(module);
+        command += " " + targetLabel(index.getRoot(), entry->file.parent_path(), module + "_verilated");
+    }
+    return command;
+}
+
+void watchFiles(const std::vector<std::string>& inputs, const BuildOptions& options, RunOptions run,
+                const std::string& invocation) {
+    std::vector<std::filesystem::path> roots;
+    for (const auto& input : inputs.empty() ? std::vector<std::string>{"."} : inputs) {
+        if (!std::filesystem::is_directory(input)) {
+            std::cout << "Error: '" << input << "' is not a directory\n";
             return;
         }
+        roots.push_back(std::filesystem::absolute(input).lexically_normal());
+    }
+
+    ThreadPool pool;
+    ModuleIndex index(std::filesystem::current_path());
+    ScanCache cache(ScanCache::defaultPath(index.getRoot()), options.preprocessor);
+    std::set<std::string> targeted;
+    std::set<std::string> reported_missing;
+    // Each rebuild gets a report of its own, replacing the previous one
+    auto report = std::make_unique<RunReport>(invocation);
+    run.report = report.get();
+    try {
+        StageTimer indexing(*run.report, "index workspace");
+        cache.load();
+        index.scanTree(pool, &cache);
+        indexing.finish();
+        StageTimer generating(*run.report, "generate BUILD files");
+        targeted = regenerateWatched(pool, index, roots, options.hier_threshold, options.preprocessor, reported_missing);
+        cache.save();
+        generating.finish();
+    } catch (const std::exception& e) {
+        std::cerr << "Error preparing workspace: " << e.what() << "\n";
+        return;
     }
 
-    // Build all targets with Bazel
-    if (!bazel_targets.empty()) {
-        std::string bazel_command = test_file ? "bazel test" : "bazel build";
-        for (const auto& target : bazel_targets) {
-            bazel_command += " " + target;
+    // Initial build starts the Bazel server and fills its action cache
+    if (!targeted.empty()) {
+        std::string bazel_command = bazelBuildCommand(index, {targeted.begin(), targeted.end()}, options);
+        if (int exit_code = executeCommand(run, "bazel build", bazel_command); exit_code != 0) {
+            std::cerr << "Warning: Initial Bazel build failed with exit code " << exit_code << "\n";
         }
+    }
+    writeReport(*report, run);
+
+    std::unique_ptr<FileWatcher> watcher;
+    try {
+        watcher = std::make_unique<FileWatcher>(index.getRoot());
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return;
+    }
 
-        std::cout << "\nBuilding Verilator targets...\n";
-        if (int exit_code = executeCommand(bazel_command); exit_code != 0) {
+    std::signal(SIGINT, handleWatchInterrupt);
+    std::cout << "Watching for changes (Ctrl-C to stop)...\n";
+
+    while (!stop_watching) {
+        std::vector<std::filesystem::path> changed = watcher->waitForChanges(std::chrono::milliseconds(500));
+        if (changed.empty()) {
+            continue;
+        }
+        report = std::make_unique<RunReport>(invocation);
+        run.report = report.get();
+        StageTimer updating(*run.report, "update BUILD files");
+
+        // A changed header changes the scan of every file that includes it
+        std::vector<std::filesystem::path> rescan;
+        std::set<std::filesystem::path> queued;
+        for (const auto& file : changed) {
+            std::cout << "Changed: " << file.lexically_relative(index.getRoot()).string() << "\n";
+            cache.invalidateInclude(file);
+            std::string extension = file.extension().string();
+            if ((extension == ".sv" || extension == ".v") && queued.insert(file).second) {
+                rescan.push_back(file);
+            }
+            for (const auto& includer : index.includers(file)) {
+                if (queued.insert(includer).second) {
+                    rescan.push_back(includer);
+                }
+            }
+        }
+
+        // Modules declared before and after the change are both affected
+        std::vector<std::string> changed_modules;
+        std::vector<std::pair<std::filesystem::path, SvScanPtr>> updates;
+        for (const auto& file : rescan) {
+            if (const SvScanResult* previous = index.findScan(file)) {
+                for (const auto& module : previous->modules) {
+                    changed_modules.push_back(module.name);
+                }
+            }
+
+            SvScanPtr scan;
+            if (std::filesystem::exists(file)) {
+                try {
+                    scan = cache.scan(file);
+                } catch (const std::exception& e) {
+                    std::cerr << "Warning: " << e.what() << "\n";
+                    continue;
+                }
+                for (const auto& module : scan->modules) {
+                    changed_modules.push_back(module.name);
+                }
+            }
+            updates.emplace_back(file, std::move(scan));
+        }
+
+        std::vector<std::string> affected;
+        try {
+            index.updateFiles(std::move(updates));
+            targeted = regenerateWatched(pool, index, roots, options.hier_threshold, options.preprocessor, reported_missing);
+            cache.save();
+        } catch (const std::exception& e) {
+            std::cerr << "Error updating BUILD files: " << e.what() << "\n";
+            updating.finish(1);
+            writeReport(*report, run);
+            continue;
+        }
+        updating.finish();
+
+        // Rebuild only the reverse-dependency closure of what changed
+        for (const auto& module : index.dependents(changed_modules)) {
+            if (targeted.count(module) != 0) {
+                affected.push_back(module);
+            }
+        }
+        if (affected.empty()) {
+            std::cout << "No affected targets.\n";
+            writeReport(*report, run);
+            continue;
+        }
+
+        std::cout << "Rebuilding " << affected.size() << " affected target(s)...\n";
+        if (int exit_code = executeCommand(run, "bazel build", bazelBuildCommand(index, affected, options));
+            exit_code != 0) {
             std::cerr << "Error: Bazel build failed with exit code " << exit_code << "\n";
+        } else {
+            std::cout << "Build completed successfully.\n";
+        }
+        writeReport(*report, run);
+    }
+
+    std::cout << "Stopped watching.\n";
+}
+
+// Lints every module of `inputs` and everything they instantiate with
+// `verilator --lint-only`, one module per job. A module's result is cached
+// by the content of the files it is linted with, so unchanged modules are
+// not linted again. Returns false if any module has errors.
+bool checkFiles(const std::vector<std::string>& inputs, const BuildOptions& options, const RunOptions& run) {
+    std::vector<std::string> files = expandInputs(inputs);
+    if (files.empty()) {
+        std::cout << "Error: No input files specified for check command\n";
+        return false;
+    }
+    for (const auto& file : files) {
+        if (!hasValidExtension(file)) {
+            std::cout << "Error: File '" << file << "' does not have .sv extension\n";
+            return false;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool pool;
+    ModuleIndex index(std::filesystem::current_path());
+    ScanCache cache(ScanCache::defaultPath(index.getRoot()), options.preprocessor);
+    std::vector<std::string> tops;
+    StageTimer indexing(*run.report, "index workspace");
+    try {
+        cache.load();
+        index.scanTree(pool, &cache);
+        for (const auto& file : files) {
+            std::filesystem::path file_path = std::filesystem::absolute(file).lexically_normal();
+            if (!index.findScan(file_path)) {
+                index.addFile(file_path, cache.scan(file_path));
+            }
+            for (const auto& module : index.findScan(file_path)->modules) {
+                tops.push_back(module.name);
+            }
+        }
+        cache.save();
+    } catch (const std::exception& e) {
+        std::cerr << "Error indexing workspace: " << e.what() << "\n";
+        indexing.finish(1);
+        return false;
+    }
+    indexing.finish();
+
+    std::vector<std::string> modules = index.transitiveSubmodules(tops);
+    for (const auto& top : tops) {
+        if (std::find(modules.begin(), modules.end(), top) == modules.end()) {
+            modules.push_back(top);
+        }
+    }
+
+    std::string flags;
+    for (const auto& [name, value] : options.preprocessor.defines) {
+        flags += " +define+" + name + (value.empty() ? "" : "=" + value);
+    }
+    for (const auto& dir : options.preprocessor.include_dirs) {
+        flags += " +incdir+" + dir.string();
+    }
+
+    // A module is linted with the files declaring everything below it, and
+    // keyed by those files and the headers they include
+    std::vector<Stage> stages;
+    std::filesystem::path log_dir = index.getRoot() / ".vpm" / "lint";
+    for (const auto& module : modules) {
+        const ModuleEntry* entry = index.find(module);
+        std::vector<std::filesystem::path> sources = {entry->file};
+        for (const auto& submodule : index.transitiveSubmodules(module)) {
+            std::filesystem::path file = index.find(submodule)->file;
+            if (std::find(sources.begin(), sources.end(), file) == sources.end()) {
+                sources.push_back(file);
+            }
+        }
+
+        Stage stage;
+        stage.name = "lint " + module;
+        stage.tool = "verilator";
+        stage.command = "verilator --lint-only -Wno-fatal --top-module " + module + flags;
+        stage.inputs = sources;
+        for (const auto& source : sources) {
+            stage.command += " " + source.string();
+            for (const auto& include : index.findScan(source)->includes) {
+                if (std::find(stage.inputs.begin(), stage.inputs.end(), include) == stage.inputs.end()) {
+                    stage.inputs.emplace_back(include);
+                }
+            }
+        }
+        stage.outputs = {log_dir / (module + ".log")};
+        stages.push_back(std::move(stage));
+    }
+
+    // Each job's output is kept in its log, whatever the lint found; only
+    // a tool that failed to run is not cached
+    StageCache stage_cache(StageCache::defaultPath(index.getRoot()));
+    std::vector<int> exit_codes(stages.size(), 0);
+    std::vector<char> cached(stages.size(), 0);
+    std::filesystem::create_directories(log_dir);
+    ThreadPool lint_pool(options.jobs > 0 ? options.jobs : ThreadPool::defaultThreads());
+    lint_pool.parallelFor(stages.size(), [&](size_t i) {
+        const Stage& stage = stages[i];
+        auto execute = [&](const std::string& command) {
+            ProcessOptions process;
+            process.timeout = run.timeout;
+            process.echo = false;
+            process.capture = true;
+            ProcessResult result;
+            try {
+                result = ProcessRunner::run(command, process);
+            } catch (const std::exception& e) {
+                result.exit_code = 127;
+                result.errors = std::string("%Error: ") + e.what() + "\n";
+            }
+            if (run.report) {
+                run.report->add(stage.name, command, result);
+            }
+            std::ofstream(stage.outputs[0], std::ios::trunc) << result.errors << result.output;
+            return result.exit_code > 1 ? result.exit_code : 0;
+        };
+        bool hit = false;
+        try {
+            exit_codes[i] = stage_cache.run(stage, execute, hit);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << stage.name << ": " << e.what() << "\n";
+            exit_codes[i] = 1;
+        }
+        cached[i] = hit;
+    });
+
+    LintReport report;
+    size_t cached_count = 0;
+    bool ran = true;
+    for (size_t i = 0; i < stages.size(); ++i) {
+        cached_count += cached[i];
+        std::ifstream log(stages[i].outputs[0]);
+        std::ostringstream output;
+        output << log.rdbuf();
+        report.addOutput(output.str());
+        if (exit_codes[i] != 0) {
+            std::cerr << "Error: " << stages[i].name << " failed with exit code " << exit_codes[i] << "\n"
+                      << output.str();
+            ran = false;
+        }
+    }
+
+    for (const auto& diagnostic : report.sorted()) {
+        std::string location;
+        if (!diagnostic.file.empty()) {
+            std::filesystem::path file(diagnostic.file);
+            location = (file.is_absolute() ? file.lexically_relative(index.getRoot()) : file).string() + ":" +
+                       std::to_string(diagnostic.line) + ":" +
+                       (diagnostic.column > 0 ? std::to_string(diagnostic.column) + ":" : "") + " ";
+        }
+        std::cout << location << (diagnostic.error ? "error" : "warning")
+                  << (diagnostic.code.empty() ? "" : "[" + diagnostic.code + "]") << ": " << diagnostic.message
+                  << "\n" << diagnostic.detail;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::ostringstream elapsed;
+    elapsed.precision(1);
+    elapsed << std::fixed << seconds;
+    std::cout << "Linted " << stages.size() << " modules (" << cached_count << " cached) in " << elapsed.str()
+              << "s: " << report.errorCount() << " errors, " << report.warningCount() << " warnings\n";
+    return ran && report.errorCount() == 0;
+}
+
+// Limits for --stats; 0 means unchecked
+struct StatsLimits {
+    size_t max_luts = 0;
+    size_t max_flip_flops = 0;
+    size_t max_depth = 0;
+};
+
+// Prints resource and depth estimates for each netlist. Returns false if a
+// netlist cannot be read or its top module exceeds a limit.
+bool showStats(const std::vector<std::string>& netlists, const StatsLimits& limits) {
+    bool within_limits = true;
+    for (const auto& netlist : netlists) {
+        NetlistStats stats;
+        try {
+            stats = NetlistStats::analyze(netlist);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return false;
+        }
+
+        std::cout << netlist << ":\n";
+        for (const auto& module : stats.getModules()) {
+            std::cout << "  Module " << module.name << (module.top ? " (top)" : "") << ": " << module.cells
+                      << " cells\n";
+            for (const auto& [type, count] : module.cell_counts) {
+                std::cout << "    " << type << std::string(type.size() < 24 ? 24 - type.size() : 1, ' ') << count
+                          << "\n";
+            }
+            std::cout << "    Flip-flops: " << module.flip_flops << ", LUTs (est.): " << module.luts
+                      << ", logic depth: " << module.logic_depth << " levels\n";
+            if (module.unmapped_cells > 0) {
+                std::cout << "    Note: " << module.unmapped_cells
+                          << " word-level cells are not technology mapped and not in the LUT estimate\n";
+            }
+            if (module.combinational_loop) {
+                std::cout << "    Warning: combinational loop detected\n";
+            }
+        }
+
+        const ModuleStats* top = stats.findTop();
+        if (!top) {
+            continue;
+        }
+        ModuleStats total = stats.hierarchyTotal(top->name);
+        std::cout << "  Design total (" << top->name << "): " << total.flip_flops << " flip-flops, " << total.luts
+                  << " LUTs (est.), logic depth " << total.logic_depth << " levels\n";
+
+        auto check = [&](const char* what, size_t value, size_t limit) {
+            if (limit > 0 && value > limit) {
+                std::cerr << "Error: " << netlist << ": " << what << " " << value << " exceeds limit " << limit << "\n";
+                within_limits = false;
+            }
+        };
+        check("LUT estimate", total.luts, limits.max_luts);
+        check("flip-flop count", total.flip_flops, limits.max_flip_flops);
+        check("logic depth", total.logic_depth, limits.max_depth);
+    }
+    return within_limits;
+}
+
+// Removes --cache-dir from `args`, returning the store it selects. Returns
+// nullopt after printing an error if it is malformed.
+std::optional<ArtifactStore> parseStoreOption(std::vector<std::string>& args) {
+    std::filesystem::path root;
+    std::vector<std::string> remaining;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--cache-dir") {
+            if (i + 1 >= args.size()) {
+                std::cout << "Error: --cache-dir requires a directory\n";
+                return std::nullopt;
+            }
+            root = std::filesystem::absolute(args[++i]);
+        } else {
+            remaining.push_back(args[i]);
+        }
+    }
+    args = std::move(remaining);
+    try {
+        return ArtifactStore(root.empty() ? ArtifactStore::defaultRoot() : root);
+    } catch (const std::exception& e) {
+        std::cout << "Error: " << e.what() << "\n";
+        return std::nullopt;
+    }
+}
+
+// Age of a store entry for display, e.g. "3 days"
+std::string describeAge(std::filesystem::file_time_type time) {
+    auto age = std::chrono::duration_cast<std::chrono::hours>(std::filesystem::file_time_type::clock::now() - time);
+    if (age.count() < 48) {
+        return std::to_string(std::max<long>(age.count(), 0)) + " hours";
+    }
+    return std::to_string(age.count() / 24) + " days";
+}
+
+void showStoreStats(const ArtifactStore& store) {
+    StoreUsage disk = store.diskCacheUsage();
+    StoreUsage repos = store.repositoryCacheUsage();
+    StoreUsage packages = store.packageStoreUsage();
+    std::cout << "Artifact store: " << store.path().string() << "\n";
+    std::cout << "  Build outputs:     " << disk.files << " files, " << ArtifactStore::formatSize(disk.bytes);
+    if (disk.oldest) {
+        std::cout << " (least recently used " << describeAge(*disk.oldest) << " ago)";
+    }
+    std::cout << "\n";
+    std::cout << "  Downloads:         " << repos.files << " files, " << ArtifactStore::formatSize(repos.bytes) << "\n";
+    std::cout << "  Packages:          " << packages.files << " files, " << ArtifactStore::formatSize(packages.bytes)
+              << "\n";
+    std::cout << "  Total:             " << ArtifactStore::formatSize(disk.bytes + repos.bytes + packages.bytes) << "\n";
+    if (disk.files == 0 && !std::filesystem::exists(store.diskCache())) {
+        std::cout << "No workspace uses this store yet; run vpm --init in a workspace\n";
+    }
+}
+
+// Trims the store's build outputs. Returns false after printing an error.
+bool collectStore(const ArtifactStore& store, std::vector<std::string> args) {
+    uintmax_t max_bytes = ArtifactStore::parseSize("10G");
+    std::optional<std::chrono::hours> max_age;
+    for (size_t i = 0; i < args.size(); ++i) {
+        bool has_value = i + 1 < args.size();
+        if (args[i] == "--max-size" && has_value) {
+            try {
+                max_bytes = ArtifactStore::parseSize(args[++i]);
+            } catch (const std::exception& e) {
+                std::cout << "Error: --max-size: " << e.what() << " (expected e.g. 500M or 10G)\n";
+                return false;
+            }
+        } else if (args[i] == "--max-age" && has_value) {
+            // File ages are compared in file_clock ticks, which must not overflow
+            const auto max_days =
+                std::chrono::duration_cast<std::chrono::hours>(std::filesystem::file_time_type::duration::max())
+                    .count() / 24;
+            std::chrono::hours::rep days = 0;
+            if (!parseNumber(args[i + 1], days, max_days)) {
+                std::cout << "Error: --max-age requires a number of days\n";
+                return false;
+            }
+            max_age = std::chrono::hours(24 * days);
+            ++i;
+        } else {
+            std::cout << "Error: Unknown --cache-gc argument '" << args[i] << "'\n";
+            return false;
+        }
+    }
+
+    StoreCollection result = store.collect(max_bytes, max_age);
+    std::cout << "Removed " << result.removed_files << " files (" << ArtifactStore::formatSize(result.removed_bytes)
+              << ") from " << store.diskCache().string() << "; kept " << result.kept_files << " files ("
+              << ArtifactStore::formatSize(result.kept_bytes) << ")\n";
+    return true;
+}
+
+// Installs the packages vpm.toml depends on into vpm_packages/<name>,
+// following vpm.lock while it still satisfies the manifest and updating it
+// otherwise. Packages pinned in the lock and already in the store are
+// linked without reading the registry. Returns false after printing an error.
+bool installPackages(const ArtifactStore& store, std::vector<std::string> args) {
+    std::filesystem::path root = std::filesystem::current_path();
+    std::filesystem::path registry;
+    bool frozen = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--frozen") {
+            frozen = true;
+        } else if (args[i] == "--registry" && i + 1 < args.size()) {
+            registry = std::filesystem::absolute(args[++i]);
+        } else {
+            std::cout << "Error: Unknown --install argument '" << args[i] << "'\n";
+            return false;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        PackageManifest manifest = PackageManifest::read(root / PackageManifest::kFileName);
+        if (registry.empty()) {
+            const char* env = std::getenv("VPM_REGISTRY");
+            registry = env && *env ? std::filesystem::absolute(env) : manifest.registry;
+        }
+        PackageResolver resolver(root, registry);
+        PackageStore packages(store.packageStore());
+
+        std::filesystem::path lock_path = root / PackageLock::kFileName;
+        PackageLock lock;
+        bool locked = std::filesystem::exists(lock_path);
+        if (locked) {
+            lock = PackageLock::read(lock_path);
+        }
+
+        // Source directory of each package, or empty when the locked
+        // content is already stored
+        std::vector<std::filesystem::path> sources;
+        bool lock_changed = false;
+        if (locked && resolver.lockSatisfies(lock, manifest)) {
+            for (const auto& package : lock.packages) {
+                // Path packages are live directories and always re-read
+                bool stored = package.source == "registry" && packages.contains(package.hash);
+                sources.push_back(stored ? std::filesystem::path() : resolver.sourceDirectory(package));
+            }
+        } else {
+            if (frozen) {
+                std::cout << "Error: " << PackageLock::kFileName << (locked ? " is out of date with " : " is missing for ")
+                          << PackageManifest::kFileName << " (--frozen)\n";
+                return false;
+            }
+            lock.packages.clear();
+            for (const auto& package : resolver.resolve(manifest)) {
+                lock.packages.push_back({package.name, package.version, package.source, "", package.dependencies});
+                sources.push_back(package.directory);
+            }
+            lock_changed = true;
+        }
+
+        std::filesystem::path install_dir = root / "vpm_packages";
+        std::vector<std::string> hashes(lock.packages.size());
+        std::atomic<size_t> installed{0};
+        LinkCounts counts;
+        ThreadPool pool;
+        pool.parallelFor(lock.packages.size(), [&](size_t i) {
+            const LockedPackage& package = lock.packages[i];
+            hashes[i] = sources[i].empty() ? package.hash : packages.add(sources[i]);
+            // Registry content is immutable once locked; path packages are
+            // live directories whose hash follows their content
+            if (!package.hash.empty() && package.source == "registry" && hashes[i] != package.hash) {
+                throw std::runtime_error("Content of " + package.name + " " + package.version +
+                                         " does not match its hash in " + PackageLock::kFileName + " (" +
+                                         sources[i].string() + " changed since it was locked)");
+            }
+            // install() replaces the target wholesale, so it must be a
+            // direct child of vpm_packages/
+            std::filesystem::path target = (install_dir / package.name).lexically_normal();
+            if (!PackageManifest::isValidName(package.name) || target.parent_path() != install_dir) {
+                throw std::runtime_error("Refusing to install package '" + package.name + "' outside " +
+                                         install_dir.string());
+            }
+            if (packages.install(hashes[i], target, counts)) {
+                ++installed;
+            }
+        });
+        for (size_t i = 0; i < lock.packages.size(); ++i) {
+            lock_changed = lock_changed || lock.packages[i].hash != hashes[i];
+            lock.packages[i].hash = hashes[i];
+        }
+
+        // Packages dropped from the lock
+        std::set<std::string> names;
+        for (const auto& package : lock.packages) {
+            names.insert(package.name);
+        }
+        if (std::filesystem::is_directory(install_dir)) {
+            for (const auto& entry : std::filesystem::directory_iterator(install_dir)) {
+                if (entry.is_directory() && names.count(entry.path().filename().string()) == 0) {
+                    std::filesystem::remove_all(entry.path());
+                    std::cout << "Removed " << entry.path().filename().string() << "\n";
+                }
+            }
+        }
+
+        if (lock_changed) {
+            if (frozen) {
+                std::cout << "Error: " << PackageLock::kFileName << " is out of date (--frozen)\n";
+                return false;
+            }
+            lock.write(lock_path);
+            std::cout << "Updated " << PackageLock::kFileName << "\n";
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Installed " << installed << " packages, " << lock.packages.size() - installed
+                  << " already up to date, in " << seconds << "s (" << counts.hardlinked << " files hardlinked, " << counts.reflinked << " reflinked, "
+                  << counts.copied << " copied)\n";
+    } catch (const std::exception& e) {
+        std::cout << "Error: " << e.what() << "\n";
+        return false;
+    }
+    return true;
+}
+
+// The device --emulate targets; the partial bitstream header names it
+BitstreamTarget emulationTarget(const std::string& design) {
+    return BitstreamTarget{"7a35tcsg324", 0x0362D093, design};
+}
+
+// Compares two .frames files, reports how many frames changed, and writes
+// a partial bitstream loading just those to `partial_bit` if any did.
+// Returns the number of changed frames, or nothing on error.
+std::optional<size_t> writeFrameDiff(const std::filesystem::path& before, const std::filesystem::path& after,
+                                     const std::filesystem::path& partial_bit, const std::string& design) {
+    try {
+        FrameSet old_frames = FrameSet::read(before);
+        FrameSet new_frames = FrameSet::read(after);
+        FrameSet changed = FrameSet::diff(old_frames, new_frames);
+        size_t total = std::max(old_frames.size(), new_frames.size());
+        std::cout << "Changed frames: " << changed.size() << " of " << total << " configured";
+        if (total > 0) {
+            std::cout << " (" << (changed.size() * 100 + total / 2) / total << "%)";
+        }
+        std::cout << "\n";
+        if (!changed.empty()) {
+            std::filesystem::path diff_frames = partial_bit;
+            changed.write(diff_frames.replace_extension(".frames"));
+            changed.writePartialBitstream(partial_bit, emulationTarget(design));
+            std::cout << "Partial bitstream: " << partial_bit.string() << "\n";
+        }
+        return changed.size();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return std::nullopt;
+    }
+}
+
+// Options of the --emulate command
+struct EmulateOptions {
+    // Top module; empty detects it from the files
+    std::string top;
+    // Place-and-route runs with different seeds; the best result is kept
+    unsigned pnr_seeds = 1;
+    // Cores shared by those runs; 0 means all of them
+    unsigned pnr_cores = 0;
+    // Stop the remaining runs once one reaches this Fmax in MHz; 0 runs all
+    double target_fmax = 0;
+    // Program only the frames that changed since the last programming
+    bool partial = false;
+};
+
+// Places and routes `pnr` once per seed, up to as many runs at once as the
+// core budget allows, and copies the .fasm of the run with the highest
+// worst-clock Fmax (then the fewest cells) to `fasm`. Each seed is its own
+// cached stage, so only seeds whose inputs changed run again. Once a run
+// reaches the target Fmax, runs in flight are cancelled and the rest skipped.
+bool placeAndRouteSeeds(const Stage& pnr, const std::filesystem::path& fasm, const EmulateOptions& options,
+                        StageCache& stage_cache, const RunOptions& run) {
+    unsigned cores = options.pnr_cores > 0 ? options.pnr_cores : ThreadPool::defaultThreads();
+    unsigned parallel = std::max(1u, std::min(options.pnr_seeds, cores));
+    unsigned threads = std::max(1u, cores / parallel);
+    std::filesystem::path seed_dir = fasm.parent_path() / "pnr";
+    std::filesystem::create_directories(seed_dir);
+    std::cout << "Placing and routing " << options.pnr_seeds << " seeds, " << parallel << " at a time"
+              << (threads > 1 ? " with " + std::to_string(threads) + " threads each" : "") << "...\n";
+
+    std::vector<Stage> stages;
+    for (unsigned seed = 1; seed <= options.pnr_seeds; ++seed) {
+        std::string base = (seed_dir / ("seed_" + std::to_string(seed))).string();
+        Stage stage = pnr;
+        stage.name = pnr.name + " seed " + std::to_string(seed);
+        stage.command += " --seed " + std::to_string(seed) + " --fasm " + base + ".fasm" + " --log " + base + ".log" +
+                         (threads > 1 ? " --threads " + std::to_string(threads) : "");
+        stage.outputs = {base + ".fasm", base + ".log"};
+        stages.push_back(std::move(stage));
+    }
+
+    std::atomic<bool> target_met{false};
+    std::mutex output_mutex;
+    std::vector<std::optional<PlaceRouteLog>> results(stages.size());
+    ThreadPool seed_pool(parallel);
+    seed_pool.parallelFor(stages.size(), [&](size_t i) {
+        const Stage& stage = stages[i];
+        if (target_met) {
             return;
         }
-        std::cout << "Build completed successfully.\n";
+        auto execute = [&](const std::string& command) {
+            ProcessOptions process;
+            process.timeout = run.timeout;
+            process.echo = false;
+            process.capture = true;
+            process.cancel = options.target_fmax > 0 ? &target_met : nullptr;
+            ProcessResult result;
+            try {
+                result = ProcessRunner::run(command, process);
+            } catch (const std::exception& e) {
+                result.exit_code = 127;
+                result.errors = std::string("Error: ") + e.what() + "\n";
+            }
+            if (run.report) {
+                run.report->add(stage.name, command, result);
+            }
+            if (result.exit_code != 0 && !result.cancelled) {
+                std::lock_guard<std::mutex> lock(output_mutex);
+                std::cerr << "Error: " << stage.name << " failed with exit code " << result.exit_code << "\n"
+                          << result.errors << result.output;
+            }
+            return result.exit_code;
+        };
+        bool cached = false;
+        int exit_code = 0;
+        try {
+            exit_code = stage_cache.run(stage, execute, cached);
+            if (exit_code == 0) {
+                results[i] = PlaceRouteLog::read(stage.outputs[1]);
+            }
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(output_mutex);
+            std::cerr << "Error: " << stage.name << ": " << e.what() << "\n";
+            return;
+        }
+        if (!results[i]) {
+            return;
+        }
+        double fmax = results[i]->worstFmax();
+        if (options.target_fmax > 0 && fmax >= options.target_fmax) {
+            target_met = true;
+        }
+        std::lock_guard<std::mutex> lock(output_mutex);
+        std::cout << "  seed " << (i + 1) << ": " << fmax << " MHz, " << results[i]->cellsUsed() << " cells"
+                  << (cached ? " (restored from cache)" : "") << "\n";
+    });
+
+    std::optional<size_t> best;
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (!results[i]) {
+            continue;
+        }
+        if (!best) {
+            best = i;
+            continue;
+        }
+        double fmax = results[i]->worstFmax();
+        double best_fmax = results[*best]->worstFmax();
+        if (fmax > best_fmax || (fmax == best_fmax && results[i]->cellsUsed() < results[*best]->cellsUsed())) {
+            best = i;
+        }
+    }
+    if (!best) {
+        std::cerr << "Error: No place-and-route seed succeeded\n";
+        return false;
+    }
+
+    double fmax = results[*best]->worstFmax();
+    std::cout << "Best result: seed " << (*best + 1) << " at " << fmax << " MHz\n";
+    if (options.target_fmax > 0 && fmax < options.target_fmax) {
+        std::cerr << "Warning: No seed reached the target of " << options.target_fmax << " MHz\n";
+    }
+    try {
+        std::filesystem::copy_file(stages[*best].outputs[0], fasm, std::filesystem::copy_options::overwrite_existing);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return false;
     }
+    return true;
 }
 
-void emulateFiles(const std::vector<std::string>& files, const std::string& xdc_file) {
+void emulateFiles(const std::vector<std::string>& files, const std::string& xdc_file, const EmulateOptions& options,
+                  const RunOptions& run) {
     // Validate file extensions
     bool hasInvalidFiles = false;
     for (const auto& file : files) {
@@ -147,83 +1749,297 @@ void emulateFiles(const std::vector<std::string>& files, const std::string& xdc_
         return;
     }
 
-    std::filesystem::path first_file_path = std::filesystem::absolute(files[0]);
-    std::string top_module = first_file_path.stem().string();
-    std::string output_dir = "build_" + top_module;
+    // Each stage re-runs only when its input files, command line or tool
+    // changed; otherwise its outputs are restored from the stage cache
+    StageCache stage_cache(StageCache::defaultPath(std::filesystem::current_path()));
+    auto runStage = [&stage_cache, &run](const Stage& stage, const std::string& prefix = "") {
+        bool cached = false;
+        int exit_code = 0;
+        StageTimer restore(*run.report, stage.name);
+        auto execute = [&](const std::string& command) {
+            return executeCommand(run, stage.name, command, prefix);
+        };
+        try {
+            exit_code = stage_cache.run(stage, execute, cached);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return false;
+        }
+        if (cached) {
+            restore.finish(0, true);
+            std::cout << "Up to date: " << stage.name << " (restored from cache)\n";
+        }
+        return exit_code == 0;
+    };
 
-    // Create build directory
+    // Step 1: Synthesis with Yosys. Each module is synthesized out of
+    // context into its own netlist, so only changed modules re-run, and
+    // the netlists are then stitched and flattened for the top.
+    std::cout << "Synthesizing design with Yosys...\n";
+    ThreadPool pool;
+    ModuleIndex index(std::filesystem::current_path());
+    ScanCache scan_cache(ScanCache::defaultPath(index.getRoot()));
+    std::vector<std::filesystem::path> file_paths;
+    StageTimer indexing(*run.report, "index workspace");
+    try {
+        scan_cache.load();
+        index.scanTree(pool, &scan_cache);
+        for (const auto& file : files) {
+            file_paths.push_back(std::filesystem::absolute(file).lexically_normal());
+            if (!index.findScan(file_paths.back())) {
+                index.addFile(file_paths.back(), scan_cache.scan(file_paths.back()));
+            }
+        }
+        scan_cache.save();
+    } catch (const std::exception& e) {
+        std::cerr << "Error indexing workspace: " << e.what() << "\n";
+        indexing.finish(1);
+        return;
+    }
+    indexing.finish();
+
+    // The top is the one module of the files that none of the others
+    // instantiates; with several, the first file's namesake, as before
+    std::vector<std::string> tops = selectTops(index, ModuleGraph(index), file_paths, options.top);
+    if (tops.empty()) {
+        return;
+    }
+    std::string top_module = tops.front();
+    if (tops.size() > 1) {
+        std::string first_stem = file_paths.front().stem().string();
+        if (std::find(tops.begin(), tops.end(), first_stem) == tops.end()) {
+            std::cerr << "Error: Several top modules found:";
+            for (const auto& top : tops) {
+                std::cerr << " " << top;
+            }
+            std::cerr << "; choose one with --top\n";
+            return;
+        }
+        top_module = first_stem;
+    }
+    std::cout << "Top module: " << top_module << "\n";
+    std::string output_dir = "build_" + top_module;
+    std::string output_base = output_dir + "/" + top_module;
     std::filesystem::create_directories(output_dir);
 
-    // Step 1: Synthesis with Yosys
-    std::cout << "Synthesizing design with Yosys...\n";
-    std::string read_files;
-    for (const auto& file : files) {
-        read_files += "read_verilog -sv " + file + "; ";
+    SynthesisPlan plan(index, top_module);
+    for (const auto& name : plan.getMissing()) {
+        std::cerr << "Warning: submodule '" << name << "' is instantiated but not declared in the workspace\n";
     }
-    
-    std::string yosys_cmd = "yosys -p \"" + read_files + 
-                           "hierarchy -check -top " + top_module + "; " +
-                           "proc; flatten; opt; fsm; opt; memory; opt; techmap; opt; " +
-                           "write_json " + output_dir + "/" + top_module + ".json\"";
-    
-    if (int exit_code = executeCommand(yosys_cmd); exit_code != 0) {
+
+    auto displayPath = [&index](const std::filesystem::path& file) {
+        std::string relative = file.lexically_relative(index.getRoot()).string();
+        return relative.empty() || relative.rfind("..", 0) == 0 ? file.string() : relative;
+    };
+
+    std::filesystem::create_directories(output_dir + "/modules");
+    const auto& units = plan.getUnits();
+    auto unitOutput = [&output_dir](const std::string& module, const std::string& extension) {
+        return output_dir + "/modules/" + module + extension;
+    };
+
+    std::vector<Stage> unit_stages(units.size());
+    size_t max_depth = 0;
+    for (size_t i = 0; i < units.size(); ++i) {
+        const SynthesisUnit& unit = units[i];
+        Stage& stage = unit_stages[i];
+        stage.name = "synthesis of " + unit.module;
+        stage.tool = "yosys";
+        max_depth = std::max(max_depth, unit.depth);
+
+        std::string script = "read_verilog -sv";
+        for (const auto& file : unit.sources) {
+            script += " " + displayPath(file);
+            stage.inputs.push_back(file);
+        }
+        script += "; ";
+
+        // Submodule units are seen through their port stubs only, so this
+        // unit is reused until a submodule's ports change. Those declared in
+        // a file read above are turned into blackboxes after elaboration.
+        std::string stubs;
+        for (const auto& blackbox : unit.blackboxes) {
+            const std::filesystem::path& file = index.find(blackbox)->file;
+            if (std::find(unit.sources.begin(), unit.sources.end(), file) == unit.sources.end()) {
+                stubs += " " + unitOutput(blackbox, ".stub.v");
+                stage.inputs.push_back(unitOutput(blackbox, ".stub.v"));
+            }
+        }
+        if (!stubs.empty()) {
+            script += "read_verilog -lib" + stubs + "; ";
+        }
+        script += "hierarchy -top " + unit.module + "; ";
+        if (!unit.blackboxes.empty()) {
+            script += "blackbox";
+            for (const auto& blackbox : unit.blackboxes) {
+                script += " " + blackbox;
+            }
+            script += "; ";
+        }
+
+        // Blackboxes are dropped from the netlist; their own units define them
+        std::string netlist = unitOutput(unit.module, ".json");
+        std::string stub = unitOutput(unit.module, ".stub.v");
+        script += "proc; flatten; hierarchy -top " + unit.module + "; " +
+                  "opt; fsm; opt; memory; opt; techmap; opt; " +
+                  "delete =A:blackbox; write_json " + netlist + "; " +
+                  "blackbox " + unit.module + "; write_verilog -blackboxes " + stub;
+        stage.command = "yosys -q -p \"" + script + "\"";
+        stage.outputs = {netlist, stub};
+    }
+
+    // Units of equal depth only depend on shallower ones, so each depth
+    // synthesizes in parallel
+    for (size_t depth = 0; depth <= max_depth; ++depth) {
+        std::vector<size_t> level;
+        for (size_t i = 0; i < units.size(); ++i) {
+            if (units[i].depth == depth) {
+                level.push_back(i);
+            }
+        }
+        std::vector<char> level_ok(level.size(), 0);
+        pool.parallelFor(level.size(), [&](size_t i) {
+            const std::string& module = units[level[i]].module;
+            level_ok[i] = runStage(unit_stages[level[i]], level.size() > 1 ? "[" + module + "] " : "");
+        });
+        for (size_t i = 0; i < level.size(); ++i) {
+            if (!level_ok[i]) {
+                std::cerr << "Error: Yosys synthesis of module '" << units[level[i]].module << "' failed\n";
+                return;
+            }
+        }
+    }
+
+    Stage synth;
+    synth.name = "netlist stitching";
+    synth.tool = "yosys";
+    std::string read_netlists;
+    for (const auto& stage : unit_stages) {
+        read_netlists += "read_json " + stage.outputs[0].string() + "; ";
+        synth.inputs.push_back(stage.outputs[0]);
+    }
+    synth.command = "yosys -p \"" + read_netlists +
+                    "hierarchy -check -top " + top_module + "; " +
+                    "flatten; opt; " +
+                    "write_json " + output_base + ".json\"";
+    synth.outputs = {output_base + ".json"};
+
+    if (!runStage(synth)) {
         std::cerr << "Error: Yosys synthesis failed\n";
         return;
     }
+    std::cout << "Synthesized " << units.size() << " module(s) out of context\n";
+    try {
+        NetlistStats stats = NetlistStats::analyze(output_base + ".json");
+        if (const ModuleStats* top = stats.findTop()) {
+            ModuleStats total = stats.hierarchyTotal(top->name);
+            std::cout << "Estimated " << total.flip_flops << " flip-flops, " << total.luts
+                      << " LUTs, logic depth " << total.logic_depth << " levels\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: " << e.what() << "\n";
+    }
 
     // Step 2: Place and Route with nextpnr-xilinx
     std::cout << "Running place and route with nextpnr-xilinx...\n";
-    std::string nextpnr_cmd = std::string("nextpnr-xilinx") +
-                             " --xdc " + xdc_file +
-                             " --json " + output_dir + "/" + top_module + ".json" +
-                             " --fasm " + output_dir + "/" + top_module + ".fasm" +
-                             " --arch xilinx" +
-                             " --family xc7" +
-                             " --part xc7a35tcsg324-1";
-    
-    if (int exit_code = executeCommand(nextpnr_cmd); exit_code != 0) {
-        std::cerr << "Error: nextpnr place and route failed\n";
-        return;
+    Stage pnr;
+    pnr.name = "place and route";
+    pnr.tool = "nextpnr-xilinx";
+    pnr.command = std::string("nextpnr-xilinx") +
+                  " --xdc " + xdc_file +
+                  " --json " + output_base + ".json" +
+                  " --arch xilinx" +
+                  " --family xc7" +
+                  " --part xc7a35tcsg324-1";
+    pnr.inputs = {xdc_file, output_base + ".json"};
+
+    if (options.pnr_seeds > 1) {
+        if (!placeAndRouteSeeds(pnr, output_base + ".fasm", options, stage_cache, run)) {
+            std::cerr << "Error: nextpnr place and route failed\n";
+            return;
+        }
+    } else {
+        pnr.command += " --fasm " + output_base + ".fasm";
+        pnr.outputs = {output_base + ".fasm"};
+        if (!runStage(pnr)) {
+            std::cerr << "Error: nextpnr place and route failed\n";
+            return;
+        }
     }
 
     // Step 3: Convert FASM to frames
     std::cout << "Converting FASM to frame data...\n";
-    std::string fasm_cmd = std::string("fasm2frames") +
-                          " --part xc7a35tcsg324-1" +
-                          " --db-root /usr/share/f4pga/database" +
-                          " --sparse" +
-                          " --roi " + output_dir + "/" + top_module + ".fasm" +
-                          " -o " + output_dir + "/" + top_module + ".frames";
+    Stage frames;
+    frames.name = "FASM to frames";
+    frames.tool = "fasm2frames";
+    frames.command = std::string("fasm2frames") +
+                     " --part xc7a35tcsg324-1" +
+                     " --db-root /usr/share/f4pga/database" +
+                     " --sparse" +
+                     " --roi " + output_base + ".fasm" +
+                     " -o " + output_base + ".frames";
+    frames.inputs = {output_base + ".fasm"};
+    frames.outputs = {output_base + ".frames"};
     
-    if (int exit_code = executeCommand(fasm_cmd); exit_code != 0) {
+    if (!runStage(frames)) {
         std::cerr << "Error: FASM to frames conversion failed\n";
         return;
     }
 
     // Step 4: Convert frames to bitstream
     std::cout << "Generating Xilinx bitstream...\n";
-    std::string bit_cmd = std::string("xc7frames2bit") +
-                         " --part_file /usr/share/f4pga/database/artix7/xc7a35tcsg324-1/part.yaml" +
-                         " --part_name xc7a35tcsg324-1" +
-                         " --frm_file " + output_dir + "/" + top_module + ".frames" +
-                         " --output_file " + output_dir + "/" + top_module + ".bit";
+    const std::string part_file = "/usr/share/f4pga/database/artix7/xc7a35tcsg324-1/part.yaml";
+    Stage bitstream;
+    bitstream.name = "bitstream";
+    bitstream.tool = "xc7frames2bit";
+    bitstream.command = std::string("xc7frames2bit") +
+                        " --part_file " + part_file +
+                        " --part_name xc7a35tcsg324-1" +
+                        " --frm_file " + output_base + ".frames" +
+                        " --output_file " + output_base + ".bit";
+    bitstream.inputs = {part_file, output_base + ".frames"};
+    bitstream.outputs = {output_base + ".bit"};
     
-    if (int exit_code = executeCommand(bit_cmd); exit_code != 0) {
+    if (!runStage(bitstream)) {
         std::cerr << "Error: Bitstream generation failed\n";
         return;
     }
 
+    // The frames last programmed are kept, so the next run can tell which
+    // frames a change touched and load only those with --partial
+    std::string programmed_frames = output_base + ".programmed.frames";
+    std::string bit_file = output_base + ".bit";
+    if (std::filesystem::exists(programmed_frames)) {
+        std::optional<size_t> changed =
+            writeFrameDiff(programmed_frames, output_base + ".frames", output_base + ".partial.bit", top_module);
+        if (options.partial && changed && *changed == 0) {
+            std::cout << "FPGA configuration is unchanged; nothing to program.\n";
+            return;
+        }
+        if (options.partial && changed) {
+            bit_file = output_base + ".partial.bit";
+        }
+    } else if (options.partial) {
+        std::cout << "No previously programmed frames; programming the full bitstream\n";
+    }
+
     // Step 5: Program FPGA with OpenOCD
     std::cout << "Programming FPGA...\n";
     std::string openocd_cmd = std::string("openocd") +
                              " -f interface/ftdi/digilent_jtag_hs2.cfg" +
                              " -f target/xc7_ft2232.cfg" +
-                             " -c \"init; pld load 0 " + output_dir + "/" + top_module + ".bit; exit\"";
+                             " -c \"init; pld load 0 " + bit_file + "; exit\"";
     
-    if (int exit_code = executeCommand(openocd_cmd); exit_code != 0) {
+    if (int exit_code = executeCommand(run, "program FPGA", openocd_cmd); exit_code != 0) {
         std::cerr << "Error: FPGA programming failed\n";
         return;
     }
+    try {
+        std::filesystem::copy_file(output_base + ".frames", programmed_frames,
+                                   std::filesystem::copy_options::overwrite_existing);
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: " << e.what() << "\n";
+    }
 
     std::cout << "FPGA emulation completed successfully.\n";
     std::cout << "Output files are in directory: " << output_dir << "\n";
@@ -236,6 +2052,10 @@ int main(int argc, char* argv[]) {
     }
 
     std::string command = argv[1];
+    std::string invocation = "vpm";
+    for (int i = 1; i < argc; i++) {
+        invocation += std::string(" ") + argv[i];
+    }
     
     if (command == "--help") {
         printUsage();
@@ -243,9 +2063,16 @@ int main(int argc, char* argv[]) {
     }
 
     if (command == "--init") {
+        std::vector<std::string> args(argv + 2, argv + argc);
+        std::optional<ArtifactStore> store = parseStoreOption(args);
+        if (!store) {
+            return 1;
+        }
         try {
             std::filesystem::path current_dir = std::filesystem::current_path();
             BuildGenerator::initWorkspace(current_dir.string());
+            store->configureWorkspace(current_dir);
+            std::cout << "Sharing build outputs through the artifact store at " << store->path().string() << "\n";
             return 0;
         } catch (const std::exception& e) {
             std::cerr << "Error initializing workspace: " << e.what() << "\n";
@@ -253,32 +2080,154 @@ int main(int argc, char* argv[]) {
         }
     }
     
-    if (command == "--build") {
-        if (argc < 3) {
-            std::cout << "Error: --build requires at least one input file\n";
-            printUsage();
+    if (command == "--build" || command == "--watch" || command == "--test" || command == "--check" ||
+        command == "--serve") {
+        std::vector<std::string> args(argv + 2, argv + argc);
+        BuildOptions options;
+        RunOptions run;
+        if (!parseBuildOptions(args, options) || !parseRunOptions(args, run)) {
             return 1;
         }
+        RunReport report(invocation);
+        bool ok = true;
 
-        std::vector<std::string> files;
-        for (int i = 2; i < argc; i++) {
-            files.push_back(argv[i]);
+        if (command == "--build") {
+            if (args.empty()) {
+                std::cout << "Error: --build requires at least one input file, directory or pattern\n";
+                printUsage();
+                return 1;
+            }
+            run.report = &report;
+            ok = buildFiles(args, options, run);
+        } else if (command == "--watch") {
+            watchFiles(args, options, run, invocation);
+            return 0;
+        } else if (command == "--check") {
+            if (args.empty()) {
+                std::cout << "Error: --check requires at least one input file, directory or pattern\n";
+                printUsage();
+                return 1;
+            }
+            run.report = &report;
+            ok = checkFiles(args, options, run);
+        } else if (command == "--serve") {
+            std::string segment;
+            auto name = std::find(args.begin(), args.end(), "--name");
+            if (name != args.end()) {
+                if (name + 1 == args.end()) {
+                    std::cout << "Error: --name requires a shared-memory name\n";
+                    return 1;
+                }
+                segment = *(name + 1);
+                args.erase(name, name + 2);
+            }
+            if (args.size() != 1) {
+                std::cout << "Error: --serve requires one module name\n";
+                printUsage();
+                return 1;
+            }
+            options.top = args[0];
+            options.serve = true;
+            run.report = &report;
+            ok = buildFiles({"."}, options, run);
+            if (ok) {
+                std::string server = "bazel-bin/build_serve/" + options.top + "/server";
+                if (!segment.empty()) {
+                    server += " --name=" + segment;
+                }
+                ok = executeCommand(run, "serve " + options.top, server) == 0;
+            }
+        } else {
+            std::vector<TestCase> tests;
+            auto manifest = std::find(args.begin(), args.end(), "--manifest");
+            if (manifest != args.end()) {
+                if (manifest + 1 == args.end()) {
+                    std::cout << "Error: --manifest requires a file\n";
+                    return 1;
+                }
+                if (!readTestManifest(*(manifest + 1), tests)) {
+                    return 1;
+                }
+                args.erase(manifest, manifest + 2);
+            }
+            if (args.size() == 2 && hasValidExtension(args[1], true)) {
+                tests.push_back({args[0], args[1]});
+            } else if (!args.empty()) {
+                std::vector<TestCase> discovered = discoverTests(args);
+                tests.insert(tests.end(), discovered.begin(), discovered.end());
+            }
+            if (tests.empty()) {
+                std::cout << "Error: --test found no module with a testbench\n";
+                printUsage();
+                return 1;
+            }
+            run.report = &report;
+            ok = buildFiles({}, options, run, tests);
         }
-        
-        buildFiles(files);
-        return 0;
+        writeReport(report, run);
+        return ok ? 0 : 1;
     }
 
-    if (command == "--test") {
-        if (argc != 4) {
-            std::cout << "Error: --test requires exactly two files: source and test\n";
+    if (command == "--install") {
+        std::vector<std::string> args(argv + 2, argv + argc);
+        std::optional<ArtifactStore> store = parseStoreOption(args);
+        if (!store) {
+            return 1;
+        }
+        return installPackages(*store, args) ? 0 : 1;
+    }
+
+    if (command == "--cache-stats" || command == "--cache-gc") {
+        std::vector<std::string> args(argv + 2, argv + argc);
+        std::optional<ArtifactStore> store = parseStoreOption(args);
+        if (!store) {
+            return 1;
+        }
+        if (command == "--cache-stats") {
+            showStoreStats(*store);
+            return 0;
+        }
+        return collectStore(*store, args) ? 0 : 1;
+    }
+
+    if (command == "--stats") {
+        std::vector<std::string> netlists;
+        StatsLimits limits;
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            size_t* limit = arg == "--max-luts" ? &limits.max_luts
+                            : arg == "--max-ffs" ? &limits.max_flip_flops
+                            : arg == "--max-depth" ? &limits.max_depth
+                            : nullptr;
+            if (!limit) {
+                netlists.push_back(arg);
+                continue;
+            }
+            if (i + 1 >= argc || !parseNumber(std::string(argv[i + 1]), *limit)) {
+                std::cout << "Error: " << arg << " requires a number\n";
+                return 1;
+            }
+            ++i;
+        }
+
+        if (netlists.empty()) {
+            std::cout << "Error: --stats requires at least one Yosys JSON netlist\n";
             printUsage();
             return 1;
         }
+        return showStats(netlists, limits) ? 0 : 1;
+    }
 
-        std::vector<std::string> files = {argv[2]};
-        buildFiles(files, argv[3]);
-        return 0;
+    if (command == "--frames-diff") {
+        if (argc != 4 && !(argc == 6 && std::string(argv[4]) == "--output")) {
+            std::cout << "Error: --frames-diff requires two .frames files\n";
+            printUsage();
+            return 1;
+        }
+        std::filesystem::path after(argv[3]);
+        std::filesystem::path partial_bit =
+            argc == 6 ? std::filesystem::path(argv[5]) : after.parent_path() / (after.stem().string() + ".partial.bit");
+        return writeFrameDiff(argv[2], after, partial_bit, after.stem().string()) ? 0 : 1;
     }
 
     if (command == "--emulate") {
@@ -288,20 +2237,56 @@ int main(int argc, char* argv[]) {
             return 1;
         }
 
+        std::vector<std::string> args(argv + 2, argv + argc);
+        RunOptions run;
+        if (!parseRunOptions(args, run)) {
+            return 1;
+        }
+
         std::vector<std::string> files;
         std::string xdc_file;
+        EmulateOptions options;
         bool found_xdc = false;
 
-        for (int i = 2; i < argc; i++) {
-            std::string arg = argv[i];
+        for (size_t i = 0; i < args.size(); i++) {
+            const std::string& arg = args[i];
             if (arg == "--xdc") {
-                if (i + 1 < argc) {
-                    xdc_file = argv[++i];
+                if (i + 1 < args.size()) {
+                    xdc_file = args[++i];
                     found_xdc = true;
                 } else {
                     std::cout << "Error: --xdc requires a constraints file\n";
                     return 1;
                 }
+            } else if (arg == "--top") {
+                if (i + 1 >= args.size()) {
+                    std::cout << "Error: --top requires a module name\n";
+                    return 1;
+                }
+                options.top = args[++i];
+            } else if (arg == "--pnr-seeds" || arg == "--pnr-cores") {
+                unsigned& count = arg == "--pnr-seeds" ? options.pnr_seeds : options.pnr_cores;
+                if (i + 1 >= args.size() || !parseNumber(args[i + 1], count) || count == 0) {
+                    std::cout << "Error: " << arg << " requires a positive number\n";
+                    return 1;
+                }
+                ++i;
+            } else if (arg == "--partial") {
+                options.partial = true;
+            } else if (arg == "--target-fmax") {
+                bool valid = i + 1 < args.size() && !args[i + 1].empty() &&
+                             args[i + 1].find_first_not_of("0123456789.") == std::string::npos &&
+                             args[i + 1].find_first_of("0123456789") == 0;
+                try {
+                    valid = valid && (options.target_fmax = std::stod(args[i + 1])) > 0;
+                } catch (const std::out_of_range&) {
+                    valid = false;
+                }
+                if (!valid) {
+                    std::cout << "Error: --target-fmax requires a frequency in MHz\n";
+                    return 1;
+                }
+                ++i;
             } else {
                 files.push_back(arg);
             }
@@ -317,7 +2302,10 @@ int main(int argc, char* argv[]) {
             return 1;
         }
 
-        emulateFiles(files, xdc_file);
+        RunReport report(invocation);
+        run.report = &report;
+        emulateFiles(files, xdc_file, options, run);
+        writeReport(report, run);
         return 0;
     }
 
@@ -0,0 +1,38 @@
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include "ArtifactStore.hpp"
+
+TEST(ArtifactStore, ParseSizeWithoutUnitIsBytes) {
+    EXPECT_EQ(ArtifactStore::parseSize("0"), 0u);
+    EXPECT_EQ(ArtifactStore::parseSize("512"), 512u);
+    EXPECT_EQ(ArtifactStore::parseSize("512B"), 512u);
+}
+
+TEST(ArtifactStore, ParseSizeUnits) {
+    EXPECT_EQ(ArtifactStore::parseSize("4K"), 4u << 10);
+    EXPECT_EQ(ArtifactStore::parseSize("4KB"), 4u << 10);
+    EXPECT_EQ(ArtifactStore::parseSize("4kb"), 4u << 10);
+    EXPECT_EQ(ArtifactStore::parseSize("300M"), 300u << 20);
+    EXPECT_EQ(ArtifactStore::parseSize("300mb"), 300u << 20);
+    EXPECT_EQ(ArtifactStore::parseSize("2G"), uintmax_t(2) << 30);
+    EXPECT_EQ(ArtifactStore::parseSize("2g"), uintmax_t(2) << 30);
+    EXPECT_EQ(ArtifactStore::parseSize("1T"), uintmax_t(1) << 40);
+}
+
+TEST(ArtifactStore, ParseSizeRejectsInvalidInput) {
+    for (const char* text : {"", "G", "GB", "B", "10X", "10KK", "10KBB", "1.5G", "-5", " 10", "10 G"}) {
+        EXPECT_THROW(ArtifactStore::parseSize(text), std::runtime_error) << '"' << text << '"';
+    }
+}
+
+TEST(ArtifactStore, ParseSizeRejectsSizesThatOverflow) {
+    EXPECT_EQ(ArtifactStore::parseSize("16777215T"), uintmax_t(16777215) << 40);
+    for (const char* text : {"99999999999999999999999", "16777216T", "18014398509481984K"}) {
+        EXPECT_THROW(ArtifactStore::parseSize(text), std::runtime_error) << '"' << text << '"';
+    }
+}
+
+TEST(ArtifactStore, FormatSize) {
+    EXPECT_EQ(ArtifactStore::formatSize(512), "512 B");
+    EXPECT_EQ(ArtifactStore::formatSize(3u << 29), "1.5 GB");
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include "BuildState.hpp"
+#include "TempDir.hpp"
+
+namespace {
+    using Clock = std::filesystem::file_time_type::clock;
+
+    // Backdates `path`, so it is clearly older than the state written after it
+    void setMtime(const std::filesystem::path& path, std::chrono::seconds offset) {
+        std::filesystem::last_write_time(path, Clock::now() + offset);
+    }
+
+    class BuildStateTest : public ::testing::Test {
+    protected:
+        TempDir dir;
+        std::filesystem::path state_path = dir.path() / ".vpm" / "build-state";
+        std::filesystem::path source;
+
+        void SetUp() override {
+            source = dir.write("rtl/top.sv", "module top;\nendmodule\n");
+            setMtime(source, std::chrono::seconds(-10));
+            setMtime(source.parent_path(), std::chrono::seconds(-10));
+        }
+
+        // Records a build of `top` that read the source and its directory
+        void record(const std::string& key) {
+            BuildState state(state_path, key);
+            state.addStamp(source.parent_path(), FileStamp::of(source.parent_path()));
+            state.addStamps({{source, FileStamp::of(source)}});
+            state.tops = {"top"};
+            state.targets = {"//rtl:top_verilated"};
+            state.warnings = {"module declared more than once, using the first: top"};
+            state.file_count = 1;
+            state.package_count = 1;
+            state.save();
+        }
+    };
+}
+
+TEST_F(BuildStateTest, ReusedWhenNothingChanged) {
+    record("rtl");
+    EXPECT_FALSE(std::filesystem::exists(state_path.string() + ".tmp"));
+
+    BuildState state(state_path, "rtl");
+    ASSERT_TRUE(state.load());
+    EXPECT_EQ(state.tops, std::vector<std::string>{"top"});
+    EXPECT_EQ(state.targets, std::vector<std::string>{"//rtl:top_verilated"});
+    EXPECT_EQ(state.warnings.size(), 1u);
+    EXPECT_EQ(state.file_count, 1u);
+    EXPECT_EQ(state.package_count, 1u);
+}
+
+TEST_F(BuildStateTest, MissingStateIsNotUpToDate) {
+    BuildState state(state_path, "rtl");
+    EXPECT_FALSE(state.load());
+}
+
+TEST_F(BuildStateTest, OtherKeyIsNotUpToDate) {
+    record("rtl");
+    BuildState state(state_path, "rtl --top top");
+    EXPECT_FALSE(state.load());
+}
+
+TEST_F(BuildStateTest, ChangedSourceIsNotUpToDate) {
+    record("rtl");
+    dir.write("rtl/top.sv", "module top;\n  alu u ();\nendmodule\n");
+    setMtime(source, std::chrono::seconds(-5));
+
+    BuildState state(state_path, "rtl");
+    EXPECT_FALSE(state.load());
+    // Nothing from a stale state is handed out
+    EXPECT_TRUE(state.targets.empty());
+}
+
+TEST_F(BuildStateTest, NewFileIsNotUpToDate) {
+    record("rtl");
+    dir.write("rtl/alu.sv", "module alu;\nendmodule\n");
+    setMtime(source.parent_path(), std::chrono::seconds(-5));
+
+    BuildState state(state_path, "rtl");
+    EXPECT_FALSE(state.load());
+}
+
+TEST_F(BuildStateTest, DeletedFileIsNotUpToDate) {
+    record("rtl");
+    std::filesystem::remove(source);
+
+    BuildState state(state_path, "rtl");
+    EXPECT_FALSE(state.load());
+}
+
+// A file rewritten within the timestamp tick the state was saved in can
+// keep its recorded stamp with different bytes
+TEST_F(BuildStateTest, RacyStampIsNotTrusted) {
+    auto tick = Clock::now() - std::chrono::seconds(5);
+    std::filesystem::last_write_time(source, tick);
+    record("rtl");
+    std::filesystem::last_write_time(state_path, tick);
+
+    BuildState state(state_path, "rtl");
+    EXPECT_FALSE(state.load());
+}
+
+TEST_F(BuildStateTest, TruncatedStateIsNotUpToDate) {
+    record("rtl");
+    std::string content;
+    {
+        std::ifstream in(state_path);
+        content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    // Drop the closing "N" line
+    content.erase(content.rfind("N "));
+    std::ofstream(state_path, std::ios::trunc) << content;
+    setMtime(state_path, std::chrono::seconds(0));
+
+    BuildState state(state_path, "rtl");
+    EXPECT_FALSE(state.load());
+}
@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "FrameSet.hpp"
+#include "TempDir.hpp"
+
+namespace {
+    constexpr size_t kWords = FrameSet::kFrameWords;
+
+    // A frame whose leading words are `words`, zero-filled as parse() does
+    std::vector<uint32_t> frame(std::vector<uint32_t> words) {
+        words.resize(kWords, 0);
+        return words;
+    }
+
+    std::vector<uint32_t> readWords(const std::string& bytes, size_t& offset, size_t count) {
+        std::vector<uint32_t> words;
+        for (size_t i = 0; i < count; ++i, offset += 4) {
+            words.push_back(static_cast<uint32_t>(static_cast<unsigned char>(bytes[offset])) << 24 |
+                            static_cast<uint32_t>(static_cast<unsigned char>(bytes[offset + 1])) << 16 |
+                            static_cast<uint32_t>(static_cast<unsigned char>(bytes[offset + 2])) << 8 |
+                            static_cast<uint32_t>(static_cast<unsigned char>(bytes[offset + 3])));
+        }
+        return words;
+    }
+
+    // A partial .bit split into its header fields and configuration words
+    struct Bitstream {
+        std::vector<std::pair<char, std::string>> fields;
+        std::vector<uint32_t> words;
+    };
+
+    Bitstream readBitstream(const std::filesystem::path& path) {
+        std::ifstream in(path, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        Bitstream bitstream;
+        // Fixed preamble, then key/length/value fields up to 'e'
+        size_t offset = 13;
+        while (offset < bytes.size() && bytes[offset] != 'e') {
+            char key = bytes[offset];
+            size_t length = static_cast<unsigned char>(bytes[offset + 1]) << 8 |
+                            static_cast<unsigned char>(bytes[offset + 2]);
+            bitstream.fields.emplace_back(key, bytes.substr(offset + 3, length - 1));
+            offset += 3 + length;
+        }
+        ++offset;
+        size_t data_size = readWords(bytes, offset, 1).front();
+        EXPECT_EQ(offset + data_size, bytes.size());
+        bitstream.words = readWords(bytes, offset, data_size / 4);
+        return bitstream;
+    }
+
+    // FAR address and frame count (without the pad frame) of each FDRI write
+    std::vector<std::pair<uint32_t, size_t>> runs(const std::vector<uint32_t>& words) {
+        std::vector<std::pair<uint32_t, size_t>> result;
+        for (size_t i = 0; i + 4 < words.size(); ++i) {
+            if (words[i] == 0x30002001 && words[i + 3] == 0x30004000) {
+                result.emplace_back(words[i + 1], (words[i + 4] & 0x07FFFFFF) / kWords - 1);
+            }
+        }
+        return result;
+    }
+}
+
+TEST(FrameSet, ParseZeroFillsShortFrames) {
+    FrameSet frames = FrameSet::parse("# comment\n0x00000010 0x1,0x2\n\n0x00000011 0x3\n");
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames.getFrames().at(0x10), frame({1, 2}));
+    EXPECT_EQ(frames.getFrames().at(0x11), frame({3}));
+}
+
+TEST(FrameSet, ParseRejectsMalformedLines) {
+    for (const char* text : {"0x10\n", "10 0x1\n", "0x10 0x1;0x2\n", "0x10 zz\n"}) {
+        EXPECT_THROW(FrameSet::parse(text), std::runtime_error) << text;
+    }
+    std::string too_long = "0x10 0x0";
+    for (size_t i = 0; i < kWords; ++i) {
+        too_long += ",0x0";
+    }
+    EXPECT_THROW(FrameSet::parse(too_long), std::runtime_error);
+}
+
+TEST(FrameSet, DiffKeepsChangedAndAddedFrames) {
+    FrameSet before = FrameSet::parse("0x10 0x1\n0x11 0x2\n0x12 0x3\n");
+    FrameSet after = FrameSet::parse("0x10 0x1\n0x11 0x7\n0x12 0x3\n0x13 0x4\n");
+    FrameSet diff = FrameSet::diff(before, after);
+    ASSERT_EQ(diff.size(), 2u);
+    EXPECT_EQ(diff.getFrames().at(0x11), frame({7}));
+    EXPECT_EQ(diff.getFrames().at(0x13), frame({4}));
+}
+
+TEST(FrameSet, DiffClearsRemovedFrames) {
+    FrameSet before = FrameSet::parse("0x05 0x9\n0x10 0x1\n0x20 0x2\n");
+    FrameSet after = FrameSet::parse("0x10 0x1\n");
+    FrameSet diff = FrameSet::diff(before, after);
+    ASSERT_EQ(diff.size(), 2u);
+    EXPECT_EQ(diff.getFrames().at(0x05), frame({}));
+    EXPECT_EQ(diff.getFrames().at(0x20), frame({}));
+}
+
+TEST(FrameSet, DiffOfEqualSetsIsEmpty) {
+    FrameSet frames = FrameSet::parse("0x10 0x1\n0x11 0x2\n");
+    EXPECT_TRUE(FrameSet::diff(frames, frames).empty());
+}
+
+TEST(FrameSet, RunsSplitAtNonConsecutiveAddresses) {
+    TempDir dir;
+    FrameSet frames = FrameSet::parse("0x1 0x1\n0x2 0x2\n0x3 0x3\n0x5 0x5\n0x100 0x6\n0x101 0x7\n");
+    std::filesystem::path path = dir.path() / "partial.bit";
+    frames.writePartialBitstream(path, {"7a35tcsg324", 0x0362D093, "top"});
+
+    std::vector<std::pair<uint32_t, size_t>> expected = {{0x1, 3}, {0x5, 1}, {0x100, 2}};
+    EXPECT_EQ(runs(readBitstream(path).words), expected);
+}
+
+// Two runs: frames 0x10-0x11 changed, frame 0x20 removed
+TEST(FrameSet, PartialBitstreamPacketWords) {
+    TempDir dir;
+    FrameSet before = FrameSet::parse("0x10 0x1\n0x11 0x2\n0x20 0x3\n");
+    FrameSet after = FrameSet::parse("0x10 0xA,0xB\n0x11 0xC\n");
+    std::filesystem::path path = dir.path() / "partial.bit";
+    FrameSet::diff(before, after).writePartialBitstream(path, {"7a35tcsg324", 0x0362D093, "top"});
+    Bitstream bitstream = readBitstream(path);
+
+    ASSERT_GE(bitstream.fields.size(), 2u);
+    EXPECT_EQ(bitstream.fields[0], std::make_pair('a', std::string("top;PARTIAL=TRUE")));
+    EXPECT_EQ(bitstream.fields[1], std::make_pair('b', std::string("7a35tcsg324")));
+
+    std::vector<uint32_t> expected(8, 0xFFFFFFFF);
+    auto append = [&expected](std::vector<uint32_t> words) {
+        expected.insert(expected.end(), words.begin(), words.end());
+    };
+    // Bus width, sync, IDCODE check, reset CRC
+    append({0x000000BB, 0x11220044, 0xFFFFFFFF, 0xFFFFFFFF, 0xAA995566, 0x20000000, 0x30018001, 0x0362D093,
+            0x30008001, 0x00000007, 0x20000000, 0x20000000});
+    // WCFG, FAR 0x10, FDRI of two frames plus a pad frame
+    append({0x30008001, 0x00000001, 0x20000000, 0x30002001, 0x00000010, 0x20000000, 0x30004000,
+            0x50000000 | 3 * kWords});
+    append(frame({0xA, 0xB}));
+    append(frame({0xC}));
+    append(frame({}));
+    // WCFG, FAR 0x20, FDRI of the zero-filled removed frame plus a pad frame
+    append({0x30008001, 0x00000001, 0x20000000, 0x30002001, 0x00000020, 0x20000000, 0x30004000,
+            0x50000000 | 2 * kWords});
+    append(frame({}));
+    append(frame({}));
+    // DESYNC, then NOOPs; no CRC check is written
+    append({0x30008001, 0x0000000D});
+    append(std::vector<uint32_t>(16, 0x20000000));
+
+    EXPECT_EQ(bitstream.words, expected);
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "JsonReader.hpp"
+#include "TempDir.hpp"
+
+namespace {
+    using Token = JsonReader::Token;
+
+    // Every token of `json` as "<kind>" or "<kind>:<text>", read through a
+    // buffer of `buffer_size` bytes
+    std::vector<std::string> tokens(const TempDir& dir, const std::string& json, size_t buffer_size = 1 << 20) {
+        static const char* const kinds[] = {"{", "}", "[", "]", "key", "string", "number", "true", "false", "null"};
+        JsonReader reader(dir.write("input.json", json), buffer_size);
+        std::vector<std::string> result;
+        for (Token token = reader.next(); token != Token::End; token = reader.next()) {
+            std::string kind = kinds[static_cast<int>(token)];
+            bool has_text = token == Token::Key || token == Token::String || token == Token::Number;
+            result.push_back(has_text ? kind + ":" + std::string(reader.text()) : kind);
+        }
+        return result;
+    }
+
+    // The error reading all of `json` throws, or empty if it parses
+    std::string errorOf(const TempDir& dir, const std::string& json) {
+        try {
+            tokens(dir, json);
+        } catch (const std::runtime_error& e) {
+            return e.what();
+        }
+        return "";
+    }
+}
+
+TEST(JsonReader, Tokens) {
+    TempDir dir;
+    std::vector<std::string> expected = {"{",     "key:a", "[", "number:1", "number:-2.5e3", "true",     "false",
+                                         "null",  "]",     "key:b", "{", "}",        "key:c",         "string:x", "}"};
+    EXPECT_EQ(tokens(dir, " {\"a\": [1, -2.5e3, true, false, null],\n\t\"b\": {}, \"c\": \"x\"}\n"), expected);
+}
+
+TEST(JsonReader, Escapes) {
+    TempDir dir;
+    struct Case {
+        const char* json;
+        const char* text;
+    };
+    for (const Case& c : {
+             Case{R"("plain")", "plain"},
+             Case{R"("a\"b")", "a\"b"},
+             Case{R"("back\\slash\/")", "back\\slash/"},
+             Case{R"("\b\f\n\r\t")", "\b\f\n\r\t"},
+             Case{R"("A\u00e9\u20AC")", "A\xc3\xa9\xe2\x82\xac"},
+             Case{R"("")", ""},
+         }) {
+        EXPECT_EQ(tokens(dir, c.json), std::vector<std::string>{std::string("string:") + c.text}) << c.json;
+    }
+}
+
+// Strings and numbers split across buffer refills decode the same
+TEST(JsonReader, TokensSpanBufferRefills) {
+    TempDir dir;
+    std::string json = R"({"module_name": ["a\"b\u00e9 long enough to span", 123456789]})";
+    std::vector<std::string> expected = tokens(dir, json);
+    for (size_t buffer_size : {1, 2, 3, 7}) {
+        EXPECT_EQ(tokens(dir, json, buffer_size), expected) << buffer_size;
+    }
+}
+
+TEST(JsonReader, MalformedInput) {
+    TempDir dir;
+    struct Case {
+        const char* json;
+        const char* error;
+    };
+    for (const Case& c : {
+             Case{R"({"a": "abc)", "unterminated string"},
+             Case{R"({"a": "abc\)", "unexpected end of file"},
+             Case{R"({"a)", "unterminated string"},
+             Case{R"({"a": )", "unexpected end of file"},
+             Case{R"([1, )", "unexpected end of file"},
+             // Truncated right after a value: the separator is missing
+             Case{R"({"a": 1)", "expected ',' or closing bracket"},
+             Case{R"([1 2])", "expected ',' or closing bracket"},
+             Case{R"(["\q"])", "invalid escape"},
+             Case{R"(["\u12g4"])", "invalid \\u escape"},
+             Case{R"([1})", "mismatched closing bracket"},
+             Case{R"({1: 2})", "expected key"},
+             Case{R"({"a" 1})", "expected ':' after key"},
+             Case{R"([tru])", "invalid literal"},
+             Case{R"([#])", "unexpected character '#'"},
+         }) {
+        std::string error = errorOf(dir, c.json);
+        EXPECT_NE(error.find(c.error), std::string::npos) << c.json << " -> " << error;
+        EXPECT_NE(error.find("Malformed JSON in "), std::string::npos) << error;
+    }
+}
+
+TEST(JsonReader, SkipValue) {
+    TempDir dir;
+    JsonReader reader(dir.write("input.json", R"({"skip": {"a": [1, {"b": null}], "c": "}"}, "keep": 5})"));
+    reader.expect(Token::BeginObject);
+    ASSERT_EQ(reader.next(), Token::Key);
+    EXPECT_EQ(reader.text(), "skip");
+    reader.skipValue();
+    ASSERT_EQ(reader.next(), Token::Key);
+    EXPECT_EQ(reader.text(), "keep");
+    reader.expect(Token::Number);
+    EXPECT_EQ(reader.text(), "5");
+    reader.expect(Token::EndObject);
+    EXPECT_EQ(reader.next(), Token::End);
+}
+
+TEST(JsonReader, MissingFile) {
+    TempDir dir;
+    EXPECT_THROW(JsonReader(dir.path() / "missing.json"), std::runtime_error);
+}
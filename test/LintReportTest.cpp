@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "LintReport.hpp"
+
+namespace {
+    // Output of linting `top` and then `alu` on its own: the warning in
+    // alu.sv is printed under both, with a different instance note
+    const char* const kTopOutput = R"(%Warning-WIDTHTRUNC: rtl/alu.sv:12:15: Operator ASSIGN expects 8 bits on the Assign RHS, but Assign RHS's VARREF 'x' generates 16 bits.
+                                      : ... note: In instance 'top.u_alu'
+   12 |   assign y = x;
+      |               ^
+                     ... For warning description see https://verilator.org/warn/WIDTHTRUNC?v=5.020
+                     ... Use "/* verilator lint_off WIDTHTRUNC */" and lint_on around source to disable this message.
+%Error: rtl/top.sv:3:3: Cannot find file containing module: 'missing'
+    3 |   missing u (.*);
+      |   ^~~~~~~
+%Error: Exiting due to 1 error(s)
+)";
+    const char* const kAluOutput = R"(%Warning-WIDTHTRUNC: rtl/alu.sv:12:15: Operator ASSIGN expects 8 bits on the Assign RHS, but Assign RHS's VARREF 'x' generates 16 bits.
+                                      : ... note: In instance 'alu'
+   12 |   assign y = x;
+      |               ^
+                     ... For warning description see https://verilator.org/warn/WIDTHTRUNC?v=5.020
+%Warning-UNUSEDSIGNAL: rtl/alu.sv:4:17: Signal is not used: 'spare'
+%Warning-DECLFILENAME: rtl/alu.sv:1: Filename 'alu' does not match MODULE name: 'alu_core'
+)";
+}
+
+TEST(LintReport, Parse) {
+    std::vector<LintDiagnostic> diagnostics = LintReport::parse(kTopOutput);
+    ASSERT_EQ(diagnostics.size(), 2u);
+
+    const LintDiagnostic& warning = diagnostics[0];
+    EXPECT_FALSE(warning.error);
+    EXPECT_EQ(warning.code, "WIDTHTRUNC");
+    EXPECT_EQ(warning.file, "rtl/alu.sv");
+    EXPECT_EQ(warning.line, 12u);
+    EXPECT_EQ(warning.column, 15u);
+    EXPECT_EQ(warning.message.rfind("Operator ASSIGN expects 8 bits", 0), 0u);
+    // The excerpt stays; the instance note and the boilerplate do not
+    EXPECT_EQ(warning.detail, "   12 |   assign y = x;\n      |               ^\n");
+
+    const LintDiagnostic& error = diagnostics[1];
+    EXPECT_TRUE(error.error);
+    EXPECT_EQ(error.code, "");
+    EXPECT_EQ(error.file, "rtl/top.sv");
+    EXPECT_EQ(error.line, 3u);
+    EXPECT_EQ(error.message, "Cannot find file containing module: 'missing'");
+    EXPECT_EQ(error.detail, "    3 |   missing u (.*);\n      |   ^~~~~~~\n");
+}
+
+TEST(LintReport, Locations) {
+    struct Case {
+        const char* output;
+        const char* file;
+        size_t line;
+        size_t column;
+        const char* message;
+    };
+    for (const Case& c : {
+             Case{"%Warning-UNUSED: a.sv:4:17: Signal is not used", "a.sv", 4, 17, "Signal is not used"},
+             Case{"%Warning-DECLFILENAME: dir/a.v:1: Filename mismatch", "dir/a.v", 1, 0, "Filename mismatch"},
+             Case{"%Error-NEEDTIMINGOPT: t.sv:9:5: Use --timing", "t.sv", 9, 5, "Use --timing"},
+             // A message of its own that merely contains a colon
+             Case{"%Error: Cannot open include file: defs.svh", "", 0, 0, "Cannot open include file: defs.svh"},
+             Case{"%Error: a.sv:x: not a line", "", 0, 0, "a.sv:x: not a line"},
+             Case{"%Error: a.sv:3:4:5 odd", "", 0, 0, "a.sv:3:4:5 odd"},
+             Case{"%Error: Internal Error", "", 0, 0, "Internal Error"},
+         }) {
+        std::vector<LintDiagnostic> diagnostics = LintReport::parse(c.output);
+        ASSERT_EQ(diagnostics.size(), 1u) << c.output;
+        EXPECT_EQ(diagnostics[0].file, c.file) << c.output;
+        EXPECT_EQ(diagnostics[0].line, c.line) << c.output;
+        EXPECT_EQ(diagnostics[0].column, c.column) << c.output;
+        EXPECT_EQ(diagnostics[0].message, c.message) << c.output;
+    }
+}
+
+TEST(LintReport, IgnoresOtherOutput) {
+    EXPECT_TRUE(LintReport::parse("").empty());
+    EXPECT_TRUE(LintReport::parse("- V e r i l a t i o n   R e p o r t\n%Error: Exiting due to 3 error(s)\n"
+                                  "%Error\n")
+                    .empty());
+}
+
+// A warning reported under several modules is kept once
+TEST(LintReport, DeduplicatesAndSorts) {
+    LintReport report;
+    report.addOutput(kTopOutput);
+    report.addOutput(kAluOutput);
+    EXPECT_EQ(report.errorCount(), 1u);
+    EXPECT_EQ(report.warningCount(), 3u);
+
+    std::vector<std::string> order;
+    for (const auto& diagnostic : report.sorted()) {
+        order.push_back(diagnostic.file + ":" + std::to_string(diagnostic.line) + " " + diagnostic.code);
+    }
+    std::vector<std::string> expected = {"rtl/alu.sv:1 DECLFILENAME", "rtl/alu.sv:4 UNUSEDSIGNAL",
+                                         "rtl/alu.sv:12 WIDTHTRUNC", "rtl/top.sv:3 "};
+    EXPECT_EQ(order, expected);
+}
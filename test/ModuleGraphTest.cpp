@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "ModuleGraph.hpp"
+#include "SvScanner.hpp"
+
+namespace {
+    const std::filesystem::path kRoot = "/ws";
+
+    // An index of in-memory files, each given as (name, source)
+    ModuleIndex index(const std::vector<std::pair<std::string, std::string>>& files) {
+        ModuleIndex result(kRoot);
+        for (const auto& [name, source] : files) {
+            result.addFile(kRoot / name, SvScanner::scan(source));
+        }
+        return result;
+    }
+
+    std::vector<std::string> names(const ModuleGraph& graph, const std::vector<ModuleGraph::Id>& ids) {
+        std::vector<std::string> result;
+        for (ModuleGraph::Id id : ids) {
+            result.push_back(graph.name(id));
+        }
+        return result;
+    }
+
+    // soc -> cpu -> alu, soc -> uart; the testbench drives soc, and pll is
+    // instantiated but declared nowhere
+    const std::vector<std::pair<std::string, std::string>> kSoc = {
+        {"alu.sv", "module alu;\nendmodule\n"},
+        {"cpu.sv", "module cpu;\n  alu a (.*);\n  pll p (.*);\nendmodule\n"},
+        {"soc.sv", "module soc;\n  cpu c (.*);\n  uart u (.*);\nendmodule\n"},
+        {"soc_tb.sv", "module soc_tb;\n  soc dut (.*);\nendmodule\n"},
+        {"uart.sv", "module uart;\nendmodule\nmodule uart_rx;\nendmodule\n"},
+    };
+}
+
+TEST(ModuleGraph, FindAndFiles) {
+    ModuleIndex modules = index(kSoc);
+    ModuleGraph graph(modules);
+    EXPECT_EQ(graph.size(), 6u);
+    EXPECT_EQ(graph.find("pll"), ModuleGraph::kNone);
+    ModuleGraph::Id cpu = graph.find("cpu");
+    ASSERT_NE(cpu, ModuleGraph::kNone);
+    EXPECT_EQ(graph.name(cpu), "cpu");
+    EXPECT_EQ(graph.file(cpu), kRoot / "cpu.sv");
+}
+
+TEST(ModuleGraph, Reachable) {
+    ModuleIndex modules = index(kSoc);
+    ModuleGraph graph(modules);
+    // In file order, the tops included
+    EXPECT_EQ(names(graph, graph.reachable({"cpu"})), (std::vector<std::string>{"alu", "cpu"}));
+    EXPECT_EQ(names(graph, graph.reachable({"soc_tb"})),
+              (std::vector<std::string>{"alu", "cpu", "soc", "soc_tb", "uart"}));
+    EXPECT_EQ(names(graph, graph.reachable({"uart_rx", "alu", "missing"})),
+              (std::vector<std::string>{"alu", "uart_rx"}));
+
+    std::vector<std::filesystem::path> files = {kRoot / "alu.sv", kRoot / "cpu.sv", kRoot / "soc.sv",
+                                                kRoot / "uart.sv"};
+    EXPECT_EQ(graph.reachableFiles({"soc", "cpu"}), files);
+}
+
+TEST(ModuleGraph, Roots) {
+    ModuleIndex modules = index({
+        {"a.sv", "module a;\n  b ub (.*);\nendmodule\n"},
+        {"b.sv", "module b;\n  glue g (.*);\nendmodule\n"},
+        {"glue.sv", "module glue;\n  c uc (.*);\nendmodule\n"},
+        {"c.sv", "module c;\nendmodule\n"},
+        {"d.sv", "module d;\nendmodule\n"},
+        {"loop.sv", "module x;\n  y uy (.*);\nendmodule\nmodule y;\n  x ux (.*);\nendmodule\n"},
+    });
+    ModuleGraph graph(modules);
+    struct Case {
+        std::vector<std::string> candidates;
+        std::vector<std::string> roots;
+    };
+    for (const Case& c : {
+             Case{{}, {}},
+             Case{{"a", "b", "c", "d"}, {"a", "d"}},
+             // Reached through glue, which is not a candidate
+             Case{{"c", "b"}, {"b"}},
+             // In the order given, once each; undeclared names are ignored
+             Case{{"d", "missing", "a", "d"}, {"d", "a"}},
+             // Modules in a cycle instantiate each other
+             Case{{"x", "y"}, {}},
+             Case{{"x", "d"}, {"d"}},
+         }) {
+        std::string text;
+        for (const auto& candidate : c.candidates) {
+            text += candidate + " ";
+        }
+        EXPECT_EQ(graph.roots(c.candidates), c.roots) << text;
+    }
+}
+
+TEST(ModuleGraph, TestbenchNames) {
+    for (const char* name : {"tb_soc", "test_soc", "soc_tb", "soc_test", "tb_", "test_"}) {
+        EXPECT_TRUE(ModuleGraph::isTestbenchName(name)) << name;
+    }
+    for (const char* name : {"soc", "_tb", "_test", "tbsoc", "testbench", "soc_tb2", "latest", "stb"}) {
+        EXPECT_FALSE(ModuleGraph::isTestbenchName(name)) << name;
+    }
+}
+
+TEST(ModuleGraph, TopsOf) {
+    ModuleIndex modules = index(kSoc);
+    ModuleGraph graph(modules);
+    struct Case {
+        std::vector<std::string> files;
+        std::vector<std::string> tops;
+    };
+    for (const Case& c : {
+             Case{{"soc.sv", "cpu.sv", "alu.sv"}, {"soc"}},
+             // Testbenches are left out while there is anything else
+             Case{{"soc_tb.sv", "soc.sv", "cpu.sv"}, {"soc"}},
+             Case{{"soc_tb.sv", "uart.sv"}, {"uart", "uart_rx"}},
+             Case{{"soc_tb.sv"}, {"soc_tb"}},
+             // Only the given files count: cpu instantiates alu, but is not
+             // one of them
+             Case{{"alu.sv", "uart.sv"}, {"alu", "uart", "uart_rx"}},
+             Case{{"alu.sv"}, {"alu"}},
+             Case{{"missing.sv"}, {}},
+             Case{{}, {}},
+         }) {
+        std::vector<std::filesystem::path> files;
+        std::string text;
+        for (const auto& file : c.files) {
+            files.push_back(kRoot / file);
+            text += file + " ";
+        }
+        EXPECT_EQ(graph.topsOf(modules, files), c.tops) << text;
+    }
+
+    // When the candidates instantiate each other, all of them are tops
+    ModuleIndex cycle = index({{"loop.sv", "module x;\n  y uy (.*);\nendmodule\nmodule y;\n  x ux (.*);\nendmodule\n"}});
+    EXPECT_EQ(ModuleGraph(cycle).topsOf(cycle, {kRoot / "loop.sv"}), (std::vector<std::string>{"x", "y"}));
+}
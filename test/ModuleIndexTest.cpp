@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+#include "ModuleIndex.hpp"
+#include "TempDir.hpp"
+
+namespace {
+    // Scans `files`, each given as (name, source), into an index of `dir`
+    ModuleIndex index(const TempDir& dir, const std::vector<std::pair<std::string, std::string>>& files) {
+        ModuleIndex result(dir.path());
+        for (const auto& [name, source] : files) {
+            std::filesystem::path path = dir.write(name, source);
+            result.addFile(path, SvScanner::scanFile(path));
+        }
+        return result;
+    }
+
+    uintmax_t sizeOf(const TempDir& dir, std::initializer_list<const char*> files) {
+        uintmax_t size = 0;
+        for (const char* file : files) {
+            size += std::filesystem::file_size(dir.path() / file);
+        }
+        return size;
+    }
+}
+
+// top -> a -> b, c -> d, with d reached twice and c sharing b's file
+TEST(ModuleIndex, HierarchicalBlocks) {
+    TempDir dir;
+    ModuleIndex modules = index(dir, {
+        {"top.sv", "module top;\n  a ua (.*);\n  tuned #(.N(4)) ut (.*);\nendmodule\n"},
+        {"a.sv", "module a;\n  b ub (.*);\n  c uc (.*);\nendmodule\n"},
+        {"bc.sv", "module b;\n  d ud (.*);\nendmodule\nmodule c;\n  d ud (.*);\nendmodule\n"},
+        {"d.sv", "module d;\n  // padding so that d alone is the largest file of all\n  wire w;\nendmodule\n"},
+        {"tuned.sv", "module tuned;\n  d ud (.*);\nendmodule\n"},
+    });
+    uintmax_t d = sizeOf(dir, {"d.sv"});
+    uintmax_t bc = sizeOf(dir, {"bc.sv", "d.sv"});
+    uintmax_t a = sizeOf(dir, {"a.sv", "bc.sv", "d.sv"});
+    ASSERT_LT(d, bc);
+    ASSERT_LT(bc, a);
+
+    struct Case {
+        uintmax_t threshold;
+        std::set<std::string> blocks;
+    };
+    // top is instantiated by nothing and tuned only with an override, so
+    // neither is ever a block
+    for (const Case& c : {
+             Case{1, {"a", "b", "c", "d"}},
+             Case{d, {"a", "b", "c", "d"}},
+             Case{d + 1, {"a", "b", "c"}},
+             Case{bc, {"a", "b", "c"}},
+             Case{bc + 1, {"a"}},
+             // Each file counts once, however often it is reached
+             Case{a, {"a"}},
+             Case{a + 1, {}},
+         }) {
+        EXPECT_EQ(modules.hierarchicalBlocks(c.threshold), c.blocks) << c.threshold;
+    }
+}
+
+// A long chain is summed bottom-up; each level adds its own file
+TEST(ModuleIndex, HierarchicalBlocksOfAChain) {
+    TempDir dir;
+    constexpr int kLevels = 200;
+    std::vector<std::pair<std::string, std::string>> files;
+    for (int level = 0; level < kLevels; ++level) {
+        std::string body = "module m" + std::to_string(level) + ";\n";
+        if (level + 1 < kLevels) {
+            body += "  m" + std::to_string(level + 1) + " u (.*);\n";
+        }
+        files.emplace_back("m" + std::to_string(level) + ".sv", body + "endmodule\n");
+    }
+    ModuleIndex modules = index(dir, files);
+
+    uintmax_t total = 0;
+    std::set<std::string> expected;
+    uintmax_t threshold = 0;
+    for (int level = kLevels - 1; level >= 1; --level) {
+        total += std::filesystem::file_size(dir.path() / files[level].first);
+        if (level == kLevels / 2) {
+            threshold = total;
+        }
+        if (level <= kLevels / 2) {
+            expected.insert("m" + std::to_string(level));
+        }
+    }
+    EXPECT_EQ(modules.hierarchicalBlocks(threshold), expected);
+}
+
+// Instantiation cycles do not recurse forever
+TEST(ModuleIndex, HierarchicalBlocksWithACycle) {
+    TempDir dir;
+    ModuleIndex modules = index(dir, {
+        {"top.sv", "module top;\n  x ux (.*);\nendmodule\n"},
+        {"xy.sv", "module x;\n  y uy (.*);\nendmodule\nmodule y;\n  x ux (.*);\nendmodule\n"},
+    });
+    EXPECT_EQ(modules.hierarchicalBlocks(1), (std::set<std::string>{"x", "y"}));
+    EXPECT_TRUE(modules.hierarchicalBlocks(sizeOf(dir, {"xy.sv"}) + 1).empty());
+}
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "NetlistStats.hpp"
+#include "TempDir.hpp"
+
+namespace {
+    // A cell of `type`; `extra` is appended to its JSON object
+    std::string cell(const std::string& type, const std::string& extra = "") {
+        return "{\"type\": \"" + type + "\"" + extra + "}";
+    }
+
+    // A two-input gate reading bits `a` and `b` and driving bit `y`
+    std::string gate(const std::string& type, int a, int b, int y) {
+        return cell(type, ", \"port_directions\": {\"A\": \"input\", \"B\": \"input\", \"Y\": \"output\"}, "
+                          "\"connections\": {\"A\": [" + std::to_string(a) + "], \"B\": [" + std::to_string(b) +
+                          "], \"Y\": [" + std::to_string(y) + "]}");
+    }
+
+    std::string inverter(int a, int y) {
+        return cell("$_NOT_", ", \"port_directions\": {\"A\": \"input\", \"Y\": \"output\"}, "
+                              "\"connections\": {\"A\": [" + std::to_string(a) + "], \"Y\": [" + std::to_string(y) +
+                              "]}");
+    }
+
+    std::string module(const std::string& name, const std::vector<std::string>& cells, bool top = false) {
+        std::string json = "\"" + name + "\": {";
+        if (top) {
+            json += "\"attributes\": {\"top\": \"00000000000000000000000000000001\"}, ";
+        }
+        json += "\"ports\": {}, \"cells\": {";
+        for (size_t i = 0; i < cells.size(); ++i) {
+            json += (i == 0 ? "" : ", ") + std::string("\"c") + std::to_string(i) + "\": " + cells[i];
+        }
+        return json + "}}";
+    }
+
+    NetlistStats analyze(const TempDir& dir, const std::vector<std::string>& modules) {
+        std::string json = "{\"creator\": \"Yosys\", \"modules\": {";
+        for (size_t i = 0; i < modules.size(); ++i) {
+            json += (i == 0 ? "" : ", ") + modules[i];
+        }
+        return NetlistStats::analyze(dir.write("netlist.json", json + "}}"));
+    }
+}
+
+TEST(NetlistStats, CountsCells) {
+    TempDir dir;
+    std::vector<std::string> cells = {
+        cell("$_AND_"), cell("$_OR_"), cell("$_XOR_"), cell("$_MUX_"), cell("$_NOT_"),
+        cell("$_DFF_P_"), cell("$_DFF_P_"),
+        cell("LUT4"), cell("FDRE"),
+        cell("$dff", ", \"parameters\": {\"WIDTH\": \"00000000000000000000000000001000\"}"),
+        cell("$add"),
+        cell("$mem_v2"),
+    };
+    NetlistStats stats = analyze(dir, {module("m", cells)});
+    ASSERT_EQ(stats.getModules().size(), 1u);
+    const ModuleStats& m = stats.getModules().front();
+    EXPECT_EQ(m.name, "m");
+    EXPECT_EQ(m.cells, cells.size());
+    EXPECT_EQ(m.cell_counts.at("$_DFF_P_"), 2u);
+    // Two gate-level flip-flops, one Xilinx primitive and an 8-bit $dff
+    EXPECT_EQ(m.flip_flops, 11u);
+    // LUT4, plus five two-input merges packed into one LUT6
+    EXPECT_EQ(m.luts, 2u);
+    EXPECT_EQ(m.unmapped_cells, 1u);
+}
+
+TEST(NetlistStats, LogicDepth) {
+    TempDir dir;
+    struct Case {
+        const char* name;
+        std::vector<std::string> cells;
+        size_t depth;
+        bool loop;
+    };
+    std::vector<Case> cases = {
+        {"empty", {}, 0, false},
+        {"single gate", {gate("$_AND_", 2, 3, 4)}, 1, false},
+        // Inverters are free
+        {"chain", {gate("$_AND_", 2, 3, 4), gate("$_AND_", 4, 3, 5), inverter(5, 6), gate("$_OR_", 6, 2, 7)}, 3, false},
+        // Flip-flops end paths
+        {"registered",
+         {gate("$_AND_", 2, 3, 4), cell("$_DFF_P_", ", \"connections\": {\"D\": [4], \"Q\": [5]}"),
+          gate("$_AND_", 5, 3, 6)},
+         1,
+         false},
+        {"loop", {gate("$_AND_", 10, 2, 11), gate("$_AND_", 11, 2, 10)}, 2, true},
+    };
+    for (const Case& c : cases) {
+        NetlistStats stats = analyze(dir, {module("m", c.cells)});
+        EXPECT_EQ(stats.getModules().front().logic_depth, c.depth) << c.name;
+        EXPECT_EQ(stats.getModules().front().combinational_loop, c.loop) << c.name;
+    }
+}
+
+TEST(NetlistStats, FindTop) {
+    TempDir dir;
+    NetlistStats marked = analyze(dir, {module("leaf", {}), module("soc", {cell("leaf")}, true)});
+    ASSERT_NE(marked.findTop(), nullptr);
+    EXPECT_EQ(marked.findTop()->name, "soc");
+
+    // Without the attribute, the module nothing instantiates
+    NetlistStats unmarked = analyze(dir, {module("leaf", {}), module("soc", {cell("leaf")})});
+    ASSERT_NE(unmarked.findTop(), nullptr);
+    EXPECT_EQ(unmarked.findTop()->name, "soc");
+}
+
+TEST(NetlistStats, HierarchyTotal) {
+    TempDir dir;
+    NetlistStats stats = analyze(dir, {
+        module("leaf", {cell("$_DFF_P_"), cell("LUT6")}),
+        module("mid", {cell("leaf"), cell("leaf"), cell("leaf"), cell("$_DFF_P_")}),
+        module("top", {cell("mid"), cell("mid"), cell("leaf")}),
+    });
+    ModuleStats total = stats.hierarchyTotal("top");
+    // 2 x (3 leaves + 1) + 1 leaf flip-flops; 7 leaves' LUTs
+    EXPECT_EQ(total.flip_flops, 9u);
+    EXPECT_EQ(total.luts, 7u);
+    EXPECT_EQ(total.cell_counts.at("LUT6"), 7u);
+    EXPECT_EQ(stats.hierarchyTotal("missing").cells, 0u);
+}
+
+// Each level instantiates the next twice: without memoisation this would
+// expand 2^60 instances
+TEST(NetlistStats, HierarchyTotalOfDeepSharedHierarchy) {
+    TempDir dir;
+    constexpr int kLevels = 60;
+    std::vector<std::string> modules = {module("level" + std::to_string(kLevels), {cell("$_DFF_P_")})};
+    for (int level = kLevels - 1; level >= 0; --level) {
+        std::string child = "level" + std::to_string(level + 1);
+        modules.push_back(module("level" + std::to_string(level), {cell(child), cell(child), cell("$_DFF_P_")}));
+    }
+    NetlistStats stats = analyze(dir, modules);
+    EXPECT_EQ(stats.hierarchyTotal("level0").flip_flops, (size_t(1) << (kLevels + 1)) - 1);
+}
+
+TEST(NetlistStats, HierarchyTotalStopsAtCycles) {
+    TempDir dir;
+    NetlistStats stats = analyze(dir, {
+        module("a", {cell("b"), cell("$_DFF_P_")}),
+        module("b", {cell("a"), cell("$_DFF_P_")}),
+    });
+    // b's instance of a counts a's own cells once, without expanding it again
+    EXPECT_EQ(stats.hierarchyTotal("a").flip_flops, 3u);
+}
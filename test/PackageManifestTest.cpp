@@ -0,0 +1,266 @@
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "PackageManifest.hpp"
+#include "PackageResolver.hpp"
+#include "TempDir.hpp"
+
+namespace {
+    // The message `call` throws, or empty if it returns
+    template <typename Call>
+    std::string errorOf(Call call) {
+        try {
+            call();
+        } catch (const std::exception& e) {
+            return e.what();
+        }
+        return "";
+    }
+
+    bool invalidName(const std::string& message) { return message.find("Invalid package name") != std::string::npos; }
+
+    // "name version source" of each resolved package, sorted by name
+    std::vector<std::string> summary(const std::vector<ResolvedPackage>& packages) {
+        std::vector<std::string> result;
+        for (const auto& package : packages) {
+            result.push_back(package.name + " " + package.version + " " + package.source);
+        }
+        return result;
+    }
+}
+
+TEST(PackageManifest, Read) {
+    TempDir dir;
+    std::filesystem::path path = dir.write("ws/vpm.toml", R"(# A workspace
+[package]
+name = "soc"   # trailing comment
+version = '0.1.0'
+
+[registry]
+path = "../registry"
+
+[dependencies]
+uart = "^1.2"
+"quoted-name" = "~0.3"
+fifo = { path = "../ip/fifo" }
+spi = { version = ">= 2", path = 'vendor/spi' }
+)");
+    PackageManifest manifest = PackageManifest::read(path);
+    EXPECT_EQ(manifest.name, "soc");
+    EXPECT_EQ(manifest.version, "0.1.0");
+    EXPECT_EQ(manifest.registry, (std::filesystem::absolute(dir.path()) / "registry").lexically_normal());
+
+    struct Expected {
+        const char* name;
+        const char* requirement;
+        const char* path;
+    };
+    std::vector<Expected> expected = {
+        {"uart", "^1.2", ""}, {"quoted-name", "~0.3", ""}, {"fifo", "", "../ip/fifo"}, {"spi", ">= 2", "vendor/spi"}};
+    ASSERT_EQ(manifest.dependencies.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(manifest.dependencies[i].name, expected[i].name);
+        EXPECT_EQ(manifest.dependencies[i].requirement, expected[i].requirement) << expected[i].name;
+        EXPECT_EQ(manifest.dependencies[i].path, expected[i].path) << expected[i].name;
+    }
+}
+
+TEST(PackageManifest, ReadRejectsMalformedToml) {
+    TempDir dir;
+    struct Case {
+        const char* toml;
+        const char* error;
+    };
+    for (const Case& c : {
+             Case{"[package]\nname = \"soc\n", "vpm.toml:2: unterminated string"},
+             Case{"[package\n", "vpm.toml:1: malformed table header"},
+             Case{"[[package]\n", "vpm.toml:1: malformed table header"},
+             Case{"name \"soc\"\n", "vpm.toml:1: expected '=' after name"},
+             Case{"= \"soc\"\n", "vpm.toml:1: expected a key"},
+             Case{"name =\n", "vpm.toml:1: expected a value"},
+             Case{"name = \"soc\" extra\n", "vpm.toml:1: unexpected text after value"},
+             Case{"[dependencies]\nuart = { version = \"1\" path = \"x\" }\n", "vpm.toml:2: expected ',' or '}'"},
+             Case{"[dependencies]\nuart = { tag = \"v1\" }\n", "Unknown field 'tag' of dependency uart"},
+             Case{"[dependencies]\nuart = [\"1\"]\n", "must be a version string or a table"},
+         }) {
+        std::string error = errorOf([&] { PackageManifest::read(dir.write("vpm.toml", c.toml)); });
+        EXPECT_NE(error.find(c.error), std::string::npos) << c.toml << " -> " << error;
+    }
+    EXPECT_NE(errorOf([&] { PackageManifest::read(dir.path() / "missing.toml"); }).find("Failed to read file"),
+              std::string::npos);
+}
+
+TEST(PackageLock, WriteAndRead) {
+    TempDir dir;
+    PackageLock lock;
+    lock.packages = {
+        {"uart", "1.2.0", "registry", "abc", {"fifo"}},
+        {"fifo", "0.0.0", "path+ip/\"fifo\"", "def", {}},
+    };
+    lock.write(dir.path() / "vpm.lock");
+    PackageLock read = PackageLock::read(dir.path() / "vpm.lock");
+    ASSERT_EQ(read.packages.size(), 2u);
+    // Sorted by name
+    EXPECT_EQ(read.packages[0].name, "fifo");
+    EXPECT_EQ(read.packages[0].source, "path+ip/\"fifo\"");
+    EXPECT_TRUE(read.packages[0].dependencies.empty());
+    EXPECT_EQ(read.packages[1].name, "uart");
+    EXPECT_EQ(read.packages[1].version, "1.2.0");
+    EXPECT_EQ(read.packages[1].hash, "abc");
+    EXPECT_EQ(read.packages[1].dependencies, std::vector<std::string>{"fifo"});
+    ASSERT_NE(read.find("uart"), nullptr);
+    EXPECT_EQ(read.find("spi"), nullptr);
+}
+
+TEST(PackageManifest, ValidNames) {
+    for (const char* name : {"uart", "fifo_2", "axi-lite", "A9"}) {
+        EXPECT_TRUE(PackageManifest::isValidName(name)) << name;
+    }
+    for (const char* name : {"", ".", "..", "a/../..", "a/b", "/etc", "a b", "a.b", "~", "a\\b"}) {
+        EXPECT_FALSE(PackageManifest::isValidName(name)) << '"' << name << '"';
+    }
+}
+
+// Dependency names become vpm_packages/<name>, which installs replace
+// wholesale
+TEST(PackageManifest, RejectsPathLikeDependencyNames) {
+    TempDir dir;
+    for (const char* key : {R"("..")", R"("a/../..")", R"('/tmp')", "a.b"}) {
+        std::filesystem::path manifest =
+            dir.write("vpm.toml", std::string("[dependencies]\n") + key + " = { path = \"../dep\" }\n");
+        EXPECT_PRED1(invalidName, errorOf([&] { PackageManifest::read(manifest); })) << key;
+    }
+}
+
+TEST(PackageManifest, RejectsPathLikeLockedNames) {
+    TempDir dir;
+    const char* header = "version = 1\n\n[[package]]\nversion = \"1.0.0\"\nsource = \"registry\"\nhash = \"h\"\n";
+    std::filesystem::path lock = dir.write("vpm.lock", std::string(header) + "name = \"..\"\n");
+    EXPECT_PRED1(invalidName, errorOf([&] { PackageLock::read(lock); }));
+    lock = dir.write("vpm.lock", std::string(header) + "name = \"ok\"\ndependencies = [\"../x\"]\n");
+    EXPECT_PRED1(invalidName, errorOf([&] { PackageLock::read(lock); }));
+}
+
+// A registry package's own vpm.toml is checked like the workspace's
+TEST(PackageResolver, RejectsPathLikeNamesFromRegistryPackages) {
+    TempDir dir;
+    dir.write("registry/uart/1.0.0/vpm.toml", "[dependencies]\n\"..\" = \"1\"\n");
+    std::filesystem::path manifest = dir.write("ws/vpm.toml", "[dependencies]\nuart = \"1\"\n");
+    PackageResolver resolver(dir.path() / "ws", dir.path() / "registry");
+    PackageManifest workspace = PackageManifest::read(manifest);
+    EXPECT_PRED1(invalidName, errorOf([&] { resolver.resolve(workspace); }));
+}
+
+TEST(PackageVersion, Parse) {
+    struct Case {
+        const char* text;
+        unsigned long major, minor, patch;
+    };
+    for (const Case& c : {Case{"1", 1, 0, 0}, Case{"1.2", 1, 2, 0}, Case{"1.2.3", 1, 2, 3}, Case{"0.10.07", 0, 10, 7}}) {
+        PackageVersion version = PackageVersion::parse(c.text);
+        EXPECT_EQ(version.major, c.major) << c.text;
+        EXPECT_EQ(version.minor, c.minor) << c.text;
+        EXPECT_EQ(version.patch, c.patch) << c.text;
+    }
+}
+
+TEST(PackageVersion, ParseRejectsMalformedVersions) {
+    for (const char* text : {"", ".", "1.", ".1", "1..2", "1.2.3.4", "1.2-beta", "v1", "1.99999999999999999999999"}) {
+        EXPECT_EQ(errorOf([&]() { PackageVersion::parse(text); }), "Invalid version: '" + std::string(text) + "'");
+    }
+}
+
+TEST(PackageVersion, Satisfies) {
+    struct Case {
+        const char* version;
+        const char* requirement;
+        bool satisfies;
+    };
+    for (const Case& c : {
+             // Bare and caret requirements allow compatible updates
+             Case{"1.2.0", "1.2", true},
+             Case{"1.9.9", "1.2", true},
+             Case{"1.1.9", "1.2", false},
+             Case{"2.0.0", "1.2", false},
+             Case{"1.2.3", "^1.2.3", true},
+             Case{"1.2.2", "^1.2.3", false},
+             Case{"1.5.0", "^1", true},
+             Case{"2.0.0", "^1", false},
+             Case{"0.2.5", "^0.2", true},
+             Case{"0.3.0", "^0.2", false},
+             Case{"0.2.3", "^0.2.3", true},
+             Case{"0.2.4", "^0.2.3", true},
+             Case{"0.3.0", "^0.2.3", false},
+             Case{"0.0.3", "^0.0.3", true},
+             Case{"0.0.4", "^0.0.3", false},
+             Case{"0.5.0", "^0", true},
+             Case{"1.0.0", "^0", false},
+             // Tilde allows patch updates, or minor ones with only a major
+             Case{"1.2.9", "~1.2.3", true},
+             Case{"1.2.2", "~1.2.3", false},
+             Case{"1.3.0", "~1.2.3", false},
+             Case{"1.2.0", "~1.2", true},
+             Case{"1.3.0", "~1.2", false},
+             Case{"1.9.0", "~1", true},
+             Case{"2.0.0", "~1", false},
+             Case{"0.1.7", "~0.1", true},
+             // Lower bounds and exact versions
+             Case{"1.2.0", ">=1.2", true},
+             Case{"7.0.0", ">= 1.2", true},
+             Case{"1.1.9", ">=1.2", false},
+             Case{"1.2.3", "=1.2.3", true},
+             Case{"1.2.4", "=1.2.3", false},
+             Case{"1.2.0", "=1.2", true},
+             Case{"9.9.9", "*", true},
+             Case{"0.0.0", "", true},
+         }) {
+        EXPECT_EQ(PackageVersion::parse(c.version).satisfies(c.requirement), c.satisfies)
+            << c.version << " " << c.requirement;
+    }
+}
+
+TEST(PackageVersion, SatisfiesRejectsMalformedRequirements) {
+    for (const char* requirement : {"<2", ">1", "^^1", "~=1", "1.x", "^"}) {
+        EXPECT_THROW(PackageVersion::parse("1.0.0").satisfies(requirement), std::runtime_error) << requirement;
+    }
+}
+
+TEST(PackageResolver, PicksNewestMatchingVersions) {
+    TempDir dir;
+    for (const char* version : {"1.0.0", "1.4.2", "2.0.0"}) {
+        dir.write(std::string("registry/uart/") + version + "/uart.sv", "");
+    }
+    dir.write("registry/uart/not-a-version/uart.sv", "");
+    dir.write("registry/fifo/0.3.1/vpm.toml", "[dependencies]\nuart = \"~1.0\"\n");
+    dir.write("registry/fifo/0.4.0/vpm.toml", "[dependencies]\nuart = \"2\"\n");
+    dir.write("ip/spi/vpm.toml", "[package]\nname = \"spi\"\nversion = \"0.2\"\n");
+    std::filesystem::path manifest = dir.write("vpm.toml", "[dependencies]\nuart = \"^1.0\"\nfifo = \"0.3\"\n"
+                                                           "spi = { path = \"ip/spi\" }\n");
+    PackageResolver resolver(dir.path(), dir.path() / "registry");
+    std::vector<std::string> expected = {"fifo 0.3.1 registry", "spi 0.2.0 path+ip/spi", "uart 1.0.0 registry"};
+    EXPECT_EQ(summary(resolver.resolve(PackageManifest::read(manifest))), expected);
+
+    // Without fifo's ~1.0, uart takes the newest 1.x
+    manifest = dir.write("vpm.toml", "[dependencies]\nuart = \"^1.0\"\n");
+    EXPECT_EQ(summary(resolver.resolve(PackageManifest::read(manifest))),
+              std::vector<std::string>{"uart 1.4.2 registry"});
+}
+
+TEST(PackageResolver, ConflictNamesEachRequirement) {
+    TempDir dir;
+    dir.write("registry/uart/1.4.2/uart.sv", "");
+    dir.write("registry/uart/2.0.0/uart.sv", "");
+    dir.write("registry/fifo/1.0.0/vpm.toml", "[dependencies]\nuart = \">=2\"\n");
+    std::filesystem::path manifest = dir.write("vpm.toml", "[dependencies]\nuart = \"^1.2\"\nfifo = \"1\"\n");
+    PackageResolver resolver(dir.path(), dir.path() / "registry");
+    EXPECT_EQ(errorOf([&] { resolver.resolve(PackageManifest::read(manifest)); }),
+              "No version in the registry satisfies all requirements: uart is required as\n"
+              "  \"^1.2\" by vpm.toml\n"
+              "  \">=2\" by fifo");
+
+    manifest = dir.write("vpm.toml", "[dependencies]\nspi = \"1\"\n");
+    EXPECT_EQ(errorOf([&] { resolver.resolve(PackageManifest::read(manifest)); }),
+              "Package not found in registry " + (dir.path() / "registry").string() +
+                  ": spi is required as\n  \"1\" by vpm.toml");
+}
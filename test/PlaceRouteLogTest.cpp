@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include "PlaceRouteLog.hpp"
+#include "TempDir.hpp"
+
+namespace {
+    // Abridged nextpnr-ecp5 log with three clocks, two of them constrained.
+    // Timing is reported after placement and again after routing.
+    const char* const kLog = R"(Info: Logic utilisation before packing:
+Info:     Total LUT4s:       812/24288     3%
+Info: Device utilisation:
+Info: 	          TRELLIS_IO:    12/  197     6%
+Info: 	                DCCA:     3/   56     5%
+Info: 	       TRELLIS_SLICE:   530/12144     4%
+Info: 	          MULT18X18D:     2/   28     7%
+
+Info: Placed 12 cells based on constraints.
+Info: Max frequency for clock '$glbnet$clk_sys': 80.00 MHz (FAIL at 100.00 MHz)
+Info: Max frequency for clock 'clk_pix': 30.10 MHz (PASS at 25.00 MHz)
+Info: Max frequency for clock 'uart_clk': 250.00 MHz
+Info: Max delay <async>                 -> posedge $glbnet$clk_sys: 3.21 ns
+Info: Routing..
+Warning: Max frequency for clock '$glbnet$clk_sys': 96.52 MHz (FAIL at 100.00 MHz)
+Info: Max frequency for clock 'clk_pix': 41.37 MHz (PASS at 25.00 MHz)
+Info: Max frequency for clock 'uart_clk': 312.50 MHz
+Info: Max delay posedge clk_pix -> <async>: 4.50 ns
+)";
+}
+
+TEST(PlaceRouteLog, ClocksAfterRouting) {
+    PlaceRouteLog log = PlaceRouteLog::parse(kLog);
+    struct Case {
+        const char* clock;
+        double achieved_mhz;
+        double target_mhz;
+    };
+    ASSERT_EQ(log.getClocks().size(), 3u);
+    for (const Case& c : {
+             Case{"$glbnet$clk_sys", 96.52, 100},
+             Case{"clk_pix", 41.37, 25},
+             Case{"uart_clk", 312.5, 0},
+         }) {
+        ASSERT_EQ(log.getClocks().count(c.clock), 1u) << c.clock;
+        EXPECT_DOUBLE_EQ(log.getClocks().at(c.clock).achieved_mhz, c.achieved_mhz) << c.clock;
+        EXPECT_DOUBLE_EQ(log.getClocks().at(c.clock).target_mhz, c.target_mhz) << c.clock;
+    }
+    EXPECT_DOUBLE_EQ(log.worstFmax(), 41.37);
+    EXPECT_FALSE(log.meetsConstraints());
+}
+
+TEST(PlaceRouteLog, MeetsConstraints) {
+    struct Case {
+        const char* log;
+        bool meets;
+        double worst_mhz;
+    };
+    for (const Case& c : {
+             Case{"", true, 0},
+             Case{"Info: Max frequency for clock 'a': 50.00 MHz\n", true, 50},
+             Case{"Info: Max frequency for clock 'a': 100.00 MHz (PASS at 100.00 MHz)\n", true, 100},
+             Case{"Info: Max frequency for clock 'a': 99.99 MHz (FAIL at 100.00 MHz)\n", false, 99.99},
+             Case{"Info: Max frequency for clock 'a': 120.00 MHz (PASS at 100.00 MHz)\r\n"
+                  "Info: Max frequency for clock 'b': 12.00 MHz (PASS at 12.00 MHz)\r\n",
+                  true, 12},
+         }) {
+        PlaceRouteLog log = PlaceRouteLog::parse(c.log);
+        EXPECT_EQ(log.meetsConstraints(), c.meets) << c.log;
+        EXPECT_DOUBLE_EQ(log.worstFmax(), c.worst_mhz) << c.log;
+    }
+}
+
+// Only the lines of the utilisation table count, not the packing summary
+// before it
+TEST(PlaceRouteLog, DeviceUtilisation) {
+    PlaceRouteLog log = PlaceRouteLog::parse(kLog);
+    struct Case {
+        const char* resource;
+        size_t used;
+        size_t available;
+    };
+    ASSERT_EQ(log.getResources().size(), 4u);
+    for (const Case& c : {
+             Case{"TRELLIS_IO", 12, 197},
+             Case{"DCCA", 3, 56},
+             Case{"TRELLIS_SLICE", 530, 12144},
+             Case{"MULT18X18D", 2, 28},
+         }) {
+        ASSERT_EQ(log.getResources().count(c.resource), 1u) << c.resource;
+        EXPECT_EQ(log.getResources().at(c.resource).used, c.used) << c.resource;
+        EXPECT_EQ(log.getResources().at(c.resource).available, c.available) << c.resource;
+    }
+    EXPECT_EQ(log.cellsUsed(), 12u + 3 + 530 + 2);
+}
+
+TEST(PlaceRouteLog, IgnoresMalformedLines) {
+    PlaceRouteLog log = PlaceRouteLog::parse("Info: Max frequency for clock 'a: 50.00 MHz\n"
+                                             "Info: Max frequency for clock 'b': fast\n"
+                                             "Info: Device utilisation:\n"
+                                             "Info:   ICESTORM_LC: many/ 5280\n"
+                                             "Info:   two words:   1/ 2\n");
+    EXPECT_TRUE(log.getClocks().empty());
+    EXPECT_TRUE(log.getResources().empty());
+}
+
+TEST(PlaceRouteLog, Read) {
+    TempDir dir;
+    PlaceRouteLog log = PlaceRouteLog::read(dir.write("nextpnr.log", kLog));
+    EXPECT_EQ(log.getClocks().size(), 3u);
+    EXPECT_THROW(PlaceRouteLog::read(dir.path() / "missing.log"), std::runtime_error);
+}
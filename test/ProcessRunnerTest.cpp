@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ProcessRunner.hpp"
+
+namespace {
+    // Runs `script` through sh with its output captured and not echoed
+    ProcessResult sh(const std::string& script, ProcessOptions options = {}) {
+        options.echo = false;
+        options.capture = true;
+        return ProcessRunner::run(std::vector<std::string>{"sh", "-c", script}, options);
+    }
+}
+
+TEST(ProcessRunner, SplitCommand) {
+    struct Case {
+        const char* command;
+        std::vector<std::string> args;
+    };
+    for (const Case& c : {
+             Case{"", {}},
+             Case{"  \t\n ", {}},
+             Case{"yosys -q -p synth", {"yosys", "-q", "-p", "synth"}},
+             Case{"  a \t b\n", {"a", "b"}},
+             Case{"a 'b c' d", {"a", "b c", "d"}},
+             Case{"a \"b c\" d", {"a", "b c", "d"}},
+             Case{"a ''", {"a", ""}},
+             Case{"a \"\"", {"a", ""}},
+             Case{"pre'quoted'post", {"prequotedpost"}},
+             Case{"'a'\"b\"c", {"abc"}},
+             // Single quotes keep everything literally, backslashes included
+             Case{"'a\\b\"c'", {"a\\b\"c"}},
+             // Inside double quotes a backslash only escapes " \\ $ and `
+             Case{"\"a\\\"b\"", {"a\"b"}},
+             Case{"\"a\\\\b\"", {"a\\b"}},
+             Case{"\"\\$x \\`y\\`\"", {"$x `y`"}},
+             Case{"\"a\\nb\"", {"a\\nb"}},
+             Case{"\"it's\"", {"it's"}},
+             // Outside quotes a backslash escapes any character
+             Case{"a\\ b c", {"a b", "c"}},
+             Case{"\\'a\\\"", {"'a\""}},
+             Case{"a\\", {"a\\"}},
+         }) {
+        EXPECT_EQ(ProcessRunner::splitCommand(c.command), c.args) << c.command;
+    }
+}
+
+TEST(ProcessRunner, SplitCommandRejectsUnterminatedQuotes) {
+    for (const char* command : {"a 'b", "a \"b", "\"a\\\"", "'"}) {
+        EXPECT_THROW(ProcessRunner::splitCommand(command), std::runtime_error) << command;
+    }
+}
+
+TEST(ProcessRunner, ExitCodes) {
+    struct Case {
+        const char* script;
+        int exit_code;
+    };
+    for (const Case& c : {
+             Case{"true", 0},
+             Case{"false", 1},
+             Case{"exit 3", 3},
+             Case{"exit 255", 255},
+             // Killed by a signal: 128 + its number
+             Case{"kill -TERM $$", 128 + 15},
+             Case{"kill -KILL $$", 128 + 9},
+         }) {
+        ProcessResult result = sh(c.script);
+        EXPECT_EQ(result.exit_code, c.exit_code) << c.script;
+        EXPECT_FALSE(result.timed_out) << c.script;
+        EXPECT_FALSE(result.cancelled) << c.script;
+    }
+}
+
+TEST(ProcessRunner, CapturesOutput) {
+    ProcessResult result = sh("echo out; echo err >&2; printf 'no newline'");
+    EXPECT_EQ(result.exit_code, 0);
+    EXPECT_EQ(result.output, "out\nno newline");
+    EXPECT_EQ(result.errors, "err\n");
+}
+
+TEST(ProcessRunner, RunsSplitCommandLine) {
+    ProcessOptions options;
+    options.echo = false;
+    options.capture = true;
+    ProcessResult result = ProcessRunner::run(std::string("sh -c 'printf \"%s|\" \"$@\"' sh 'a b' \"c\\\"d\""), options);
+    EXPECT_EQ(result.exit_code, 0);
+    EXPECT_EQ(result.output, "a b|c\"d|");
+}
+
+TEST(ProcessRunner, Timeout) {
+    ProcessOptions options;
+    options.timeout = std::chrono::milliseconds(100);
+    ProcessResult result = sh("exec sleep 10", options);
+    EXPECT_TRUE(result.timed_out);
+    EXPECT_EQ(result.exit_code, 124);
+    EXPECT_LT(result.wall_seconds, 5);
+}
+
+TEST(ProcessRunner, Cancel) {
+    std::atomic<bool> cancel{true};
+    ProcessOptions options;
+    options.cancel = &cancel;
+    ProcessResult result = sh("exec sleep 10", options);
+    EXPECT_TRUE(result.cancelled);
+    EXPECT_EQ(result.exit_code, 125);
+}
+
+TEST(ProcessRunner, MissingProgramThrows) {
+    EXPECT_THROW(ProcessRunner::run(std::vector<std::string>{"vpm-no-such-program"}), std::runtime_error);
+    EXPECT_THROW(ProcessRunner::run(std::vector<std::string>{}), std::runtime_error);
+    EXPECT_THROW(ProcessRunner::run(std::string("   ")), std::runtime_error);
+}
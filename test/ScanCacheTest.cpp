@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include "ScanCache.hpp"
+#include "TempDir.hpp"
+
+namespace {
+    using Clock = std::filesystem::file_time_type::clock;
+
+    // Sets the mtime of `path` to `offset` from now. Files written by a test
+    // are backdated so that they are clearly older than the cache written
+    // after them, whatever the timestamp granularity of the file system.
+    void setMtime(const std::filesystem::path& path, std::chrono::seconds offset) {
+        std::filesystem::last_write_time(path, Clock::now() + offset);
+    }
+
+    std::string firstInstance(const SvScanResult& result) {
+        return result.modules.at(0).instances.at(0).module_name;
+    }
+
+    class ScanCacheTest : public ::testing::Test {
+    protected:
+        TempDir dir;
+        std::filesystem::path cache_path = dir.path() / ".vpm" / "cache";
+
+        // Scans `file` with a fresh cache loaded from disk, then saves it
+        SvScanResult scanOnce(const std::filesystem::path& file, ScanCache& cache) {
+            cache.load();
+            SvScanResult result = *cache.scan(file);
+            cache.save();
+            return result;
+        }
+    };
+}
+
+TEST_F(ScanCacheTest, HitsWhenNothingChanged) {
+    std::filesystem::path file = dir.write("top.sv", "module top;\n  alu u (.a(a));\nendmodule\n");
+    setMtime(file, std::chrono::seconds(-10));
+
+    ScanCache first(cache_path);
+    EXPECT_EQ(firstInstance(scanOnce(file, first)), "alu");
+    EXPECT_EQ(first.getMisses(), 1u);
+    ASSERT_TRUE(std::filesystem::exists(cache_path));
+    // Saved by renaming a temporary file over the cache
+    EXPECT_FALSE(std::filesystem::exists(cache_path.string() + ".tmp"));
+
+    auto saved = std::filesystem::last_write_time(cache_path);
+    ScanCache second(cache_path);
+    EXPECT_EQ(firstInstance(scanOnce(file, second)), "alu");
+    EXPECT_EQ(second.getHits(), 1u);
+    EXPECT_EQ(second.getMisses(), 0u);
+    // Nothing changed, so the cache is not rewritten
+    EXPECT_EQ(std::filesystem::last_write_time(cache_path), saved);
+}
+
+TEST_F(ScanCacheTest, MissesWhenTheFileChanges) {
+    std::filesystem::path file = dir.write("top.sv", "module top;\n  alu u (.a(a));\nendmodule\n");
+    setMtime(file, std::chrono::seconds(-10));
+    ScanCache first(cache_path);
+    scanOnce(file, first);
+
+    dir.write("top.sv", "module top;\n  fifo u (.a(a));\nendmodule\n");
+    setMtime(file, std::chrono::seconds(-5));
+    ScanCache second(cache_path);
+    EXPECT_EQ(firstInstance(scanOnce(file, second)), "fifo");
+    EXPECT_EQ(second.getMisses(), 1u);
+}
+
+TEST_F(ScanCacheTest, TouchedFileHitsByContentHash) {
+    std::filesystem::path file = dir.write("top.sv", "module top;\n  alu u (.a(a));\nendmodule\n");
+    setMtime(file, std::chrono::seconds(-10));
+    ScanCache first(cache_path);
+    scanOnce(file, first);
+
+    setMtime(file, std::chrono::seconds(-5));
+    ScanCache second(cache_path);
+    EXPECT_EQ(firstInstance(scanOnce(file, second)), "alu");
+    EXPECT_EQ(second.getHits(), 1u);
+    EXPECT_EQ(second.getMisses(), 0u);
+}
+
+// A file rewritten within the timestamp tick of the cache write can keep
+// its recorded mtime and size with different bytes; it must not be served
+// from mtime and size alone
+TEST_F(ScanCacheTest, RacyMtimeIsVerifiedByHash) {
+    std::filesystem::path file = dir.write("top.sv", "module top;\n  aaa u (.a(a));\nendmodule\n");
+    auto tick = Clock::now() - std::chrono::seconds(10);
+    std::filesystem::last_write_time(file, tick);
+    ScanCache first(cache_path);
+    scanOnce(file, first);
+    std::filesystem::last_write_time(cache_path, tick);
+
+    // Same size, same mtime, different module
+    dir.write("top.sv", "module top;\n  bbb u (.a(a));\nendmodule\n");
+    std::filesystem::last_write_time(file, tick);
+    ScanCache second(cache_path);
+    EXPECT_EQ(firstInstance(scanOnce(file, second)), "bbb");
+    EXPECT_EQ(second.getMisses(), 1u);
+}
+
+TEST_F(ScanCacheTest, ChangedIncludeInvalidatesIncluders) {
+    std::filesystem::path header = dir.write("units.svh", "`define LEAF alu\n");
+    std::filesystem::path file =
+        dir.write("top.sv", "`include \"units.svh\"\nmodule top;\n  `LEAF u (.a(a));\nendmodule\n");
+    setMtime(header, std::chrono::seconds(-10));
+    setMtime(file, std::chrono::seconds(-10));
+
+    ScanCache first(cache_path);
+    SvScanResult result = scanOnce(file, first);
+    EXPECT_EQ(firstInstance(result), "alu");
+    ASSERT_EQ(result.includes.size(), 1u);
+
+    ScanCache unchanged(cache_path);
+    scanOnce(file, unchanged);
+    EXPECT_EQ(unchanged.getHits(), 1u);
+
+    dir.write("units.svh", "`define LEAF fifo\n");
+    setMtime(header, std::chrono::seconds(-5));
+    ScanCache second(cache_path);
+    EXPECT_EQ(firstInstance(scanOnce(file, second)), "fifo");
+    EXPECT_EQ(second.getMisses(), 1u);
+}
+
+TEST_F(ScanCacheTest, ChangedDefinesDiscardTheCache) {
+    std::filesystem::path file = dir.write(
+        "top.sv", "module top;\n`ifdef FAST\n  fast_alu u (.a(a));\n`else\n  slow_alu u (.a(a));\n`endif\nendmodule\n");
+    setMtime(file, std::chrono::seconds(-10));
+    ScanCache first(cache_path);
+    EXPECT_EQ(firstInstance(scanOnce(file, first)), "slow_alu");
+
+    SvPreprocessorOptions options;
+    ASSERT_TRUE(options.parseArgument("+define+FAST"));
+    ScanCache fast(cache_path, options);
+    EXPECT_EQ(firstInstance(scanOnce(file, fast)), "fast_alu");
+    EXPECT_EQ(fast.getMisses(), 1u);
+
+    // The cache now belongs to the +define+FAST settings
+    ScanCache fast_again(cache_path, options);
+    scanOnce(file, fast_again);
+    EXPECT_EQ(fast_again.getHits(), 1u);
+}
+
+TEST_F(ScanCacheTest, DropsFilesNotScannedThisRun) {
+    std::filesystem::path kept = dir.write("kept.sv", "module kept;\n  alu u (.a(a));\nendmodule\n");
+    std::filesystem::path removed = dir.write("removed.sv", "module removed;\nendmodule\n");
+    setMtime(kept, std::chrono::seconds(-10));
+    setMtime(removed, std::chrono::seconds(-10));
+    ScanCache first(cache_path);
+    first.load();
+    first.scan(kept);
+    first.scan(removed);
+    first.save();
+
+    ScanCache second(cache_path);
+    scanOnce(kept, second);
+    ScanCache third(cache_path);
+    scanOnce(removed, third);
+    EXPECT_EQ(third.getMisses(), 1u);
+}
+
+TEST_F(ScanCacheTest, CorruptCacheStartsEmpty) {
+    std::filesystem::path file = dir.write("top.sv", "module top;\n  alu u (.a(a));\nendmodule\n");
+    setMtime(file, std::chrono::seconds(-10));
+    ScanCache first(cache_path);
+    scanOnce(file, first);
+
+    // Truncate the last record
+    std::string content;
+    {
+        MappedFile mapped(cache_path);
+        content = std::string(mapped.view().substr(0, mapped.view().size() - 8));
+    }
+    dir.write(".vpm/cache", content + "\nI x\n");
+    setMtime(cache_path, std::chrono::seconds(-1));
+    ScanCache second(cache_path);
+    EXPECT_EQ(firstInstance(scanOnce(file, second)), "alu");
+    EXPECT_EQ(second.getMisses(), 1u);
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include "StageCache.hpp"
+#include "TempDir.hpp"
+
+namespace {
+    std::string readFile(const std::filesystem::path& path) {
+        std::ifstream in(path);
+        return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    }
+
+    class StageCacheTest : public ::testing::Test {
+    protected:
+        TempDir dir;
+        std::filesystem::path cache_path = StageCache::defaultPath(dir.path());
+        // Commands run so far
+        int runs = 0;
+
+        // A tool script printing `version`, so tests control its identity
+        std::filesystem::path writeTool(const std::string& version) {
+            std::filesystem::path path = dir.write("bin/synth", "#!/bin/sh\necho " + version + "\n");
+            std::filesystem::permissions(path, std::filesystem::perms::owner_all);
+            return path;
+        }
+
+        std::filesystem::path tool = writeTool("1.0");
+
+        Stage stage() {
+            Stage s;
+            s.name = "synth";
+            s.tool = tool.string();
+            s.command = "synth -top top";
+            s.inputs = {dir.write("top.sv", "module top;\nendmodule\n")};
+            s.outputs = {dir.path() / "out" / "top.json"};
+            return s;
+        }
+
+        // Stands in for the tool: writes each output from the command line
+        // and the first input, or fails with `exit_code`
+        std::function<int(const std::string&)> execute(const Stage& s, int exit_code = 0) {
+            return [this, s, exit_code](const std::string& command) {
+                ++runs;
+                if (exit_code == 0) {
+                    for (const auto& output : s.outputs) {
+                        std::filesystem::create_directories(output.parent_path());
+                        std::ofstream(output) << command << "\n" << readFile(s.inputs.front());
+                    }
+                }
+                return exit_code;
+            };
+        }
+
+        int run(StageCache& cache, const Stage& s, bool& cached) { return cache.run(s, execute(s), cached); }
+    };
+}
+
+TEST_F(StageCacheTest, RestoresCachedOutputs) {
+    Stage s = stage();
+    StageCache cache(cache_path);
+    bool cached = true;
+    EXPECT_EQ(run(cache, s, cached), 0);
+    EXPECT_FALSE(cached);
+    std::string produced = readFile(s.outputs.front());
+
+    // Restored even after the output directory is gone, by a new cache too
+    std::filesystem::remove_all(dir.path() / "out");
+    StageCache second(cache_path);
+    EXPECT_EQ(run(second, s, cached), 0);
+    EXPECT_TRUE(cached);
+    EXPECT_EQ(runs, 1);
+    EXPECT_EQ(readFile(s.outputs.front()), produced);
+}
+
+TEST_F(StageCacheTest, KeyCoversInputsCommandAndTool) {
+    struct Case {
+        const char* name;
+        std::function<void(Stage&)> change;
+        bool same_key;
+    };
+    std::vector<Case> cases = {
+        {"nothing", [](Stage&) {}, true},
+        // Content addressed: rewriting identical bytes keeps the key
+        {"input rewritten", [this](Stage&) { dir.write("top.sv", "module top;\nendmodule\n"); }, true},
+        {"input edited", [this](Stage&) { dir.write("top.sv", "module top;\n  wire w;\nendmodule\n"); }, false},
+        {"input added", [this](Stage& s) { s.inputs.push_back(dir.write("pins.xdc", "")); }, false},
+        {"command", [](Stage& s) { s.command += " -flatten"; }, false},
+        {"output", [this](Stage& s) { s.outputs.push_back(dir.path() / "out" / "top.log"); }, false},
+        {"tool rebuilt", [this](Stage&) { writeTool("1.0.1"); }, false},
+    };
+    std::string base;
+    {
+        StageCache cache(cache_path);
+        base = cache.key(stage());
+        EXPECT_EQ(base.size(), 16u);
+    }
+    for (const Case& c : cases) {
+        Stage s = stage();
+        c.change(s);
+        // Tool versions are remembered per cache, so each case starts afresh
+        StageCache cache(cache_path);
+        EXPECT_EQ(cache.key(s) == base, c.same_key) << c.name;
+    }
+}
+
+TEST_F(StageCacheTest, FailedStagesAreNotCached) {
+    Stage s = stage();
+    StageCache cache(cache_path);
+    bool cached = true;
+    EXPECT_EQ(cache.run(s, execute(s, 3), cached), 3);
+    EXPECT_FALSE(cached);
+    EXPECT_EQ(cache.run(s, execute(s), cached), 0);
+    EXPECT_FALSE(cached);
+    EXPECT_EQ(cache.run(s, execute(s), cached), 0);
+    EXPECT_TRUE(cached);
+    EXPECT_EQ(runs, 2);
+}
+
+TEST_F(StageCacheTest, MissingOutputThrows) {
+    Stage s = stage();
+    s.outputs.push_back(dir.path() / "out" / "never.json");
+    StageCache cache(cache_path);
+    bool cached = false;
+    auto execute_first_only = [&](const std::string& command) {
+        std::filesystem::create_directories(s.outputs.front().parent_path());
+        std::ofstream(s.outputs.front()) << command;
+        return 0;
+    };
+    EXPECT_THROW(cache.run(s, execute_first_only, cached), std::runtime_error);
+    // Nothing half-written is left to be restored
+    for (const auto& entry : std::filesystem::directory_iterator(cache_path)) {
+        ADD_FAILURE() << "left in the cache: " << entry.path();
+    }
+}
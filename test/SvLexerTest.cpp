@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "SvLexer.hpp"
+#include "TempDir.hpp"
+
+namespace {
+    std::vector<SvToken> lex(std::string_view source) {
+        std::vector<SvToken> tokens;
+        SvLexer lexer(source);
+        for (SvToken tok = lexer.next(); tok.kind != SvToken::Kind::End; tok = lexer.next()) {
+            tokens.push_back(tok);
+        }
+        return tokens;
+    }
+
+    std::vector<std::string> texts(const std::vector<SvToken>& tokens) {
+        std::vector<std::string> result;
+        for (const auto& tok : tokens) {
+            result.emplace_back(tok.text);
+        }
+        return result;
+    }
+}
+
+TEST(SvLexer, SkipsCommentsAndAttributes) {
+    auto tokens = lex("// module a;\n/* module b;\nendmodule */ (* keep *) wire w;");
+    EXPECT_EQ(texts(tokens), (std::vector<std::string>{"wire", "w", ";"}));
+    EXPECT_EQ(tokens[0].line, 3u);
+}
+
+TEST(SvLexer, KeepsEventControlStar) {
+    EXPECT_EQ(texts(lex("always @(*) y = a;")),
+              (std::vector<std::string>{"always", "@", "(", "*", ")", "y", "=", "a", ";"}));
+}
+
+TEST(SvLexer, StringsAreSingleTokens) {
+    auto tokens = lex(R"($display("module m u (x); \" endmodule");)");
+    ASSERT_EQ(tokens.size(), 5u);
+    EXPECT_EQ(tokens[0].kind, SvToken::Kind::SystemIdentifier);
+    EXPECT_EQ(tokens[2].kind, SvToken::Kind::String);
+    EXPECT_EQ(tokens[2].text, R"("module m u (x); \" endmodule")");
+}
+
+TEST(SvLexer, Numbers) {
+    auto tokens = lex("8'hFF 4 'b10x1 '0 1.5e3 10ns 'x");
+    ASSERT_EQ(tokens.size(), 7u);
+    for (const auto& tok : tokens) {
+        EXPECT_EQ(tok.kind, SvToken::Kind::Number) << tok.text;
+    }
+    EXPECT_EQ(tokens[1].text, "4 'b10x1");
+}
+
+TEST(SvLexer, DirectivesCarryTheirArguments) {
+    auto tokens = lex("`define W \\\n  8\n`ifdef FAST\n`include \"defs.svh\"\n`W");
+    EXPECT_EQ(texts(tokens), (std::vector<std::string>{"`define W \\\n  8", "`ifdef FAST", "`include \"defs.svh\"",
+                                                       "`W"}));
+    for (const auto& tok : tokens) {
+        EXPECT_EQ(tok.kind, SvToken::Kind::Directive);
+    }
+    EXPECT_EQ(tokens[3].line, 5u);
+}
+
+TEST(SvLexer, EscapedIdentifiers) {
+    auto tokens = lex("\\bus[0] u (.a(a));");
+    ASSERT_FALSE(tokens.empty());
+    EXPECT_EQ(tokens[0].kind, SvToken::Kind::Identifier);
+    EXPECT_EQ(tokens[0].text, "\\bus[0]");
+}
+
+TEST(SvLexer, Keywords) {
+    for (const char* word : {"module", "endinterface", "do", "if", "or", "pulsestyle_ondetect", "s_until_with",
+                             "sync_accept_on", "unique0", "xor"}) {
+        EXPECT_TRUE(isSvKeyword(word)) << word;
+    }
+    for (const char* word : {"counter", "", "d", "Module", "MODULE", "modules", "modul", "end_", "endmodulee",
+                             "pulsestyle_ondetects", "_if", "if0", "$display"}) {
+        EXPECT_FALSE(isSvKeyword(word)) << word;
+    }
+}
+
+// Small files are read and large ones mapped; both give the whole contents
+TEST(MappedFile, Contents) {
+    TempDir dir;
+    for (size_t size : {size_t(0), size_t(1), size_t(4096), size_t(64 * 1024), size_t(64 * 1024 + 1),
+                        size_t(1 << 20)}) {
+        std::string contents;
+        for (size_t i = 0; i < size; ++i) {
+            contents += static_cast<char>('a' + i % 26);
+        }
+        MappedFile file(dir.write("file.sv", contents));
+        EXPECT_EQ(file.view(), contents) << size;
+
+        MappedFile moved(std::move(file));
+        EXPECT_EQ(moved.view(), contents) << size;
+        EXPECT_TRUE(file.view().empty()) << size;
+    }
+    EXPECT_THROW(MappedFile(dir.path() / "missing.sv"), std::runtime_error);
+}
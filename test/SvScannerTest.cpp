@@ -0,0 +1,216 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "SvPreprocessor.hpp"
+#include "SvScanner.hpp"
+#include "TempDir.hpp"
+
+namespace {
+    std::vector<std::string> moduleNames(const SvScanResult& result) {
+        std::vector<std::string> names;
+        for (const auto& module : result.modules) {
+            names.push_back(module.name);
+        }
+        return names;
+    }
+
+    std::vector<std::string> instanceTypes(const SvModuleDecl& module) {
+        std::vector<std::string> types;
+        for (const auto& instance : module.instances) {
+            types.push_back(instance.module_name);
+        }
+        return types;
+    }
+}
+
+TEST(SvScanner, FindsInstancesOfEachModule) {
+    SvScanResult result = SvScanner::scan(R"(
+module top (input logic clk);
+  alu u_alu (.clk(clk));
+  fifo u_a (.clk(clk)), u_b (.clk(clk));
+endmodule
+
+interface bus_if;
+  logic valid;
+endinterface
+)");
+    ASSERT_EQ(moduleNames(result), (std::vector<std::string>{"top", "bus_if"}));
+    EXPECT_EQ(instanceTypes(result.modules[0]), (std::vector<std::string>{"alu", "fifo", "fifo"}));
+    EXPECT_EQ(result.modules[0].instances[2].instance_name, "u_b");
+    EXPECT_EQ(result.modules[0].instances[0].line, 3u);
+    EXPECT_EQ(result.instantiatedModules(), (std::vector<std::string>{"alu", "fifo"}));
+}
+
+// Regression: "interface" after "virtual" used to open a declaration of
+// bus_if that swallowed every module after it
+TEST(SvScanner, VirtualInterfaceIsNotADeclaration) {
+    SvScanResult result = SvScanner::scan(R"(
+package env_pkg;
+  class driver;
+    virtual interface bus_if vif;
+    function new(virtual interface bus_if.master mp);
+    endfunction
+  endclass
+endpackage
+
+module m1;
+  sub u0 (.a(a));
+endmodule
+)");
+    ASSERT_EQ(moduleNames(result), (std::vector<std::string>{"m1"}));
+    EXPECT_EQ(instanceTypes(result.modules[0]), (std::vector<std::string>{"sub"}));
+}
+
+TEST(SvScanner, VirtualInterfaceAtFileScope) {
+    SvScanResult result = SvScanner::scan(R"(
+typedef virtual interface bus_if vif_t;
+function automatic void connect(virtual interface bus_if vif);
+endfunction
+module m2;
+  sub u0 (.a(a));
+endmodule
+)");
+    ASSERT_EQ(moduleNames(result), (std::vector<std::string>{"m2"}));
+    EXPECT_EQ(instanceTypes(result.modules[0]), (std::vector<std::string>{"sub"}));
+}
+
+TEST(SvScanner, InterfaceClassIsNotADesignUnit) {
+    SvScanResult result = SvScanner::scan(R"(
+interface class listener;
+  pure virtual function void notify();
+endclass
+module m;
+  sub u (.a(a));
+endmodule
+)");
+    ASSERT_EQ(moduleNames(result), (std::vector<std::string>{"m"}));
+    EXPECT_EQ(instanceTypes(result.modules[0]), (std::vector<std::string>{"sub"}));
+}
+
+TEST(SvScanner, MultiLineHeadersAndInstances) {
+    SvScanResult result = SvScanner::scan(R"(
+module
+  automatic
+  wide
+(
+  input  logic [7:0] a,
+  output logic [7:0] y
+);
+  adder
+    u_add
+    [3:0]
+    (
+      .a(a),
+      .y(y)
+    );
+endmodule
+)");
+    ASSERT_EQ(moduleNames(result), (std::vector<std::string>{"wide"}));
+    ASSERT_EQ(result.modules[0].instances.size(), 1u);
+    EXPECT_EQ(result.modules[0].instances[0].module_name, "adder");
+    EXPECT_EQ(result.modules[0].instances[0].instance_name, "u_add");
+    EXPECT_EQ(result.modules[0].instances[0].line, 10u);
+}
+
+TEST(SvScanner, ParameterLists) {
+    SvScanResult result = SvScanner::scan(R"(
+module core #(
+  parameter int W = 8,
+  parameter type T = logic [W-1:0]
+) (input T a);
+  reg_file #(.W(W), .DEPTH(f(W, 2))) u_rf (.a(a));
+  counter #8 u_cnt (.a(a));
+  plain u_plain (.a(a));
+endmodule
+)");
+    ASSERT_EQ(moduleNames(result), (std::vector<std::string>{"core"}));
+    const auto& instances = result.modules[0].instances;
+    ASSERT_EQ(instanceTypes(result.modules[0]), (std::vector<std::string>{"reg_file", "counter", "plain"}));
+    EXPECT_TRUE(instances[0].parameterized);
+    EXPECT_TRUE(instances[1].parameterized);
+    EXPECT_FALSE(instances[2].parameterized);
+}
+
+TEST(SvScanner, IgnoresModuleInCommentsAndStrings) {
+    SvScanResult result = SvScanner::scan(R"(
+// module fake_line;
+/* module fake_block;
+   ghost u_ghost (.a(a));
+endmodule */
+module real_one;
+  initial $display("module fake_string; ghost u (x); endmodule");
+  sub u_sub (.a(a)); // ghost u_comment (.a(a));
+endmodule
+)");
+    ASSERT_EQ(moduleNames(result), (std::vector<std::string>{"real_one"}));
+    EXPECT_EQ(instanceTypes(result.modules[0]), (std::vector<std::string>{"sub"}));
+}
+
+TEST(SvScanner, ExternModuleIsOnlyAPrototype) {
+    SvScanResult result = SvScanner::scan(R"(
+extern module ext #(parameter W = 8) (input logic [W-1:0] a, output logic y);
+extern interface ext_if (input logic clk);
+module user;
+  ext u_ext (.*);
+endmodule
+)");
+    ASSERT_EQ(moduleNames(result), (std::vector<std::string>{"user"}));
+    EXPECT_EQ(instanceTypes(result.modules[0]), (std::vector<std::string>{"ext"}));
+}
+
+TEST(SvScanner, RejectsCallsKeywordsAndLabels) {
+    SvScanResult result = SvScanner::scan(R"(
+module m;
+  logic [3:0] q;
+  always_ff @(posedge clk) begin : g_seq
+    do_reset(q);
+    if (en) q <= next(q);
+  end
+  assign y = f(a);
+  generate
+    for (genvar i = 0; i < 4; i++) begin : g_lane
+      lane u_lane (.i(i));
+    end
+  endgenerate
+endmodule
+)");
+    ASSERT_EQ(moduleNames(result), (std::vector<std::string>{"m"}));
+    EXPECT_EQ(instanceTypes(result.modules[0]), (std::vector<std::string>{"lane"}));
+}
+
+TEST(SvScanner, IfdefSelectsInstances) {
+    const char* source = R"(
+module m;
+`ifdef FAST
+  fast_alu u_alu (.a(a));
+`else
+  slow_alu u_alu (.a(a));
+`endif
+endmodule
+)";
+    EXPECT_EQ(instanceTypes(SvScanner::scan(source).modules.at(0)), (std::vector<std::string>{"slow_alu"}));
+
+    SvPreprocessorOptions options;
+    ASSERT_TRUE(options.parseArgument("+define+FAST"));
+    SvIncludeCache includes(options);
+    EXPECT_EQ(instanceTypes(SvScanner::scan(source, {}, &includes).modules.at(0)),
+              (std::vector<std::string>{"fast_alu"}));
+}
+
+TEST(SvScanner, FollowsIncludes) {
+    TempDir dir;
+    dir.write("inc/units.svh", "module from_header;\n  leaf u_leaf (.a(a));\nendmodule\n");
+    std::filesystem::path file = dir.write("rtl/top.sv", "`include \"units.svh\"\nmodule top;\nendmodule\n");
+
+    SvScanResult without = SvScanner::scanFile(file);
+    EXPECT_EQ(moduleNames(without), (std::vector<std::string>{"top"}));
+    EXPECT_TRUE(without.includes.empty());
+
+    SvPreprocessorOptions options;
+    ASSERT_TRUE(options.parseArgument("+incdir+" + (dir.path() / "inc").string()));
+    SvIncludeCache includes(options);
+    SvScanResult with = SvScanner::scanFile(file, &includes);
+    ASSERT_EQ(moduleNames(with), (std::vector<std::string>{"from_header", "top"}));
+    EXPECT_EQ(instanceTypes(with.modules[0]), (std::vector<std::string>{"leaf"}));
+    EXPECT_EQ(with.includes, (std::vector<std::string>{(dir.path() / "inc/units.svh").string()}));
+}
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "SynthesisPlan.hpp"
+#include "SvScanner.hpp"
+
+namespace {
+    const std::filesystem::path kRoot = "/ws";
+
+    // An index of in-memory files, each given as (name, source)
+    ModuleIndex index(const std::vector<std::pair<std::string, std::string>>& files) {
+        ModuleIndex result(kRoot);
+        for (const auto& [name, source] : files) {
+            result.addFile(kRoot / name, SvScanner::scan(source));
+        }
+        return result;
+    }
+
+    struct ExpectedUnit {
+        std::string module;
+        std::vector<std::string> sources;
+        std::vector<std::string> blackboxes;
+        size_t depth;
+    };
+
+    void expectUnits(const SynthesisPlan& plan, const std::vector<ExpectedUnit>& expected) {
+        ASSERT_EQ(plan.getUnits().size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            const SynthesisUnit& unit = plan.getUnits()[i];
+            const ExpectedUnit& e = expected[i];
+            EXPECT_EQ(unit.module, e.module) << i;
+            std::vector<std::string> sources;
+            for (const auto& source : unit.sources) {
+                sources.push_back(source.lexically_relative(kRoot).string());
+            }
+            EXPECT_EQ(sources, e.sources) << e.module;
+            EXPECT_EQ(unit.blackboxes, e.blackboxes) << e.module;
+            EXPECT_EQ(unit.depth, e.depth) << e.module;
+        }
+    }
+}
+
+// uart and adder are instantiated with parameter overrides, so they are
+// synthesized inline; everything else is a unit of its own
+TEST(SynthesisPlan, SplitsHierarchyIntoUnits) {
+    ModuleIndex modules = index({
+        {"top.sv", "module top;\n  cpu c (.*);\n  uart #(.W(8)) u (.*);\n  mem m (.*);\nendmodule\n"},
+        {"cpu.sv", "module cpu;\n  alu a (.*);\n  regfile r (.*);\nendmodule\n"},
+        {"alu.sv", "module alu;\n  adder #(4) add (.*);\nendmodule\n"},
+        {"adder.sv", "module adder;\nendmodule\n"},
+        {"regfile.sv", "module regfile;\nendmodule\n"},
+        {"uart.sv", "module uart;\n  fifo f (.*);\nendmodule\n"},
+        {"fifo.sv", "module fifo;\nendmodule\n"},
+        {"mem.sv", "module mem;\n  sram_macro s (.*);\nendmodule\n"},
+        {"unused.sv", "module unused;\n  cpu c (.*);\nendmodule\n"},
+    });
+    SynthesisPlan plan(modules, "top");
+    expectUnits(plan, {
+                          {"alu", {"alu.sv", "adder.sv"}, {}, 0},
+                          {"regfile", {"regfile.sv"}, {}, 0},
+                          {"cpu", {"cpu.sv"}, {"alu", "regfile"}, 1},
+                          {"fifo", {"fifo.sv"}, {}, 0},
+                          {"mem", {"mem.sv"}, {}, 0},
+                          // fifo stays a black box behind the inlined uart
+                          {"top", {"top.sv", "uart.sv"}, {"cpu", "fifo", "mem"}, 2},
+                      });
+    EXPECT_EQ(plan.getMissing(), std::vector<std::string>{"sram_macro"});
+}
+
+// An inline module is pulled into every unit instantiating it, and a file
+// holding several inline modules is read once per unit
+TEST(SynthesisPlan, InlineModulesAreSharedAcrossUnits) {
+    ModuleIndex modules = index({
+        {"top.sv", "module top;\n  a ua (.*);\n  b ub (.*);\nendmodule\n"},
+        {"a.sv", "module a;\n  lib_x #(1) x (.*);\n  lib_y #(2) y (.*);\nendmodule\n"},
+        {"b.sv", "module b;\n  lib_x #(3) x (.*);\n  a nested (.*);\nendmodule\n"},
+        {"lib.sv", "module lib_x;\nendmodule\nmodule lib_y;\n  lib_x #(4) x (.*);\nendmodule\n"},
+    });
+    SynthesisPlan plan(modules, "top");
+    expectUnits(plan, {
+                          {"a", {"a.sv", "lib.sv"}, {}, 0},
+                          {"b", {"b.sv", "lib.sv"}, {"a"}, 1},
+                          {"top", {"top.sv"}, {"a", "b"}, 2},
+                      });
+    EXPECT_TRUE(plan.getMissing().empty());
+}
+
+// The top is always a unit, even if something instantiates it with
+// parameter overrides
+TEST(SynthesisPlan, TopIsAlwaysAUnit) {
+    ModuleIndex modules = index({
+        {"top.sv", "module top;\n  leaf #(1) l (.*);\nendmodule\n"},
+        {"leaf.sv", "module leaf;\nendmodule\n"},
+        {"tb.sv", "module tb;\n  top #(.N(2)) dut (.*);\nendmodule\n"},
+    });
+    expectUnits(SynthesisPlan(modules, "top"), {{"top", {"top.sv", "leaf.sv"}, {}, 0}});
+    expectUnits(SynthesisPlan(modules, "leaf"), {{"leaf", {"leaf.sv"}, {}, 0}});
+    EXPECT_TRUE(SynthesisPlan(modules, "missing").getUnits().empty());
+}
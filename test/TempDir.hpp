@@ -0,0 +1,44 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+extern "C" {
+    #include <unistd.h>
+}
+
+// A fresh directory under the test's temporary directory, removed with it
+class TempDir {
+private:
+    std::filesystem::path root;
+
+public:
+    TempDir() {
+        const auto* test = ::testing::UnitTest::GetInstance()->current_test_info();
+        std::string name = std::string(test ? test->test_suite_name() : "vpm") + "." +
+                           (test ? test->name() : "test") + "." + std::to_string(getpid());
+        root = std::filesystem::path(::testing::TempDir()) / name;
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root);
+    }
+
+    ~TempDir() {
+        std::error_code ec;
+        std::filesystem::remove_all(root, ec);
+    }
+
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    const std::filesystem::path& path() const { return root; }
+
+    // Writes `content` to `relative`, creating its directories
+    std::filesystem::path write(const std::string& relative, const std::string& content) const {
+        std::filesystem::path file = root / relative;
+        std::filesystem::create_directories(file.parent_path());
+        std::ofstream(file, std::ios::trunc) << content;
+        return file;
+    }
+};
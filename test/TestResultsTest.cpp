@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "TestResults.hpp"
+#include "TempDir.hpp"
+
+namespace {
+    // A testResult event as Bazel writes it, one per line
+    std::string result(const std::string& label, int shard, int attempt, const std::string& status,
+                       const std::string& duration = "\"testAttemptDurationMillis\": \"1000\"", bool cached = false) {
+        return R"({"id": {"testResult": {"label": ")" + label + R"(", "run": 1, "shard": )" + std::to_string(shard) +
+               R"(, "attempt": )" + std::to_string(attempt) +
+               R"(, "configuration": {"id": "c0ffee"}}}, "testResult": {"status": ")" + status + "\", " + duration +
+               (cached ? ", \"cachedLocally\": true" : "") +
+               R"(, "testActionOutput": [{"name": "test.log", "uri": "file:///tmp/test.log"}]}})" + "\n";
+    }
+
+    std::string summary(const std::string& label, const std::string& status) {
+        return R"({"id": {"testSummary": {"label": ")" + label +
+               R"(", "configuration": {"id": "c0ffee"}}}, "testSummary": {"overallStatus": ")" + status +
+               R"(", "totalRunCount": 2}})" + "\n";
+    }
+
+    const char* const kStarted =
+        R"({"id": {"started": {}}, "children": [{"pattern": {"pattern": ["//..."]}}], "started": {"uuid": "u"}})"
+        "\n";
+
+    TestOutcome outcome(const TestResults& results, const std::string& label) {
+        for (const auto& outcome : results.bySlowest()) {
+            if (outcome.label == label) {
+                return outcome;
+            }
+        }
+        ADD_FAILURE() << "no outcome for " << label;
+        return {};
+    }
+}
+
+TEST(TestResults, StatusOfEachTest) {
+    TempDir dir;
+    std::string events = std::string(kStarted) +
+                         result("//a:a_test", 1, 1, "PASSED", "\"testAttemptDurationMillis\": \"1500\"", true) +
+                         // Failed, then passed on retry; the summary calls it flaky
+                         result("//b:b_test", 1, 1, "FAILED") + result("//b:b_test", 1, 2, "PASSED") +
+                         summary("//b:b_test", "FLAKY") +
+                         // Retried without a summary: the last attempt counts
+                         result("//c:c_test", 1, 2, "PASSED") + result("//c:c_test", 1, 1, "FAILED") +
+                         // One failing shard fails the test, in either order
+                         result("//d:d_test", 1, 1, "PASSED") + result("//d:d_test", 2, 1, "FAILED") +
+                         result("//e:e_test", 1, 1, "FAILED") + result("//e:e_test", 2, 1, "PASSED") +
+                         result("//f:f_test", 1, 1, "TIMEOUT", "\"testAttemptDuration\": \"2.5s\"");
+    TestResults results = TestResults::fromBuildEvents(dir.write("events.json", events), {"//a:a_test", "//g:g_test"});
+
+    struct Case {
+        const char* label;
+        const char* status;
+        double duration_seconds;
+        size_t attempts;
+        bool cached;
+        bool passed;
+    };
+    std::vector<Case> cases = {
+        {"//a:a_test", "PASSED", 1.5, 1, true, true},   {"//b:b_test", "FLAKY", 2, 2, false, true},
+        {"//c:c_test", "PASSED", 2, 2, false, true},    {"//d:d_test", "FAILED", 2, 2, false, false},
+        {"//e:e_test", "FAILED", 2, 2, false, false},   {"//f:f_test", "TIMEOUT", 2.5, 1, false, false},
+        {"//g:g_test", "NO_STATUS", 0, 0, false, false},
+    };
+    ASSERT_EQ(results.size(), cases.size());
+    for (const Case& c : cases) {
+        TestOutcome o = outcome(results, c.label);
+        EXPECT_EQ(o.status, c.status) << c.label;
+        EXPECT_DOUBLE_EQ(o.duration_seconds, c.duration_seconds) << c.label;
+        EXPECT_EQ(o.attempts, c.attempts) << c.label;
+        EXPECT_EQ(o.cached, c.cached) << c.label;
+        EXPECT_EQ(o.passed(), c.passed) << c.label;
+    }
+    EXPECT_EQ(results.passedCount(), 3u);
+}
+
+TEST(TestResults, BySlowest) {
+    TempDir dir;
+    std::string events = result("//a:fast", 1, 1, "PASSED", "\"testAttemptDurationMillis\": \"10\"") +
+                         result("//a:slow", 1, 1, "PASSED", "\"testAttemptDurationMillis\": \"9000\"") +
+                         result("//a:mid", 1, 1, "PASSED", "\"testAttemptDurationMillis\": \"500\"");
+    TestResults results = TestResults::fromBuildEvents(dir.write("events.json", events), {"//a:none"});
+    std::vector<std::string> order;
+    for (const auto& o : results.bySlowest()) {
+        order.push_back(o.label);
+    }
+    EXPECT_EQ(order, (std::vector<std::string>{"//a:slow", "//a:mid", "//a:fast", "//a:none"}));
+}
+
+// Bazel interrupted mid-write: the complete events are kept
+TEST(TestResults, TruncatedStream) {
+    TempDir dir;
+    std::string events = result("//a:a_test", 1, 1, "PASSED") + result("//b:b_test", 1, 1, "FAILED");
+    events.resize(events.size() - 40);
+    TestResults results = TestResults::fromBuildEvents(dir.write("events.json", events), {"//b:b_test"});
+    EXPECT_EQ(outcome(results, "//a:a_test").status, "PASSED");
+    EXPECT_EQ(outcome(results, "//b:b_test").status, "NO_STATUS");
+}
+
+// Bazel failed before writing any events
+TEST(TestResults, MissingStream) {
+    TempDir dir;
+    TestResults results = TestResults::fromBuildEvents(dir.path() / "events.json", {"//a:a_test", "//b:b_test"});
+    EXPECT_EQ(results.size(), 2u);
+    EXPECT_EQ(results.passedCount(), 0u);
+    EXPECT_EQ(outcome(results, "//a:a_test").status, "NO_STATUS");
+}
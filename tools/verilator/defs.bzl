@@ -1,7 +1,177 @@
-load("@bazel_tools//tools/cpp:toolchain_utils.bzl", "find_cpp_toolchain")
+load("@bazel_tools//tools/cpp:toolchain_utils.bzl", "find_cpp_toolchain", "use_cpp_toolchain")
+load("@rules_cc//cc:defs.bzl", "cc_binary")
+
+VerilogInfo = provider(
+    doc = "Verilog sources needed to elaborate a module and its submodules",
+    fields = {
+        "transitive_sources": "depset of .sv/.v files for the module and everything it instantiates",
+        "transitive_hdrs": "depset of the files those sources `include",
+        "defines": "depset of NAME or NAME=VALUE macros they are verilated with",
+        "includes": "depset of directories searched for their `include files",
+        "hier_blocks": "CcInfo of the hierarchical blocks below the module, linked into every model above them",
+    },
+)
+
+# Verilator and C++ options per simulation profile. "debug" builds quickly
+# and is easy to step through; "fast" and "max" spend build time on
+# simulation speed, with "max" also partitioning the model across threads.
+VERILATOR_PROFILES = {
+    "debug": struct(
+        verilator_flags = ["-O0"],
+        threads = 1,
+        copts = ["-O0", "-g"],
+    ),
+    "fast": struct(
+        verilator_flags = [
+            "-O3",
+            "--x-assign fast",
+            "--x-initial fast",
+            "--output-split 20000",
+            "--output-split-cfuncs 5000",
+        ],
+        threads = 1,
+        copts = ["-O2"],
+    ),
+    "max": struct(
+        verilator_flags = [
+            "-O3",
+            "--x-assign fast",
+            "--x-initial fast",
+            "--noassert",
+            "--output-split 20000",
+            "--output-split-cfuncs 5000",
+        ],
+        threads = 4,
+        copts = ["-O3", "-march=native", "-fno-stack-protector"],
+    ),
+}
+
+# Verilator options, runtime library and model defines per waveform format.
+# "off" verilates without tracing, so no tracing code is compiled or linked.
+VERILATOR_TRACE_FORMATS = {
+    "off": struct(
+        verilator_flags = [],
+        defines = ["VM_TRACE=0", "VM_TRACE_FST=0", "VM_TRACE_VCD=0"],
+    ),
+    "fst": struct(
+        verilator_flags = ["--trace-fst"],
+        defines = ["VM_TRACE=1", "VM_TRACE_FST=1", "VM_TRACE_VCD=0"],
+    ),
+    "vcd": struct(
+        verilator_flags = ["--trace"],
+        defines = ["VM_TRACE=1", "VM_TRACE_FST=0", "VM_TRACE_VCD=1"],
+    ),
+}
+
+VerilatorFlagInfo = provider(
+    doc = "Value of a workspace-wide Verilator build setting such as --//tools/verilator:profile",
+    fields = {"value": "The selected value"},
+)
+
+def _verilator_flag_impl(ctx):
+    if ctx.build_setting_value not in ctx.attr.values:
+        fail("Unknown value '{}' for {}, expected one of {}".format(
+            ctx.build_setting_value,
+            ctx.label,
+            ", ".join(ctx.attr.values),
+        ))
+    return VerilatorFlagInfo(value = ctx.build_setting_value)
+
+verilator_flag = rule(
+    implementation = _verilator_flag_impl,
+    build_setting = config.string(flag = True),
+    attrs = {
+        "values": attr.string_list(mandatory = True),
+    },
+)
+
+def verilator_profile(ctx):
+    """Returns the profile struct for a target: its own attribute, else the workspace flag."""
+    name = ctx.attr.profile if ctx.attr.profile else ctx.attr._profile_flag[VerilatorFlagInfo].value
+    return VERILATOR_PROFILES[name]
+
+def verilator_trace(ctx):
+    """Returns the trace format name for a target: its own attribute, else the workspace flag."""
+    return ctx.attr.trace if ctx.attr.trace else ctx.attr._trace_flag[VerilatorFlagInfo].value
+
+def verilator_threads(ctx, profile):
+    return ctx.attr.threads if ctx.attr.threads > 0 else profile.threads
+
+def verilator_profile_copts(profile = ""):
+    """C++ options of `profile` for use in a macro, or a select on the workspace flag if empty."""
+    if profile:
+        return VERILATOR_PROFILES[profile].copts
+    return select({
+        "//tools/verilator:profile_debug": VERILATOR_PROFILES["debug"].copts,
+        "//tools/verilator:profile_max": VERILATOR_PROFILES["max"].copts,
+        "//conditions:default": VERILATOR_PROFILES["fast"].copts,
+    })
+
+def _shell_quote(text):
+    return "'" + text.replace("'", "'\\''") + "'"
 
 def _verilator_hdl_library_impl(ctx):
-    output_dir = ctx.actions.declare_directory(ctx.attr.name + "_verilated")
+    top_name = ctx.attr.top_module if ctx.attr.top_module else ctx.file.src.basename.rsplit(".", 1)[0]
+    srcs = depset(
+        [ctx.file.src],
+        transitive = [dep[VerilogInfo].transitive_sources for dep in ctx.attr.deps],
+    )
+    hdrs = depset(
+        ctx.files.hdrs,
+        transitive = [dep[VerilogInfo].transitive_hdrs for dep in ctx.attr.deps],
+    )
+    defines = depset(ctx.attr.defines, transitive = [dep[VerilogInfo].defines for dep in ctx.attr.deps])
+    includes = depset(ctx.attr.includes, transitive = [dep[VerilogInfo].includes for dep in ctx.attr.deps])
+    hier_blocks = cc_common.merge_cc_infos(cc_infos = [dep[VerilogInfo].hier_blocks for dep in ctx.attr.deps])
+    profile = verilator_profile(ctx)
+    trace = verilator_trace(ctx)
+
+    # The same macros and include path vpm preprocessed with when it found
+    # the deps, so Verilator elaborates the same `ifdef branches and headers.
+    # Directories of the sources and headers come first, as vpm looks next
+    # to the including file before the +incdir+ directories.
+    include_dirs = []
+    for f in srcs.to_list() + hdrs.to_list():
+        if f.dirname not in include_dirs:
+            include_dirs.append(f.dirname)
+    for include in includes.to_list():
+        if include not in include_dirs:
+            include_dirs.append(include)
+    verilator_flags = [_shell_quote("+define+" + define) for define in defines.to_list()] + \
+                      [_shell_quote("+incdir+" + include) for include in include_dirs]
+    verilator_flags = verilator_flags + profile.verilator_flags + VERILATOR_TRACE_FORMATS[trace].verilator_flags
+    if trace == "fst" and ctx.attr.trace_threads > 0:
+        # Offloads FST compression and writing from the simulation threads
+        verilator_flags = verilator_flags + ["--trace-threads {}".format(ctx.attr.trace_threads)]
+    threads = verilator_threads(ctx, profile)
+    if ctx.attr.savable:
+        # Verilator serializes only single-threaded models, and a
+        # hierarchical block's state lives in its own, unsavable model
+        if hier_blocks.linking_context.linker_inputs.to_list():
+            fail("{}: savable models cannot instantiate hierarchical blocks".format(ctx.label))
+        verilator_flags = verilator_flags + ["--savable"]
+        threads = 1
+
+    # Generated sources and headers go to separate tree artifacts: Verilator
+    # decides the file names, and Bazel expands a source tree into one cached
+    # compile action per file
+    verilated_srcs = ctx.actions.declare_directory(ctx.attr.name + "_srcs")
+    verilated_hdrs = ctx.actions.declare_directory(ctx.attr.name + "_hdrs")
+
+    # A hierarchical block is also verilated as a library with a stub module
+    # of the same name, which models above it elaborate instead of its
+    # sources. Their verilation then costs the same however many copies of
+    # the block they instantiate; the block's model is compiled once, here.
+    outputs = []
+    move_wrapper = ""
+    if ctx.attr.hier_block:
+        wrapper = ctx.actions.declare_file(ctx.attr.name + "_hier/" + top_name + ".sv")
+        outputs.append(wrapper)
+        verilator_flags = verilator_flags + [
+            "--lib-create {}".format(top_name),
+            "--protect-key vpm-{}".format(top_name),
+        ]
+        move_wrapper = "mv {}/{}.sv {}\n".format(verilated_srcs.path, top_name, wrapper.path)
     
     verilate_action = ctx.actions.declare_file(ctx.attr.name + "_verilate.sh")
     ctx.actions.write(
@@ -9,32 +179,93 @@ def _verilator_hdl_library_impl(ctx):
         content = '''\
 #!/bin/bash
 set -e
-mkdir -p {output_dir}
-/usr/local/bin/verilator --cc {input} --Mdir {output_dir}
-rm -f {output_dir}/*.mk {output_dir}/*.dat {output_dir}/*.d
+mkdir -p {srcs_dir} {hdrs_dir}
+/usr/local/bin/verilator --cc {inputs} --top-module {top_name} --Mdir {srcs_dir} \\
+    {verilator_flags} --threads {threads}
+{move_wrapper}mv {srcs_dir}/*.h {hdrs_dir}/
+rm -f {srcs_dir}/*.mk {srcs_dir}/*.dat {srcs_dir}/*.d
 '''.format(
-            input = ctx.file.src.path,
-            output_dir = output_dir.path,
+            move_wrapper = move_wrapper,
+            inputs = " ".join([f.path for f in srcs.to_list()]),
+            top_name = top_name,
+            verilator_flags = " ".join(verilator_flags),
+            threads = threads,
+            srcs_dir = verilated_srcs.path,
+            hdrs_dir = verilated_hdrs.path,
         ),
         is_executable = True,
     )
     
     ctx.actions.run(
-        outputs = [output_dir],
-        inputs = [ctx.file.src],
+        outputs = [verilated_srcs, verilated_hdrs] + outputs,
+        inputs = depset(transitive = [srcs, hdrs]),
         tools = [verilate_action],
         executable = verilate_action,
         mnemonic = "Verilate",
     )
-    
+
+    # Compile the model against the shared runtime. These actions only run
+    # when something links the model, so building the target alone verilates.
+    cc_toolchain = find_cpp_toolchain(ctx)
+    feature_configuration = cc_common.configure_features(
+        ctx = ctx,
+        cc_toolchain = cc_toolchain,
+        requested_features = ctx.features,
+        unsupported_features = ctx.disabled_features,
+    )
+    runtime = [ctx.attr._verilator_runtime[CcInfo], ctx.attr._vpm_trace[CcInfo]]
+    if trace == "fst":
+        runtime.append(ctx.attr._verilator_trace_fst[CcInfo])
+    elif trace == "vcd":
+        runtime.append(ctx.attr._verilator_trace_vcd[CcInfo])
+    compilation_context, compilation_outputs = cc_common.compile(
+        name = ctx.attr.name,
+        actions = ctx.actions,
+        feature_configuration = feature_configuration,
+        cc_toolchain = cc_toolchain,
+        srcs = [verilated_srcs],
+        public_hdrs = [verilated_hdrs],
+        includes = [verilated_hdrs.path],
+        defines = ["VM_COVERAGE=0", "VM_SC=0", "VM_SAVABLE={}".format(int(ctx.attr.savable))] +
+                  VERILATOR_TRACE_FORMATS[trace].defines,
+        user_compile_flags = ["-std=c++17"] + profile.copts,
+        compilation_contexts = [dep.compilation_context for dep in runtime],
+    )
+    linking_context, _ = cc_common.create_linking_context_from_compilation_outputs(
+        name = ctx.attr.name,
+        actions = ctx.actions,
+        feature_configuration = feature_configuration,
+        cc_toolchain = cc_toolchain,
+        compilation_outputs = compilation_outputs,
+        linking_contexts = [dep.linking_context for dep in runtime] + [hier_blocks.linking_context],
+    )
+    model = CcInfo(
+        compilation_context = compilation_context,
+        linking_context = linking_context,
+    )
+
+    if ctx.attr.hier_block:
+        # The stub includes nothing
+        verilog_info = VerilogInfo(
+            transitive_sources = depset(outputs),
+            transitive_hdrs = depset(),
+            defines = depset(),
+            includes = depset(),
+            hier_blocks = cc_common.merge_cc_infos(cc_infos = [model, hier_blocks]),
+        )
+    else:
+        verilog_info = VerilogInfo(
+            transitive_sources = srcs,
+            transitive_hdrs = hdrs,
+            defines = defines,
+            includes = includes,
+            hier_blocks = hier_blocks,
+        )
+
     return [
-        DefaultInfo(files = depset([output_dir])),
-        CcInfo(
-            compilation_context = cc_common.create_compilation_context(
-                headers = depset([output_dir]),
-                includes = depset([output_dir.path]),
-            ),
-        ),
+        DefaultInfo(files = depset([verilated_srcs, verilated_hdrs] + outputs)),
+        model,
+        verilog_info,
     ]
 
 verilator_hdl_library = rule(
@@ -44,7 +275,130 @@ verilator_hdl_library = rule(
             allow_single_file = [".v", ".sv"],
             mandatory = True,
         ),
+        "top_module": attr.string(
+            mandatory = False,
+            doc = "Name of the top module. If not specified, the src filename without its extension",
+        ),
+        "deps": attr.label_list(
+            providers = [VerilogInfo],
+            doc = "verilator_hdl_library targets of the modules instantiated by this one",
+        ),
+        "hdrs": attr.label_list(
+            allow_files = True,
+            doc = "Files `included by src, made available to Verilator in the sandbox",
+        ),
+        "defines": attr.string_list(
+            doc = "Macros as NAME or NAME=VALUE, passed to Verilator as +define+",
+        ),
+        "includes": attr.string_list(
+            doc = "Directories searched for `include files, relative to the workspace root or absolute",
+        ),
+        "hier_block": attr.bool(
+            default = False,
+            doc = "Verilate as a hierarchical block: modules instantiating this one see a stub and link its model",
+        ),
+        "savable": attr.bool(
+            default = False,
+            doc = "Verilate with --savable so VpmCheckpoint can save and restore the model; forces one thread",
+        ),
+        "profile": attr.string(
+            mandatory = False,
+            values = ["", "debug", "fast", "max"],
+            doc = "Simulation profile. If not specified, taken from --//tools/verilator:profile",
+        ),
+        "threads": attr.int(
+            default = 0,
+            doc = "Verilator --threads for the model. If 0, taken from the profile",
+        ),
+        "trace": attr.string(
+            mandatory = False,
+            values = ["", "off", "fst", "vcd"],
+            doc = "Waveform format. If not specified, taken from --//tools/verilator:trace",
+        ),
+        "trace_threads": attr.int(
+            default = 0,
+            doc = "Threads that write FST waveforms off the simulation threads. If 0, Verilator's default",
+        ),
+        "_profile_flag": attr.label(default = "//tools/verilator:profile"),
+        "_trace_flag": attr.label(default = "//tools/verilator:trace"),
+        "_verilator_runtime": attr.label(
+            default = "@verilator//:verilator_runtime",
+            providers = [CcInfo],
+        ),
+        "_verilator_trace_fst": attr.label(
+            default = "@verilator//:verilator_trace_fst",
+            providers = [CcInfo],
+        ),
+        "_verilator_trace_vcd": attr.label(
+            default = "@verilator//:verilator_trace_vcd",
+            providers = [CcInfo],
+        ),
+        "_vpm_trace": attr.label(
+            default = "//tools/verilator:vpm_trace",
+            providers = [CcInfo],
+        ),
+        "_cc_toolchain": attr.label(default = "@bazel_tools//tools/cpp:current_cc_toolchain"),
     },
     fragments = ["cpp"],
-    provides = [CcInfo],
+    toolchains = use_cpp_toolchain(),
+    provides = [CcInfo, VerilogInfo],
 )
+
+# main() of a verilator_hdl_server. The port table is read from the
+# VL_IN*/VL_OUT* declarations of the verilated model header.
+_SERVE_MAIN_HEAD = """#include <vector>
+#include "V{top}.h"
+#include "vpm_serve.h"
+
+int main(int argc, char** argv) {{
+    VerilatedContext context;
+    context.commandArgs(argc, argv);
+    V{top} model(&context, "top");
+    std::vector<vpm::ServedPort> ports = {{
+"""
+
+_SERVE_MAIN_TAIL = """    }};
+    return vpm::serveMain(argc, argv, "{top}", context, model, ports.data(), ports.size());
+}}
+"""
+
+def verilator_hdl_server(name, model, top, **kwargs):
+    """Process hosting a verilated model behind a shared-memory ring.
+
+    `model` is the verilator_hdl_library target of module `top`. The binary
+    serves it on /vpm-<top> until a client stops it; host software drives
+    the ports through vpm::ShmClient from "vpm_shm.h" without linking any
+    generated code. See vpm_serve.h.
+    """
+    native.genrule(
+        name = name + "_main",
+        srcs = [model],
+        outs = [name + "_main.cpp"],
+        cmd = r"""hdr=$$(find $(SRCS) -name V{top}.h | head -n 1)
+cat > $@ <<'EOF'
+{head}EOF
+sed -n 's/^ *VL_\(IN\|OUT\|INOUT\)[0-9W]*(&\{{0,1\}}\([A-Za-z0-9_]*\),\([0-9]*\),\([0-9]*\).*/\1 \2 \3 \4/p' $$hdr |
+while read dir port msb lsb; do
+    input=true
+    [ $$dir = OUT ] && input=false
+    echo "        {{\"$$port\", $$((msb - lsb + 1)), $$input, &model.$$port}},"
+done >> $@
+cat >> $@ <<'EOF'
+{tail}EOF""".format(
+            top = top,
+            head = _SERVE_MAIN_HEAD.format(top = top),
+            tail = _SERVE_MAIN_TAIL.format(top = top),
+        ),
+    )
+
+    cc_binary(
+        name = name,
+        srcs = [":" + name + "_main"],
+        copts = ["-std=c++17", "-O2"],
+        linkopts = ["-lrt", "-pthread"],
+        deps = [
+            model,
+            "//tools/verilator:vpm_serve",
+        ],
+        **kwargs
+    )
@@ -1,170 +1,188 @@
-load("@bazel_tools//tools/cpp:toolchain_utils.bzl", "find_cpp_toolchain")
 load("@rules_cc//cc:defs.bzl", "cc_test")
-
-def _verilator_hdl_test_impl(ctx):
-    output_dir = ctx.actions.declare_directory(ctx.attr.name + "_verilated")
-    output_exe = ctx.actions.declare_file(ctx.attr.name)
-    test_log = ctx.actions.declare_file(ctx.attr.name + ".log")
-    
-    # Create a script to handle the Verilator compilation process
-    verilate_action = ctx.actions.declare_file(ctx.attr.name + "_verilate.sh")
-    ctx.actions.write(
-        output = verilate_action,
-        content = '''\
-#!/bin/bash
-set -ex
-echo "Current directory: $(pwd)"
-echo "Output directory: {output_dir}"
-echo "Output executable: {exe}"
-echo "Test log: {test_log}"
-
-# Convert relative paths to absolute
-WORKSPACE_ROOT=$(pwd)
-OUTPUT_DIR="$WORKSPACE_ROOT/{output_dir}"
-OUTPUT_EXE="$WORKSPACE_ROOT/{exe}"
-TEST_LOG="$WORKSPACE_ROOT/{test_log}"
-
-mkdir -p "$OUTPUT_DIR"
-cp {input} "$OUTPUT_DIR"/
-cp {testbench} "$OUTPUT_DIR"/
-cd "$OUTPUT_DIR"
-
-echo "Changed to directory: $(pwd)"
-ls -la
-
-# Get Verilator include path
-VERILATOR_ROOT=/usr/local/Cellar/verilator/5.026/share/verilator
-
-/usr/local/bin/verilator --cc --exe --trace {input_name} {testbench_name} \\
-    --Mdir . --prefix V{top_name} \\
-    --top-module {top_name} \\
-    -CFLAGS "-I. -I/usr/local/include -I$VERILATOR_ROOT/include -I/usr/local/include/gtest -std=c++17"
-
-sed -i.bak 's|#include "test/rtl/V{top_name}.h"|#include "V{top_name}.h"|' {testbench_name}
-
-echo "Compiling Verilator runtime..."
-# Compile Verilator runtime
-c++ -c -I. -I$VERILATOR_ROOT/include -std=c++17 \\
-    $VERILATOR_ROOT/include/verilated.cpp \\
-    $VERILATOR_ROOT/include/verilated_vcd_c.cpp \\
-    $VERILATOR_ROOT/include/verilated_threads.cpp
-
-# Create archive
-ar rvs libverilated.a verilated.o verilated_vcd_c.o verilated_threads.o
-
-echo "Compiling generated Verilator files..."
-# Compile the generated Verilator files
-c++ -c -I. -I$VERILATOR_ROOT/include -I/usr/local/include \\
-    -std=c++17 -Os \\
-    -DVM_COVERAGE=0 -DVM_SC=0 -DVM_TRACE=1 -DVM_TRACE_FST=0 -DVM_TRACE_VCD=1 \\
-    Vcounter.cpp \\
-    Vcounter___024root__DepSet_h0dd033c2__0.cpp \\
-    Vcounter___024root__DepSet_h5086c508__0.cpp \\
-    Vcounter__Trace__0.cpp \\
-    Vcounter___024root__Slow.cpp \\
-    Vcounter___024root__DepSet_h5086c508__0__Slow.cpp \\
-    Vcounter__Syms.cpp \\
-    Vcounter__Trace__0__Slow.cpp \\
-    Vcounter__TraceDecls__0__Slow.cpp
-
-echo "Compiling test..."
-# Compile the test
-c++ -c -I. -I$VERILATOR_ROOT/include -I/usr/local/include \\
-    -std=c++17 -Os \\
-    -DVM_COVERAGE=0 -DVM_SC=0 -DVM_TRACE=1 -DVM_TRACE_FST=0 -DVM_TRACE_VCD=1 \\
-    counter_tb.cpp
-
-echo "Creating output directory and linking..."
-# Create output directory and link everything together
-mkdir -p $(dirname "$OUTPUT_EXE")
-echo "Output directory created: $(ls -la $(dirname "$OUTPUT_EXE"))"
-
-echo "Linking with debug output..."
-c++ -v -o counter_hdl_test \\
-    counter_tb.o \\
-    Vcounter.o \\
-    Vcounter___024root__DepSet_h0dd033c2__0.o \\
-    Vcounter___024root__DepSet_h5086c508__0.o \\
-    Vcounter__Trace__0.o \\
-    Vcounter___024root__Slow.o \\
-    Vcounter___024root__DepSet_h5086c508__0__Slow.o \\
-    Vcounter__Syms.o \\
-    Vcounter__Trace__0__Slow.o \\
-    Vcounter__TraceDecls__0__Slow.o \\
-    -L/usr/local/lib -L. \\
-    -lpthread -lverilated \\
-    -lgtest -lgtest_main
-
-cp counter_hdl_test "$OUTPUT_EXE"
-echo "Final output: $(ls -la "$OUTPUT_EXE")"
-
-# Run the test and capture output
-echo "Running test..."
-set +e  # Don't exit on error
-"$OUTPUT_EXE" 2>&1 | tee "$TEST_LOG"
-test_exit=$?
-set -e  # Re-enable exit on error
-
-# Print test log
-echo "=== Test Log ==="
-cat "$TEST_LOG"
-echo "=== End Test Log ==="
-
-exit $test_exit
-'''.format(
-            input = ctx.file.src.path,
-            testbench = ctx.file.testbench.path,
-            output_dir = output_dir.path,
-            exe = output_exe.path,
-            test_log = test_log.path,
-            input_name = ctx.file.src.basename,
-            testbench_name = ctx.file.testbench.basename,
-            top_name = ctx.attr.top_module if ctx.attr.top_module else ctx.file.src.basename.replace(".sv", ""),
-        ),
-        is_executable = True,
+load("//tools/verilator:defs.bzl", "verilator_hdl_library", "verilator_profile_copts")
+
+# main() of a verilator_hdl_sweep: runs the testbench's vpmSweep() over
+# many instances of the model through vpm_sweep.h
+_SWEEP_MAIN = """#include "V{top}.h"
+#include "vpm_sweep.h"
+
+void vpmSweep(V{top}& model, vpm::SweepRun& run);
+
+int main(int argc, char** argv) {{
+    return vpm::sweepMain<V{top}>(argc, argv, vpmSweep);
+}}
+"""
+
+def verilator_hdl_test(
+        name,
+        src,
+        testbench,
+        top_module = None,
+        deps = [],
+        hdrs = [],
+        defines = [],
+        includes = [],
+        profile = "",
+        threads = 0,
+        trace = "",
+        trace_threads = 0,
+        warm_up = None,
+        **kwargs):
+    """GoogleTest testbench for a Verilog module.
+
+    Expands to a verilator_hdl_library holding the compiled model
+    (`<name>_model`) and a cc_test linking `testbench` against it and the
+    shared Verilator runtime, so the runtime is built once for all tests and
+    the model compiles as separate cached actions.
+
+    With tracing enabled the testbench can dump waveforms through
+    VpmTrace from "vpm_trace.h"; with tracing off that class compiles to
+    nothing.
+
+    `warm_up` is a C++ file holding the reset and initialization code the
+    testbench runs through VpmCheckpoint from "vpm_checkpoint.h". It makes
+    the model savable (and single-threaded), and keys the checkpoints by a
+    hash of the verilated model and this file, so they are rebuilt when the
+    RTL or the warm-up changes but not when the rest of the testbench does.
+    """
+    top_name = top_module if top_module else src.split(":")[-1].split("/")[-1].rsplit(".", 1)[0]
+
+    verilator_hdl_library(
+        name = name + "_model",
+        src = src,
+        top_module = top_module,
+        deps = deps,
+        hdrs = hdrs,
+        defines = defines,
+        includes = includes,
+        profile = profile,
+        threads = threads,
+        trace = trace,
+        trace_threads = trace_threads,
+        savable = warm_up != None,
+        testonly = True,
     )
-    
-    # Run the compilation script
-    ctx.actions.run(
-        outputs = [output_dir, output_exe, test_log],
-        inputs = [ctx.file.src, ctx.file.testbench],
-        tools = [verilate_action],
-        executable = verilate_action,
-        mnemonic = "VerilateTest",
-        use_default_shell_env = True,
+
+    # Testbenches may include the model header by its source path
+    # (e.g. "test/rtl/Vcounter.h"); the model exports it as "Vcounter.h"
+    native.genrule(
+        name = name + "_testbench",
+        srcs = [testbench],
+        outs = [name + "_tb.cpp"],
+        cmd = "sed 's|#include \".*/V{top}.h\"|#include \"V{top}.h\"|' $< > $@".format(top = top_name),
+        testonly = True,
     )
-    
-    return [
-        DefaultInfo(
-            files = depset([output_dir]),
-            executable = output_exe,
-            runfiles = ctx.runfiles(files = [output_exe, test_log]),
-        ),
-        CcInfo(
-            compilation_context = cc_common.create_compilation_context(
-                headers = depset([output_dir]),
-                includes = depset([output_dir.path]),
-            ),
-        ),
+
+    test_srcs = [":" + name + "_testbench"]
+    test_deps = [
+        ":" + name + "_model",
+        "@gtest//:gtest_main",
     ]
+    if warm_up:
+        native.genrule(
+            name = name + "_warm_up",
+            srcs = [warm_up],
+            outs = [name + "_warm_up.cpp"],
+            cmd = "sed 's|#include \".*/V{top}.h\"|#include \"V{top}.h\"|' $< > $@".format(top = top_name),
+            testonly = True,
+        )
+
+        # The key covers everything verilated for the model and its direct
+        # submodules, plus the warm-up code
+        native.genrule(
+            name = name + "_checkpoint_key",
+            srcs = [":" + name + "_model", warm_up] + deps,
+            outs = [name + "_checkpoint_key.cpp"],
+            cmd = """key=$$(find $(SRCS) -type f | LC_ALL=C sort | xargs cat | sha256sum | cut -c1-16)
+cat > $@ <<EOF
+namespace vpm {{
+const char* checkpointKey() {{ return "$$key"; }}
+const char* checkpointTarget() {{ return "{name}"; }}
+}}
+EOF""".format(name = name),
+            testonly = True,
+        )
+        test_srcs += [":" + name + "_warm_up", ":" + name + "_checkpoint_key"]
+        test_deps.append("//tools/verilator:vpm_checkpoint")
+
+    cc_test(
+        name = name,
+        srcs = test_srcs,
+        copts = ["-std=c++17"] + verilator_profile_copts(profile),
+        deps = test_deps,
+        **kwargs
+    )
+
+def verilator_hdl_sweep(
+        name,
+        src,
+        testbench,
+        top_module = None,
+        deps = [],
+        hdrs = [],
+        defines = [],
+        includes = [],
+        profile = "",
+        seeds = 0,
+        stimulus = [],
+        sweep_threads = 0,
+        **kwargs):
+    """Seed or stimulus sweep over many instances of a Verilog module.
+
+    `testbench` defines `void vpmSweep(V<top>& model, vpm::SweepRun& run)`,
+    which simulates one instance; a generated main() runs it once per seed
+    (or once per `stimulus` file) across a work-stealing thread pool in a
+    single process and reports results per instance. See vpm_sweep.h.
+
+    Instances already run in parallel, so the model itself is verilated
+    single-threaded whatever the profile.
+    """
+    top_name = top_module if top_module else src.split(":")[-1].split("/")[-1].rsplit(".", 1)[0]
+
+    verilator_hdl_library(
+        name = name + "_model",
+        src = src,
+        top_module = top_module,
+        deps = deps,
+        hdrs = hdrs,
+        defines = defines,
+        includes = includes,
+        profile = profile,
+        threads = 1,
+        trace = "off",
+        testonly = True,
+    )
 
-verilator_hdl_test = rule(
-    implementation = _verilator_hdl_test_impl,
-    attrs = {
-        "src": attr.label(
-            allow_single_file = [".v", ".sv"],
-            mandatory = True,
-        ),
-        "testbench": attr.label(
-            allow_single_file = [".cpp"],
-            mandatory = True,
-        ),
-        "top_module": attr.string(
-            mandatory = False,
-            doc = "Name of the top module. If not specified, derived from src filename",
-        ),
-    },
-    fragments = ["cpp"],
-    test = True,
-    executable = True,
-)
+    native.genrule(
+        name = name + "_testbench",
+        srcs = [testbench],
+        outs = [name + "_tb.cpp"],
+        cmd = "sed 's|#include \".*/V{top}.h\"|#include \"V{top}.h\"|' $< > $@".format(top = top_name),
+        testonly = True,
+    )
+
+    native.genrule(
+        name = name + "_main",
+        outs = [name + "_main.cpp"],
+        cmd = "cat > $@ <<'EOF'\n" + _SWEEP_MAIN.format(top = top_name) + "EOF",
+        testonly = True,
+    )
+
+    args = ["--stimulus=$(rootpath {})".format(file) for file in stimulus]
+    if seeds > 0:
+        args.append("--seeds={}".format(seeds))
+    if sweep_threads > 0:
+        args.append("--threads={}".format(sweep_threads))
+
+    cc_test(
+        name = name,
+        srcs = [":" + name + "_testbench", ":" + name + "_main"],
+        copts = ["-std=c++17"] + verilator_profile_copts(profile),
+        args = args + kwargs.pop("args", []),
+        data = stimulus + kwargs.pop("data", []),
+        deps = [
+            ":" + name + "_model",
+            "//tools/verilator:vpm_sweep",
+        ],
+        **kwargs
+    )
@@ -0,0 +1,118 @@
+#pragma once
+
+// Warm-up checkpoints for verilator_hdl_test testbenches. A target with a
+// `warm_up` file builds its model with Verilator's --savable, and the
+// testbench can run the shared reset and initialization sequence once,
+// snapshot the model, and restore that snapshot in every later test:
+//
+//   TEST(Counter, Overflow) {
+//       Vcounter model;
+//       VpmCheckpoint("reset").warmUp(model, [&] { resetSequence(model); });
+//       ...
+//   }
+//
+// The warm-up code (resetSequence above) lives in the `warm_up` file.
+// Checkpoints are keyed by the verilated model and that file, so changing
+// the RTL or the warm-up starts from scratch, while changes to the rest of
+// the testbench keep restoring. They are kept in $VPM_CHECKPOINT_DIR, which
+// `vpm --test` points at .vpm/checkpoints, else in the test's temporary
+// directory for the duration of one run. Without a `warm_up` file the
+// model is not savable and warmUp() always runs the warm-up.
+
+#include <cstdint>
+#include <string>
+
+#if VM_SAVABLE
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "verilated.h"
+#include "verilated_save.h"
+
+namespace vpm {
+// Defined in the <target>_checkpoint_key.cpp generated for the test
+const char* checkpointKey();
+const char* checkpointTarget();
+}  // namespace vpm
+#endif
+
+class VpmCheckpoint {
+private:
+#if VM_SAVABLE
+    std::string path;
+
+    static bool exists(const std::string& file) {
+        if (std::FILE* handle = std::fopen(file.c_str(), "rb")) {
+            std::fclose(handle);
+            return true;
+        }
+        return false;
+    }
+#endif
+
+public:
+    // A checkpoint taken after the warm-up phase `phase`
+    explicit VpmCheckpoint(const std::string& phase) {
+#if VM_SAVABLE
+        const char* dir = std::getenv("VPM_CHECKPOINT_DIR");
+        if (!dir) {
+            dir = std::getenv("TEST_TMPDIR");
+        }
+        path = std::string(dir ? dir : ".") + "/" + vpm::checkpointTarget() + "-" + phase + "-" +
+               vpm::checkpointKey() + ".vlt";
+#else
+        (void)phase;
+#endif
+    }
+
+    // Loads the checkpoint into `model` and its context; false if there is
+    // none for this model and warm-up code yet
+    template <typename Model>
+    bool restore(Model& model) {
+#if VM_SAVABLE
+        if (!exists(path)) {
+            return false;
+        }
+        VerilatedRestore is;
+        is.open(path.c_str());
+        uint64_t time = 0;
+        is >> time;
+        is >> model;
+        is.close();
+        model.contextp()->time(time);
+        return true;
+#else
+        (void)model;
+        return false;
+#endif
+    }
+
+    // Snapshots `model` and its simulation time. Written to a temporary
+    // file first, so tests running in parallel never read half a file.
+    template <typename Model>
+    void save(Model& model) {
+#if VM_SAVABLE
+        std::string temporary = path + "." + std::to_string(getpid()) + ".tmp";
+        VerilatedSave os;
+        os.open(temporary.c_str());
+        os << static_cast<uint64_t>(model.contextp()->time());
+        os << model;
+        os.close();
+        std::rename(temporary.c_str(), path.c_str());
+#else
+        (void)model;
+#endif
+    }
+
+    // Restores the checkpoint, or runs `warm_up` on the model and saves
+    // one. Returns true if the warm-up was skipped.
+    template <typename Model, typename WarmUp>
+    bool warmUp(Model& model, WarmUp&& warm_up) {
+        if (restore(model)) {
+            return true;
+        }
+        warm_up();
+        save(model);
+        return false;
+    }
+};
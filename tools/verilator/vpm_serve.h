@@ -0,0 +1,160 @@
+#pragma once
+
+// Server main() of verilator_hdl_server targets: hosts one V<top> model and
+// exposes its ports through vpm_shm.h, for host software using
+// vpm::ShmClient. The target generates the port table from the model header:
+//
+//   Vcounter model(&context);
+//   vpm::ServedPort ports[] = {{"clk", 1, true, &model.clk}, ...};
+//   return vpm::serveMain(argc, argv, "counter", context, model, ports, count);
+//
+// Options: --name=/vpm-<top> names the shared-memory segment and
+// --capacity=N sets the entries per ring (default 4096). The server runs
+// until a client calls stop() or it gets SIGINT or SIGTERM.
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "verilated.h"
+#include "vpm_shm.h"
+
+namespace vpm {
+
+// A model port: Verilator keeps up to 8, 16, 32 and 64 bits in CData,
+// SData, IData and QData, and wider ports as arrays of 32-bit words
+struct ServedPort {
+    const char* name;
+    uint32_t width;
+    bool input;
+    void* data;
+};
+
+namespace detail {
+    inline std::atomic<bool>& interrupted() {
+        static std::atomic<bool> flag{false};
+        return flag;
+    }
+
+    template <typename Model>
+    class ModelPorts {
+    private:
+        VerilatedContext& context;
+        Model& model;
+        const ServedPort* ports;
+
+    public:
+        ModelPorts(VerilatedContext& context, Model& model, const ServedPort* ports)
+            : context(context), model(model), ports(ports) {}
+
+        uint64_t read(uint32_t index, uint32_t word) {
+            const ServedPort& port = ports[index];
+            if (port.width <= 8) {
+                return *static_cast<const uint8_t*>(port.data);
+            }
+            if (port.width <= 16) {
+                return *static_cast<const uint16_t*>(port.data);
+            }
+            if (port.width <= 32) {
+                return *static_cast<const uint32_t*>(port.data);
+            }
+            if (port.width <= 64) {
+                return *static_cast<const uint64_t*>(port.data);
+            }
+            return word < (port.width + 31) / 32 ? static_cast<const uint32_t*>(port.data)[word] : 0;
+        }
+
+        bool write(uint32_t index, uint32_t word, uint64_t value) {
+            const ServedPort& port = ports[index];
+            if (!port.input) {
+                return false;
+            }
+            uint64_t mask = port.width >= 64 ? ~uint64_t(0) : (uint64_t(1) << port.width) - 1;
+            if (port.width <= 8) {
+                *static_cast<uint8_t*>(port.data) = static_cast<uint8_t>(value & mask);
+            } else if (port.width <= 16) {
+                *static_cast<uint16_t*>(port.data) = static_cast<uint16_t>(value & mask);
+            } else if (port.width <= 32) {
+                *static_cast<uint32_t*>(port.data) = static_cast<uint32_t>(value & mask);
+            } else if (port.width <= 64) {
+                *static_cast<uint64_t*>(port.data) = value & mask;
+            } else if (word < (port.width + 31) / 32) {
+                static_cast<uint32_t*>(port.data)[word] = static_cast<uint32_t>(value);
+            } else {
+                return false;
+            }
+            return true;
+        }
+
+        void eval() { model.eval(); }
+
+        // One cycle is a falling then a rising edge, each a time unit apart
+        void tick(uint32_t clock, uint64_t cycles) {
+            if (ports[clock].width != 1 || !ports[clock].input) {
+                return;
+            }
+            uint8_t& clk = *static_cast<uint8_t*>(ports[clock].data);
+            for (uint64_t i = 0; i < cycles && !context.gotFinish(); ++i) {
+                clk = 0;
+                model.eval();
+                context.timeInc(1);
+                clk = 1;
+                model.eval();
+                context.timeInc(1);
+            }
+        }
+    };
+
+    // Value of --name=value among the arguments
+    inline bool option(int argc, char** argv, const char* name, std::string& value) {
+        std::string flag = std::string("--") + name + "=";
+        for (int i = 1; i < argc; ++i) {
+            if (std::strncmp(argv[i], flag.c_str(), flag.size()) == 0) {
+                value = argv[i] + flag.size();
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+template <typename Model>
+int serveMain(int argc, char** argv, const char* top, VerilatedContext& context, Model& model,
+              const ServedPort* ports, size_t count) {
+    std::string name = std::string("/vpm-") + top;
+    std::string value;
+    uint32_t capacity = 4096;
+    detail::option(argc, argv, "name", name);
+    if (detail::option(argc, argv, "capacity", value)) {
+        capacity = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+    }
+
+    std::vector<ShmPort> table(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::strncpy(table[i].name, ports[i].name, sizeof(table[i].name) - 1);
+        table[i].width = static_cast<uint16_t>(ports[i].width);
+        table[i].input = ports[i].input;
+    }
+
+    std::signal(SIGINT, [](int) { detail::interrupted() = true; });
+    std::signal(SIGTERM, [](int) { detail::interrupted() = true; });
+    try {
+        ShmServer server(name, table, capacity);
+        model.eval();
+        std::cout << "Serving " << top << " on " << name << " (" << count << " ports)" << std::endl;
+        detail::ModelPorts<Model> handler(context, model, ports);
+        uint64_t handled = server.run(handler, &detail::interrupted());
+        model.final();
+        std::cout << "Stopped after " << handled << " requests" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+}  // namespace vpm
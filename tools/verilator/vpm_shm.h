@@ -0,0 +1,495 @@
+#pragma once
+
+// Shared-memory transport between a verilated model served by `vpm --serve`
+// and host software driving it. Header-only and independent of Verilator, so
+// drivers and firmware models link nothing generated:
+//
+//   #include "vpm_shm.h"
+//
+//   vpm::ShmClient alu("/vpm-alu");
+//   uint32_t clk = alu.port("clk"), a = alu.port("a"), y = alu.port("y");
+//   for (uint64_t i = 0; i < 1000000; ++i) {
+//       alu.write(a, i);
+//       alu.tick(clk);
+//   }
+//   uint64_t result = alu.read(y);
+//
+// The segment holds a port table and two single-producer single-consumer
+// rings: requests from the client and responses from the server. Each side
+// only spins on the other's index, on its own cache line, so a transaction
+// costs a few cache-line transfers and no system call. Writes, evals and
+// ticks are posted without waiting; read() and sync() wait for the server to
+// catch up. One client is attached at a time; the server empties both rings
+// before it serves a new one, and drops responses to a client that detached
+// or died.
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+}
+
+namespace vpm {
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory rings need lock-free 64-bit atomics");
+
+constexpr uint32_t kShmMagic = 0x534d5056;  // "VPMS"
+constexpr uint32_t kShmVersion = 2;
+constexpr uint32_t kShmMaxPorts = 512;
+
+enum class ShmOp : uint16_t {
+    Write,
+    Read,
+    Eval,
+    // Toggles the clock port through `value` full cycles, evaluating on each edge
+    Tick,
+    // Responds once every earlier request has been handled
+    Sync,
+    // Shuts the server down
+    Stop,
+};
+
+struct ShmPort {
+    char name[60];
+    uint16_t width;
+    uint16_t input;
+};
+
+struct ShmRequest {
+    ShmOp op;
+    // 32-bit word of a port wider than 64 bits
+    uint16_t word;
+    uint32_t port;
+    uint64_t value;
+};
+
+struct alignas(64) ShmIndex {
+    std::atomic<uint64_t> value{0};
+};
+
+// Start of the segment; the rings follow it
+struct ShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t port_count;
+    // Entries per ring, a power of two
+    uint32_t capacity;
+    // Requests naming a missing port or writing an output
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint32_t> attached{0};
+    std::atomic<uint32_t> stopped{0};
+    // Bumped by each client that attaches; the server echoes it in `served`
+    // once the rings are empty for that client
+    std::atomic<uint32_t> session{0};
+    std::atomic<uint32_t> served{0};
+    std::atomic<int32_t> client_pid{0};
+    ShmPort ports[kShmMaxPorts];
+};
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Spins briefly, then yields, then sleeps, so a waiting side costs little
+// once the other goes quiet but reacts within nanoseconds while it is busy
+class Backoff {
+private:
+    uint32_t rounds = 0;
+
+public:
+    void wait() {
+        if (rounds < 128) {
+            cpuRelax();
+        } else if (rounds < 4096) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        ++rounds;
+    }
+
+    void reset() { rounds = 0; }
+};
+
+// One endpoint of a ring in the segment. The producer and the consumer each
+// keep a private copy of the other's index and only reload it when the ring
+// looks full or empty.
+template <typename T>
+class ShmRing {
+private:
+    ShmIndex* head = nullptr;
+    ShmIndex* tail = nullptr;
+    T* slots = nullptr;
+    uint64_t mask = 0;
+    uint64_t cached = 0;
+
+public:
+    static size_t bytes(uint32_t capacity) { return 2 * sizeof(ShmIndex) + capacity * sizeof(T); }
+
+    ShmRing() = default;
+    ShmRing(void* memory, uint32_t capacity)
+        : head(static_cast<ShmIndex*>(memory)),
+          tail(head + 1),
+          slots(reinterpret_cast<T*>(head + 2)),
+          mask(capacity - 1) {}
+
+    bool tryPush(const T& item) {
+        uint64_t position = tail->value.load(std::memory_order_relaxed);
+        if (position - cached > mask) {
+            cached = head->value.load(std::memory_order_acquire);
+            if (position - cached > mask) {
+                return false;
+            }
+        }
+        slots[position & mask] = item;
+        tail->value.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& item) {
+        uint64_t position = head->value.load(std::memory_order_relaxed);
+        // Indices only grow, so a fresh endpoint's zero copy just reloads
+        if (cached <= position) {
+            cached = tail->value.load(std::memory_order_acquire);
+            if (cached <= position) {
+                return false;
+            }
+        }
+        item = slots[position & mask];
+        head->value.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Discards every entry. Only while the other side is not using the ring.
+    void clear() { head->value.store(tail->value.load(std::memory_order_acquire), std::memory_order_release); }
+};
+
+// A mapped POSIX shared-memory object; the creator unlinks it when done
+class ShmSegment {
+private:
+    std::string name;
+    void* memory = MAP_FAILED;
+    size_t size = 0;
+    bool owner = false;
+
+    void map(int fd) {
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (memory == MAP_FAILED) {
+            throw std::runtime_error("Failed to map shared memory: " + name);
+        }
+    }
+
+public:
+    static size_t bytes(uint32_t capacity) {
+        return sizeof(ShmHeader) + ShmRing<ShmRequest>::bytes(capacity) + ShmRing<uint64_t>::bytes(capacity);
+    }
+
+    // Creates `name` (e.g. "/vpm-alu"), replacing a stale one
+    ShmSegment(const std::string& segment, uint32_t capacity) : name(segment), size(bytes(capacity)), owner(true) {
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 || ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Failed to create shared memory: " + name);
+        }
+        map(fd);
+    }
+
+    // Opens an existing `name`
+    explicit ShmSegment(const std::string& segment) : name(segment) {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) {
+            throw std::runtime_error("No vpm server at " + name);
+        }
+        // magic, version, port_count, capacity
+        uint32_t fields[4] = {};
+        if (pread(fd, fields, sizeof(fields), 0) != static_cast<ssize_t>(sizeof(fields)) || fields[0] != kShmMagic ||
+            fields[1] != kShmVersion) {
+            close(fd);
+            throw std::runtime_error("Not a vpm server segment: " + name);
+        }
+        size = bytes(fields[3]);
+        map(fd);
+    }
+
+    ~ShmSegment() {
+        if (memory != MAP_FAILED) {
+            munmap(memory, size);
+        }
+        if (owner) {
+            shm_unlink(name.c_str());
+        }
+    }
+
+    ShmSegment(const ShmSegment&) = delete;
+    ShmSegment& operator=(const ShmSegment&) = delete;
+
+    ShmHeader* header() const { return static_cast<ShmHeader*>(memory); }
+    char* rings() const { return static_cast<char*>(memory) + sizeof(ShmHeader); }
+};
+
+// Host side: drives a served model through its ports
+class ShmClient {
+private:
+    ShmSegment segment;
+    ShmHeader* header;
+    ShmRing<ShmRequest> requests;
+    ShmRing<uint64_t> responses;
+
+    void post(ShmOp op, uint32_t port = 0, uint64_t value = 0, uint32_t word = 0) {
+        ShmRequest request{op, static_cast<uint16_t>(word), port, value};
+        Backoff backoff;
+        while (!requests.tryPush(request)) {
+            if (header->stopped.load(std::memory_order_acquire)) {
+                throw std::runtime_error("vpm server stopped");
+            }
+            backoff.wait();
+        }
+    }
+
+    uint64_t receive() {
+        uint64_t value = 0;
+        Backoff backoff;
+        while (!responses.tryPop(value)) {
+            if (header->stopped.load(std::memory_order_acquire)) {
+                throw std::runtime_error("vpm server stopped");
+            }
+            backoff.wait();
+        }
+        return value;
+    }
+
+public:
+    // Throws if no server is running under `name` or another client is attached
+    explicit ShmClient(const std::string& name) : segment(name), header(segment.header()) {
+        uint32_t expected = 0;
+        if (header->stopped.load() || !header->attached.compare_exchange_strong(expected, 1)) {
+            throw std::runtime_error("vpm server at " + name + " is stopped or busy");
+        }
+        header->client_pid.store(static_cast<int32_t>(getpid()), std::memory_order_relaxed);
+        uint32_t session = header->session.fetch_add(1, std::memory_order_acq_rel) + 1;
+        // Wait until the server has dropped what an earlier client left behind
+        Backoff backoff;
+        while (header->served.load(std::memory_order_acquire) != session) {
+            if (header->stopped.load(std::memory_order_acquire)) {
+                header->attached.store(0, std::memory_order_release);
+                throw std::runtime_error("vpm server at " + name + " is stopped or busy");
+            }
+            backoff.wait();
+        }
+        requests = ShmRing<ShmRequest>(segment.rings(), header->capacity);
+        responses = ShmRing<uint64_t>(segment.rings() + ShmRing<ShmRequest>::bytes(header->capacity),
+                                      header->capacity);
+    }
+
+    ~ShmClient() {
+        try {
+            if (!header->stopped.load()) {
+                sync();
+            }
+        } catch (const std::exception&) {
+        }
+        header->attached.store(0, std::memory_order_release);
+    }
+
+    ShmClient(const ShmClient&) = delete;
+    ShmClient& operator=(const ShmClient&) = delete;
+
+    // Index of the port called `name`; throws if the model has none
+    uint32_t port(const std::string& name) const {
+        for (uint32_t i = 0; i < header->port_count; ++i) {
+            if (name == header->ports[i].name) {
+                return i;
+            }
+        }
+        throw std::runtime_error("No port named " + name);
+    }
+
+    std::vector<ShmPort> ports() const { return {header->ports, header->ports + header->port_count}; }
+
+    // Requests the server rejected so far
+    uint64_t errors() const { return header->errors.load(); }
+
+    void write(uint32_t port, uint64_t value, uint32_t word = 0) { post(ShmOp::Write, port, value, word); }
+    void eval() { post(ShmOp::Eval); }
+    void tick(uint32_t clock, uint64_t cycles = 1) { post(ShmOp::Tick, clock, cycles); }
+
+    // Value of `port` after every earlier request
+    uint64_t read(uint32_t port, uint32_t word = 0) {
+        post(ShmOp::Read, port, 0, word);
+        return receive();
+    }
+
+    void sync() {
+        post(ShmOp::Sync);
+        receive();
+    }
+
+    // Stops the server process
+    void stop() {
+        post(ShmOp::Stop);
+        receive();
+    }
+};
+
+// Served side: creates the segment and hands requests to a handler with
+//   uint64_t read(uint32_t port, uint32_t word)
+//   bool write(uint32_t port, uint32_t word, uint64_t value)  // false if rejected
+//   void eval()
+//   void tick(uint32_t clock, uint64_t cycles)
+class ShmServer {
+private:
+    ShmSegment segment;
+    ShmHeader* header;
+    ShmRing<ShmRequest> requests;
+    ShmRing<uint64_t> responses;
+    // Session of the client being served
+    uint32_t session = 0;
+
+    // True once the client being served can no longer read its responses
+    bool clientGone() const {
+        if (!header->attached.load(std::memory_order_acquire) ||
+            header->session.load(std::memory_order_acquire) != session) {
+            return true;
+        }
+        pid_t pid = static_cast<pid_t>(header->client_pid.load(std::memory_order_relaxed));
+        return pid > 0 && kill(pid, 0) != 0 && errno == ESRCH;
+    }
+
+    // Waits for room in the responses ring. Gives up, dropping the value,
+    // when the client is gone or `interrupt` is set.
+    void respond(uint64_t value, const std::atomic<bool>* interrupt) {
+        Backoff backoff;
+        while (!responses.tryPush(value)) {
+            if ((interrupt && interrupt->load(std::memory_order_relaxed)) || clientGone()) {
+                if (header->attached.load(std::memory_order_acquire) &&
+                    header->session.load(std::memory_order_acquire) == session) {
+                    // Died while attached; let the next client in
+                    header->attached.store(0, std::memory_order_release);
+                }
+                return;
+            }
+            backoff.wait();
+        }
+    }
+
+    // Empties both rings for a client that just attached. Its requests wait
+    // for `served`, and the previous client has detached, so neither ring is
+    // in use.
+    void acceptSession(uint32_t next) {
+        requests.clear();
+        responses.clear();
+        session = next;
+        header->served.store(next, std::memory_order_release);
+    }
+
+    static uint32_t ringCapacity(uint32_t capacity) {
+        uint32_t rounded = 2;
+        while (rounded < capacity) {
+            rounded *= 2;
+        }
+        return rounded;
+    }
+
+public:
+    // `capacity` is rounded up to a power of two
+    ShmServer(const std::string& name, const std::vector<ShmPort>& ports, uint32_t capacity = 4096)
+        : segment(name, ringCapacity(capacity)), header(new (segment.header()) ShmHeader()) {
+        if (ports.size() > kShmMaxPorts) {
+            throw std::runtime_error("Too many ports to serve: " + std::to_string(ports.size()));
+        }
+        header->port_count = static_cast<uint32_t>(ports.size());
+        header->capacity = ringCapacity(capacity);
+        std::memcpy(header->ports, ports.data(), ports.size() * sizeof(ShmPort));
+        new (segment.rings()) ShmIndex[2];
+        new (segment.rings() + ShmRing<ShmRequest>::bytes(header->capacity)) ShmIndex[2];
+        requests = ShmRing<ShmRequest>(segment.rings(), header->capacity);
+        responses = ShmRing<uint64_t>(segment.rings() + ShmRing<ShmRequest>::bytes(header->capacity),
+                                      header->capacity);
+        // Clients only accept the segment once the magic is set
+        header->version = kShmVersion;
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = kShmMagic;
+    }
+
+    ~ShmServer() { header->stopped.store(1, std::memory_order_release); }
+
+    ShmServer(const ShmServer&) = delete;
+    ShmServer& operator=(const ShmServer&) = delete;
+
+    // Handles requests until a client sends Stop or `interrupt` is set.
+    // Returns the number of requests handled.
+    template <typename Handler>
+    uint64_t run(Handler& handler, const std::atomic<bool>* interrupt = nullptr) {
+        uint64_t handled = 0;
+        ShmRequest request;
+        Backoff backoff;
+        while (!interrupt || !interrupt->load(std::memory_order_relaxed)) {
+            uint32_t next = header->session.load(std::memory_order_acquire);
+            if (next != session) {
+                acceptSession(next);
+            }
+            if (!requests.tryPop(request)) {
+                backoff.wait();
+                continue;
+            }
+            backoff.reset();
+            ++handled;
+            bool valid = request.port < header->port_count;
+            switch (request.op) {
+            case ShmOp::Write:
+                if (!valid || !handler.write(request.port, request.word, request.value)) {
+                    header->errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                break;
+            case ShmOp::Read:
+                if (!valid) {
+                    header->errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                respond(valid ? handler.read(request.port, request.word) : 0, interrupt);
+                break;
+            case ShmOp::Eval:
+                handler.eval();
+                break;
+            case ShmOp::Tick:
+                if (valid) {
+                    handler.tick(request.port, request.value);
+                } else {
+                    header->errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                break;
+            case ShmOp::Sync:
+                respond(0, interrupt);
+                break;
+            case ShmOp::Stop:
+                header->stopped.store(1, std::memory_order_release);
+                respond(0, interrupt);
+                return handled;
+            }
+        }
+        header->stopped.store(1, std::memory_order_release);
+        return handled;
+    }
+};
+
+}  // namespace vpm
@@ -0,0 +1,311 @@
+#pragma once
+
+// Harness for verilator_hdl_sweep targets: runs many independent instances
+// of one Verilator model in a single process, one per seed or stimulus file,
+// across a work-stealing thread pool. The testbench only defines what one
+// instance does; the target generates main() around it:
+//
+//   #include "Vcounter.h"
+//   #include "vpm_sweep.h"
+//
+//   void vpmSweep(Vcounter& model, vpm::SweepRun& run) {
+//       std::mt19937_64 rng(run.seed);
+//       for (run.cycles = 0; run.cycles < 1000 && !run.context.gotFinish(); ++run.cycles) {
+//           model.in = rng();
+//           model.clk = !model.clk;
+//           model.eval();
+//           if (model.out != expected) {
+//               return run.fail("mismatch at cycle " + std::to_string(run.cycles));
+//           }
+//       }
+//   }
+//
+// Every instance has its own VerilatedContext, seeded with its seed, so
+// instances share no simulation state. $stop and $fatal fail only the
+// instance that hit them. Options (or VPM_SWEEP_* environment variables):
+//
+//   --seeds=N            run N instances with seeds first-seed... (default 16)
+//   --first-seed=S       first seed (default 1)
+//   --stimulus=FILE      one instance per stimulus file (repeatable)
+//   --stimulus-list=FILE file listing stimulus files, one per line
+//   --threads=N          worker threads (default: all cores)
+//   --results=FILE       per-instance JSON results (default:
+//                        $TEST_UNDECLARED_OUTPUTS_DIR/sweep_results.json)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "verilated.h"
+
+namespace vpm {
+
+// One instance of a sweep, handed to the testbench
+struct SweepRun {
+    size_t index;
+    uint64_t seed;
+    // Empty for seed sweeps
+    std::string stimulus;
+    VerilatedContext& context;
+
+    bool passed = true;
+    std::string message;
+    // Reported per instance; set by the testbench
+    uint64_t cycles = 0;
+
+    // Marks the instance failed; the first message is kept
+    void fail(const std::string& why) {
+        if (passed) {
+            passed = false;
+            message = why;
+        }
+    }
+};
+
+struct SweepResult {
+    size_t index = 0;
+    uint64_t seed = 0;
+    std::string stimulus;
+    bool passed = false;
+    std::string message;
+    uint64_t cycles = 0;
+    double seconds = 0;
+};
+
+// Each worker owns a deque of job indices seeded with a contiguous block.
+// It takes jobs from the front of its own deque and, once that is empty,
+// steals from the back of the others, so uneven run times still keep
+// every core busy without a shared queue on the fast path.
+class WorkStealingPool {
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<size_t> jobs;
+    };
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    bool take(size_t self, size_t& job) {
+        {
+            Worker& own = *workers[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty()) {
+                job = own.jobs.front();
+                own.jobs.pop_front();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < workers.size(); ++offset) {
+            Worker& victim = *workers[(self + offset) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                job = victim.jobs.back();
+                victim.jobs.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    explicit WorkStealingPool(size_t threads) {
+        for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+    }
+
+    size_t size() const { return workers.size(); }
+
+    // Runs fn(job, worker) for every job in [0, count) and waits. Jobs are
+    // independent, so none is ever added once the run starts.
+    void run(size_t count, const std::function<void(size_t, size_t)>& fn) {
+        for (size_t i = 0; i < workers.size(); ++i) {
+            size_t begin = count * i / workers.size();
+            size_t end = count * (i + 1) / workers.size();
+            for (size_t job = begin; job < end; ++job) {
+                workers[i]->jobs.push_back(job);
+            }
+        }
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < workers.size(); ++i) {
+            threads.emplace_back([this, i, &fn]() {
+                size_t job;
+                while (take(i, job)) {
+                    fn(job, i);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+};
+
+namespace detail {
+    // Value of --name=value, or of the VPM_SWEEP_<NAME> environment variable
+    inline bool option(int argc, char** argv, const std::string& name, std::string& value) {
+        std::string flag = "--" + name + "=";
+        bool found = false;
+        for (int i = 1; i < argc; ++i) {
+            if (std::string(argv[i]).rfind(flag, 0) == 0) {
+                value = argv[i] + flag.size();
+                found = true;
+            }
+        }
+        if (found) {
+            return true;
+        }
+        std::string env = "VPM_SWEEP_" + name;
+        std::transform(env.begin(), env.end(), env.begin(), [](char c) { return c == '-' ? '_' : std::toupper(c); });
+        if (const char* env_value = std::getenv(env.c_str())) {
+            value = env_value;
+            return true;
+        }
+        return false;
+    }
+
+    inline std::string jsonString(const std::string& value) {
+        std::string out = "\"";
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                out += escape;
+            } else {
+                out += c;
+            }
+        }
+        return out + "\"";
+    }
+
+    inline void writeResults(const std::string& path, const std::vector<SweepResult>& results, double seconds,
+                             size_t threads) {
+        std::ofstream out(path);
+        if (!out.is_open()) {
+            std::cerr << "vpm_sweep: cannot write " << path << "\n";
+            return;
+        }
+        out << "{\n  \"wall_seconds\": " << seconds << ",\n  \"threads\": " << threads << ",\n  \"instances\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const SweepResult& result = results[i];
+            out << (i == 0 ? "\n" : ",\n") << "    {\"index\": " << result.index << ", \"seed\": " << result.seed
+                << ", \"stimulus\": " << jsonString(result.stimulus)
+                << ", \"passed\": " << (result.passed ? "true" : "false")
+                << ", \"message\": " << jsonString(result.message) << ", \"cycles\": " << result.cycles
+                << ", \"seconds\": " << result.seconds << "}";
+        }
+        out << (results.empty() ? "]\n}\n" : "\n  ]\n}\n");
+    }
+}
+
+// main() of a sweep: runs `simulate` once per seed or stimulus file and
+// returns non-zero if any instance failed
+template <typename Model>
+int sweepMain(int argc, char** argv, void (*simulate)(Model&, SweepRun&)) {
+    std::string value;
+    uint64_t seeds = 16;
+    uint64_t first_seed = 1;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> stimuli;
+    if (detail::option(argc, argv, "seeds", value)) {
+        seeds = std::strtoull(value.c_str(), nullptr, 10);
+    }
+    if (detail::option(argc, argv, "first-seed", value)) {
+        first_seed = std::strtoull(value.c_str(), nullptr, 10);
+    }
+    if (detail::option(argc, argv, "threads", value) && std::strtoull(value.c_str(), nullptr, 10) > 0) {
+        threads = std::strtoull(value.c_str(), nullptr, 10);
+    }
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--stimulus=", 0) == 0) {
+            stimuli.push_back(arg.substr(11));
+        }
+    }
+    if (detail::option(argc, argv, "stimulus-list", value)) {
+        std::ifstream list(value);
+        if (!list.is_open()) {
+            std::cerr << "vpm_sweep: cannot read stimulus list " << value << "\n";
+            return 1;
+        }
+        for (std::string line; std::getline(list, line);) {
+            if (!line.empty() && line[0] != '#') {
+                stimuli.push_back(line);
+            }
+        }
+    }
+    std::string results_path = "sweep_results.json";
+    if (const char* output_dir = std::getenv("TEST_UNDECLARED_OUTPUTS_DIR")) {
+        results_path = std::string(output_dir) + "/sweep_results.json";
+    }
+    detail::option(argc, argv, "results", results_path);
+
+    size_t count = stimuli.empty() ? seeds : stimuli.size();
+    std::vector<SweepResult> results(count);
+    WorkStealingPool pool(std::min<size_t>(threads, std::max<size_t>(count, 1)));
+    std::atomic<size_t> failures{0};
+
+    auto start = std::chrono::steady_clock::now();
+    pool.run(count, [&](size_t job, size_t) {
+        SweepResult& result = results[job];
+        result.index = job;
+        result.seed = first_seed + job;
+        result.stimulus = stimuli.empty() ? "" : stimuli[job];
+        auto job_start = std::chrono::steady_clock::now();
+
+        // A context per instance keeps seeds, time and $finish apart
+        VerilatedContext context;
+        context.randReset(2);
+        context.randSeed(static_cast<int>(result.seed));
+        context.fatalOnError(false);
+        SweepRun run{job, result.seed, result.stimulus, context, true, "", 0};
+        try {
+            Model model(&context, "top");
+            simulate(model, run);
+            model.final();
+        } catch (const std::exception& e) {
+            run.fail(std::string("exception: ") + e.what());
+        }
+        if (context.gotError()) {
+            run.fail("simulation error ($stop or $fatal)");
+        }
+
+        result.passed = run.passed;
+        result.message = run.message;
+        result.cycles = run.cycles;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job_start).count();
+        if (!run.passed) {
+            ++failures;
+        }
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    detail::writeResults(results_path, results, seconds, pool.size());
+    std::cout << "Sweep: " << count - failures << "/" << count << " instances passed in " << seconds << "s on "
+              << pool.size() << " threads\n";
+    size_t shown = 0;
+    for (const auto& result : results) {
+        if (!result.passed && shown++ < 20) {
+            std::cout << "  FAILED instance " << result.index << " (seed " << result.seed
+                      << (result.stimulus.empty() ? "" : ", stimulus " + result.stimulus) << "): " << result.message
+                      << "\n";
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+}  // namespace vpm
@@ -0,0 +1,104 @@
+#pragma once
+
+// Waveform dumping for verilator_hdl_test testbenches. The format follows the
+// target's `trace` setting; with tracing off the model has no trace code and
+// this class does nothing, so testbenches can call it unconditionally.
+//
+//   Vcounter model;
+//   VpmTrace trace(model, "counter");
+//   for (uint64_t cycle = 0; cycle < 1000; ++cycle) {
+//       model.clk = !model.clk;
+//       model.eval();
+//       trace.dump(cycle);
+//   }
+//
+// Waves are written to $TEST_UNDECLARED_OUTPUTS_DIR (bazel-testlogs/.../
+// test.outputs) when run under `bazel test`. Setting VPM_TRACE_WINDOW to
+// "<start>:<stop>" (either side may be empty) dumps only times in
+// [start, stop), so a long run can be traced around the interesting part.
+
+#include <cstdint>
+#include <string>
+
+#if VM_TRACE
+#include <cstdlib>
+#include <limits>
+#include "verilated.h"
+#if VM_TRACE_FST
+#include "verilated_fst_c.h"
+#else
+#include "verilated_vcd_c.h"
+#endif
+#endif
+
+class VpmTrace {
+private:
+#if VM_TRACE
+#if VM_TRACE_FST
+    VerilatedFstC writer;
+    static constexpr const char* extension = ".fst";
+#else
+    VerilatedVcdC writer;
+    static constexpr const char* extension = ".vcd";
+#endif
+    uint64_t start = 0;
+    uint64_t stop = std::numeric_limits<uint64_t>::max();
+
+    // Reads the dump window from VPM_TRACE_WINDOW
+    void parseWindow() {
+        const char* window = std::getenv("VPM_TRACE_WINDOW");
+        if (!window) {
+            return;
+        }
+        std::string spec(window);
+        size_t colon = spec.find(':');
+        std::string first = spec.substr(0, colon);
+        std::string second = colon == std::string::npos ? "" : spec.substr(colon + 1);
+        if (!first.empty()) {
+            start = std::strtoull(first.c_str(), nullptr, 10);
+        }
+        if (!second.empty()) {
+            stop = std::strtoull(second.c_str(), nullptr, 10);
+        }
+    }
+#endif
+
+public:
+    // Opens `<name>.fst` or `<name>.vcd` and attaches it to `model`
+    template <typename Model>
+    VpmTrace(Model& model, const std::string& name, int levels = 99) {
+#if VM_TRACE
+        parseWindow();
+        Verilated::traceEverOn(true);
+        model.trace(&writer, levels);
+
+        const char* output_dir = std::getenv("TEST_UNDECLARED_OUTPUTS_DIR");
+        std::string path = output_dir ? std::string(output_dir) + "/" + name : name;
+        writer.open((path + extension).c_str());
+#else
+        (void)model;
+        (void)name;
+        (void)levels;
+#endif
+    }
+
+    ~VpmTrace() {
+#if VM_TRACE
+        writer.close();
+#endif
+    }
+
+    VpmTrace(const VpmTrace&) = delete;
+    VpmTrace& operator=(const VpmTrace&) = delete;
+
+    // Records signal values at `time` if it lies in the dump window
+    void dump(uint64_t time) {
+#if VM_TRACE
+        if (time >= start && time < stop) {
+            writer.dump(time);
+        }
+#else
+        (void)time;
+#endif
+    }
+};